@@ -1,4 +1,4 @@
 #!/bin/bash
 
-cd /home/marco/Documents/gnssins/analysis
-R < reference.R --no-save
+cd "$(dirname "$0")"
+../src/evalins -r ../data/26082019/reference.pos -o summary.txt -e errors.txt -H hist.txt ../out/out_PVA.txt
@@ -0,0 +1,28 @@
+#!/bin/bash
+# PPP-AR warm vs cold z-transformation timing of the TC filter (benchins)
+# on the 19032019 session: real GPS observations and an IMU log synthesized
+# along the reference trajectory (siminsgnss). The AR statistics benchins
+# prints to stderr (fix rate, reduction/search time per call) are appended
+# to its timing row. Results go to bench_ar.csv.
+
+cd "$(dirname "$0")"
+W=${W:-/tmp/benchar}
+mkdir -p $W
+sed -e 's/^\(pos2-armode *=\)[^#]*/\1PPP-AR        /' \
+    -e 's/^\(file-[a-z]*file *=\).*/\1/' ../config/opts3.conf > $W/opts.conf
+[ -f $W/sim_imu.txt ] || ../src/siminsgnss -r ../data/19032019/reference.pos \
+  -span 0 -o $W/sim ../data/19032019/navigation.nav
+rm -f $W/bench.csv
+for m in "" -arcold; do
+  ../src/benchins $m -k $W/opts.conf -i $W/sim_imu.txt -sys G -w $W \
+    -o $W/bench.csv -tag ppp-ar$m ../data/19032019/observations.rnx \
+    ../data/19032019/navigation.nav ../data/19032019/orbit.sp3 \
+    2> $W/stderr$m.txt || exit 1
+  sed -n 's/^.*ar: epochs=\([0-9]*\) fix=\([0-9]*\) (\([0-9.]*\)%) amb=\([0-9.]*\) warm=\([0-9]*\) cold=\([0-9]*\) reduct=\([0-9.]*\)us search=\([0-9.]*\)us$/\1,\2,\3,\4,\5,\6,\7,\8/p' \
+    $W/stderr$m.txt > $W/ar$m.txt
+  [ -s $W/ar$m.txt ] || echo ",,,,,,," > $W/ar$m.txt
+done
+(head -1 $W/bench.csv | sed 's/$/,ar_epochs,fix_epochs,fix_pct,amb_per_fix,warm,cold,reduct_us,search_us/'
+ paste -d, <(sed -n 2p $W/bench.csv) $W/ar.txt
+ paste -d, <(sed -n 3p $W/bench.csv) $W/ar-arcold.txt) > bench_ar.csv
+cat bench_ar.csv
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Wall time of the time-chunked TC processing (chunkins) against the number
+# of parallel processes -p on the 19032019 session: real GPS observations and
+# an IMU log synthesized along the reference trajectory (siminsgnss). The
+# first row is the session as a single chunk, the second the chunks of equal
+# length (-eqt), the others the chunks of equal observation/IMU count.
+# Results go to bench_chunk.csv.
+
+cd "$(dirname "$0")"
+W=${W:-/tmp/benchchunk}
+N=${N:-4}
+OV=${OV:-120}
+mkdir -p $W
+sed -e 's/^\(pos1-navsys *=\)[^#]*/\11           /' \
+    -e 's/^\(file-[a-z]*file *=\).*/\1/' ../config/opts3.conf > $W/opts.conf
+[ -f $W/sim_imu.txt ] || ../src/siminsgnss -r ../data/19032019/reference.pos \
+  -span 0 -o $W/sim ../data/19032019/navigation.nav
+echo "split,chunks,processes,overlap_s,cpus,wall_s,cpu_s,max_chunk_cpu_s,speedup,bound" \
+  > bench_chunk.csv
+for r in "1 1 count" "$N 1 time" "$N 1 count" "$N 2 count" "$N 4 count"; do
+  set -- $r
+  ../src/chunkins -k $W/opts.conf -i $W/sim_imu.txt -n $1 -p $2 -ov $OV \
+    $([ $3 = time ] && echo -eqt) \
+    -w $W/chunks -o $W/out ../data/19032019/observations.rnx \
+    ../data/19032019/navigation.nav ../data/19032019/orbit.sp3 || exit 1
+  sed -n 's/^% wall=\(.*\)s cpu=\(.*\)s max chunk cpu=\(.*\)s speedup=\(.*\) bound=\(.*\)$/\1,\2,\3,\4,\5/p' \
+    $W/out/seams.txt | sed "s/^/$3,$1,$2,$OV,$(nproc),/" >> bench_chunk.csv
+done
+cat bench_chunk.csv
@@ -0,0 +1,18 @@
+#!/bin/bash
+# End-to-end throughput of the TC filter (benchins) over the imu-rate and
+# constellation sweep on the 19032019 session: real GPS/GLONASS observations
+# and an IMU log synthesized along the reference trajectory (siminsgnss),
+# resampled to 50, 100 and 200 Hz. One row per run goes to bench_ins.csv.
+
+cd "$(dirname "$0")"
+W=${W:-/tmp/benchsweep}
+mkdir -p $W
+sed -e 's/^\(file-[a-z]*file *=\).*/\1/' ../config/opts3.conf > $W/opts.conf
+[ -f $W/sim_imu.txt ] || ../src/siminsgnss -r ../data/19032019/reference.pos \
+  -span 0 -o $W/sim ../data/19032019/navigation.nav
+rm -f bench_ins.csv
+../src/benchins -k $W/opts.conf -i $W/sim_imu.txt -r ${RATES:-50,100,200} \
+  -sys ${SYS:-G,GR} -w $W -o bench_ins.csv -tag ${TAG:-sweep} \
+  ../data/19032019/observations.rnx ../data/19032019/navigation.nav \
+  ../data/19032019/orbit.sp3 || exit 1
+cat bench_ins.csv
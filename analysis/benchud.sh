@@ -0,0 +1,23 @@
+#!/bin/bash
+# Dense vs u-d factorized covariance of the TC filter (benchins -ud) on the
+# 19032019 session: real GPS observations and an IMU log synthesized along
+# the reference trajectory (siminsgnss). Throughput goes to bench_ud.csv,
+# position errors against the reference (evalins) to bench_ud_acc.csv.
+
+cd "$(dirname "$0")"
+W=${W:-/tmp/benchud}
+mkdir -p $W/dense $W/ud
+sed -e 's/^\(pos1-navsys *=\)[^#]*/\11           /' \
+    -e 's/^\(file-[a-z]*file *=\).*/\1/' ../config/opts3.conf > $W/opts.conf
+[ -f $W/sim_imu.txt ] || ../src/siminsgnss -r ../data/19032019/reference.pos \
+  -span 0 -o $W/sim ../data/19032019/navigation.nav
+rm -f bench_ud.csv bench_ud_acc.csv
+for m in dense ud; do
+  ../src/benchins $([ $m = ud ] && echo -ud) -k $W/opts.conf \
+    -i $W/sim_imu.txt -sys G -w $W/$m -o bench_ud.csv -tag $m \
+    ../data/19032019/observations.rnx ../data/19032019/navigation.nav \
+    ../data/19032019/orbit.sp3 || exit 1
+  ../src/evalins -r ../data/19032019/reference.pos -c bench_ud_acc.csv \
+    -tag $m $W/$m/out_PVA.txt
+done
+cat bench_ud.csv bench_ud_acc.csv
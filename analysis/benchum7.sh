@@ -0,0 +1,11 @@
+#!/bin/bash
+# UM7 byte-stream decoder vs the line parser it replaced (um7ins) on the
+# 12072018 low-cost IMU log. The log has empty week fields, which the line
+# parser can not read, so week 2009 is filled in. Results go to bench_um7.csv.
+
+cd "$(dirname "$0")"
+W=${W:-/tmp}
+rm -f bench_um7.csv
+../src/um7ins -wk 2009 -n 20 -w $W -o bench_um7.csv -tag LOG__040 \
+  ../data/12072018/LOG__040.SBF_SBF_ASCIIIn.txt
+cat bench_um7.csv
@@ -25,6 +25,8 @@
 *                           add approx position in rinex obs header if blank
 *           2014/05/24 1.8  support beidou B1
 *           2014/08/26 1.9  support input format rt17
+*           2019/10/19 1.10 add parallel decoding of rtcm3, u-blox, sbf and
+*                           novatel oem4 logs (rnxopt_t nthread)
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
@@ -32,6 +34,13 @@ static const char rcsid[]="$Id:$";
 
 #define NOUTFILE        7       /* number of output files */
 #define TSTARTMARGIN    60.0    /* time margin for file name replacement */
+#define MAXPARTHREAD    32      /* max number of decoding threads */
+#define PARCHKSIZE      4194304 /* chunk size of parallel decoding (bytes) */
+#define PARWARMSIZE     1048576 /* warm-up size of chunk decoder (bytes) */
+#define PARSYNCSIZE     65536   /* search window of chunk boundary (bytes) */
+#define PARNSYNC        3       /* number of valid messages at chunk boundary */
+#define RTCM3PREAMB     0xD3    /* rtcm ver.3 frame preamble */
+#define MAXPARREG       (MAXSAT*14+64) /* max number of decoder state regions */
 
 /* type definition -----------------------------------------------------------*/
 
@@ -45,8 +54,75 @@ typedef struct {                /* stream file type */
     raw_t  raw;                 /* receiver raw data */
     rnxctr_t rnx;               /* rinex data */
     FILE   *fp;                 /* file pointer */
+    int    nthread;             /* number of decoding threads (0,1:sequential) */
+    const rnxopt_t *opt;        /* rinex options (NULL: no approx position) */
+    gtime_t tend;               /* end time of previous file */
+    struct parfile_tag *par;    /* parallel decoding (NULL: sequential) */
 } strfile_t;
 
+typedef struct {                /* decoder state region type */
+    unsigned char *p;           /* state */
+    int    size;                /* size (bytes) */
+    int    sat;                 /* satellite (0:decoder,-1:output only) */
+} parreg_t;
+
+typedef struct {                /* decoded message type */
+    int    type;                /* message type (input_strfile()) */
+    int    sat;                 /* input satellite */
+    gtime_t time;               /* current time */
+    int    index,n;             /* index/number of observation data */
+    int    pos;                 /* approx position (0:none,1:ok) */
+    double rr[3];               /* approx position (ecef) (m) */
+    union {
+        eph_t  eph;             /* ephemeris */
+        geph_t geph;            /* glonass ephemeris */
+        seph_t seph;            /* sbas ephemeris */
+        sbsmsg_t sbsmsg;        /* sbas message */
+    } data;
+} parmsg_t;
+
+typedef struct {                /* decoding chunk type */
+    long   pos,end;             /* start/end file position */
+    int    state;               /* state (0:wait,1:decoding,2:decoded,3:redo) */
+    int    stop;                /* stopped at end time (0:no,1:yes) */
+    int    npos;                /* number of approx position trials */
+    strfile_t *str;             /* chunk decoder */
+    unsigned char *snap;        /* decoder state at chunk start */
+    int    *size,nreg;          /* sizes/number of decoder state regions */
+    unsigned char sats[MAXSAT]; /* satellites of decoded messages */
+    parmsg_t *msg;              /* decoded messages */
+    int    nmsg,nmmax;          /* number of decoded messages */
+    obsd_t *obs;                /* observation data of decoded messages */
+    int    nobs,nomax;          /* number of observation data */
+} parchk_t;
+
+typedef struct parfile_tag {    /* parallel decoding type */
+    int    format;              /* stream format (STRFMT_???) */
+    char   file[1024];          /* input file */
+    char   opt[256];            /* receiver dependent options */
+    gtime_t time;               /* approx time of decoders */
+    gtime_t tend;               /* end time of previous file */
+    gtime_t te;                 /* end time of conversion */
+    int    apppos;              /* approx position trial (0:off,1:on) */
+    int    posok;               /* approx position found by merged messages */
+    int    navsys;              /* navigation system of approx position */
+    int    nthread;             /* number of decoding threads */
+    int    state;               /* state (0:stop,1:running) */
+    int    nchk,nend;           /* number of chunks/chunks to decode */
+    int    next;                /* next chunk to decode */
+    int    ichk,imsg;           /* chunk/message index of merge (-1:unmerged) */
+    parchk_t *chk;              /* chunks */
+    strfile_t *dec;             /* decoder carried over files */
+    const parmsg_t *msg;        /* last merged message */
+    lock_t lock;                /* lock flag */
+    thread_t thread[MAXPARTHREAD]; /* decoding threads */
+} parfile_t;
+
+static int  open_parfile (strfile_t *str, const char *file);
+static int  input_parfile(strfile_t *str);
+static void close_parfile(strfile_t *str);
+static void free_parfile (parfile_t *par);
+
 /* global variables ----------------------------------------------------------*/
 static const int navsys[]={     /* system codes */
     SYS_GPS,SYS_GLO,SYS_GAL,SYS_QZS,SYS_SBS,SYS_CMP,0
@@ -183,6 +259,11 @@ static void rtcm2opt(const rtcm_t *rtcm, rnxopt_t *opt)
         opt->antdel[0]=0.0;
     }
 }
+/* receiver raw data format --------------------------------------------------*/
+static int israw(int format)
+{
+    return format<=MAXRCVFMT||format==STRFMT_SEPT;
+}
 /* generate stream file ------------------------------------------------------*/
 static strfile_t *gen_strfile(int format, const char *opt, gtime_t time)
 {
@@ -190,7 +271,7 @@ static strfile_t *gen_strfile(int format, const char *opt, gtime_t time)
     
     trace(3,"init_strfile:\n");
     
-    if (!(str=(strfile_t *)malloc(sizeof(strfile_t)))) return NULL;
+    if (!(str=(strfile_t *)calloc(1,sizeof(strfile_t)))) return NULL;
     
     if (format==STRFMT_RTCM2||format==STRFMT_RTCM3) {
         if (!init_rtcm(&str->rtcm)) {
@@ -202,7 +283,7 @@ static strfile_t *gen_strfile(int format, const char *opt, gtime_t time)
         str->nav=&str->rtcm.nav; 
         strcpy(str->rtcm.opt,opt);
     }
-    else if (format<=MAXRCVFMT) {
+    else if (israw(format)) {
         if (!init_raw(&str->raw)) {
             showmsg("init raw error");
             return 0;
@@ -221,9 +302,19 @@ static strfile_t *gen_strfile(int format, const char *opt, gtime_t time)
         str->nav=&str->rnx.nav;
         strcpy(str->rnx.opt,opt);
     }
+    else {
+        showmsg("unsupported format: %d",format);
+        free(str);
+        return NULL;
+    }
     str->format=format;
     str->sat=0;
+    str->time.time=0; str->time.sec=0.0;
     str->fp=NULL;
+    str->nthread=0;
+    str->opt=NULL;
+    str->tend.time=0; str->tend.sec=0.0;
+    str->par=NULL;
     return str;
 }
 /* free stream file ----------------------------------------------------------*/
@@ -231,10 +322,12 @@ static void free_strfile(strfile_t *str)
 {
     trace(3,"free_strfile:\n");
     
+    if (str->par) free_parfile(str->par);
+    
     if (str->format==STRFMT_RTCM2||str->format==STRFMT_RTCM3) {
         free_rtcm(&str->rtcm);
     }
-    else if (str->format<=MAXRCVFMT) {
+    else if (israw(str->format)) {
         free_raw(&str->raw);
     }
     else if (str->format==STRFMT_RINEX) {
@@ -249,6 +342,8 @@ static int input_strfile(strfile_t *str)
     
     trace(4,"input_strfile:\n");
     
+    if (str->par) return input_parfile(str);
+    
     if (str->format==STRFMT_RTCM2) {
         if ((type=input_rtcm2f(&str->rtcm,str->fp))>=1) {
             str->time=str->rtcm.time;
@@ -261,7 +356,7 @@ static int input_strfile(strfile_t *str)
             str->sat=str->rtcm.ephsat;
         }
     }
-    else if (str->format<=MAXRCVFMT) {
+    else if (israw(str->format)) {
         if ((type=input_rawf(&str->raw,str->format,str->fp))>=1) {
             str->time=str->raw.time;
             str->sat=str->raw.ephsat;
@@ -282,13 +377,17 @@ static int open_strfile(strfile_t *str, const char *file)
 {
     trace(3,"open_strfile: file=%s\n",file);
     
+    if (str->nthread>1&&(str->format==STRFMT_RTCM3||str->format==STRFMT_OEM4||
+        str->format==STRFMT_UBX||str->format==STRFMT_SEPT)) {
+        return open_parfile(str,file);
+    }
     if (str->format==STRFMT_RTCM2||str->format==STRFMT_RTCM3) {
         if (!(str->fp=fopen(file,"rb"))) {
             showmsg("rtcm open error: %s",file);
             return 0;
         }
     }
-    else if (str->format<=MAXRCVFMT) {
+    else if (israw(str->format)) {
         if (!(str->fp=fopen(file,"rb"))) {
             showmsg("log open error: %s",file);
             return 0;
@@ -320,16 +419,763 @@ static void close_strfile(strfile_t *str)
 {
     trace(3,"close_strfile:\n");
     
+    if (str->par) {
+        close_parfile(str);
+        return;
+    }
     if (str->format==STRFMT_RTCM2||str->format==STRFMT_RTCM3) {
         if (str->fp) fclose(str->fp);
     }
-    else if (str->format<=MAXRCVFMT) {
+    else if (israw(str->format)) {
         if (str->fp) fclose(str->fp);
     }
     else if (str->format==STRFMT_RINEX) {
         if (str->fp) fclose(str->fp);
     }
 }
+/* little-endian fields of raw message ---------------------------------------*/
+static unsigned short U2(const unsigned char *p)
+{
+    return (unsigned short)(p[0]|(p[1]<<8));
+}
+static unsigned int U4(const unsigned char *p)
+{
+    return (unsigned int)p[0]|((unsigned int)p[1]<<8)|
+           ((unsigned int)p[2]<<16)|((unsigned int)p[3]<<24);
+}
+/* length of valid message ---------------------------------------------------*/
+static int msglen(int format, const unsigned char *p, int n)
+{
+    unsigned char cka=0,ckb=0;
+    int i,len;
+    
+    if (format==STRFMT_RTCM3) {
+        if (n<6||p[0]!=RTCM3PREAMB||(p[1]&0xFC)) return 0;
+        len=(int)getbitu(p,14,10)+3;
+        if (n<len+3||crc24q(p,len)!=getbitu(p,len*8,24)) return 0;
+        return len+3;
+    }
+    else if (format==STRFMT_UBX) {
+        if (n<8||p[0]!=0xB5||p[1]!=0x62) return 0;
+        if ((len=U2(p+4)+8)>MAXRAWLEN||n<len) return 0;
+        for (i=2;i<len-2;i++) {
+            cka+=p[i]; ckb+=cka;
+        }
+        return cka==p[len-2]&&ckb==p[len-1]?len:0;
+    }
+    else if (format==STRFMT_SEPT) {
+        if (n<8||p[0]!='$'||p[1]!='@') return 0;
+        if ((len=U2(p+6))<8||len>MAXRAWLEN||n<len) return 0;
+        return crc16(p+4,len-4)==U2(p+2)?len:0;
+    }
+    else if (format==STRFMT_OEM4) {
+        if (n<10||p[0]!=0xAA||p[1]!=0x44||p[2]!=0x12) return 0;
+        if ((len=U2(p+8)+p[3])>MAXRAWLEN-4||n<len+4) return 0;
+        return crc32(p,len)==U4(p+len)?len+4:0;
+    }
+    return 0;
+}
+/* search chunk boundary -------------------------------------------------------
+* search the first position where PARNSYNC valid messages continue
+*-----------------------------------------------------------------------------*/
+static long syncpos(int format, FILE *fp, long pos)
+{
+    unsigned char *buff;
+    int i,j,k,len,n,size=PARSYNCSIZE+MAXRAWLEN*PARNSYNC;
+    
+    if (!(buff=(unsigned char *)malloc(size))) return -1;
+    
+    if (fseek(fp,pos,SEEK_SET)||(n=(int)fread(buff,1,size,fp))<=0) {
+        free(buff);
+        return -1;
+    }
+    for (i=0;i<n&&i<PARSYNCSIZE;i++) {
+        for (j=0,k=i;j<PARNSYNC;j++,k+=len) {
+            if (!(len=msglen(format,buff+k,n-k))) break;
+        }
+        if (j>=PARNSYNC) {
+            free(buff);
+            return pos+i;
+        }
+    }
+    free(buff);
+    return -1;
+}
+/* check decoder with static state ---------------------------------------------
+* u-blox trk-meas and trk-d5 keep the carrier-phase in static variables, so
+* they are decoded only by the sequential decoder
+*-----------------------------------------------------------------------------*/
+static int is_unsafe(int format, const unsigned char *buff, int n)
+{
+    int i;
+    
+    if (format!=STRFMT_UBX) return 0;
+    
+    for (i=0;i<n-3;i++) {
+        if (buff[i]==0xB5&&buff[i+1]==0x62&&buff[i+2]==0x03&&
+            (buff[i+3]==0x10||buff[i+3]==0x0A)) return 1;
+    }
+    return 0;
+}
+/* add decoder state region --------------------------------------------------*/
+static void addreg(parreg_t *reg, int *n, void *p, int size, int sat)
+{
+    if (*n>=MAXPARREG) return;
+    reg[*n].p=(unsigned char *)p;
+    reg[*n].size=size;
+    reg[(*n)++].sat=sat;
+}
+/* decoder state regions -------------------------------------------------------
+* regions of decoder state which decoding of following messages depends on.
+* sat=0: decoder state, sat>0: satellite slice, sat=-1: output only
+*-----------------------------------------------------------------------------*/
+static int stateregs(strfile_t *str, parreg_t *reg)
+{
+    rtcm_t *rtcm=&str->rtcm;
+    raw_t *raw=&str->raw;
+    nav_t *nav=str->nav;
+    int i,n=0;
+    
+    addreg(reg,&n,&str->time,sizeof(gtime_t),0);
+    addreg(reg,&n,&str->obs->n,sizeof(int),0);
+    addreg(reg,&n,str->obs->data,sizeof(obsd_t)*str->obs->n,0);
+    
+    if (str->format==STRFMT_RTCM3) {
+        addreg(reg,&n,&rtcm->staid,sizeof(int),0);
+        addreg(reg,&n,&rtcm->stah,sizeof(int),0);
+        addreg(reg,&n,&rtcm->seqno,sizeof(int),0);
+        addreg(reg,&n,&rtcm->time,sizeof(gtime_t),0);
+        addreg(reg,&n,&rtcm->time_s,sizeof(gtime_t),0);
+        addreg(reg,&n,&rtcm->obsflag,sizeof(int),0);
+        addreg(reg,&n,&rtcm->nbyte,sizeof(int),0);
+        addreg(reg,&n,&rtcm->sta,sizeof(sta_t),-1);
+    
+        for (i=0;i<MAXSAT;i++) {
+            addreg(reg,&n,rtcm->cp[i],sizeof(rtcm->cp[i]),i+1);
+            addreg(reg,&n,rtcm->lock[i],sizeof(rtcm->lock[i]),i+1);
+            addreg(reg,&n,rtcm->loss[i],sizeof(rtcm->loss[i]),i+1);
+            addreg(reg,&n,rtcm->lltime[i],sizeof(rtcm->lltime[i]),i+1);
+            addreg(reg,&n,rtcm->ssr+i,sizeof(ssr_t),i+1);
+            addreg(reg,&n,nav->eph+i,sizeof(eph_t),i+1);
+        }
+        for (i=0;i<MAXPRNGLO;i++) {
+            addreg(reg,&n,nav->geph+i,sizeof(geph_t),satno(SYS_GLO,i+1));
+        }
+        return n;
+    }
+    addreg(reg,&n,&raw->time,sizeof(gtime_t),0);
+    addreg(reg,&n,&raw->tobs,sizeof(gtime_t),0);
+    addreg(reg,&n,&raw->obuf.n,sizeof(int),0);
+    addreg(reg,&n,raw->obuf.data,sizeof(obsd_t)*raw->obuf.n,0);
+    addreg(reg,&n,&raw->icpc,sizeof(double),0);
+    addreg(reg,&n,raw->freqn,sizeof(raw->freqn),0);
+    addreg(reg,&n,&raw->nbyte,sizeof(int),0);
+    addreg(reg,&n,&raw->iod,sizeof(int),0);
+    addreg(reg,&n,&raw->tod,sizeof(int),0);
+    addreg(reg,&n,&raw->tbase,sizeof(int),0);
+    addreg(reg,&n,&raw->flag,sizeof(int),0);
+    addreg(reg,&n,nav->glo_fcn,sizeof(nav->glo_fcn),0);
+    addreg(reg,&n,&raw->sta,sizeof(sta_t),-1);
+    addreg(reg,&n,nav->utc_gps,sizeof(nav->utc_gps),-1);
+    addreg(reg,&n,nav->utc_glo,sizeof(nav->utc_glo),-1);
+    addreg(reg,&n,nav->utc_gal,sizeof(nav->utc_gal),-1);
+    addreg(reg,&n,nav->utc_qzs,sizeof(nav->utc_qzs),-1);
+    addreg(reg,&n,nav->utc_cmp,sizeof(nav->utc_cmp),-1);
+    addreg(reg,&n,nav->utc_sbs,sizeof(nav->utc_sbs),-1);
+    addreg(reg,&n,nav->ion_gps,sizeof(nav->ion_gps),-1);
+    addreg(reg,&n,nav->ion_gal,sizeof(nav->ion_gal),-1);
+    addreg(reg,&n,nav->ion_qzs,sizeof(nav->ion_qzs),-1);
+    addreg(reg,&n,nav->ion_cmp,sizeof(nav->ion_cmp),-1);
+    addreg(reg,&n,&nav->leaps,sizeof(int),-1);
+    
+    for (i=0;i<MAXSAT;i++) {
+        addreg(reg,&n,raw->subfrm[i],sizeof(raw->subfrm[i]),i+1);
+        addreg(reg,&n,raw->lockt[i],sizeof(raw->lockt[i]),i+1);
+        addreg(reg,&n,raw->halfc[i],sizeof(raw->halfc[i]),i+1);
+        addreg(reg,&n,raw->icpp+i,sizeof(double),i+1);
+        addreg(reg,&n,raw->off+i,sizeof(double),i+1);
+        addreg(reg,&n,raw->prCA+i,sizeof(double),i+1);
+        addreg(reg,&n,raw->dpCA+i,sizeof(double),i+1);
+        addreg(reg,&n,nav->eph+i,sizeof(eph_t),i+1);
+        addreg(reg,&n,nav->alm+i,sizeof(alm_t),i+1);
+        addreg(reg,&n,nav->lam[i],sizeof(nav->lam[i]),i+1);
+    }
+    for (i=0;i<NSATGLO;i++) {
+        addreg(reg,&n,nav->geph+i,sizeof(geph_t),satno(SYS_GLO,MINPRNGLO+i));
+    }
+    for (i=0;i<NSATSBS*2;i++) {
+        addreg(reg,&n,nav->seph+i,sizeof(seph_t),satno(SYS_SBS,MINPRNSBS+i));
+    }
+    return n;
+}
+/* save decoder state at chunk start -----------------------------------------*/
+static int savestate(parchk_t *chk, strfile_t *str)
+{
+    parreg_t *reg;
+    unsigned char *p;
+    int i,size=0;
+    
+    if (!(reg=(parreg_t *)malloc(sizeof(parreg_t)*MAXPARREG))) return 0;
+    
+    chk->nreg=stateregs(str,reg);
+    
+    for (i=0;i<chk->nreg;i++) size+=reg[i].size;
+    
+    if (!(chk->size=(int *)malloc(sizeof(int)*chk->nreg))||
+        !(chk->snap=(unsigned char *)malloc(size>0?size:1))) {
+        free(reg);
+        return 0;
+    }
+    for (i=0,p=chk->snap;i<chk->nreg;p+=reg[i++].size) {
+        chk->size[i]=reg[i].size;
+        memcpy(p,reg[i].p,reg[i].size);
+    }
+    free(reg);
+    return 1;
+}
+/* verify chunk decoder by previous decoder ------------------------------------
+* compare the state of the previous decoder at the chunk start with the saved
+* state of the chunk decoder. a satellite slice may differ only if the chunk
+* decoder did not change it and no decoded message of the chunk refers to the
+* satellite, and an output only state only if it was not changed and not used
+* by approx position. the differing slices are copied from the previous
+* decoder, so the chunk decoder continues as the sequential one.
+* args   : strfile_t *prev  I   previous decoder at chunk start
+*          parchk_t  *chk   IO  decoded chunk
+*          int       pos    I   approx position of chunk used (1:used,0:found)
+* return : status (1:ok,0:differ)
+*-----------------------------------------------------------------------------*/
+static int verify_chunk(strfile_t *prev, parchk_t *chk, int pos)
+{
+    parreg_t *rp,*rc;
+    unsigned char *p,*patch;
+    int i,np,nc,stat=1;
+    
+    rp=(parreg_t *)malloc(sizeof(parreg_t)*MAXPARREG);
+    rc=(parreg_t *)malloc(sizeof(parreg_t)*MAXPARREG);
+    patch=(unsigned char *)calloc(MAXPARREG,1);
+    
+    if (!rp||!rc||!patch) {
+        free(rp); free(rc); free(patch);
+        return 0;
+    }
+    np=stateregs(prev,rp);
+    nc=stateregs(chk->str,rc);
+    
+    if (np!=chk->nreg||nc!=chk->nreg) stat=0;
+    
+    for (i=0,p=chk->snap;stat&&i<np;p+=chk->size[i++]) {
+        if (rp[i].size!=chk->size[i]) {
+            stat=0;
+        }
+        else if (!memcmp(rp[i].p,p,rp[i].size)) {
+            continue;
+        }
+        else if (!rp[i].sat||(rp[i].sat>0&&chk->sats[rp[i].sat-1])||
+                 (rp[i].sat<0&&pos&&chk->npos>0)) {
+            stat=0;
+        }
+        else if (rc[i].size!=chk->size[i]||memcmp(rc[i].p,p,rc[i].size)) {
+            stat=0;
+        }
+        else patch[i]=1;
+    }
+    if (stat) {
+        for (i=0;i<np;i++) {
+            if (patch[i]) memcpy(rc[i].p,rp[i].p,rp[i].size);
+        }
+    }
+    else {
+        trace(3,"verify_chunk: state differ pos=%ld region=%d\n",chk->pos,i);
+    }
+    free(rp); free(rc); free(patch);
+    return stat;
+}
+/* input stream data ---------------------------------------------------------*/
+static int input_strdata(strfile_t *str, unsigned char data)
+{
+    int type;
+    
+    if (str->format==STRFMT_RTCM3) {
+        if ((type=input_rtcm3(&str->rtcm,data))>=1) {
+            str->time=str->rtcm.time;
+            str->sat=str->rtcm.ephsat;
+        }
+    }
+    else if ((type=input_raw(&str->raw,str->format,data))>=1) {
+        str->time=str->raw.time;
+        str->sat=str->raw.ephsat;
+    }
+    return type;
+}
+/* add decoded message to chunk ----------------------------------------------*/
+static parmsg_t *addmsg(parchk_t *chk, strfile_t *str, int type)
+{
+    parmsg_t *msg;
+    obsd_t *obs;
+    int i,n,sys,prn,sat;
+    
+    if (chk->nmsg>=chk->nmmax) {
+        n=chk->nmmax<=0?1024:chk->nmmax*2;
+        if (!(msg=(parmsg_t *)realloc(chk->msg,sizeof(parmsg_t)*n))) {
+            return NULL;
+        }
+        chk->msg=msg;
+        chk->nmmax=n;
+    }
+    msg=chk->msg+chk->nmsg++;
+    msg->type=type;
+    msg->sat=str->sat;
+    msg->time=str->time;
+    msg->index=chk->nobs;
+    msg->n=msg->pos=0;
+    
+    if (type==1) {
+        if (chk->nobs+str->obs->n>chk->nomax) {
+            n=chk->nomax<=0?16384:chk->nomax*2;
+            if (n<chk->nobs+str->obs->n) n=chk->nobs+str->obs->n;
+            if (!(obs=(obsd_t *)realloc(chk->obs,sizeof(obsd_t)*n))) {
+                return NULL;
+            }
+            chk->obs=obs;
+            chk->nomax=n;
+        }
+        for (i=0;i<str->obs->n;i++) {
+            chk->obs[chk->nobs++]=str->obs->data[i];
+            chk->sats[str->obs->data[i].sat-1]=1;
+        }
+        msg->n=str->obs->n;
+    }
+    else if (type==2&&str->sat>0) {
+        sys=satsys(str->sat,&prn);
+        if (sys==SYS_GLO) {
+            msg->data.geph=str->nav->geph[prn-1];
+        }
+        else if (sys==SYS_SBS) {
+            msg->data.seph=str->nav->seph[prn-MINPRNSBS];
+        }
+        else {
+            msg->data.eph=str->nav->eph[str->sat-1];
+        }
+        chk->sats[str->sat-1]=1;
+    }
+    else if (type==3) {
+        msg->data.sbsmsg=str->raw.sbsmsg;
+        prn=str->raw.sbsmsg.prn;
+        if      (MINPRNSBS<=prn&&prn<=MAXPRNSBS) sat=satno(SYS_SBS,prn);
+        else if (MINPRNQZS<=prn&&prn<=MAXPRNQZS) sat=satno(SYS_QZS,prn);
+        else sat=0;
+        if (sat) chk->sats[sat-1]=1;
+    }
+    return msg;
+}
+/* decode chunk data -----------------------------------------------------------
+* args   : parfile_t *par   I   parallel decoding
+*          parchk_t  *chk   IO  chunk (NULL: warm-up without messages)
+*          strfile_t *str   IO  decoder
+*          unsigned char *buff I data
+*          int       n      I   data length (bytes)
+* return : decoded length (bytes) (-1: error)
+* notes  : the message processing of convrnx_s() which changes the decoder state
+*          (sbas corrections) and approx position by the decoder are done here
+*          as the sequential conversion
+*-----------------------------------------------------------------------------*/
+static int decode_chunk(parfile_t *par, parchk_t *chk, strfile_t *str,
+                        const unsigned char *buff, int n)
+{
+    prcopt_t prcopt=prcopt_default;
+    parmsg_t *msg;
+    sol_t sol={{0}};
+    char errmsg[128];
+    int i,type,found=0;
+    
+    prcopt.navsys=par->navsys;
+    
+    for (i=0;i<n;i++) {
+        if (!(i&0xFFFF)&&!par->state) return -1;
+    
+        if (!(type=input_strdata(str,buff[i]))||!chk) continue;
+    
+        if (!(msg=addmsg(chk,str,type))) return -1;
+    
+        if (par->tend.time&&timediff(str->time,par->tend)<=0.0) continue;
+    
+        if (type==3) sbsupdatecorr(&str->raw.sbsmsg,str->nav);
+    
+        if (type==1&&par->apppos&&!found) {
+            chk->npos++;
+            if (pntpos(str->obs->data,str->obs->n,str->nav,&prcopt,&sol,NULL,
+                       NULL,errmsg)) {
+                matcpy(msg->rr,sol.rr,3,1);
+                msg->pos=found=1;
+            }
+        }
+        if (par->te.time&&timediff(str->time,par->te)>10.0) {
+            chk->stop=1;
+            return i+1;
+        }
+    }
+    return n;
+}
+/* read file data ------------------------------------------------------------*/
+static unsigned char *readdata(FILE *fp, long pos, long end)
+{
+    unsigned char *buff;
+    
+    if (!(buff=(unsigned char *)malloc(end>pos?end-pos:1))) return NULL;
+    
+    if (fseek(fp,pos,SEEK_SET)||fread(buff,1,end-pos,fp)<(size_t)(end-pos)) {
+        free(buff);
+        return NULL;
+    }
+    return buff;
+}
+/* close and free decoder ----------------------------------------------------*/
+static void free_decoder(strfile_t *str)
+{
+    if (!str) return;
+    if (str->fp) fclose(str->fp);
+    str->fp=NULL;
+    free_strfile(str);
+}
+/* free decoded messages of chunk --------------------------------------------*/
+static void free_chunkmsg(parchk_t *chk)
+{
+    free(chk->msg ); chk->msg =NULL; chk->nmsg=chk->nmmax=0;
+    free(chk->obs ); chk->obs =NULL; chk->nobs=chk->nomax=0;
+    free(chk->snap); chk->snap=NULL;
+    free(chk->size); chk->size=NULL; chk->nreg=0;
+    memset(chk->sats,0,sizeof(chk->sats));
+    chk->npos=chk->stop=0;
+}
+/* decode chunk by chunk decoder -----------------------------------------------
+* the chunk decoder is warmed-up by the data before the chunk and the state at
+* the chunk start is saved to verify. the first chunk is decoded by the
+* decoder of the sequential conversion.
+*-----------------------------------------------------------------------------*/
+static int decode_par(parfile_t *par, parchk_t *chk, int k)
+{
+    strfile_t *str=chk->str;
+    unsigned char *buff;
+    long pos=k==0?chk->pos:(chk->pos>PARWARMSIZE?chk->pos-PARWARMSIZE:0);
+    int n=(int)(chk->pos-pos),stat;
+    
+    if (k>0) {
+        if (!(str=gen_strfile(par->format,par->opt,par->time))) return 0;
+    
+        if (!open_strfile(str,par->file)) {
+            free_strfile(str);
+            return 0;
+        }
+    }
+    if (!(buff=readdata(str->fp,pos,chk->end))||
+        (k>0&&is_unsafe(par->format,buff,(int)(chk->end-pos)))) {
+        free(buff);
+        if (k>0) free_decoder(str);
+        return 0;
+    }
+    /* warm-up and save state */
+    stat=decode_chunk(par,NULL,str,buff,n)>=0&&(k==0||savestate(chk,str));
+    
+    /* decode chunk */
+    if (stat) {
+        stat=decode_chunk(par,chk,str,buff+n,(int)(chk->end-chk->pos))>=0;
+    }
+    free(buff);
+    
+    if (k>0) {
+        if (stat) chk->str=str; else free_decoder(str);
+    }
+    return stat;
+}
+/* parallel decoding thread --------------------------------------------------*/
+#ifdef WIN32
+static DWORD WINAPI parthread(void *arg)
+#else
+static void *parthread(void *arg)
+#endif
+{
+    parfile_t *par=(parfile_t *)arg;
+    int k,stat;
+    
+    while (par->state) {
+        lock(&par->lock);
+        k=par->next;
+        if (k>=par->nend) {
+            unlock(&par->lock);
+            break;
+        }
+        if (k>=par->ichk+par->nthread*2) k=-1; /* limit chunks ahead of merge */
+        else par->chk[par->next++].state=1;
+        unlock(&par->lock);
+    
+        if (k<0) {
+            sleepms(1);
+            continue;
+        }
+        stat=decode_par(par,par->chk+k,k);
+    
+        lock(&par->lock);
+        par->chk[k].state=stat?2:3;
+        if (stat&&par->chk[k].stop&&par->nend>k+1) par->nend=k+1;
+        unlock(&par->lock);
+    }
+    return 0;
+}
+/* merge chunk -----------------------------------------------------------------
+* wait the chunk decoded and verify it by the previous decoder. if the chunk
+* decoder differs, the chunk is decoded again by the previous decoder.
+*-----------------------------------------------------------------------------*/
+static int merge_chunk(parfile_t *par)
+{
+    parchk_t *chk=par->chk+par->ichk,*prev=chk-1;
+    unsigned char *buff;
+    int state,stat;
+    
+    for (;;) {
+        lock(&par->lock);
+        state=chk->state;
+        if (state==0&&par->ichk>=par->nend) state=3; /* not to be decoded */
+        unlock(&par->lock);
+        if (state>=2) break;
+        sleepms(1);
+    }
+    if (par->ichk==0) return state==2;
+    
+    if (state==2&&verify_chunk(prev->str,chk,!par->posok)) {
+        free_decoder(prev->str);
+    }
+    else {
+        trace(2,"parallel decoding: chunk decoded again pos=%ld\n",chk->pos);
+    
+        free_decoder(chk->str);
+        free_chunkmsg(chk);
+        chk->str=prev->str;
+    
+        if (!(buff=readdata(chk->str->fp,chk->pos,chk->end))) return 0;
+        stat=decode_chunk(par,chk,chk->str,buff,(int)(chk->end-chk->pos));
+        free(buff);
+        if (stat<0) return 0;
+    }
+    prev->str=NULL;
+    return 1;
+}
+/* open parallel decoding ------------------------------------------------------
+* split the file to chunks at message boundaries and start decoding threads
+*-----------------------------------------------------------------------------*/
+static int open_parfile(strfile_t *str, const char *file)
+{
+    parfile_t *par=str->par;
+    FILE *fp;
+    long pos,size;
+    int i,n,nmax;
+    
+    trace(3,"open_parfile: file=%s nthread=%d\n",file,str->nthread);
+    
+    if (!par) {
+        if (!(par=(parfile_t *)calloc(1,sizeof(parfile_t)))) return 0;
+        par->format=str->format;
+        if (str->format==STRFMT_RTCM3) {
+            strcpy(par->opt,str->rtcm.opt);
+            par->time=str->rtcm.time;
+        }
+        else {
+            strcpy(par->opt,str->raw.opt);
+            par->time=str->raw.time;
+        }
+        par->nthread=str->nthread<MAXPARTHREAD?str->nthread:MAXPARTHREAD;
+        initlock(&par->lock);
+        str->par=par;
+    }
+    strcpy(par->file,file);
+    par->tend=str->tend;
+    par->te.time=0; par->te.sec=0.0;
+    par->apppos=par->posok=0;
+    if (str->opt) {
+        par->te=str->opt->te;
+        par->apppos=!str->opt->autopos&&norm(str->opt->apppos,3)<=0.0;
+        par->navsys=str->opt->navsys;
+    }
+    /* decoder of sequential conversion for first chunk */
+    if (!par->dec&&!(par->dec=gen_strfile(par->format,par->opt,par->time))) {
+        return 0;
+    }
+    if (!open_strfile(par->dec,file)) return 0;
+    
+    /* split file to chunks at message boundaries */
+    fp=par->dec->fp;
+    fseek(fp,0,SEEK_END);
+    size=ftell(fp);
+    nmax=(int)(size/PARCHKSIZE)+1;
+    
+    if (!(par->chk=(parchk_t *)calloc(nmax,sizeof(parchk_t)))) {
+        fclose(fp);
+        par->dec->fp=NULL;
+        return 0;
+    }
+    for (i=1,n=1;i<nmax;i++) {
+        if (i*(long)PARCHKSIZE+PARWARMSIZE>=size) break;
+        pos=syncpos(par->format,fp,i*(long)PARCHKSIZE);
+        if (pos<=par->chk[n-1].pos) continue;
+        par->chk[n-1].end=pos;
+        par->chk[n++].pos=pos;
+    }
+    par->chk[n-1].end=size;
+    par->nchk=par->nend=n;
+    par->chk[0].str=par->dec;
+    par->dec=NULL;
+    par->next=par->ichk=0;
+    par->imsg=-1;
+    par->msg=NULL;
+    par->state=1;
+    
+    trace(3,"open_parfile: size=%ld nchk=%d\n",size,n);
+    
+    /* start decoding threads */
+    for (i=0;i<par->nthread;i++) {
+#ifdef WIN32
+        if (!(par->thread[i]=CreateThread(NULL,0,parthread,par,0,NULL))) break;
+#else
+        if (pthread_create(&par->thread[i],NULL,parthread,par)) break;
+#endif
+    }
+    if ((par->nthread=i)<=0) {
+        par->state=0;
+        close_parfile(str);
+        return 0;
+    }
+    return 1;
+}
+/* input parallel decoding ---------------------------------------------------*/
+static int input_parfile(strfile_t *str)
+{
+    parfile_t *par=str->par;
+    parchk_t *chk;
+    const parmsg_t *msg;
+    int sys,prn;
+    
+    if (!par->chk) return -2;
+    
+    for (;;) {
+        if (par->ichk>=par->nchk) return -2;
+        chk=par->chk+par->ichk;
+    
+        if (par->imsg<0) {
+            if (!merge_chunk(par)) {
+                showmsg("parallel decoding error: %s",par->file);
+                par->nchk=par->ichk;
+                return -2;
+            }
+            par->imsg=0;
+        }
+        if (par->imsg<chk->nmsg) break;
+        if (chk->stop) return -2;
+    
+        free_chunkmsg(chk);
+        lock(&par->lock);
+        par->ichk++;
+        unlock(&par->lock);
+        par->imsg=-1;
+    }
+    msg=chk->msg+par->imsg++;
+    
+    str->time=msg->time;
+    str->sat=msg->sat;
+    
+    if (msg->type==1) {
+        memcpy(str->obs->data,chk->obs+msg->index,sizeof(obsd_t)*msg->n);
+        str->obs->n=msg->n;
+    }
+    else if (msg->type==2&&msg->sat>0) {
+        sys=satsys(msg->sat,&prn);
+        if (sys==SYS_GLO) {
+            str->nav->geph[prn-1]=msg->data.geph;
+        }
+        else if (sys==SYS_SBS) {
+            if (str->nav->seph) str->nav->seph[prn-MINPRNSBS]=msg->data.seph;
+        }
+        else {
+            str->nav->eph[msg->sat-1]=msg->data.eph;
+        }
+    }
+    else if (msg->type==3) {
+        str->raw.sbsmsg=msg->data.sbsmsg;
+    }
+    if (msg->pos) par->posok=1;
+    par->msg=msg;
+    return msg->type;
+}
+/* close parallel decoding -----------------------------------------------------
+* stop decoding threads and keep the decoder at the last merged message to
+* continue the next file
+*-----------------------------------------------------------------------------*/
+static void close_parfile(strfile_t *str)
+{
+    parfile_t *par=str->par;
+    strfile_t *dec=NULL;
+    int i;
+    
+    trace(3,"close_parfile:\n");
+    
+    if (!par->chk) return;
+    
+    par->state=0;
+    for (i=0;i<par->nthread;i++) {
+#ifdef WIN32
+        WaitForSingleObject(par->thread[i],INFINITE);
+        CloseHandle(par->thread[i]);
+#else
+        pthread_join(par->thread[i],NULL);
+#endif
+    }
+    par->nthread=str->nthread<MAXPARTHREAD?str->nthread:MAXPARTHREAD;
+    
+    /* decoder at last merged message */
+    if (par->ichk>=par->nchk) i=par->nchk-1;
+    else if (par->imsg>=0||par->ichk==0) i=par->ichk;
+    else i=par->ichk-1;
+    dec=par->chk[i].str;
+    par->chk[i].str=NULL;
+    
+    for (i=0;i<par->nchk;i++) {
+        free_decoder(par->chk[i].str);
+        free_chunkmsg(par->chk+i);
+    }
+    free(par->chk); par->chk=NULL;
+    par->nchk=par->nend=0;
+    par->msg=NULL;
+    
+    if (!dec) return;
+    if (dec->fp) fclose(dec->fp);
+    dec->fp=NULL;
+    par->dec=dec;
+    
+    /* station and navigation info for output header */
+    if (str->format==STRFMT_RTCM3) {
+        str->rtcm.staid=dec->rtcm.staid;
+        str->rtcm.sta=dec->rtcm.sta;
+    }
+    else {
+        str->raw.sta=dec->raw.sta;
+    }
+    matcpy(str->nav->utc_gps,dec->nav->utc_gps,4,1);
+    matcpy(str->nav->utc_glo,dec->nav->utc_glo,4,1);
+    matcpy(str->nav->utc_gal,dec->nav->utc_gal,4,1);
+    matcpy(str->nav->utc_qzs,dec->nav->utc_qzs,4,1);
+    matcpy(str->nav->utc_cmp,dec->nav->utc_cmp,4,1);
+    matcpy(str->nav->utc_sbs,dec->nav->utc_sbs,4,1);
+    matcpy(str->nav->ion_gps,dec->nav->ion_gps,8,1);
+    matcpy(str->nav->ion_gal,dec->nav->ion_gal,4,1);
+    matcpy(str->nav->ion_qzs,dec->nav->ion_qzs,8,1);
+    matcpy(str->nav->ion_cmp,dec->nav->ion_cmp,8,1);
+    str->nav->leaps=dec->nav->leaps;
+}
+/* free parallel decoding ----------------------------------------------------*/
+static void free_parfile(parfile_t *par)
+{
+    free_decoder(par->dec);
+    free(par);
+}
 /* sort codes ----------------------------------------------------------------*/
 static void sort_codes(unsigned char *codes, unsigned char *types, int n)
 {
@@ -407,6 +1253,8 @@ static int scan_obstype(int format, const char *file, rnxopt_t *opt,
     
     if (!(str=gen_strfile(format,opt->rcvopt,*time))) return 0;
     
+    str->nthread=opt->nthread;
+    
     if (!open_strfile(str,file)) {
         free_strfile(str);
         return 0;
@@ -846,6 +1694,13 @@ static void setapppos(strfile_t *str, rnxopt_t *opt)
     
     prcopt.navsys=opt->navsys;
     
+    /* approx position by parallel decoding */
+    if (str->par) {
+        if (str->par->msg&&str->par->msg->pos) {
+            matcpy(opt->apppos,str->par->msg->rr,3,1);
+        }
+        return;
+    }
     /* point positioning with last obs data */
     if (!pntpos(str->obs->data,str->obs->n,str->nav,&prcopt,&sol,NULL,NULL,
                 msg)) {
@@ -926,6 +1781,8 @@ static int convrnx_s(int sess, int format, rnxopt_t *opt, const char *file,
         for (i=0;i<MAXEXFILE;i++) free(epath[i]);
         return 0;
     }
+    str->nthread=opt->nthread;
+    str->opt=opt;
     time=opt->ts.time?opt->ts:(time.time?timeadd(time,TSTARTMARGIN):time);
     
     /* replace keywords in output file */
@@ -947,6 +1804,7 @@ static int convrnx_s(int sess, int format, rnxopt_t *opt, const char *file,
     for (i=0;i<nf&&!abort;i++) {
         
         /* open stream file */
+        str->tend=tend;
         if (!open_strfile(str,epath[i])) continue;
         
         /* input message */
@@ -1023,6 +1881,12 @@ static int convrnx_s(int sess, int format, rnxopt_t *opt, const char *file,
 *          keywords in ofile[] are replaced by first obs date/time and station
 *          id (%r)
 *          the order of wild-card expanded files must be in-order by time
+*          if opt->nthread>1, rtcm3, u-blox, sbf and novatel oem4 logs are
+*          split to chunks at message boundaries and decoded by opt->nthread
+*          threads. a chunk decoder is warmed-up by the data before the chunk
+*          and verified by the previous decoder at the chunk start, or the
+*          chunk is decoded again by the previous decoder, so the output is
+*          identical to the sequential conversion.
 *-----------------------------------------------------------------------------*/
 extern int convrnx(int format, rnxopt_t *opt, const char *file, char **ofile)
 {
@@ -12,15 +12,38 @@
 *           2009/09/04 1.1  replace geoid data by global model
 *           2009/12/05 1.2  added api:
 *                               opengeoid(),closegeoid()
+*           2019/10/13 1.3  memory-mapped geoid files and decoded tile cache
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 static const char rcsid[]="$Id: geoid.c,v 1.1 2008/07/17 21:48:06 ttaka Exp $";
 
+#define NTILE       32              /* number of cached geoid tiles */
+#define TILESIZE    8               /* geoid tile size (grid points) */
+
+typedef struct {                    /* decoded geoid tile */
+    long i0,j0;                     /* grid index of tile origin */
+    unsigned int tick;              /* last access count */
+    double h[TILESIZE*TILESIZE];    /* geoid heights (m) */
+} tile_t;
+
 static const double range[4];       /* embedded geoid area range {W,E,S,N} (deg) */
 static const float geoid[361][181]; /* embedded geoid heights (m) (lon x lat) */
 static FILE *fp_geoid=NULL;         /* geoid file pointer */
 static int model_geoid=GEOID_EMBEDDED; /* geoid model */
+static const unsigned char *map_geoid=NULL; /* mapped geoid file (NULL:no map) */
+static long size_geoid=0;           /* size of mapped geoid file (bytes) */
+static tile_t tile_geoid[NTILE];    /* decoded geoid tiles (lru cache) */
+static int ntile_geoid=0;           /* number of decoded geoid tiles */
+static unsigned int tick_geoid=0;   /* geoid tile access count */
+static lock_t lock_geoid;           /* lock for geoid tiles */
+static int init_geoid=0;            /* lock initialized flag */
 
 /* bilinear interpolation ----------------------------------------------------*/
 static double interpb(const double *y, double a, double b)
@@ -48,15 +71,109 @@ static double geoidh_emb(const double *pos)
     y[3]=geoid[i2][j2];
     return interpb(y,a,b);
 }
+/* read geoid data file (mapped or file) -------------------------------------*/
+static int readgeoid(long off, void *buff, int size)
+{
+    if (map_geoid) {
+        if (off<0||off+size>size_geoid) return 0;
+        memcpy(buff,map_geoid+off,size);
+        return 1;
+    }
+    return fseek(fp_geoid,off,SEEK_SET)!=EOF&&fread(buff,size,1,fp_geoid)==1;
+}
 /* get 2 byte signed integer from file ---------------------------------------*/
-static short fget2b(FILE *fp, long off)
+static short fget2b(long off)
 {
-    unsigned char v[2];
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(v,2,1,fp)<1) {
+    unsigned char v[2]={0};
+    if (!readgeoid(off,v,2)) {
         trace(2,"geoid data file range error: off=%ld\n",off);
     }
     return ((short)v[0]<<8)+v[1]; /* big-endian */
 }
+/* get 4byte float from file -------------------------------------------------*/
+static float fget4f(long off)
+{
+    float v=0.0;
+    if (!readgeoid(off,&v,4)) {
+        trace(2,"geoid data file range error: off=%ld\n",off);
+    }
+    return v; /* small-endian */
+}
+/* get gsi geoid data --------------------------------------------------------*/
+static double fgetgsi(int nlon, int nlat, int i, int j)
+{
+    const int nf=28,wf=9,nl=nf*wf+2,nr=(nlon-1)/nf+1;
+    double v;
+    long off=nl+j*nr*nl+i/nf*nl+i%nf*wf;
+    char buff[16]="";
+    
+    if (!readgeoid(off,buff,wf)) {
+        trace(2,"out of range for gsi geoid: i=%d j=%d\n",i,j);
+        return 0.0;
+    }
+    if (sscanf(buff,"%lf",&v)<1) {
+        trace(2,"gsi geoid data format error: i=%d j=%d buff=%s\n",i,j,buff);
+        return 0.0;
+    }
+    return v;
+}
+/* geoid height at grid point of geoid data file -----------------------------*/
+static double gridh(long i, long j)
+{
+    /* notes: 4byte-zeros are inserted at first and last field of a record */
+    /*        for current egm2008 geid data files (2009/12/10) */
+    /* http://earth-info.nga.mil/GandG/wgs84/gravitymod/egm2008/egm08_wgs84.html */
+    /* (1) Und_min1x1_egm2008_isw=82_WGS84_TideFree_SE.gz */
+    /* (2) Und_min2.5x2.5_egm2008_isw=82_WGS84_TideFree_SE.gz */
+    switch (model_geoid) {
+        case GEOID_EGM96_M150 : /* 1440 x 721 */
+            if (i>=1440||j>=721) return 0.0;
+            return fget2b(2L*(i+j*1440))*0.01;
+        case GEOID_EGM2008_M25: /* 8640 x 4321 */
+            if (i>=8640||j>=4321) return 0.0;
+            return fget4f(4L*(i+j*(8640+2)+1));
+        case GEOID_EGM2008_M10: /* 21600 x 10801 */
+            if (i>=21600||j>=10801) return 0.0;
+            return fget4f(4L*(i+j*(21600+2)+1));
+        case GEOID_GSI2000_M15: /* 1201 x 1801 */
+            if (i>=1201||j>=1801) return 0.0;
+            return fgetgsi(1201,1801,(int)i,(int)j);
+    }
+    return 0.0;
+}
+/* geoid height at grid point (tile cache) -------------------------------------
+* grid points of a mapped geoid file are decoded by TILESIZE x TILESIZE tiles.
+* the least recently used tile is replaced on a tile miss
+*-----------------------------------------------------------------------------*/
+static double geoidv(long i, long j)
+{
+    tile_t *t=NULL;
+    long i0,j0,ii,jj;
+    int k;
+    
+    if (!map_geoid) return gridh(i,j);
+    
+    i0=i/TILESIZE*TILESIZE;
+    j0=j/TILESIZE*TILESIZE;
+    for (k=0;k<ntile_geoid;k++) {
+        if (tile_geoid[k].i0==i0&&tile_geoid[k].j0==j0) {
+            t=tile_geoid+k;
+            break;
+        }
+    }
+    if (!t) {
+        if (ntile_geoid<NTILE) t=tile_geoid+ntile_geoid++;
+        else for (t=tile_geoid,k=1;k<NTILE;k++) {
+            if (tile_geoid[k].tick<t->tick) t=tile_geoid+k;
+        }
+        t->i0=i0; t->j0=j0;
+        for (jj=0;jj<TILESIZE;jj++) for (ii=0;ii<TILESIZE;ii++) {
+            t->h[ii+jj*TILESIZE]=gridh(i0+ii,j0+jj);
+        }
+    }
+    t->tick=++tick_geoid;
+    return t->h[i-i0+(j-j0)*TILESIZE];
+}
 /* egm96 15x15" model --------------------------------------------------------*/
 static double geoidh_egm96(const double *pos)
 {
@@ -71,21 +188,12 @@ static double geoidh_egm96(const double *pos)
     b=(pos[0]-lat0)/dlat;
     i1=(long)a; a-=i1; i2=i1<nlon-1?i1+1:0;
     j1=(long)b; b-=j1; j2=j1<nlat-1?j1+1:j1;
-    y[0]=fget2b(fp_geoid,2L*(i1+j1*nlon))*0.01;
-    y[1]=fget2b(fp_geoid,2L*(i2+j1*nlon))*0.01;
-    y[2]=fget2b(fp_geoid,2L*(i1+j2*nlon))*0.01;
-    y[3]=fget2b(fp_geoid,2L*(i2+j2*nlon))*0.01;
+    y[0]=geoidv(i1,j1);
+    y[1]=geoidv(i2,j1);
+    y[2]=geoidv(i1,j2);
+    y[3]=geoidv(i2,j2);
     return interpb(y,a,b);
 }
-/* get 4byte float from file -------------------------------------------------*/
-static float fget4f(FILE *fp, long off)
-{
-    float v=0.0;
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(&v,4,1,fp)<1) {
-        trace(2,"geoid data file range error: off=%ld\n",off);
-    }
-    return v; /* small-endian */
-}
 /* egm2008 model -------------------------------------------------------------*/
 static double geoidh_egm08(const double *pos, int model)
 {
@@ -114,44 +222,12 @@ static double geoidh_egm08(const double *pos, int model)
     i1=(long)a; a-=i1; i2=i1<nlon-1?i1+1:0;
     j1=(long)b; b-=j1; j2=j1<nlat-1?j1+1:j1;
     
-    /* notes: 4byte-zeros are inserted at first and last field of a record */
-    /*        for current geid data files */
-    /* http://earth-info.nga.mil/GandG/wgs84/gravitymod/egm2008/egm08_wgs84.html */
-    /* (1) Und_min1x1_egm2008_isw=82_WGS84_TideFree_SE.gz */
-    /* (2) Und_min2.5x2.5_egm2008_isw=82_WGS84_TideFree_SE.gz */
-#if 0
-    /* not zero-inserted */
-    y[0]=fget4f(fp_geoid,4L*(i1+j1*(nlon)));
-    y[1]=fget4f(fp_geoid,4L*(i2+j1*(nlon)));
-    y[2]=fget4f(fp_geoid,4L*(i1+j2*(nlon)));
-    y[3]=fget4f(fp_geoid,4L*(i2+j2*(nlon)));
-#else
-    /* zero-inserted version (2009/12/10) */
-    y[0]=fget4f(fp_geoid,4L*(i1+j1*(nlon+2)+1));
-    y[1]=fget4f(fp_geoid,4L*(i2+j1*(nlon+2)+1));
-    y[2]=fget4f(fp_geoid,4L*(i1+j2*(nlon+2)+1));
-    y[3]=fget4f(fp_geoid,4L*(i2+j2*(nlon+2)+1));
-#endif
+    y[0]=geoidv(i1,j1);
+    y[1]=geoidv(i2,j1);
+    y[2]=geoidv(i1,j2);
+    y[3]=geoidv(i2,j2);
     return interpb(y,a,b);
 }
-/* get gsi geoid data --------------------------------------------------------*/
-static double fgetgsi(FILE *fp, int nlon, int nlat, int i, int j)
-{
-    const int nf=28,wf=9,nl=nf*wf+2,nr=(nlon-1)/nf+1;
-    double v;
-    long off=nl+j*nr*nl+i/nf*nl+i%nf*wf;
-    char buff[16]="";
-    
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(buff,wf,1,fp)<1) {
-        trace(2,"out of range for gsi geoid: i=%d j=%d\n",i,j);
-        return 0.0;
-    }
-    if (sscanf(buff,"%lf",&v)<1) {
-        trace(2,"gsi geoid data format error: i=%d j=%d buff=%s\n",i,j,buff);
-        return 0.0;
-    }
-    return v;
-}
 /* gsi geoid 2000 1.0x1.5" model ---------------------------------------------*/
 static double geoidh_gsi(const double *pos)
 {
@@ -169,16 +245,33 @@ static double geoidh_gsi(const double *pos)
     b=(pos[0]-lat0)/dlat;
     i1=(int)a; a-=i1; i2=i1<nlon-1?i1+1:i1;
     j1=(int)b; b-=j1; j2=j1<nlat-1?j1+1:j1;
-    y[0]=fgetgsi(fp_geoid,nlon,nlat,i1,j1);
-    y[1]=fgetgsi(fp_geoid,nlon,nlat,i2,j1);
-    y[2]=fgetgsi(fp_geoid,nlon,nlat,i1,j2);
-    y[3]=fgetgsi(fp_geoid,nlon,nlat,i2,j2);
+    y[0]=geoidv(i1,j1);
+    y[1]=geoidv(i2,j1);
+    y[2]=geoidv(i1,j2);
+    y[3]=geoidv(i2,j2);
     if (y[0]==999.0||y[1]==999.0||y[2]==999.0||y[3]==999.0) {
         trace(2,"geoidh_gsi: data outage (lat=%.3f lon=%.3f)\n",pos[0],pos[1]);
         return 0.0;
     }
     return interpb(y,a,b);
 }
+/* map geoid model file ------------------------------------------------------*/
+static void mapgeoid(const char *file)
+{
+#ifndef WIN32
+    struct stat st;
+    void *p;
+    int fd;
+    
+    if ((fd=open(file,O_RDONLY))<0) return;
+    if (!fstat(fd,&st)&&st.st_size>0&&
+        (p=mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0))!=MAP_FAILED) {
+        map_geoid=(const unsigned char *)p;
+        size_geoid=(long)st.st_size;
+    }
+    close(fd);
+#endif
+}
 /* open geoid model file -------------------------------------------------------
 * open geoid model file
 * args   : int    model     I   geoid model type
@@ -195,6 +288,9 @@ static double geoidh_gsi(const double *pos)
 *          Und_min1x1_egm2008_isw=82_WGS84_TideFree_SE    : EGM2008 1.0x1.0"
 *          gsigeome_ver4 : GSI geoid 2000 1.0x1.5" (japanese area)
 *          (byte-order of binary files must be compatible to cpu)
+*          the file is memory-mapped if possible and grid points are decoded
+*          into a small tile cache around recent positions. otherwise grid
+*          points are read from the file for each query
 *-----------------------------------------------------------------------------*/
 extern int opengeoid(int model, const char *file)
 {
@@ -213,6 +309,11 @@ extern int opengeoid(int model, const char *file)
         trace(2,"geoid model file open error: model=%d file=%s\n",model,file);
         return 0;
     }
+    if (!init_geoid) {
+        initlock(&lock_geoid);
+        init_geoid=1;
+    }
+    mapgeoid(file);
     model_geoid=model;
     return 1;
 }
@@ -225,6 +326,12 @@ extern void closegeoid(void)
 {
     trace(3,"closegoid:\n");
     
+#ifndef WIN32
+    if (map_geoid) munmap((void *)map_geoid,size_geoid);
+#endif
+    map_geoid=NULL;
+    size_geoid=0;
+    ntile_geoid=0;
     if (fp_geoid) fclose(fp_geoid);
     fp_geoid=NULL;
     model_geoid=GEOID_EMBEDDED;
@@ -247,13 +354,19 @@ extern double geoidh(const double *pos)
         trace(2,"out of range for geoid model: lat=%.3f lon=%.3f\n",posd[0],posd[1]);
         return 0.0;
     }
-    switch (model_geoid) {
-        case GEOID_EMBEDDED   : h=geoidh_emb  (posd); break;
-        case GEOID_EGM96_M150 : h=geoidh_egm96(posd); break;
-        case GEOID_EGM2008_M25: h=geoidh_egm08(posd,model_geoid); break;
-        case GEOID_EGM2008_M10: h=geoidh_egm08(posd,model_geoid); break;
-        case GEOID_GSI2000_M15: h=geoidh_gsi  (posd); break;
-        default: return 0.0;
+    if (model_geoid==GEOID_EMBEDDED) {
+        h=geoidh_emb(posd);
+    }
+    else {
+        lock(&lock_geoid);
+        switch (model_geoid) {
+            case GEOID_EGM96_M150 : h=geoidh_egm96(posd); break;
+            case GEOID_EGM2008_M25: h=geoidh_egm08(posd,model_geoid); break;
+            case GEOID_EGM2008_M10: h=geoidh_egm08(posd,model_geoid); break;
+            case GEOID_GSI2000_M15: h=geoidh_gsi  (posd); break;
+            default: h=0.0; break;
+        }
+        unlock(&lock_geoid);
     }
     if (fabs(h)>200.0) {
         trace(2,"invalid geoid model: lat=%.3f lon=%.3f h=%.3f\n",posd[0],posd[1],h);
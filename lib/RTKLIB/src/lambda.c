@@ -186,3 +186,59 @@ extern int lambda(int n, int m, const double *a, const double *Q, double *F,
     free(L); free(D); free(Z); free(z); free(E);
     return info;
 }
+/* lambda reduction with initial z-transformation ------------------------------
+* decorrelate float parameters by lambda reduction (ref.[1]) starting from an
+* initial z-transformation. with the transformation of a previous epoch Z'*Q*Z
+* is already nearly reduced and few gauss transformations and permutations are
+* needed
+* args   : int    n      I  number of float parameters
+*          double *Q     I  covariance matrix of float parameters (n x n)
+*          double *Z     IO z-transformation (n x n)
+*                           (input: initial transformation, eye(n) for none)
+*          double *L     O  L of Qz=Z'*Q*Z=L'*diag(D)*L (n x n)
+*          double *D     O  D of Qz=Z'*Q*Z=L'*diag(D)*L (n x 1)
+* return : status (0:ok,other:error)
+*-----------------------------------------------------------------------------*/
+extern int lambda_reduct(int n, const double *Q, double *Z, double *L,
+                         double *D)
+{
+    int i,info;
+    double *QZ,*Qz,*Zr,*Z0;
+    
+    if (n<=0) return -1;
+    QZ=mat(n,n); Qz=mat(n,n); Zr=eye(n); Z0=mat(n,n);
+    
+    matmul("NN",n,n,n,1.0,Q,Z,0.0,QZ);
+    matmul("TN",n,n,n,1.0,Z,QZ,0.0,Qz); /* Qz=Z'*Q*Z */
+    
+    for (i=0;i<n*n;i++) L[i]=0.0;
+    
+    /* LD factorization and reduction of transformed covariance */
+    if (!(info=LD(n,Qz,L,D))) {
+        reduction(n,L,D,Zr);
+        matcpy(Z0,Z,n,n);
+        matmul("NN",n,n,n,1.0,Z0,Zr,0.0,Z);
+    }
+    free(QZ); free(Qz); free(Zr); free(Z0);
+    return info;
+}
+/* mlambda search of decorrelated parameters -----------------------------------
+* mlambda search (ref.[2]) with LD factors of the decorrelated covariance
+* args   : int    n      I  number of decorrelated float parameters
+*          int    m      I  number of fixed solutions
+*          double *L     I  L of Qz=L'*diag(D)*L (n x n)
+*          double *D     I  D of Qz=L'*diag(D)*L (n x 1)
+*          double *z     I  decorrelated float parameters (n x 1)
+*          double *E     O  fixed solutions of decorrelated parameters (n x m)
+*          double *s     O  sum of squared residulas of fixed solutions (1 x m)
+* return : status (0:ok,other:error)
+* notes  : the trailing k x k block of L and D is the LD factorization of the
+*          trailing block of Qz, so a subset of the last k parameters can be
+*          searched without refactorization
+*-----------------------------------------------------------------------------*/
+extern int lambda_search(int n, int m, const double *L, const double *D,
+                         const double *z, double *E, double *s)
+{
+    if (n<=0||m<=0) return -1;
+    return search(n,m,L,D,z,E,s);
+}
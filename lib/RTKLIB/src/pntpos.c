@@ -16,6 +16,9 @@
 *           2012/12/25 1.3  add variable snr mask
 *           2014/05/26 1.4  support galileo and beidou
 *           2015/03/19 1.5  fix bug on ionosphere correction for GLO and BDS
+*           2019/10/14 1.6  raim fde by downdates of normal equation
+*                           exclude pairs of satellites by raim fde
+*           2019/10/15 1.7  add api pntposp()
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
@@ -28,6 +31,8 @@ static const char rcsid[]="$Id:$";
 #define NX          (4+3)       /* # of estimated parameters */
 
 #define MAXITR      10          /* max number of iteration for point pos */
+#define MAXRAIMEX   2           /* max number of satellites excluded by raim */
+#define MAXDXP      30.0        /* max step from prediction without iteration (m) */
 #define ERR_ION     5.0         /* ionospheric delay std (m) */
 #define ERR_TROP    3.0         /* tropspheric delay std (m) */
 #define ERR_SAAS    0.3         /* saastamoinen model error std (m) */
@@ -307,147 +312,390 @@ static int valsol(const double *azel, const int *vsat, int n,
     }
     return 1;
 }
-/* estimate receiver position ------------------------------------------------*/
-static int estpos(const obsd_t *obs, int n, const double *rs, const double *dts,
+/* least square estimation of receiver position --------------------------------
+* args   : ...                  (see estpos)
+*          double *x        IO  states (I:initial,O:estimated)
+*          double varp      I   variance of predicted states x (m^2) (0:no pred)
+*          double *v,*H,*var O  weighted residuals/design matrix, variances
+*          double *Q        O   inverse of normal matrix
+*          int    *nv,*ns   O   number of residuals/valid satellites
+*          int    *nitr     IO  number of iterations (NULL: no count)
+* return : status (1:ok,0:error,-1:prediction inconsistent with measurements)
+* notes  : with prediction, innovations at x less their weighted mean (clock)
+*          are checked by chi-square first. if consistent, the models of the
+*          last iteration are applied from the start and the first step is
+*          accepted with linearized post-fit residuals if it is shorter than
+*          MAXDXP, where the linearization error |dx|^2/2/range is below the
+*          convergence threshold
+*-----------------------------------------------------------------------------*/
+static int lsqpos(const obsd_t *obs, int n, const double *rs, const double *dts,
                   const double *vare, const int *svh, const nav_t *nav,
-                  const prcopt_t *opt, sol_t *sol, double *azel, int *vsat,
-                  double *resp, char *msg)
+                  const prcopt_t *opt, double *x, double varp, double *v,
+                  double *H, double *var, double *Q, int *nv, int *ns,
+                  double *azel, int *vsat, double *resp, int *nitr, char *msg)
 {
-    double x[NX]={0},dx[NX],Q[NX*NX],*v,*H,*var,sig;
-    int i,j,k,info,stat,nv,ns;
-
-    trace(3,"estpos  : n=%d\n",n);
-
-    v=mat(n+4,1); H=mat(NX,n+4); var=mat(n+4,1);
-
-    for (i=0;i<3;i++) x[i]=sol->rr[i];
+    double dx[NX],sig,sw,swv,vv;
+    int i,j,k,info,ip=varp>0.0?1:0;
 
     for (i=0;i<MAXITR;i++) {
 
         /* pseudorange residuals */
-        nv=rescode(i,obs,n,rs,dts,vare,svh,nav,x,opt,v,H,var,azel,vsat,resp,
-                   &ns);
+        *nv=rescode(i+ip,obs,n,rs,dts,vare,svh,nav,x,opt,v,H,var,azel,vsat,
+                    resp,ns);
+        if (nitr) (*nitr)++;
 
-        if (nv<NX) {
-            sprintf(msg,"lack of valid sats ns=%d",nv);
-            break;
+        if (*nv<NX) {
+            sprintf(msg,"lack of valid sats ns=%d",*nv);
+            return 0;
+        }
+        /* innovation consistency of predicted position */
+        if (i==0&&ip) {
+            for (j=0,sw=swv=0.0;j<*ns;j++) {
+                sw +=1.0/(var[j]+varp);
+                swv+=v[j]/(var[j]+varp);
+            }
+            for (j=0,vv=0.0;j<*ns;j++) vv+=SQR(v[j]-swv/sw)/(var[j]+varp);
+            if (vv>chisqr[*ns-2]) {
+                trace(3,"lsqpos  : prediction inconsistent vv=%.1f cs=%.1f\n",
+                      vv,chisqr[*ns-2]);
+                return -1;
+            }
         }
         /* weight by variance */
-        for (j=0;j<nv;j++) {
+        for (j=0;j<*nv;j++) {
             sig=sqrt(var[j]);
             v[j]/=sig;
             for (k=0;k<NX;k++) H[k+j*NX]/=sig;
         }
         /* least square estimation */
-        if ((info=lsq(H,v,NX,nv,dx,Q))) {
+        if ((info=lsq(H,v,NX,*nv,dx,Q))) {
             sprintf(msg,"lsq error info=%d",info);
-            break;
+            return 0;
         }
-        
         for (j=0;j<NX;j++) x[j]+=dx[j];
 
-        if (norm(dx,NX)<1E-4) {
-
-            sol->type=0;
-            sol->time=timeadd(obs[0].time,-x[3]/CLIGHT);
-            sol->dtr[0]=x[3]/CLIGHT; /* receiver clock bias (s) */
-            sol->dtr[1]=x[4]/CLIGHT; /* glo-gps time offset (s) */
-            sol->dtr[2]=x[5]/CLIGHT; /* gal-gps time offset (s) */
-            sol->dtr[3]=x[6]/CLIGHT; /* bds-gps time offset (s) */
-            for (j=0;j<6;j++) sol->rr[j]=j<3?x[j]:0.0;
-            for (j=0;j<3;j++) sol->qr[j]=(float)Q[j+j*NX];
-            sol->qdtr=(float)Q[3+3*NX]; /* receiver clock variance s^2*/
-            sol->qr[3]=(float)Q[1];    /* cov xy */
-            sol->qr[4]=(float)Q[2+NX]; /* cov yz */
-            sol->qr[5]=(float)Q[2];    /* cov zx */
-            sol->ns=(unsigned char)ns;
-            sol->age=sol->ratio=0.0;
-
-            /* validate solution */
-            if ((stat=valsol(azel,vsat,n,opt,v,nv,NX,msg,sol))) {
-                sol->stat=opt->sateph==EPHOPT_SBAS?SOLQ_SBAS:SOLQ_SINGLE;
-            }
-            free(v); free(H); free(var);
+        if (norm(dx,NX)<1E-4) return 1;
 
-            return stat;
+        /* one step from prediction: post-fit residuals by linearization */
+        if (i==0&&ip&&norm(dx,3)<MAXDXP) {
+            for (j=0;j<*nv;j++) v[j]-=dot(H+j*NX,dx,NX);
+            for (j=k=0;j<n&&j<MAXOBS;j++) {
+                if (vsat[j]) resp[j]=v[k]*sqrt(var[k]),k++;
+            }
+            return 1;
         }
     }
-    if (i>=MAXITR) sprintf(msg,"iteration divergent i=%d",i);
+    sprintf(msg,"iteration divergent i=%d",i);
+    return 0;
+}
+/* estimate receiver position ------------------------------------------------*/
+static int estpos(const obsd_t *obs, int n, const double *rs, const double *dts,
+                  const double *vare, const int *svh, const nav_t *nav,
+                  const prcopt_t *opt, const double *xp, double varp,
+                  sol_t *sol, double *azel, int *vsat, double *resp, int *nitr,
+                  char *msg)
+{
+    double x[NX]={0},Q[NX*NX],*v,*H,*var;
+    int j,stat=0,nv,ns,info=-1;
 
+    trace(3,"estpos  : n=%d\n",n);
+
+    v=mat(n+4,1); H=mat(NX,n+4); var=mat(n+4,1);
+
+    /* seeded by prediction of position/clock and previous time offsets */
+    if (xp&&varp>0.0) {
+        for (j=0;j<NX;j++) x[j]=j<4?xp[j]:sol->dtr[j-3]*CLIGHT;
+        info=lsqpos(obs,n,rs,dts,vare,svh,nav,opt,x,varp,v,H,var,Q,&nv,&ns,
+                    azel,vsat,resp,nitr,msg);
+    }
+    /* previous position with predicted clock if prediction failed/inconsistent */
+    if (info<=0) {
+        for (j=0;j<NX;j++) x[j]=j<3?sol->rr[j]:(xp&&varp>0.0?x[j]:0.0);
+        info=lsqpos(obs,n,rs,dts,vare,svh,nav,opt,x,0.0,v,H,var,Q,&nv,&ns,
+                    azel,vsat,resp,nitr,msg);
+    }
+    if (info) {
+        sol->type=0;
+        sol->time=timeadd(obs[0].time,-x[3]/CLIGHT);
+        sol->dtr[0]=x[3]/CLIGHT; /* receiver clock bias (s) */
+        sol->dtr[1]=x[4]/CLIGHT; /* glo-gps time offset (s) */
+        sol->dtr[2]=x[5]/CLIGHT; /* gal-gps time offset (s) */
+        sol->dtr[3]=x[6]/CLIGHT; /* bds-gps time offset (s) */
+        for (j=0;j<6;j++) sol->rr[j]=j<3?x[j]:0.0;
+        for (j=0;j<3;j++) sol->qr[j]=(float)Q[j+j*NX];
+        sol->qdtr=(float)Q[3+3*NX]; /* receiver clock variance s^2*/
+        sol->qr[3]=(float)Q[1];    /* cov xy */
+        sol->qr[4]=(float)Q[2+NX]; /* cov yz */
+        sol->qr[5]=(float)Q[2];    /* cov zx */
+        sol->ns=(unsigned char)ns;
+        sol->age=sol->ratio=0.0;
+
+        /* validate solution */
+        if ((stat=valsol(azel,vsat,n,opt,v,nv,NX,msg,sol))) {
+            sol->stat=opt->sateph==EPHOPT_SBAS?SOLQ_SBAS:SOLQ_SINGLE;
+        }
+    }
     free(v); free(H); free(var);
 
-    return 0;
+    return stat;
+}
+/* leave-out correction by downdate of normal equation -------------------------
+* args   : double *H        I   weighted design matrix (NX x nv)
+*          double *v        I   weighted residuals at linearization (nv x 1)
+*          double *Q        I   inverse of normal matrix (H*H')^-1 (NX x NX)
+*          double *dx       I   correction with all rows Q*H*v (NX x 1)
+*          int    *row      I   rows left out
+*          int    m         I   number of rows left out (m<=MAXRAIMEX)
+*          double *dxs      O   correction without rows (NX x 1)
+*          double *vv       IO  weighted ssr (I:with all rows,O:without rows)
+* return : status (1:ok,0:singular)
+* notes  : with post-fit residuals r=v(row)-H(row)'*dx and S=I-H(row)'*Q*H(row)
+*          by woodbury identity,
+*            dxs=dx-Q*H(row)*S^-1*r, vv=vv-r'*S^-1*r
+*          no re-linearization and no NX x NX inverse per leave-out set
+*-----------------------------------------------------------------------------*/
+static int downdate(const double *H, const double *v, const double *Q,
+                    const double *dx, const int *row, int m, double *dxs,
+                    double *vv)
+{
+    double QH[NX*MAXRAIMEX],S[MAXRAIMEX*MAXRAIMEX],r[MAXRAIMEX],w[MAXRAIMEX];
+    int i,j;
+
+    for (i=0;i<m;i++) {
+        matmul("NN",NX,1,NX,1.0,Q,H+row[i]*NX,0.0,QH+i*NX);
+        r[i]=v[row[i]]-dot(H+row[i]*NX,dx,NX);
+    }
+    for (i=0;i<m;i++) for (j=0;j<m;j++) {
+        S[i+j*m]=(i==j?1.0:0.0)-dot(H+row[i]*NX,QH+j*NX,NX);
+    }
+    for (i=0;i<m;i++) if (S[i+i*m]<1E-9) return 0; /* unobservable */
+    if (matinv(S,m)) return 0;
+
+    matmul("NN",m,1,m,1.0,S,r,0.0,w);
+    matcpy(dxs,dx,NX,1);
+    matmul("NN",NX,1,m,-1.0,QH,w,1.0,dxs);
+    *vv-=dot(r,w,m);
+    return 1;
+}
+/* raim exclusion candidate --------------------------------------------------*/
+typedef struct {
+    int ex[MAXRAIMEX];  /* excluded observation indices */
+    int m;              /* number of excluded satellites */
+    int ok;             /* predicted validation (1:ok,0:ng) */
+    double rms;         /* predicted residual rms (m) */
+    double rr[3];       /* predicted receiver position (ecef) (m) */
+} raimc_t;
+
+static int cmpraimc(const void *p1, const void *p2)
+{
+    const raimc_t *c1=(const raimc_t *)p1,*c2=(const raimc_t *)p2;
+    if (c1->ok!=c2->ok) return c2->ok-c1->ok;
+    return c1->rms<c2->rms?-1:(c1->rms>c2->rms?1:0);
+}
+/* predict exclusion candidate -------------------------------------------------
+* predict residual rms, chi-square and gdop validation of the leave-out
+* solution without rows row[0..m-1] (satellite rows 0..ns-1 of obs index io)
+*-----------------------------------------------------------------------------*/
+static void predraimc(const double *H, const double *v, const double *var,
+                      const double *Q, const double *dx, const double *x,
+                      int nv, int ns, const int *io, const double *azel,
+                      const prcopt_t *opt, const int *row, int m, double vv,
+                      raimc_t *c)
+{
+    double dxs[NX],azels[MAXOBS*2],dop[4],res,rms=0.0;
+    int i,j,k,nvs=nv-m;
+
+    c->m=m;
+    c->ok=0;
+    c->rms=1E9;
+    for (i=0;i<m;i++) c->ex[i]=io[row[i]];
+    for (i=0;i<3;i++) c->rr[i]=x[i];
+
+    if (!downdate(H,v,Q,dx,row,m,dxs,&vv)) {
+
+        /* single satellite of a system fits exactly and is replaced by the
+           clock constraint, other residuals are unchanged */
+        if (m>1) return;
+        matcpy(dxs,dx,NX,1);
+        nvs=nv;
+    }
+    for (i=k=0;i<ns;i++) {
+        for (j=0;j<m;j++) if (row[j]==i) break;
+        if (j<m) continue;
+        res=(v[i]-dot(H+i*NX,dxs,NX))*sqrt(var[i]);
+        rms+=res*res;
+        azels[k*2]=azel[io[i]*2]; azels[1+k*2]=azel[1+io[i]*2];
+        k++;
+    }
+    for (i=0;i<3;i++) c->rr[i]=x[i]-dx[i]+dxs[i];
+    if (k<=0) return;
+    c->rms=sqrt(rms/k);
+
+    if (k<5) return;
+    if (nvs>NX&&vv>chisqr[nvs-NX-1]) return;
+    dops(k,azels,opt->elmin,dop);
+    if (dop[0]<=0.0||dop[0]>opt->maxgdop) return;
+    c->ok=1;
+}
+/* raim exclusion candidates -------------------------------------------------*/
+static int raimcands(const obsd_t *obs, int n, const double *rs,
+                     const double *dts, const double *vare, const int *svh,
+                     const nav_t *nav, const prcopt_t *opt, const sol_t *sol,
+                     int m, raimc_t *c, int *nitr)
+{
+    double x[NX]={0},Q[NX*NX],dx[NX],Hv[NX],*v,*H,*var,*azel,*resp,vv=0.0;
+    int i,j,k,nv,ns,nc=0,io[MAXOBS],row[MAXRAIMEX],*vsat;
+    char msg[128];
+
+    v=mat(n+4,1); H=mat(NX,n+4); var=mat(n+4,1); azel=zeros(2,n);
+    resp=mat(1,n); vsat=imat(1,n);
+
+    for (i=0;i<3;i++) x[i]=sol->rr[i];
+
+    /* normal equation with all satellites at the linearization point */
+    if (lsqpos(obs,n,rs,dts,vare,svh,nav,opt,x,0.0,v,H,var,Q,&nv,&ns,azel,
+               vsat,resp,nitr,msg)) {
+
+        matmul("NN",NX,1,nv,1.0,H,v,0.0,Hv);
+        matmul("NN",NX,1,NX,1.0,Q,Hv,0.0,dx);
+        for (i=0;i<nv;i++) vv+=SQR(v[i]-dot(H+i*NX,dx,NX));
+
+        /* satellite rows to observation indices */
+        for (i=j=0;i<n&&j<ns;i++) if (vsat[i]) io[j++]=i;
+
+        if (m==1) {
+            for (i=0;i<ns;i++) {
+                row[0]=i;
+                predraimc(H,v,var,Q,dx,x,nv,ns,io,azel,opt,row,1,vv,c+nc++);
+            }
+        }
+        else if (m==2) {
+            for (i=0;i<ns;i++) for (j=i+1;j<ns;j++) {
+                row[0]=i; row[1]=j;
+                predraimc(H,v,var,Q,dx,x,nv,ns,io,azel,opt,row,2,vv,c+nc++);
+            }
+        }
+        for (i=k=0;i<nc;i++) if (c[i].ok) k++;
+        qsort(c,nc,sizeof(raimc_t),cmpraimc);
+
+        trace(3,"raimcands: m=%d ns=%d nc=%d predicted ok=%d\n",m,ns,nc,k);
+    }
+    free(v); free(H); free(var); free(azel); free(resp); free(vsat);
+    return nc;
 }
-/* raim fde (failure detection and exclution) -------------------------------*/
+/* raim fde (failure detection and exclution) ------------------------------------
+* the normal equation of all satellites is solved once and the residual rms,
+* chi-square and gdop of every exclusion are predicted by downdates of it.
+* the candidates are re-solved by estpos() in the order of the predicted rms
+* until the best one is validated. if the solution with all satellites does
+* not converge, every satellite is excluded and re-solved in turn. pairs of
+* satellites are excluded if no single exclusion is valid
+*-----------------------------------------------------------------------------*/
 static int raim_fde(const obsd_t *obs, int n, const double *rs,
                     const double *dts, const double *vare, const int *svh,
                     const nav_t *nav, const prcopt_t *opt, sol_t *sol,
-                    double *azel, int *vsat, double *resp, char *msg)
+                    double *azel, int *vsat, double *resp, int *nitr,
+                    char *msg)
 {
     obsd_t *obs_e;
     sol_t sol_e={{0}};
+    raimc_t *c;
     char tstr[32],name[16],msg_e[128];
     double *rs_e,*dts_e,*vare_e,*azel_e,*resp_e,rms_e,rms=100.0;
-    int i,j,k,nvsat,stat=0,*svh_e,*vsat_e,sat=0;
+    int i,j,k,l,m,nc,nvsat,stat=0,*svh_e,*vsat_e,sat[MAXRAIMEX]={0},nsol=0;
 
     trace(3,"raim_fde: %s n=%2d\n",time_str(obs[0].time,0),n);
 
     if (!(obs_e=(obsd_t *)malloc(sizeof(obsd_t)*n))) return 0;
+    if (!(c=(raimc_t *)malloc(sizeof(raimc_t)*(n*(n-1)/2+n)))) {
+        free(obs_e);
+        return 0;
+    }
     rs_e = mat(6,n); dts_e = mat(2,n); vare_e=mat(1,n); azel_e=zeros(2,n);
     svh_e=imat(1,n); vsat_e=imat(1,n); resp_e=mat(1,n);
 
-    for (i=0;i<n;i++) {
+    for (m=1;m<=MAXRAIMEX&&!stat&&n-m>=5;m++) {
 
-        /* satellite exclution */
-        for (j=k=0;j<n;j++) {
-            if (j==i) continue;
-            obs_e[k]=obs[j];
-            matcpy(rs_e +6*k,rs +6*j,6,1);
-            matcpy(dts_e+2*k,dts+2*j,2,1);
-            vare_e[k]=vare[j];
-            svh_e[k++]=svh[j];
-        }
-        /* estimate receiver position without a satellite */
-        if (!estpos(obs_e,n-1,rs_e,dts_e,vare_e,svh_e,nav,opt,&sol_e,azel_e,
-                    vsat_e,resp_e,msg_e)) {
-            trace(3,"raim_fde: exsat=%2d (%s)\n",obs[i].sat,msg);
-            continue;
-        }
-        for (j=nvsat=0,rms_e=0.0;j<n-1;j++) {
-            if (!vsat_e[j]) continue;
-            rms_e+=SQR(resp_e[j]);
-            nvsat++;
-        }
-        if (nvsat<5) {
-            trace(3,"raim_fde: exsat=%2d lack of satellites nvsat=%2d\n",
-                  obs[i].sat,nvsat);
-            continue;
+        if (!(nc=raimcands(obs,n,rs,dts,vare,svh,nav,opt,sol,m,c,nitr))) {
+            if (m>1) break;
+
+            /* no linearization point: exclude every satellite in turn */
+            for (i=0;i<n;i++) {
+                c[i].ex[0]=i; c[i].m=1; c[i].ok=0; c[i].rms=0.0;
+                c[i].rr[0]=c[i].rr[1]=c[i].rr[2]=0.0;
+            }
+            nc=n;
         }
-        rms_e=sqrt(rms_e/nvsat);
+        for (l=0;l<nc;l++) {
+
+            /* stop at candidates predicted worse than the validated one */
+            if (stat&&c[l].ok&&c[l].rms>rms) break;
+            if (!c[l].ok&&(m>1||(stat&&c[0].ok))) break;
+
+            /* satellite exclution */
+            for (j=k=0;j<n;j++) {
+                for (i=0;i<c[l].m;i++) if (c[l].ex[i]==j) break;
+                if (i<c[l].m) continue;
+                obs_e[k]=obs[j];
+                matcpy(rs_e +6*k,rs +6*j,6,1);
+                matcpy(dts_e+2*k,dts+2*j,2,1);
+                vare_e[k]=vare[j];
+                svh_e[k++]=svh[j];
+            }
+            /* estimate receiver position from predicted position */
+            for (i=0;i<3;i++) sol_e.rr[i]=c[l].rr[i];
+            nsol++;
+            if (!estpos(obs_e,k,rs_e,dts_e,vare_e,svh_e,nav,opt,NULL,0.0,
+                        &sol_e,azel_e,vsat_e,resp_e,nitr,msg_e)) {
+                trace(3,"raim_fde: exsat=%2d (%s)\n",obs[c[l].ex[0]].sat,
+                      msg_e);
+                continue;
+            }
+            for (j=nvsat=0,rms_e=0.0;j<k;j++) {
+                if (!vsat_e[j]) continue;
+                rms_e+=SQR(resp_e[j]);
+                nvsat++;
+            }
+            if (nvsat<5) {
+                trace(3,"raim_fde: exsat=%2d lack of satellites nvsat=%2d\n",
+                      obs[c[l].ex[0]].sat,nvsat);
+                continue;
+            }
+            rms_e=sqrt(rms_e/nvsat);
 
-        trace(3,"raim_fde: exsat=%2d rms=%8.3f\n",obs[i].sat,rms_e);
+            trace(3,"raim_fde: exsat=%2d m=%d rms=%8.3f pred=%8.3f\n",
+                  obs[c[l].ex[0]].sat,c[l].m,rms_e,c[l].rms);
 
-        if (rms_e>rms) continue;
+            if (rms_e>rms) continue;
 
-        /* save result */
-        for (j=k=0;j<n;j++) {
-            if (j==i) continue;
-            matcpy(azel+2*j,azel_e+2*k,2,1);
-            vsat[j]=vsat_e[k];
-            resp[j]=resp_e[k++];
+            /* save result */
+            for (j=k=0;j<n;j++) {
+                for (i=0;i<c[l].m;i++) if (c[l].ex[i]==j) break;
+                if (i<c[l].m) continue;
+                matcpy(azel+2*j,azel_e+2*k,2,1);
+                vsat[j]=vsat_e[k];
+                resp[j]=resp_e[k++];
+            }
+            stat=1;
+            *sol=sol_e;
+            for (i=0;i<MAXRAIMEX;i++) {
+                sat[i]=i<c[l].m?obs[c[l].ex[i]].sat:0;
+                if (i<c[l].m) vsat[c[l].ex[i]]=0;
+            }
+            rms=rms_e;
+            strcpy(msg,msg_e);
         }
-        stat=1;
-        *sol=sol_e;
-        sat=obs[i].sat;
-        rms=rms_e;
-        vsat[i]=0;
-        strcpy(msg,msg_e);
     }
     if (stat) {
-        time2str(obs[0].time,tstr,2); satno2id(sat,name);
-        trace(2,"%s: %s excluded by raim\n",tstr+11,name);
+        time2str(obs[0].time,tstr,2);
+        for (i=0;i<MAXRAIMEX&&sat[i];i++) {
+            satno2id(sat[i],name);
+            trace(2,"%s: %s excluded by raim\n",tstr+11,name);
+        }
     }
-    free(obs_e);
+    trace(3,"raim_fde: re-solved=%d\n",nsol);
+
+    free(obs_e); free(c);
     free(rs_e ); free(dts_e ); free(vare_e); free(azel_e);
     free(svh_e); free(vsat_e); free(resp_e);
     return stat;
@@ -565,6 +813,33 @@ static void estvel(const obsd_t *obs, int n, const double *rs, const double *dts
 extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
                   const prcopt_t *opt, sol_t *sol, double *azel, ssat_t *ssat,
                   char *msg)
+{
+    return pntposp(obs,n,nav,opt,NULL,0.0,sol,azel,ssat,NULL,msg);
+}
+/* single-point positioning seeded by prediction -------------------------------
+* compute receiver position, velocity, clock bias by single-point positioning
+* starting from predicted receiver position and clock (e.g. by ins)
+* args   : obsd_t *obs      I   observation data
+*          int    n         I   number of observation data
+*          nav_t  *nav      I   navigation data
+*          prcopt_t *opt    I   processing options
+*          double *xp       I   predicted position (ecef) and clock bias (m)
+*                               {x,y,z,dtr} (NULL: no prediction)
+*          double varp      I   variance of predicted position (m^2)
+*          sol_t  *sol      IO  solution
+*          double *azel     IO  azimuth/elevation angle (rad) (NULL: no output)
+*          ssat_t *ssat     IO  satellite status              (NULL: no output)
+*          int    *nitr     IO  number of iterations added    (NULL: no count)
+*          char   *msg      O   error message for error exit
+* return : status(1:ok,0:error)
+* notes  : the predicted position is used only if the innovations are consistent
+*          with varp, otherwise iterated from sol->rr as pntpos(). time offsets to
+*          gps time of other systems are seeded by sol->dtr
+*-----------------------------------------------------------------------------*/
+extern int pntposp(const obsd_t *obs, int n, const nav_t *nav,
+                   const prcopt_t *opt, const double *xp, double varp,
+                   sol_t *sol, double *azel, ssat_t *ssat, int *nitr,
+                   char *msg)
 {
     prcopt_t opt_=*opt;
     double *rs,*dts,*var,*azel_,*resp;
@@ -591,11 +866,13 @@ extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
     satposs(sol->time,obs,n,nav,opt_.sateph,rs,dts,var,svh);
 
     /* estimate receiver position with pseudorange */
-    stat=estpos(obs,n,rs,dts,var,svh,nav,&opt_,sol,azel_,vsat,resp,msg);
+    stat=estpos(obs,n,rs,dts,var,svh,nav,&opt_,xp,varp,sol,azel_,vsat,resp,
+                nitr,msg);
 
     /* raim fde */
     if (!stat&&n>=6&&opt->posopt[4]) {
-        stat=raim_fde(obs,n,rs,dts,var,svh,nav,&opt_,sol,azel_,vsat,resp,msg);
+        stat=raim_fde(obs,n,rs,dts,var,svh,nav,&opt_,sol,azel_,vsat,resp,nitr,
+                      msg);
     }
 
     /* estimate receiver velocity with doppler */
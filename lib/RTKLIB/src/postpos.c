@@ -27,6 +27,7 @@
 *           2014/06/29  1.14 fix problem on overflow of # of satellites
 *           2015/03/23  1.15 fix bug on ant type replacement by rinex header
 *                            fix bug on combined filter for moving-base mode
+*           2019/10/14  1.16 per-pass states of forward/backward processing
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
@@ -38,6 +39,15 @@ static const char rcsid[]="$Id: postpos.c,v 1.1 2008/07/17 21:48:06 ttaka Exp $"
 #define MAXPRCDAYS  100          /* max days of continuous processing */
 #define MAXINFILE   1000         /* max number of input files */
 
+typedef struct {        /* processing pass type */
+    int revs;           /* analysis direction (0:forward,1:backward) */
+    int iobsu,iobsr;    /* current rover/reference observation data index */
+    int isbs,ilex;      /* current sbas/lex message index */
+    sol_t *sol;         /* solutions (combined) */
+    double *rb;         /* base positions (combined) */
+    int nsol;           /* number of solutions (combined) */
+} pass_t;
+
 /* constants/global variables ------------------------------------------------*/
 
 static pcvs_t pcvss={0};        /* receiver antenna parameters */
@@ -48,18 +58,7 @@ static sbs_t sbss={0};          /* sbas messages */
 static lex_t lexs={0};          /* lex messages */
 static sta_t stas[MAXRCV];      /* station infomation */
 static int nepoch=0;            /* number of observation epochs */
-static int iobsu =0;            /* current rover observation data index */
-static int iobsr =0;            /* current reference observation data index */
-static int isbs  =0;            /* current sbas message index */
-static int ilex  =0;            /* current lex message index */
-static int revs  =0;            /* analysis direction (0:forward,1:backward) */
 static int aborts=0;            /* abort status */
-static sol_t *solf;             /* forward solutions */
-static sol_t *solb;             /* backward solutions */
-static double *rbf;             /* forward base positions */
-static double *rbb;             /* backward base positions */
-static int isolf=0;             /* current forward solutions index */
-static int isolb=0;             /* current backward solutions index */
 static char proc_rov [64]="";   /* rover for current processing */
 static char proc_base[64]="";   /* base station for current processing */
 static char rtcm_file[1024]=""; /* rtcm data file */
@@ -185,52 +184,53 @@ static int nextobsb(const obs_t *obs, int *i, int rcv)
     return n;
 }
 /* input obs data, navigation messages and sbas correction -------------------*/
-static int inputobs(obsd_t *obs, int solq, const prcopt_t *popt)
+static int inputobs(pass_t *ps, obsd_t *obs, int solq, const prcopt_t *popt)
 {
     gtime_t time={0};
     char path[1024];
     int i,nu,nr,n=0;
 
-    trace(3,"infunc  : revs=%d iobsu=%d iobsr=%d isbs=%d\n",revs,iobsu,iobsr,isbs);
+    trace(3,"infunc  : revs=%d iobsu=%d iobsr=%d isbs=%d\n",ps->revs,ps->iobsu,
+          ps->iobsr,ps->isbs);
 
-    if (0<=iobsu&&iobsu<obss.n) {
-        settime((time=obss.data[iobsu].time));
+    if (0<=ps->iobsu&&ps->iobsu<obss.n) {
+        settime((time=obss.data[ps->iobsu].time));
         if (checkbrk("processing: %s Q=%d",time_str(time,0),solq)) {
             aborts=1; showmsg("aborted"); return -1;
         }
     }
-    if (!revs) { /* input forward data */
-        if ((nu=nextobsf(&obss,&iobsu,1))<=0) return -1;
+    if (!ps->revs) { /* input forward data */
+        if ((nu=nextobsf(&obss,&ps->iobsu,1))<=0) return -1;
 
         if (popt->intpref) {
-            for (;(nr=nextobsf(&obss,&iobsr,2))>0;iobsr+=nr)
-                if (timediff(obss.data[iobsr].time,obss.data[iobsu].time)>-DTTOL) break;
+            for (;(nr=nextobsf(&obss,&ps->iobsr,2))>0;ps->iobsr+=nr)
+                if (timediff(obss.data[ps->iobsr].time,obss.data[ps->iobsu].time)>-DTTOL) break;
         }
         else {
-            for (i=iobsr;(nr=nextobsf(&obss,&i,2))>0;iobsr=i,i+=nr)
-                if (timediff(obss.data[i].time,obss.data[iobsu].time)>DTTOL) break;
+            for (i=ps->iobsr;(nr=nextobsf(&obss,&i,2))>0;ps->iobsr=i,i+=nr)
+                if (timediff(obss.data[i].time,obss.data[ps->iobsu].time)>DTTOL) break;
         }
-        nr=nextobsf(&obss,&iobsr,2);
-        for (i=0;i<nu&&n<MAXOBS*2;i++) obs[n++]=obss.data[iobsu+i];
-        for (i=0;i<nr&&n<MAXOBS*2;i++) obs[n++]=obss.data[iobsr+i];
-        iobsu+=nu;
+        nr=nextobsf(&obss,&ps->iobsr,2);
+        for (i=0;i<nu&&n<MAXOBS*2;i++) obs[n++]=obss.data[ps->iobsu+i];
+        for (i=0;i<nr&&n<MAXOBS*2;i++) obs[n++]=obss.data[ps->iobsr+i];
+        ps->iobsu+=nu;
 
         /* update sbas corrections */
-        while (isbs<sbss.n) {
-            time=gpst2time(sbss.msgs[isbs].week,sbss.msgs[isbs].tow);
+        while (ps->isbs<sbss.n) {
+            time=gpst2time(sbss.msgs[ps->isbs].week,sbss.msgs[ps->isbs].tow);
 
-            if (getbitu(sbss.msgs[isbs].msg,8,6)!=9) { /* except for geo nav */
-                sbsupdatecorr(sbss.msgs+isbs,&navs);
+            if (getbitu(sbss.msgs[ps->isbs].msg,8,6)!=9) { /* except for geo nav */
+                sbsupdatecorr(sbss.msgs+ps->isbs,&navs);
             }
             if (timediff(time,obs[0].time)>-1.0-DTTOL) break;
-            isbs++;
+            ps->isbs++;
         }
         /* update lex corrections */
-        while (ilex<lexs.n) {
-            if (lexupdatecorr(lexs.msgs+ilex,&navs,&time)) {
+        while (ps->ilex<lexs.n) {
+            if (lexupdatecorr(lexs.msgs+ps->ilex,&navs,&time)) {
                 if (timediff(time,obs[0].time)>-1.0-DTTOL) break;
             }
-            ilex++;
+            ps->ilex++;
         }
         /* update rtcm corrections */
         if (*rtcm_file) {
@@ -258,43 +258,54 @@ static int inputobs(obsd_t *obs, int solq, const prcopt_t *popt)
         }
     }
     else { /* input backward data */
-        if ((nu=nextobsb(&obss,&iobsu,1))<=0) return -1;
+        if ((nu=nextobsb(&obss,&ps->iobsu,1))<=0) return -1;
         if (popt->intpref) {
-            for (;(nr=nextobsb(&obss,&iobsr,2))>0;iobsr-=nr)
-                if (timediff(obss.data[iobsr].time,obss.data[iobsu].time)<DTTOL) break;
+            for (;(nr=nextobsb(&obss,&ps->iobsr,2))>0;ps->iobsr-=nr)
+                if (timediff(obss.data[ps->iobsr].time,obss.data[ps->iobsu].time)<DTTOL) break;
         }
         else {
-            for (i=iobsr;(nr=nextobsb(&obss,&i,2))>0;iobsr=i,i-=nr)
-                if (timediff(obss.data[i].time,obss.data[iobsu].time)<-DTTOL) break;
+            for (i=ps->iobsr;(nr=nextobsb(&obss,&i,2))>0;ps->iobsr=i,i-=nr)
+                if (timediff(obss.data[i].time,obss.data[ps->iobsu].time)<-DTTOL) break;
         }
-        nr=nextobsb(&obss,&iobsr,2);
-        for (i=0;i<nu&&n<MAXOBS*2;i++) obs[n++]=obss.data[iobsu-nu+1+i];
-        for (i=0;i<nr&&n<MAXOBS*2;i++) obs[n++]=obss.data[iobsr-nr+1+i];
-        iobsu-=nu;
+        nr=nextobsb(&obss,&ps->iobsr,2);
+        for (i=0;i<nu&&n<MAXOBS*2;i++) obs[n++]=obss.data[ps->iobsu-nu+1+i];
+        for (i=0;i<nr&&n<MAXOBS*2;i++) obs[n++]=obss.data[ps->iobsr-nr+1+i];
+        ps->iobsu-=nu;
 
         /* update sbas corrections */
-        while (isbs>=0) {
-            time=gpst2time(sbss.msgs[isbs].week,sbss.msgs[isbs].tow);
+        while (ps->isbs>=0) {
+            time=gpst2time(sbss.msgs[ps->isbs].week,sbss.msgs[ps->isbs].tow);
 
-            if (getbitu(sbss.msgs[isbs].msg,8,6)!=9) { /* except for geo nav */
-                sbsupdatecorr(sbss.msgs+isbs,&navs);
+            if (getbitu(sbss.msgs[ps->isbs].msg,8,6)!=9) { /* except for geo nav */
+                sbsupdatecorr(sbss.msgs+ps->isbs,&navs);
             }
             if (timediff(time,obs[0].time)<1.0+DTTOL) break;
-            isbs--;
+            ps->isbs--;
         }
         /* update lex corrections */
-        while (ilex>=0) {
-            if (lexupdatecorr(lexs.msgs+ilex,&navs,&time)) {
+        while (ps->ilex>=0) {
+            if (lexupdatecorr(lexs.msgs+ps->ilex,&navs,&time)) {
                 if (timediff(time,obs[0].time)<1.0+DTTOL) break;
             }
-            ilex--;
+            ps->ilex--;
         }
     }
     return n;
 }
+/* initialize processing pass -----------------------------------------------*/
+static void initpass(pass_t *ps, int revs)
+{
+    ps->revs=revs;
+    ps->iobsu=ps->iobsr=revs?obss.n-1:0;
+    ps->isbs=revs?sbss.n-1:0;
+    ps->ilex=revs?lexs.n-1:0;
+    ps->sol=NULL;
+    ps->rb=NULL;
+    ps->nsol=0;
+}
 /* process positioning -------------------------------------------------------*/
 static void procpos(FILE *fp, const prcopt_t *popt, const solopt_t *sopt,
-                    int mode)
+                    pass_t *ps, int mode)
 {
     gtime_t time={0};
     sol_t sol={{0}};
@@ -303,15 +314,16 @@ static void procpos(FILE *fp, const prcopt_t *popt, const solopt_t *sopt,
     double rb[3]={0};
     int i,nobs,n,solstatic,pri[]={0,1,2,3,4,5,1,6};
 
-    trace(3,"procpos : mode=%d\n",mode);
+    trace(3,"procpos : mode=%d revs=%d\n",mode,ps->revs);
 
     solstatic=sopt->solstatic&&
               (popt->mode==PMODE_STATIC||popt->mode==PMODE_PPP_STATIC);
 
     rtkinit(&rtk,popt);
+    rtk.revs=ps->revs;
     rtcm_path[0]='\0';
 
-    while ((nobs=inputobs(obs,rtk.sol.stat,popt))>=0) {
+    while ((nobs=inputobs(ps,obs,rtk.sol.stat,popt))>=0) {
 
         /* exclude satellites */
         for (i=n=0;i<nobs;i++) {
@@ -335,17 +347,11 @@ static void procpos(FILE *fp, const prcopt_t *popt, const solopt_t *sopt,
                 }
             }
         }
-        else if (!revs) { /* combined-forward */
-            if (isolf>=nepoch) return;
-            solf[isolf]=rtk.sol;
-            for (i=0;i<3;i++) rbf[i+isolf*3]=rtk.rb[i];
-            isolf++;
-        }
-        else { /* combined-backward */
-            if (isolb>=nepoch) return;
-            solb[isolb]=rtk.sol;
-            for (i=0;i<3;i++) rbb[i+isolb*3]=rtk.rb[i];
-            isolb++;
+        else { /* combined-forward/backward */
+            if (ps->nsol>=nepoch) return;
+            ps->sol[ps->nsol]=rtk.sol;
+            for (i=0;i<3;i++) ps->rb[i+ps->nsol*3]=rtk.rb[i];
+            ps->nsol++;
         }
     }
     if (mode==0&&solstatic&&time.time!=0.0) {
@@ -379,12 +385,15 @@ static int valcomb(const sol_t *solf, const sol_t *solb)
     return 1;
 }
 /* combine forward/backward solutions and output results ---------------------*/
-static void combres(FILE *fp, const prcopt_t *popt, const solopt_t *sopt)
+static void combres(FILE *fp, const prcopt_t *popt, const solopt_t *sopt,
+                    const pass_t *pf, const pass_t *pb)
 {
+    const sol_t *solf=pf->sol,*solb=pb->sol;
+    const double *rbf=pf->rb,*rbb=pb->rb;
     gtime_t time={0};
     sol_t sols={{0}},sol={{0}};
     double tt,Qf[9],Qb[9],Qs[9],rbs[3]={0},rb[3]={0},rr_f[3],rr_b[3],rr_s[3];
-    int i,j,k,solstatic,pri[]={0,1,2,3,4,5,1,6};
+    int i,j,k,isolf=pf->nsol,isolb=pb->nsol,solstatic,pri[]={0,1,2,3,4,5,1,6};
 
     trace(3,"combres : isolf=%d isolb=%d\n",isolf,isolb);
 
@@ -883,7 +892,9 @@ static int execses(gtime_t ts, gtime_t te, double ti, const prcopt_t *popt,
 {
     FILE *fp;
     prcopt_t popt_=*popt;
+    pass_t ps[2];
     char tracefile[1024],statfile[1024];
+    int i;
 
     trace(3,"execses : n=%d outfile=%s\n",n,outfile);
 
@@ -937,44 +948,43 @@ static int execses(gtime_t ts, gtime_t te, double ti, const prcopt_t *popt,
         freeobsnav(&obss,&navs);
         return 0;
     }
-    iobsu=iobsr=isbs=ilex=revs=aborts=0;
+    aborts=0;
 
     if (popt_.mode==PMODE_SINGLE||popt_.soltype==0) {
         if ((fp=openfile(outfile))) {
-            procpos(fp,&popt_,sopt,0); /* forward */
+            initpass(ps,0);
+            procpos(fp,&popt_,sopt,ps,0); /* forward */
             fclose(fp);
         }
     }
     else if (popt_.soltype==1) {
         if ((fp=openfile(outfile))) {
-            revs=1; iobsu=iobsr=obss.n-1; isbs=sbss.n-1; ilex=lexs.n-1;
-            procpos(fp,&popt_,sopt,0); /* backward */
+            initpass(ps,1);
+            procpos(fp,&popt_,sopt,ps,0); /* backward */
             fclose(fp);
         }
     }
     else { /* combined */
-        solf=(sol_t *)malloc(sizeof(sol_t)*nepoch);
-        solb=(sol_t *)malloc(sizeof(sol_t)*nepoch);
-        rbf=(double *)malloc(sizeof(double)*nepoch*3);
-        rbb=(double *)malloc(sizeof(double)*nepoch*3);
-
-        if (solf&&solb) {
-            isolf=isolb=0;
-            procpos(NULL,&popt_,sopt,1); /* forward */
-            revs=1; iobsu=iobsr=obss.n-1; isbs=sbss.n-1; ilex=lexs.n-1;
-            procpos(NULL,&popt_,sopt,1); /* backward */
+        for (i=0;i<2;i++) {
+            initpass(ps+i,i);
+            ps[i].sol=(sol_t *)malloc(sizeof(sol_t)*nepoch);
+            ps[i].rb=(double *)malloc(sizeof(double)*nepoch*3);
+        }
+        if (ps[0].sol&&ps[1].sol) {
+            procpos(NULL,&popt_,sopt,ps  ,1); /* forward */
+            procpos(NULL,&popt_,sopt,ps+1,1); /* backward */
 
             /* combine forward/backward solutions */
             if (!aborts&&(fp=openfile(outfile))) {
-                combres(fp,&popt_,sopt);
+                combres(fp,&popt_,sopt,ps,ps+1);
                 fclose(fp);
             }
         }
         else showmsg("error : memory allocation");
-        free(solf);
-        free(solb);
-        free(rbf);
-        free(rbb);
+        for (i=0;i<2;i++) {
+            free(ps[i].sol);
+            free(ps[i].rb);
+        }
     }
     /* free obs and nav data */
     freeobsnav(&obss,&navs);
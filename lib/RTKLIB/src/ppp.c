@@ -36,6 +36,7 @@
 *           2014/05/23 1.5  add output of trop gradient in solution status
 *           2014/10/13 1.6  fix bug on P0(a[3]) computation in tide_oload()
 *                           fix bug on m2 computation in tide_pole()
+*           2019/10/20 1.7  add api tidedisp_sunmoon()
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 #include "../../../src/satinsmap.h"
@@ -331,9 +332,31 @@ static void tide_pole(gtime_t tut, const double *pos, const double *erpv,
 *-----------------------------------------------------------------------------*/
 extern void tidedisp(gtime_t tutc, const double *rr, int opt, const erp_t *erp,
                      const double *odisp, double *dr)
+{
+    tidedisp_sunmoon(tutc,rr,opt,erp,odisp,NULL,NULL,0.0,dr);
+}
+/* tidal displacement with sun and moon positions ------------------------------
+* displacements by earth tides with precomputed sun and moon positions
+* args   : gtime_t tutc     I   time in utc
+*          double *rr       I   site position (ecef) (m)
+*          int    opt       I   options (see tidedisp())
+*          double *erp      I   earth rotation parameters (NULL: not used)
+*          double *odisp    I   ocean loading parameters  (NULL: not used)
+*          double *rsun     I   sun position  (ecef) (m) (NULL: computed)
+*          double *rmoon    I   moon position (ecef) (m) (NULL: computed)
+*          double gmst      I   gmst (rad) (used with rsun and rmoon)
+*          double *dr       O   displacement by earth tides (ecef) (m)
+* return : none
+* notes  : rsun, rmoon and gmst shall be computed by sunmoonpos() at tutc with
+*          the earth rotation parameters of erp
+*-----------------------------------------------------------------------------*/
+extern void tidedisp_sunmoon(gtime_t tutc, const double *rr, int opt,
+                             const erp_t *erp, const double *odisp,
+                             const double *rsun, const double *rmoon,
+                             double gmst, double *dr)
 {
     gtime_t tut;
-    double pos[2],E[9],drt[3],denu[3],rs[3],rm[3],gmst,erpv[5]={0};
+    double pos[2],E[9],drt[3],denu[3],rs[3],rm[3],erpv[5]={0};
     int i;
 #ifdef IERS_MODEL
     double ep[6],fhr;
@@ -357,7 +380,10 @@ extern void tidedisp(gtime_t tutc, const double *rr, int opt, const erp_t *erp,
     if (opt&1) { /* solid earth tides */
 
         /* sun and moon position in ecef */
-        sunmoonpos(tutc,erpv,rs,rm,&gmst);
+        if (rsun&&rmoon) {
+            for (i=0;i<3;i++) {rs[i]=rsun[i]; rm[i]=rmoon[i];}
+        }
+        else sunmoonpos(tutc,erpv,rs,rm,&gmst);
 
 #ifdef IERS_MODEL
         time2epoch(tutc,ep);
@@ -13,6 +13,7 @@
 *           2013/10/24  1.1  GPS L1 working
 *           2013/11/02  1.2  modified by TTAKASU
 *           2015/01/26  1.3  fix some problems by Jens Reimann
+*           2019/10/21  1.4  reject block length shorter than the header
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
@@ -1295,7 +1296,7 @@ extern int input_sbf(raw_t *raw, unsigned char data)
 
     if (raw->nbyte<8) return 0;
 
-    if ((raw->len=U2(raw->buff+6))>MAXRAWLEN) {
+    if ((raw->len=U2(raw->buff+6))>MAXRAWLEN||raw->len<8) {
         trace(2,"sbf length error: len=%d\n",raw->len);
         raw->nbyte=0;
         return -1;
@@ -1332,7 +1333,7 @@ extern int input_sbff(raw_t *raw, FILE *fp)
     raw->nbyte=8;
 
     /* decode le length of the block and store it in len*/
-    if ((raw->len=U2(raw->buff+6))>MAXRAWLEN) {
+    if ((raw->len=U2(raw->buff+6))>MAXRAWLEN||raw->len<8) {
         trace(2,"sbf length error: len=%d\n",raw->len);
         raw->nbyte=0;
         return -1;
@@ -28,6 +28,7 @@
 *                           add support input format rt17
 *           2014/08/31 1.9  suppress warning
 *           2014/11/07 1.10 support qzss navigation subframes
+*           2019/10/21 1.11 support input format septentrio sbf
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 #include <stdint.h>
@@ -856,6 +857,7 @@ extern int input_raw(raw_t *raw, int format, unsigned char data)
         case STRFMT_BINEX: return input_bnx  (raw,data);
         case STRFMT_RT17 : return input_rt17 (raw,data);
         case STRFMT_LEXR : return input_lexr (raw,data);
+        case STRFMT_SEPT : return input_sbf  (raw,data);
     }
     return 0;
 }
@@ -883,6 +885,7 @@ extern int input_rawf(raw_t *raw, int format, FILE *fp)
         case STRFMT_BINEX: return input_bnxf  (raw,fp);
         case STRFMT_RT17 : return input_rt17f (raw,fp);
         case STRFMT_LEXR : return input_lexrf (raw,fp);
+        case STRFMT_SEPT : return input_sbff  (raw,fp);
     }
     return -2;
 }
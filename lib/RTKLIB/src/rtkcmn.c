@@ -106,16 +106,27 @@
 *                           add leap second insertion before 2015/07/01 00:00
 *                           add api read_leaps()
 *           2017/01/03 1.31 add leap second before 2017/1/1 00:00:00
+*           2019/10/19 1.32 add binary flight recorder of trace
+*                           add api tracerec(),tracedump()
+*           2019/10/20 1.33 async-signal-safe dump of trace recorder on abort
+*                           chain and restore previous signal handlers
+*                           add api windupcorr_sun()
 *-----------------------------------------------------------------------------*/
 #define _POSIX_C_SOURCE 199309
 #include <stdarg.h>
 #include <ctype.h>
+#include <signal.h>
 #ifndef WIN32
 #include <dirent.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#define write       _write
+#define fileno      _fileno
 #endif
 #include "rtklib.h"
 
@@ -2820,12 +2831,72 @@ extern void freenav(nav_t *nav, int opt)
 /* debug trace functions -----------------------------------------------------*/
 #ifdef TRACE
 
+#define MAXTRCTHREAD 64         /* max number of threads of trace recorder */
+#define MAXTRCARG   32          /* max number of arguments of trace record */
+#define MAXTRCDATA  232         /* max argument data of trace record (bytes) */
+#define MAXTRCLINE  4096        /* max length of decoded trace record */
+#define NTRCFMT     256         /* size of format cache of trace ring */
+
+#define TRC_INT     1           /* trace argument type: int */
+#define TRC_LONG    2           /* trace argument type: long */
+#define TRC_LLONG   3           /* trace argument type: long long */
+#define TRC_SIZE    4           /* trace argument type: size_t */
+#define TRC_DBL     5           /* trace argument type: double */
+#define TRC_LDBL    6           /* trace argument type: long double */
+#define TRC_STR     7           /* trace argument type: string */
+#define TRC_PTR     8           /* trace argument type: pointer */
+
+#ifdef WIN32
+#define atomic_inc(p)   InterlockedIncrement((LONG volatile *)(p))
+#define membarrier()    MemoryBarrier()
+#else
+#define atomic_inc(p)   __sync_add_and_fetch((p),1)
+#define membarrier()    __sync_synchronize()
+#endif
+
+typedef struct {                /* trace record type */
+    volatile unsigned int seq;  /* sequence number (0:invalid) */
+    unsigned int tick;          /* tick time (ms) */
+    unsigned char level;        /* trace level */
+    unsigned char type;         /* record type (0:trace,1:tracet) */
+    unsigned char narg;         /* number of recorded arguments */
+    const char *format;         /* format (format id) */
+    unsigned char data[MAXTRCDATA]; /* raw argument data */
+} trcrec_t;
+
+typedef struct {                /* format cache type */
+    const char *format;         /* format */
+    int narg;                   /* number of arguments */
+    unsigned char type[MAXTRCARG]; /* argument types (TRC_???) */
+} trcfmt_t;
+
+typedef struct {                /* trace ring of thread type */
+    int nmax;                   /* number of records */
+    unsigned int n;             /* number of written records */
+    trcrec_t *rec;              /* records */
+    trcfmt_t fmt[NTRCFMT];      /* format cache */
+} trcring_t;
+
 static FILE *fp_trace=NULL;     /* file pointer of trace */
+static volatile int fd_trace=2; /* file descriptor of trace (for signal) */
 static char file_trace[1024];   /* trace file */
-static int level_trace=0;       /* level of trace */
+int level_trace=0;              /* level of trace */
 static unsigned int tick_trace=0; /* tick time at traceopen (ms) */
 static gtime_t time_trace={0};  /* time at traceopen */
 static lock_t lock_trace;       /* lock for trace */
+static int init_trace=0;        /* lock for trace initialized */
+static int nrec_trace=0;        /* records of trace ring (0:text trace) */
+static volatile unsigned int seq_trace=0; /* sequence number of trace record */
+static volatile int dump_trace=0; /* dump request of trace recorder */
+static trcring_t *rings_trace[MAXTRCTHREAD]; /* trace rings of threads */
+static volatile int nring_trace=0; /* number of trace rings */
+static thlocal trcring_t *ring_trace=NULL; /* trace ring of the thread */
+static char *buff_trace=NULL;   /* dump buffer of trace recorder (for signal) */
+#ifdef WIN32
+static void (*sigold_trace)(int)=SIG_DFL; /* previous SIGABRT handler */
+#else
+static struct sigaction sigold_trace[2]; /* previous SIGUSR1/SIGABRT actions */
+#endif
 
 static void traceswap(void)
 {
@@ -2850,8 +2921,445 @@ static void traceswap(void)
     if (!(fp_trace=fopen(path,"w"))) {
         fp_trace=stderr;
     }
+    fd_trace=fileno(fp_trace);
     unlock(&lock_trace);
 }
+/* parse conversion spec of trace format ---------------------------------------
+* p points '%' of the spec. return the end of the spec and set the types of the
+* arguments (*n=0: no argument, -1: unsupported conversion)
+*-----------------------------------------------------------------------------*/
+static const char *trcspec(const char *p, unsigned char *type, int *n)
+{
+    int len=0;
+
+    *n=0;
+    if (*++p=='%') return p+1;
+
+    while (*p&&strchr("-+ #0'",*p)) p++;
+    if (*p=='*') {type[(*n)++]=TRC_INT; p++;}
+    else while (isdigit((int)(unsigned char)*p)) p++;
+    if (*p=='.') {
+        if (*++p=='*') {type[(*n)++]=TRC_INT; p++;}
+        else while (isdigit((int)(unsigned char)*p)) p++;
+    }
+    for (;*p&&strchr("hlLqjzt",*p);p++) {
+        if      (*p=='l') len=len=='l'?'L':'l';
+        else if (*p=='z'||*p=='t') len='z';
+        else if (*p!='h') len='L';
+    }
+    if (!*p) {*n=-1; return p;}
+
+    if (strchr("diouxXc",*p)) {
+        type[(*n)++]=len=='l'?TRC_LONG:(len=='L'?TRC_LLONG:(len=='z'?TRC_SIZE:TRC_INT));
+    }
+    else if (strchr("fFeEgGaA",*p)) type[(*n)++]=len=='L'?TRC_LDBL:TRC_DBL;
+    else if (*p=='s') type[(*n)++]=TRC_STR;
+    else if (*p=='p') type[(*n)++]=TRC_PTR;
+    else *n=-1;
+    return p+1;
+}
+/* parse trace format to argument types --------------------------------------*/
+static int trcparse(const char *format, unsigned char *type)
+{
+    unsigned char t[3];
+    const char *p=format;
+    int i,n,narg=0;
+
+    while ((p=strchr(p,'%'))) {
+        p=trcspec(p,t,&n);
+        if (n<0||narg+n>MAXTRCARG) break;
+        for (i=0;i<n;i++) type[narg++]=t[i];
+    }
+    return narg;
+}
+/* new trace ring of the thread ----------------------------------------------*/
+static trcring_t *trcring(void)
+{
+    trcring_t *ring=NULL;
+
+    lock(&lock_trace);
+    if (nrec_trace>0&&nring_trace<MAXTRCTHREAD&&
+        (ring=(trcring_t *)calloc(1,sizeof(trcring_t)))) {
+        if (!(ring->rec=(trcrec_t *)calloc(nrec_trace,sizeof(trcrec_t)))) {
+            free(ring);
+            ring=NULL;
+        }
+        else {
+            ring->nmax=nrec_trace;
+            rings_trace[nring_trace]=ring;
+            membarrier();
+            nring_trace++;
+        }
+    }
+    unlock(&lock_trace);
+    return ring;
+}
+/* record trace to trace ring of the thread --------------------------------------
+* the arguments are copied to a fixed-size record by the types of the format
+* without formatting. strings are copied and truncated to the record size.
+*-----------------------------------------------------------------------------*/
+static void trcrecord(int level, int type, const char *format, va_list ap)
+{
+    trcring_t *ring;
+    trcrec_t *rec;
+    trcfmt_t *fmt;
+    unsigned char *p,*end;
+    unsigned int seq;
+    const void *arg;
+    const char *str;
+    long lval;
+    long long llval;
+    size_t zval;
+    double dval;
+    void *pval;
+    int i,ival,len;
+
+    if (!(ring=ring_trace)&&!(ring=ring_trace=trcring())) return;
+
+    /* argument types of format by format cache */
+    fmt=ring->fmt+((size_t)format>>2)%NTRCFMT;
+    if (fmt->format!=format) {
+        fmt->narg=trcparse(format,fmt->type);
+        fmt->format=format;
+    }
+    rec=ring->rec+ring->n++%ring->nmax;
+    rec->seq=0;
+    membarrier();
+
+    rec->tick=tickget();
+    rec->level=(unsigned char)level;
+    rec->type=(unsigned char)type;
+    rec->format=format;
+
+    for (i=0,p=rec->data,end=p+MAXTRCDATA;i<fmt->narg;i++) {
+        switch (fmt->type[i]) {
+            case TRC_INT  : ival =va_arg(ap,int      ); arg=&ival ; len=sizeof(ival ); break;
+            case TRC_LONG : lval =va_arg(ap,long     ); arg=&lval ; len=sizeof(lval ); break;
+            case TRC_LLONG: llval=va_arg(ap,long long); arg=&llval; len=sizeof(llval); break;
+            case TRC_SIZE : zval =va_arg(ap,size_t   ); arg=&zval ; len=sizeof(zval ); break;
+            case TRC_DBL  : dval =va_arg(ap,double   ); arg=&dval ; len=sizeof(dval ); break;
+            case TRC_LDBL : dval =(double)va_arg(ap,long double); arg=&dval; len=sizeof(dval); break;
+            case TRC_PTR  : pval =va_arg(ap,void *   ); arg=&pval ; len=sizeof(pval ); break;
+            default:
+                if (!(str=va_arg(ap,const char *))) str="(null)";
+                arg=str; len=(int)strlen(str)+1;
+                break;
+        }
+        if (p+len>end) {
+            if (fmt->type[i]==TRC_STR&&end-p>=2) { /* truncate string */
+                memcpy(p,arg,end-p-1);
+                end[-1]='\0';
+                i++;
+            }
+            break;
+        }
+        memcpy(p,arg,len); p+=len;
+    }
+    rec->narg=(unsigned char)i;
+
+    if (!(seq=atomic_inc(&seq_trace))) seq=atomic_inc(&seq_trace);
+    membarrier();
+    rec->seq=seq;
+
+    if (dump_trace) {
+        dump_trace=0;
+        tracedump("");
+    }
+}
+/* digits of unsigned integer -------------------------------------------------
+* write the digits backwards before s with at least ndig digits
+*-----------------------------------------------------------------------------*/
+static char *trcdigit(char *s, unsigned long long u, int base, int upper,
+                      int ndig)
+{
+    const char *dig=upper?"0123456789ABCDEF":"0123456789abcdef";
+
+    do {
+        *--s=dig[u%base];
+        u/=base;
+    } while (--ndig>0||u);
+    return s;
+}
+/* format argument of trace record without stdio -------------------------------
+* async-signal-safe subset of printf(): flags '-', '+', ' ' and '0', width,
+* precision,
+* integers, characters, strings, pointers and doubles. doubles are output in
+* fixed or exponent notation with up to 9 digits of fraction. return the length
+*-----------------------------------------------------------------------------*/
+static int trcfmtsafe(char *buff, const char *spec, int type, const void *arg)
+{
+    const char *p=spec+1,*str=NULL,*pre="";
+    char num[96],*e=num+sizeof(num),*s=e,c;
+    long long v=0;
+    unsigned long long u=0,scale,ip,fp;
+    double d=0.0,x;
+    int i,n,left=0,zero=0,plus=0,width=0,prec=-1,exp=0,expo=0,base=10,sgn=0;
+
+    for (;*p&&strchr("-+ #0'",*p);p++) {
+        if      (*p=='-') left=1;
+        else if (*p=='0') zero=1;
+        else if (*p=='+') plus='+';
+        else if (*p==' '&&!plus) plus=' ';
+    }
+    for (;isdigit((int)(unsigned char)*p);p++) width=width*10+*p-'0';
+    if (*p=='.') {
+        for (prec=0,p++;isdigit((int)(unsigned char)*p);p++) prec=prec*10+*p-'0';
+    }
+    for (;*p&&strchr("hlLqjzt",*p);p++) ;
+    c=*p;
+    if (width>64) width=64;
+
+    switch (type) {
+        case TRC_INT  : v=*(const int       *)arg; u=(unsigned int)v;  break;
+        case TRC_LONG : v=*(const long      *)arg; u=(unsigned long)v; break;
+        case TRC_LLONG: v=*(const long long *)arg; u=(unsigned long long)v; break;
+        case TRC_SIZE : u=*(const size_t    *)arg; v=(long long)u;     break;
+        case TRC_DBL  :
+        case TRC_LDBL : d=*(const double    *)arg; break;
+        case TRC_PTR  : u=(unsigned long long)(size_t)*(void * const *)arg; break;
+        default       : str=(const char *)arg; break;
+    }
+    if (str) { /* string */
+        for (n=0;str[n]&&(prec<0||n<prec);n++) ;
+        zero=0;
+    }
+    else if (type==TRC_DBL||type==TRC_LDBL) {
+        if (d<0.0) {sgn=1; d=-d;}
+        if (d!=d) s-=3,memcpy(s,"nan",3);
+        else if (d>1E308) s-=3,memcpy(s,"inf",3);
+        else {
+            if (prec<0) prec=6; else if (prec>9) prec=9;
+            for (i=0,scale=1;i<prec;i++) scale*=10;
+            expo=c=='e'||c=='E'||(c!='f'&&c!='F'&&d!=0.0&&(d<1E-4||d>=1E15));
+            if (expo&&d!=0.0) {
+                for (;d>=10.0;d/=10.0) exp++;
+                for (;d<1.0;d*=10.0) exp--;
+            }
+            else if (d>=1E18) d=1E18; /* overflow of integer part */
+            ip=(unsigned long long)d;
+            x=(d-ip)*scale;
+            fp=(unsigned long long)x;
+            if (x-fp>0.5||(x-fp==0.5&&(fp&1))) fp++; /* half to even */
+            if (fp>=scale) {ip++; fp-=scale;}
+            if (expo&&ip>=10) {ip/=10; exp++;}
+            if (expo) {
+                s=trcdigit(s,exp<0?-exp:exp,10,0,2);
+                *--s=exp<0?'-':'+';
+                *--s=c=='E'||c=='G'||c=='A'?'E':'e';
+            }
+            if (prec>0) s=trcdigit(s,fp,10,0,prec),*--s='.';
+            s=trcdigit(s,ip,10,0,1);
+        }
+        n=(int)(e-s);
+    }
+    else if (c=='c') {
+        *--s=(char)v; n=1; zero=0;
+    }
+    else if (type==TRC_PTR||strchr("xXop",c)) {
+        base=c=='o'?8:16;
+        if (type==TRC_PTR||c=='p') pre="0x";
+        s=trcdigit(s,u,base,c=='X',prec<0?1:prec);
+        n=(int)(e-s);
+    }
+    else {
+        if (c!='u'&&v<0) {sgn=1; u=(unsigned long long)-(v+1)+1;}
+        else if (c!='u') u=(unsigned long long)v;
+        s=trcdigit(s,u,10,0,prec<0?1:prec);
+        n=(int)(e-s);
+    }
+    if (sgn) pre="-";
+    else if (plus&&c!='u'&&(type<=TRC_LDBL)&&!strchr("xXoc",c)) {
+        pre=plus=='+'?"+":" ";
+    }
+    if (!str) str=s;
+
+    /* padding by width */
+    i=n+(int)strlen(pre);
+    s=buff;
+    if (!left&&!zero) for (;i<width;i++) *s++=' ';
+    while (*pre) *s++=*pre++;
+    if (!left&&zero) for (;i<width;i++) *s++='0';
+    memcpy(s,str,n); s+=n;
+    if (left) for (;i<width;i++) *s++=' ';
+    return (int)(s-buff);
+}
+/* decode trace record to text -------------------------------------------------
+* safe=1: async-signal-safe decoding by trcfmtsafe() instead of sprintf()
+*-----------------------------------------------------------------------------*/
+static void trcdecode(const trcrec_t *rec, char *buff, int safe)
+{
+    const unsigned char *p=rec->data;
+    const char *f=rec->format,*e,*q;
+    unsigned char type[3];
+    char spec[64],*r,*s=buff;
+    long lval;
+    long long llval;
+    size_t zval;
+    double dval;
+    void *pval;
+    int i,n,ival,narg=0;
+
+    if (safe) {
+        ival=rec->level;
+        s+=trcfmtsafe(s,"%d",TRC_INT,&ival); *s++=' ';
+        if (rec->type) {
+            dval=(rec->tick-tick_trace)/1000.0;
+            s+=trcfmtsafe(s,"%9.3f",TRC_DBL,&dval); *s++=':'; *s++=' ';
+        }
+    }
+    else {
+        s+=sprintf(s,"%d ",rec->level);
+        if (rec->type) s+=sprintf(s,"%9.3f: ",(rec->tick-tick_trace)/1000.0);
+    }
+
+    while (*f&&s<buff+MAXTRCLINE-512) {
+        if (*f!='%') {
+            *s++=*f++;
+            continue;
+        }
+        e=trcspec(f,type,&n);
+        if (n==0) {
+            *s++='%';
+            f=e;
+            continue;
+        }
+        if (n<0||narg+n>rec->narg) break;
+
+        /* spec with width and precision arguments */
+        for (q=f,r=spec,i=0;q<e&&r<spec+40;q++) {
+            if (*q!='*') {
+                *r++=*q;
+                continue;
+            }
+            memcpy(&ival,p,sizeof(ival)); p+=sizeof(ival); i++;
+            ival=ival<-64?-64:(ival>64?64:ival);
+            if (ival<0) {*r++='-'; ival=-ival;}
+            if (ival>=10) *r++='0'+ival/10;
+            *r++='0'+ival%10;
+        }
+        *r='\0';
+        switch (type[i]) {
+            case TRC_INT  : memcpy(&ival ,p,sizeof(ival )); p+=sizeof(ival );
+                            s+=safe?trcfmtsafe(s,spec,TRC_INT  ,&ival ):sprintf(s,spec,ival ); break;
+            case TRC_LONG : memcpy(&lval ,p,sizeof(lval )); p+=sizeof(lval );
+                            s+=safe?trcfmtsafe(s,spec,TRC_LONG ,&lval ):sprintf(s,spec,lval ); break;
+            case TRC_LLONG: memcpy(&llval,p,sizeof(llval)); p+=sizeof(llval);
+                            s+=safe?trcfmtsafe(s,spec,TRC_LLONG,&llval):sprintf(s,spec,llval); break;
+            case TRC_SIZE : memcpy(&zval ,p,sizeof(zval )); p+=sizeof(zval );
+                            s+=safe?trcfmtsafe(s,spec,TRC_SIZE ,&zval ):sprintf(s,spec,zval ); break;
+            case TRC_DBL  : memcpy(&dval ,p,sizeof(dval )); p+=sizeof(dval );
+                            s+=safe?trcfmtsafe(s,spec,TRC_DBL  ,&dval ):sprintf(s,spec,dval ); break;
+            case TRC_LDBL : memcpy(&dval ,p,sizeof(dval )); p+=sizeof(dval );
+                            s+=safe?trcfmtsafe(s,spec,TRC_LDBL ,&dval ):sprintf(s,spec,(long double)dval); break;
+            case TRC_PTR  : memcpy(&pval ,p,sizeof(pval )); p+=sizeof(pval );
+                            s+=safe?trcfmtsafe(s,spec,TRC_PTR  ,&pval ):sprintf(s,spec,pval ); break;
+            default:
+                s+=safe?trcfmtsafe(s,spec,TRC_STR,p):sprintf(s,spec,(const char *)p);
+                p+=strlen((const char *)p)+1;
+                break;
+        }
+        narg+=n;
+        f=e;
+    }
+    /* format without recorded arguments */
+    while (*f&&s<buff+MAXTRCLINE-2) *s++=*f++;
+    *s='\0';
+}
+/* compare trace records by age ----------------------------------------------*/
+static int cmptrcrec(const void *p1, const void *p2)
+{
+    const trcrec_t *q1=(const trcrec_t *)p1,*q2=(const trcrec_t *)p2;
+    return q1->seq<q2->seq?1:(q1->seq>q2->seq?-1:0);
+}
+/* dump trace recorder in signal handler ---------------------------------------
+* async-signal-safe tracedump() to the trace file or stderr by write(). the
+* rings are merged by age without sort and decoded to the buffer allocated by
+* tracerec()
+*-----------------------------------------------------------------------------*/
+static void trcdumpsafe(void)
+{
+    static trcrec_t rec; /* not on the stack of the aborted thread */
+    static unsigned int nrec[MAXTRCTHREAD],cur[MAXTRCTHREAD];
+    trcring_t *ring;
+    const char *p;
+    unsigned int seq,age,amin=0,n;
+    int i,j,k,w,nring=nring_trace,fd=fd_trace;
+
+    if (!buff_trace) return;
+
+    for (i=0;i<nring;i++) {
+        nrec[i]=rings_trace[i]->n;
+        cur[i]=nrec[i]<(unsigned int)rings_trace[i]->nmax?0:
+               nrec[i]-rings_trace[i]->nmax;
+    }
+    for (;;) {
+        /* oldest record of the rings */
+        for (i=0,k=-1;i<nring;i++) {
+            ring=rings_trace[i];
+            for (;cur[i]<nrec[i];cur[i]++) {
+                if (ring->rec[cur[i]%ring->nmax].seq) break;
+            }
+            if (cur[i]>=nrec[i]) continue;
+            age=seq_trace-ring->rec[cur[i]%ring->nmax].seq;
+            if (k<0||age>amin) {k=i; amin=age;}
+        }
+        if (k<0) break;
+        ring=rings_trace[k];
+        j=cur[k]++%ring->nmax;
+        if (!(seq=ring->rec[j].seq)) continue;
+        membarrier();
+        memcpy(&rec,ring->rec+j,sizeof(trcrec_t));
+        membarrier();
+        if (ring->rec[j].seq!=seq) continue;
+
+        trcdecode(&rec,buff_trace,1);
+        for (p=buff_trace,n=(unsigned int)strlen(p);n>0;p+=w,n-=w) {
+            if ((w=(int)write(fd,p,n))<=0) break;
+        }
+    }
+}
+/* signal handlers of trace recorder -------------------------------------------
+* SIGUSR1 requests dump at the next trace. SIGABRT dumps the recorder and
+* chains to the previous handler or action
+*-----------------------------------------------------------------------------*/
+#ifdef WIN32
+static void sigabrt_trace(int sig)
+{
+    void (*old)(int)=sigold_trace;
+
+    trcdumpsafe();
+    signal(sig,old);
+    if (old!=SIG_DFL&&old!=SIG_IGN&&old!=SIG_ERR) old(sig);
+}
+#else
+static void sigchain_trace(const struct sigaction *old, int sig,
+                           siginfo_t *info, void *ctx)
+{
+    if (old->sa_flags&SA_SIGINFO) {
+        if (old->sa_sigaction) old->sa_sigaction(sig,info,ctx);
+    }
+    else if (old->sa_handler!=SIG_DFL&&old->sa_handler!=SIG_IGN) {
+        old->sa_handler(sig);
+    }
+}
+static void sigdump_trace(int sig, siginfo_t *info, void *ctx)
+{
+    dump_trace=1; /* dumped by the next trace */
+    sigchain_trace(sigold_trace,sig,info,ctx);
+}
+static void sigabrt_trace(int sig, siginfo_t *info, void *ctx)
+{
+    trcdumpsafe();
+
+    /* restore previous action and re-raise for default action */
+    sigaction(sig,sigold_trace+1,NULL);
+    if (!(sigold_trace[1].sa_flags&SA_SIGINFO)&&
+        sigold_trace[1].sa_handler==SIG_DFL) {
+        raise(sig);
+    }
+    else sigchain_trace(sigold_trace+1,sig,info,ctx);
+}
+#endif
 extern void traceopen(const char *file)
 {
     gtime_t time=utc2gpst(timeget());
@@ -2859,13 +3367,18 @@ extern void traceopen(const char *file)
 
     reppath(file,path,time,"","");
     if (!*path||!(fp_trace=fopen(path,"w"))) fp_trace=stderr;
+    fd_trace=fileno(fp_trace);
     strcpy(file_trace,file);
     tick_trace=tickget();
     time_trace=time;
-    initlock(&lock_trace);
+    if (!init_trace) {
+        initlock(&lock_trace);
+        init_trace=1;
+    }
 }
 extern void traceclose(void)
 {
+    fd_trace=2;
     if (fp_trace&&fp_trace!=stderr) fclose(fp_trace);
     fp_trace=NULL;
     file_trace[0]='\0';
@@ -2874,7 +3387,118 @@ extern void tracelevel(int level)
 {
     level_trace=level;
 }
-extern void trace(int level, const char *format, ...)
+/* start/stop trace recorder ---------------------------------------------------
+* record trace() and tracet() to in-memory rings instead of the trace file
+* args   : int    nrec      I   number of records of the ring of a thread
+*                               (0: stop recorder and restart text trace)
+* return : none
+* notes  : each thread records to its own ring of fixed-size records (tick
+*          time, level, format and raw arguments) without lock and formatting.
+*          the records are decoded to text by tracedump(), by SIGUSR1 (dumped
+*          at the next trace) or on abort (SIGABRT) to the trace file or stderr.
+*          the abort dump is async-signal-safe: it decodes without stdio to a
+*          buffer allocated here and writes by write().
+*          the previous signal handlers are chained and restored by
+*          tracerec(0).
+*          the ring size of a thread is fixed by the first record of it.
+*          tracemat(), traceobs(), tracenav() etc. are not output by the
+*          recorder.
+*-----------------------------------------------------------------------------*/
+extern void tracerec(int nrec)
+{
+#ifndef WIN32
+    struct sigaction sa;
+#endif
+    if (!init_trace) {
+        initlock(&lock_trace);
+        init_trace=1;
+    }
+    if (!tick_trace) tick_trace=tickget();
+
+    if (nrec>0&&nrec_trace<=0) {
+        if (!buff_trace&&!(buff_trace=(char *)malloc(MAXTRCLINE))) return;
+#ifdef WIN32
+        sigold_trace=signal(SIGABRT,sigabrt_trace);
+#else
+        memset(&sa,0,sizeof(sa));
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags=SA_SIGINFO;
+#ifdef SA_RESTART
+        sa.sa_flags|=SA_RESTART; /* as signal() */
+#endif
+        sa.sa_sigaction=sigdump_trace;
+        sigaction(SIGUSR1,&sa,sigold_trace);
+        sa.sa_sigaction=sigabrt_trace;
+        sigaction(SIGABRT,&sa,sigold_trace+1);
+#endif
+    }
+    else if (nrec<=0&&nrec_trace>0) {
+#ifdef WIN32
+        signal(SIGABRT,sigold_trace);
+#else
+        sigaction(SIGUSR1,sigold_trace,NULL);
+        sigaction(SIGABRT,sigold_trace+1,NULL);
+#endif
+    }
+    nrec_trace=nrec>0?nrec:0;
+}
+/* dump trace recorder ---------------------------------------------------------
+* decode the records of the trace recorder to text in the order of recording
+* args   : char   *file     I   output file ("": trace file or stderr)
+* return : number of records dumped (-1: error)
+* notes  : strings of a record are truncated to the record size and the format
+*          after the truncated arguments is output without conversion.
+*-----------------------------------------------------------------------------*/
+extern int tracedump(const char *file)
+{
+    trcring_t *ring;
+    trcrec_t *rec;
+    FILE *fp;
+    char *buff;
+    unsigned int seq;
+    int i,j,n=0,nmax=0,nring=nring_trace;
+
+    for (i=0;i<nring;i++) nmax+=rings_trace[i]->nmax;
+
+    if (!(rec=(trcrec_t *)malloc(sizeof(trcrec_t)*(nmax>0?nmax:1)))||
+        !(buff=(char *)malloc(MAXTRCLINE))) {
+        free(rec);
+        return -1;
+    }
+    /* copy valid records of rings */
+    for (i=0;i<nring;i++) {
+        ring=rings_trace[i];
+        for (j=0;j<ring->nmax;j++) {
+            if (!(seq=ring->rec[j].seq)) continue;
+            membarrier();
+            memcpy(rec+n,ring->rec+j,sizeof(trcrec_t));
+            membarrier();
+            if (ring->rec[j].seq==seq) rec[n++].seq=seq;
+        }
+    }
+    /* sort records by age for wrap-around of sequence number */
+    seq=seq_trace;
+    for (i=0;i<n;i++) rec[i].seq=seq-rec[i].seq;
+    qsort(rec,n,sizeof(trcrec_t),cmptrcrec);
+
+    if (file&&*file) {
+        if (!(fp=fopen(file,"w"))) {
+            free(rec); free(buff);
+            return -1;
+        }
+    }
+    else fp=fp_trace?fp_trace:stderr;
+
+    for (i=0;i<n;i++) {
+        trcdecode(rec+i,buff,0);
+        fputs(buff,fp);
+    }
+    fflush(fp);
+    if (file&&*file) fclose(fp);
+    free(rec); free(buff);
+    return n;
+}
+extern void (trace)(int level, const char *format, ...)
 {
     va_list ap;
 
@@ -2882,33 +3506,43 @@ extern void trace(int level, const char *format, ...)
     if (level<=1) {
         va_start(ap,format); vfprintf(stderr,format,ap); va_end(ap);
     }
-    if (!fp_trace||level>level_trace) return;
+    if (level>level_trace) return;
+    if (nrec_trace>0) {
+        va_start(ap,format); trcrecord(level,0,format,ap); va_end(ap);
+        return;
+    }
+    if (!fp_trace) return;
     traceswap();
     fprintf(fp_trace,"%d ",level);
     va_start(ap,format); vfprintf(fp_trace,format,ap); va_end(ap);
     fflush(fp_trace);
 }
-extern void tracet(int level, const char *format, ...)
+extern void (tracet)(int level, const char *format, ...)
 {
     va_list ap;
 
-    if (!fp_trace||level>level_trace) return;
+    if (level>level_trace) return;
+    if (nrec_trace>0) {
+        va_start(ap,format); trcrecord(level,1,format,ap); va_end(ap);
+        return;
+    }
+    if (!fp_trace) return;
     traceswap();
     fprintf(fp_trace,"%d %9.3f: ",level,(tickget()-tick_trace)/1000.0);
     va_start(ap,format); vfprintf(fp_trace,format,ap); va_end(ap);
     fflush(fp_trace);
 }
-extern void tracemat(int level, const double *A, int n, int m, int p, int q)
+extern void (tracemat)(int level, const double *A, int n, int m, int p, int q)
 {
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     matfprint(A,n,m,p,q,fp_trace); fflush(fp_trace);
 }
-extern void traceobs(int level, const obsd_t *obs, int n)
+extern void (traceobs)(int level, const obsd_t *obs, int n)
 {
     char str[64],id[16];
     int i;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     for (i=0;i<n;i++) {
         time2str(obs[i].time,str,3);
         satno2id(obs[i].sat,id);
@@ -2919,12 +3553,12 @@ extern void traceobs(int level, const obsd_t *obs, int n)
     }
     fflush(fp_trace);
 }
-extern void tracenav(int level, const nav_t *nav)
+extern void (tracenav)(int level, const nav_t *nav)
 {
     char s1[64],s2[64],id[16];
     int i;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     for (i=0;i<nav->n;i++) {
         time2str(nav->eph[i].toe,s1,0);
         time2str(nav->eph[i].ttr,s2,0);
@@ -2939,12 +3573,12 @@ extern void tracenav(int level, const nav_t *nav)
     fprintf(fp_trace,"(ion) %9.4e %9.4e %9.4e %9.4e\n",nav->ion_gal[0],
             nav->ion_gal[1],nav->ion_gal[2],nav->ion_gal[3]);
 }
-extern void tracegnav(int level, const nav_t *nav)
+extern void (tracegnav)(int level, const nav_t *nav)
 {
     char s1[64],s2[64],id[16];
     int i;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     for (i=0;i<nav->ng;i++) {
         time2str(nav->geph[i].toe,s1,0);
         time2str(nav->geph[i].tof,s2,0);
@@ -2953,12 +3587,12 @@ extern void tracegnav(int level, const nav_t *nav)
                 id,s1,s2,nav->geph[i].frq,nav->geph[i].svh,nav->geph[i].taun*1E6);
     }
 }
-extern void tracehnav(int level, const nav_t *nav)
+extern void (tracehnav)(int level, const nav_t *nav)
 {
     char s1[64],s2[64],id[16];
     int i;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     for (i=0;i<nav->ns;i++) {
         time2str(nav->seph[i].t0,s1,0);
         time2str(nav->seph[i].tof,s2,0);
@@ -2967,12 +3601,12 @@ extern void tracehnav(int level, const nav_t *nav)
                 id,s1,s2,nav->seph[i].svh,nav->seph[i].sva);
     }
 }
-extern void tracepeph(int level, const nav_t *nav)
+extern void (tracepeph)(int level, const nav_t *nav)
 {
     char s[64],id[16];
     int i,j;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
 
     for (i=0;i<nav->ne;i++) {
         time2str(nav->peph[i].time,s,0);
@@ -2987,12 +3621,12 @@ extern void tracepeph(int level, const nav_t *nav)
         }
     }
 }
-extern void tracepclk(int level, const nav_t *nav)
+extern void (tracepclk)(int level, const nav_t *nav)
 {
     char s[64],id[16];
     int i,j;
 
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
 
     for (i=0;i<nav->nc;i++) {
         time2str(nav->pclk[i].time,s,0);
@@ -3004,10 +3638,10 @@ extern void tracepclk(int level, const nav_t *nav)
         }
     }
 }
-extern void traceb(int level, const unsigned char *p, int n)
+extern void (traceb)(int level, const unsigned char *p, int n)
 {
     int i;
-    if (!fp_trace||level>level_trace) return;
+    if (!fp_trace||nrec_trace>0||level>level_trace) return;
     for (i=0;i<n;i++) fprintf(fp_trace,"%02X%s",*p++,i%8==7?" ":"");
     fprintf(fp_trace,"\n");
 }
@@ -3015,16 +3649,18 @@ extern void traceb(int level, const unsigned char *p, int n)
 extern void traceopen(const char *file) {}
 extern void traceclose(void) {}
 extern void tracelevel(int level) {}
-extern void trace   (int level, const char *format, ...) {}
-extern void tracet  (int level, const char *format, ...) {}
-extern void tracemat(int level, const double *A, int n, int m, int p, int q) {}
-extern void traceobs(int level, const obsd_t *obs, int n) {}
-extern void tracenav(int level, const nav_t *nav) {}
-extern void tracegnav(int level, const nav_t *nav) {}
-extern void tracehnav(int level, const nav_t *nav) {}
-extern void tracepeph(int level, const nav_t *nav) {}
-extern void tracepclk(int level, const nav_t *nav) {}
-extern void traceb  (int level, const unsigned char *p, int n) {}
+extern void tracerec(int nrec) {}
+extern int  tracedump(const char *file) {return 0;}
+extern void (trace)   (int level, const char *format, ...) {}
+extern void (tracet)  (int level, const char *format, ...) {}
+extern void (tracemat)(int level, const double *A, int n, int m, int p, int q) {}
+extern void (traceobs)(int level, const obsd_t *obs, int n) {}
+extern void (tracenav)(int level, const nav_t *nav) {}
+extern void (tracegnav)(int level, const nav_t *nav) {}
+extern void (tracehnav)(int level, const nav_t *nav) {}
+extern void (tracepeph)(int level, const nav_t *nav) {}
+extern void (tracepclk)(int level, const nav_t *nav) {}
+extern void (traceb)  (int level, const unsigned char *p, int n) {}
 
 #endif /* TRACE */
 
@@ -3756,15 +4392,33 @@ extern void sunmoonpos(gtime_t tutc, const double *erpv, double *rsun,
 *-----------------------------------------------------------------------------*/
 extern void windupcorr(gtime_t time, const double *rs, const double *rr,
                        double *phw)
+{
+    windupcorr_sun(time,rs,rr,NULL,phw);
+}
+/* phase windup correction with sun position -----------------------------------
+* phase windup correction with precomputed sun position
+* args   : gtime_t time     I   time (GPST)
+*          double  *rs      I   satellite position (ecef) {x,y,z} (m)
+*          double  *rr      I   receiver  position (ecef) {x,y,z} (m)
+*          double  *rsun    I   sun position (ecef) {x,y,z} (m) (NULL: computed)
+*          double  *phw     IO  phase windup correction (cycle)
+* return : none
+* notes  : see windupcorr()
+*-----------------------------------------------------------------------------*/
+extern void windupcorr_sun(gtime_t time, const double *rs, const double *rr,
+                           const double *rsun, double *phw)
 {
     double ek[3],exs[3],eys[3],ezs[3],ess[3],exr[3],eyr[3],eks[3],ekr[3],E[9];
-    double dr[3],ds[3],drs[3],r[3],pos[3],rsun[3],cosp,ph,erpv[5]={0};
+    double dr[3],ds[3],drs[3],r[3],pos[3],rsn[3],cosp,ph,erpv[5]={0};
     int i;
 
     trace(4,"windupcorr: time=%s\n",time_str(time,0));
 
     /* sun position in ecef */
-    sunmoonpos(gpst2utc(time),erpv,rsun,NULL,NULL);
+    if (!rsun) {
+        sunmoonpos(gpst2utc(time),erpv,rsn,NULL,NULL);
+        rsun=rsn;
+    }
 
     /* unit vector satellite to receiver */
     for (i=0;i<3;i++) r[i]=rr[i]-rs[i];
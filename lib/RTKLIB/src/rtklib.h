@@ -456,6 +456,7 @@ extern "C" {
 #define initlock(f) InitializeCriticalSection(f)
 #define lock(f)     EnterCriticalSection(f)
 #define unlock(f)   LeaveCriticalSection(f)
+#define thlocal     __declspec(thread)
 #define FILEPATHSEP '\\'
 #else
 #define thread_t    pthread_t
@@ -463,6 +464,7 @@ extern "C" {
 #define initlock(f) pthread_mutex_init(f,NULL)
 #define lock(f)     pthread_mutex_lock(f)
 #define unlock(f)   pthread_mutex_unlock(f)
+#define thlocal     __thread
 #define FILEPATHSEP '/'
 #endif
 
@@ -1089,6 +1091,7 @@ typedef struct {        /* RINEX options type */
     int outtime;        /* output time system correction */
     int outleaps;       /* output leap seconds */
     int autopos;        /* auto approx position */
+    int nthread;        /* number of decoding threads (0,1:sequential) */
     gtime_t tstart;     /* first obs time */
     gtime_t tend;       /* last obs time */
     gtime_t trtcm;      /* approx log start time for rtcm */
@@ -1140,6 +1143,13 @@ typedef struct {        /* RTK control/result type */
     int neb;            /* bytes in error message buffer */
     char errbuf[MAXERRMSG]; /* error message buffer */
     prcopt_t opt;       /* processing options */
+    int revs;           /* analysis direction (0:forward,1:backward) */
+    int nb;             /* number of buffered base obs (time-interpolation) */
+    obsd_t obsb[MAXOBS]; /* buffered base obs (time-interpolation) */
+    gtime_t tins;       /* time of ins antenna position for spp (0:none) */
+    double xins[6];     /* ins antenna position/velocity (ecef) (m|m/s) */
+    double qins;        /* ins antenna position variance (m^2) */
+    unsigned int nspp[2],nitr[2]; /* spp epochs/iterations {unaided,ins-aided} */
 } rtk_t;
 
 typedef struct {        /* receiver raw data control type */
@@ -1204,19 +1214,42 @@ typedef struct {        /* stream converter type */
     rtcm_t out;         /* rtcm output data buffer */
 } strconv_t;
 
+typedef struct {        /* stream server input chunk type */
+    int off;            /* offset in ring buffer (bytes) */
+    int n;              /* data length (bytes) */
+    int lost;           /* overwritten flag */
+    unsigned int tick;  /* input tick */
+} strchk_t;
+
+typedef struct {        /* stream server output type */
+    void *svr;          /* stream server */
+    int index;          /* output stream index */
+    unsigned int rseq;  /* sequence number of next chunk to write */
+    int boff,nbusy;     /* offset/length of chunk being written */
+    unsigned int ndrop; /* bytes dropped */
+    thread_t thread;    /* output thread */
+} strout_t;
+
 typedef struct {        /* stream server type */
     int state;          /* server state (0:stop,1:running) */
     int cycle;          /* server cycle (ms) */
     int buffsize;       /* input/monitor buffer size (bytes) */
+    int rsize;          /* ring buffer size (bytes) */
+    int nchk;           /* number of chunks in ring buffer */
+    int maxlag;         /* max output lag before dropping data (ms) (0:no) */
     int nmeacycle;      /* NMEA request cycle (ms) (0:no) */
     int nstr;           /* number of streams (1 input + (nstr-1) outputs */
     int npb;            /* data length in peek buffer (bytes) */
     double nmeapos[3];  /* NMEA request position (ecef) (m) */
-    unsigned char *buff; /* input buffers */
+    unsigned char *buff; /* input ring buffer shared by outputs */
     unsigned char *pbuf; /* peek buffer */
+    strchk_t *chk;      /* input chunks in ring buffer */
+    unsigned int wseq;  /* sequence number of next input chunk */
+    int woff;           /* offset of next input chunk (bytes) */
     unsigned int tick;  /* start tick */
     stream_t stream[16]; /* input/output streams */
     strconv_t *conv[16]; /* stream converter */
+    strout_t out[16];   /* outputs */
     thread_t thread;    /* server thread */
     lock_t lock;        /* lock flag */
 } strsvr_t;
@@ -1247,15 +1280,22 @@ typedef struct {        /* RTK server type */
     gtime_t ftime[3];   /* download time {rov,base,corr} */
     char files[3][MAXSTRPATH]; /* download paths {rov,base,corr} */
     obs_t obs[3][MAXOBSBUF]; /* observation data {rov,base,corr} */
-    nav_t nav;          /* navigation data */
+    nav_t nav;          /* navigation data (updated by decoders) */
+    nav_t navs[2];      /* published navigation data snapshots */
+    int inav;           /* index of current navigation data snapshot */
+    int nref[2];        /* number of readers of navigation data snapshots */
+    unsigned int npub;  /* number of published navigation data snapshots */
+    unsigned int nretry; /* number of snapshot retries by readers */
     sbsmsg_t sbsmsg[MAXSBSMSG]; /* SBAS message buffer */
     stream_t stream[8]; /* streams {rov,base,corr,sol1,sol2,logr,logb,logc} */
     stream_t *moni;     /* monitor stream */
     unsigned int tick;  /* start tick */
     thread_t thread;    /* server thread */
+    thread_t cthread;   /* correction stream thread */
     int cputime;        /* CPU time (ms) for a processing cycle */
     int prcout;         /* missing observation data count */
     lock_t lock;        /* lock flag */
+    lock_t lockn;       /* lock flag of navigation data updated by decoders */
 } rtksvr_t;
 
 /* global variables ----------------------------------------------------------*/
@@ -1382,6 +1422,54 @@ extern void tracehnav(int level, const nav_t *nav);
 extern void tracepeph(int level, const nav_t *nav);
 extern void tracepclk(int level, const nav_t *nav);
 extern void traceb   (int level, const unsigned char *p, int n);
+extern void tracerec (int nrec);
+extern int  tracedump(const char *file);
+
+/* lazy debug trace: arguments are not evaluated for disabled trace levels ---*/
+#ifdef TRACE
+extern int level_trace;
+#define trace(level,...) \
+    ((level)<=1||(level)<=level_trace?(trace)(level,__VA_ARGS__):(void)0)
+#define tracet(level,...) \
+    ((level)<=level_trace?(tracet   )(level,__VA_ARGS__):(void)0)
+#define tracemat(level,...) \
+    ((level)<=level_trace?(tracemat )(level,__VA_ARGS__):(void)0)
+#define traceobs(level,...) \
+    ((level)<=level_trace?(traceobs )(level,__VA_ARGS__):(void)0)
+#define tracenav(level,...) \
+    ((level)<=level_trace?(tracenav )(level,__VA_ARGS__):(void)0)
+#define tracegnav(level,...) \
+    ((level)<=level_trace?(tracegnav)(level,__VA_ARGS__):(void)0)
+#define tracehnav(level,...) \
+    ((level)<=level_trace?(tracehnav)(level,__VA_ARGS__):(void)0)
+#define tracepeph(level,...) \
+    ((level)<=level_trace?(tracepeph)(level,__VA_ARGS__):(void)0)
+#define tracepclk(level,...) \
+    ((level)<=level_trace?(tracepclk)(level,__VA_ARGS__):(void)0)
+#define traceb(level,...) \
+    ((level)<=level_trace?(traceb   )(level,__VA_ARGS__):(void)0)
+#else
+#define trace(level,...) \
+    (0?(trace    )(level,__VA_ARGS__):(void)0)
+#define tracet(level,...) \
+    (0?(tracet   )(level,__VA_ARGS__):(void)0)
+#define tracemat(level,...) \
+    (0?(tracemat )(level,__VA_ARGS__):(void)0)
+#define traceobs(level,...) \
+    (0?(traceobs )(level,__VA_ARGS__):(void)0)
+#define tracenav(level,...) \
+    (0?(tracenav )(level,__VA_ARGS__):(void)0)
+#define tracegnav(level,...) \
+    (0?(tracegnav)(level,__VA_ARGS__):(void)0)
+#define tracehnav(level,...) \
+    (0?(tracehnav)(level,__VA_ARGS__):(void)0)
+#define tracepeph(level,...) \
+    (0?(tracepeph)(level,__VA_ARGS__):(void)0)
+#define tracepclk(level,...) \
+    (0?(tracepclk)(level,__VA_ARGS__):(void)0)
+#define traceb(level,...) \
+    (0?(traceb   )(level,__VA_ARGS__):(void)0)
+#endif
 
 /* platform dependent functions ----------------------------------------------*/
 extern int execcmd(const char *cmd);
@@ -1435,6 +1523,10 @@ extern void sunmoonpos(gtime_t tutc, const double *erpv, double *rsun,
                        double *rmoon, double *gmst);
 extern void tidedisp(gtime_t tutc, const double *rr, int opt, const erp_t *erp,
                      const double *odisp, double *dr);
+extern void tidedisp_sunmoon(gtime_t tutc, const double *rr, int opt,
+                             const erp_t *erp, const double *odisp,
+                             const double *rsun, const double *rmoon,
+                             double gmst, double *dr);
 
 /* geiod models --------------------------------------------------------------*/
 extern int opengeoid(int model, const char *file);
@@ -1536,6 +1628,7 @@ extern int input_nvs   (raw_t *raw, unsigned char data);
 extern int input_bnx   (raw_t *raw, unsigned char data);
 extern int input_rt17  (raw_t *raw, unsigned char data);
 extern int input_lexr  (raw_t *raw, unsigned char data);
+extern int input_sbf   (raw_t *raw, unsigned char data);
 extern int input_oem4f (raw_t *raw, FILE *fp);
 extern int input_oem3f (raw_t *raw, FILE *fp);
 extern int input_ubxf  (raw_t *raw, FILE *fp);
@@ -1548,6 +1641,7 @@ extern int input_nvsf  (raw_t *raw, FILE *fp);
 extern int input_bnxf  (raw_t *raw, FILE *fp);
 extern int input_rt17f (raw_t *raw, FILE *fp);
 extern int input_lexrf (raw_t *raw, FILE *fp);
+extern int input_sbff  (raw_t *raw, FILE *fp);
 
 extern int gen_ubx (const char *msg, unsigned char *buff);
 extern int gen_stq (const char *msg, unsigned char *buff);
@@ -1654,11 +1748,19 @@ extern void strsetproxy(const char *addr);
 /* integer ambiguity resolution ----------------------------------------------*/
 extern int lambda(int n, int m, const double *a, const double *Q, double *F,
                   double *s);
+extern int lambda_reduct(int n, const double *Q, double *Z, double *L,
+                         double *D);
+extern int lambda_search(int n, int m, const double *L, const double *D,
+                         const double *z, double *E, double *s);
 
 /* standard positioning ------------------------------------------------------*/
 extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
                   const prcopt_t *opt, sol_t *sol, double *azel,
                   ssat_t *ssat, char *msg);
+extern int pntposp(const obsd_t *obs, int n, const nav_t *nav,
+                   const prcopt_t *opt, const double *xp, double varp,
+                   sol_t *sol, double *azel, ssat_t *ssat, int *nitr,
+                   char *msg);
 
 /* precise positioning -------------------------------------------------------*/
 extern void rtkinit(rtk_t *rtk, const prcopt_t *opt);
@@ -1679,6 +1781,10 @@ extern int pppnx(const prcopt_t *opt);
 extern void pppoutsolstat(rtk_t *rtk, int level, FILE *fp);
 extern void windupcorr(gtime_t time, const double *rs, const double *rr,
                        double *phw);
+extern void windupcorr_sun(gtime_t time, const double *rs, const double *rr,
+                           const double *rsun, double *phw);
+extern void satantpcv(const double *rs, const double *rr, const pcv_t *pcv,
+                      double *dant);
 
 /* post-processing positioning -----------------------------------------------*/
 extern int postpos(gtime_t ts, gtime_t te, double ti, double tu,
@@ -1693,6 +1799,8 @@ extern int  strsvrstart(strsvr_t *svr, int *opts, int *strs, char **paths,
                         const double *nmeapos);
 extern void strsvrstop (strsvr_t *svr, const char *cmd);
 extern void strsvrstat (strsvr_t *svr, int *stat, int *byte, int *bps, char *msg);
+extern void strsvrsetring(strsvr_t *svr, int rsize, int maxlag);
+extern void strsvrlag  (strsvr_t *svr, int *lag, int *drop);
 extern strconv_t *strconvnew(int itype, int otype, const char *msgs, int staid,
                              int stasel, const char *opt);
 extern void strconvfree(strconv_t *conv);
@@ -1711,6 +1819,8 @@ extern int  rtksvropenstr(rtksvr_t *svr, int index, int str, const char *path,
 extern void rtksvrclosestr(rtksvr_t *svr, int index);
 extern void rtksvrlock  (rtksvr_t *svr);
 extern void rtksvrunlock(rtksvr_t *svr);
+extern const nav_t *rtksvrnavget(rtksvr_t *svr, int *index);
+extern void rtksvrnavrel(rtksvr_t *svr, int index);
 extern int  rtksvrostat (rtksvr_t *svr, int type, gtime_t *time, int *sat,
                          double *az, double *el, int **snr, int *vsat);
 extern void rtksvrsstat (rtksvr_t *svr, int *sstat, char *msg);
@@ -34,6 +34,7 @@
 *           2014/10/21 1.16 fix bug on beidou amb-res with pos2-bdsarmode=0
 *           2014/11/08 1.17 fix bug on ar-degradation by unhealthy satellites
 *           2015/03/23 1.18 residuals referenced to reference satellite
+*           2019/10/15 1.19 seed single point positioning by ins prediction
 *-----------------------------------------------------------------------------*/
 #include <stdarg.h>
 #include "rtklib.h"
@@ -62,6 +63,10 @@ static const char rcsid[]="$Id:$";
 
 #define VAR_HOLDAMB 0.001    /* constraint to hold ambiguity (cycle^2) */
 
+#define MAXDTINS    30.0     /* max age of ins position for spp seed (s) */
+#define ACC_INS     1.0      /* acceleration noise of ins extrapolation (m/s^2) */
+#define VAR_INSMIN  SQR(3.0) /* min variance of ins antenna position (m^2) */
+
 #define TTOL_MOVEB  (1.0+2*DTTOL)
                              /* time sync tolerance for moving-baseline (s) */
 
@@ -1207,31 +1212,31 @@ static int ddres(rtk_t *rtk, const nav_t *nav, double dt, const double *x,
 static double intpres(gtime_t time, const obsd_t *obs, int n, const nav_t *nav,
                       rtk_t *rtk, double *y)
 {
-    static obsd_t obsb[MAXOBS];
-    static double yb[MAXOBS*NFREQ*2],rs[MAXOBS*6],dts[MAXOBS*2],var[MAXOBS];
-    static double e[MAXOBS*3],azel[MAXOBS*2];
-    static int nb=0,svh[MAXOBS*2];
+    obsd_t *obsb=rtk->obsb;
+    double yb[MAXOBS*NFREQ*2],rs[MAXOBS*6],dts[MAXOBS*2],var[MAXOBS];
+    double e[MAXOBS*3],azel[MAXOBS*2];
+    int svh[MAXOBS*2];
     prcopt_t *opt=&rtk->opt;
     double tt=timediff(time,obs[0].time),ttb,*p,*q;
     int i,j,k,nf=NF(opt);
 
     trace(3,"intpres : n=%d tt=%.1f\n",n,tt);
 
-    if (nb==0||fabs(tt)<DTTOL) {
-        nb=n; for (i=0;i<n;i++) obsb[i]=obs[i];
+    if (rtk->nb==0||fabs(tt)<DTTOL) {
+        rtk->nb=n; for (i=0;i<n;i++) obsb[i]=obs[i];
         return tt;
     }
     ttb=timediff(time,obsb[0].time);
     if (fabs(ttb)>opt->maxtdiff*2.0||ttb==tt) return tt;
 
-    satposs(time,obsb,nb,nav,opt->sateph,rs,dts,var,svh);
+    satposs(time,obsb,rtk->nb,nav,opt->sateph,rs,dts,var,svh);
 
-    if (!zdres(1,obsb,nb,rs,dts,svh,nav,rtk->rb,opt,1,yb,e,azel)) {
+    if (!zdres(1,obsb,rtk->nb,rs,dts,svh,nav,rtk->rb,opt,1,yb,e,azel)) {
         return tt;
     }
     for (i=0;i<n;i++) {
-        for (j=0;j<nb;j++) if (obsb[j].sat==obs[i].sat) break;
-        if (j>=nb) continue;
+        for (j=0;j<rtk->nb;j++) if (obsb[j].sat==obs[i].sat) break;
+        if (j>=rtk->nb) continue;
         for (k=0,p=y+i*nf*2,q=yb+j*nf*2;k<nf*2;k++,p++,q++) {
             if (*p==0.0||*q==0.0) *p=0.0; else *p=(ttb*(*p)-tt*(*q))/(ttb-tt);
         }
@@ -1669,6 +1674,28 @@ static int relpos(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
 
     return stat!=SOLQ_NONE;
 }
+/* rover position by single point positioning seeded by ins ------------------*/
+static int sppins(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav,
+                  char *msg)
+{
+    double xp[4],varp=0.0,dt;
+    int i,aid=0,nitr=0,stat;
+
+    /* ins antenna position extrapolated and clock predicted to epoch */
+    if (rtk->tins.time&&fabs(dt=timediff(obs[0].time,rtk->tins))<=MAXDTINS) {
+        for (i=0;i<3;i++) xp[i]=rtk->xins[i]+rtk->xins[3+i]*dt;
+        xp[3]=rtk->sol.dtr[0]*CLIGHT+
+              rtk->sol.dtrr*timediff(obs[0].time,rtk->sol.time);
+        varp=(rtk->qins>VAR_INSMIN?rtk->qins:VAR_INSMIN)+
+             3.0*SQR(0.5*ACC_INS*dt*dt);
+        aid=1;
+    }
+    stat=pntposp(obs,n,nav,&rtk->opt,aid?xp:NULL,varp,&rtk->sol,NULL,
+                 rtk->ssat,&nitr,msg);
+    rtk->nspp[aid]++;
+    rtk->nitr[aid]+=nitr;
+    return stat;
+}
 /* initialize rtk control ------------------------------------------------------
 * initialize rtk control struct
 * args   : rtk_t    *rtk    IO  rtk control/result struct
@@ -1700,6 +1727,11 @@ extern void rtkinit(rtk_t *rtk, const prcopt_t *opt)
     }
     for (i=0;i<MAXERRMSG;i++) rtk->errbuf[i]=0;
     rtk->opt=*opt;
+    rtk->revs=rtk->nb=0;
+    rtk->tins=sol0.time;
+    for (i=0;i<6;i++) rtk->xins[i]=0.0;
+    rtk->qins=0.0;
+    rtk->nspp[0]=rtk->nspp[1]=rtk->nitr[0]=rtk->nitr[1]=0;
 }
 /* free rtk control ------------------------------------------------------------
 * free memory for rtk control struct
@@ -1800,7 +1832,7 @@ extern int rtkpos(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav)
     time=rtk->sol.time; /* previous epoch */
    
     /* rover position by single point positioning */
-    if (!pntpos(obs,nu,nav,&rtk->opt,&rtk->sol,NULL,rtk->ssat,msg)) {
+    if (!sppins(rtk,obs,nu,nav,msg)) {
         errmsg(rtk,"point pos error (%s)\n",msg);
 
         if (!rtk->opt.dynamics) {
@@ -25,11 +25,27 @@
 *                            fix problem on ephemeris with inverted toe
 *                            add api rtksvrfree()
 *           2014/06/28  1.9  fix probram on ephemeris update of beidou
+*           2019/10/17  1.10 publish navigation data as double-buffered
+*                            snapshots read by positioning without lock
+*                            decode correction stream in its own thread
+*                            add api rtksvrnavget(),rtksvrnavrel()
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
 static const char rcsid[]="$Id:$";
 
+#ifdef WIN32
+#define atomic_inc(p)   InterlockedIncrement((LONG volatile *)(p))
+#define atomic_dec(p)   InterlockedDecrement((LONG volatile *)(p))
+#define atomic_get(p)   InterlockedCompareExchange((LONG volatile *)(p),0,0)
+#define atomic_set(p,v) InterlockedExchange((LONG volatile *)(p),(v))
+#else
+#define atomic_inc(p)   __sync_add_and_fetch((p),1)
+#define atomic_dec(p)   __sync_sub_and_fetch((p),1)
+#define atomic_get(p)   __sync_add_and_fetch((p),0)
+#define atomic_set(p,v) __sync_lock_test_and_set((p),(v))
+#endif
+
 /* write solution header to output stream ------------------------------------*/
 static void writesolhead(stream_t *stream, const solopt_t *solopt)
 {
@@ -115,15 +131,15 @@ static void updatefcn(rtksvr_t *svr)
         }
     }
 }
-/* update rtk server struct --------------------------------------------------*/
-static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
-                      sbsmsg_t *sbsmsg, int index, int iobs)
+/* update rtk server struct (return navigation data updated) ----------------*/
+static int updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
+                     sbsmsg_t *sbsmsg, int index, int iobs)
 {
     eph_t *eph1,*eph2,*eph3;
     geph_t *geph1,*geph2,*geph3;
     gtime_t tof;
     double pos[3],del[3]={0},dr[3];
-    int i,n=0,prn,sbssat=svr->rtk.opt.sbassatsel,sys,iode;
+    int i,n=0,prn,sbssat=svr->rtk.opt.sbassatsel,sys,iode,upd=0;
     
     tracet(4,"updatesvr: ret=%d sat=%2d index=%d\n",ret,sat,index);
     
@@ -153,6 +169,7 @@ static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
                     *eph3=*eph2;
                     *eph2=*eph1;
                     updatenav(&svr->nav);
+                    upd=1;
                 }
             }
             svr->nmsg[index][1]++;
@@ -168,6 +185,7 @@ static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
                    *geph2=*geph1;
                    updatenav(&svr->nav);
                    updatefcn(svr);
+                   upd=1;
                }
            }
            svr->nmsg[index][6]++;
@@ -182,7 +200,7 @@ static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
                 for (i=0;i<MAXSBSMSG-1;i++) svr->sbsmsg[i]=svr->sbsmsg[i+1];
                 svr->sbsmsg[i]=*sbsmsg;
             }
-            sbsupdatecorr(sbsmsg,&svr->nav);
+            upd=sbsupdatecorr(sbsmsg,&svr->nav)>=0;
         }
         svr->nmsg[index][3]++;
     }
@@ -195,6 +213,7 @@ static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
             for (i=0;i<8;i++) svr->nav.ion_qzs[i]=nav->ion_qzs[i];
             for (i=0;i<4;i++) svr->nav.utc_qzs[i]=nav->utc_qzs[i];
             svr->nav.leaps=nav->leaps;
+            upd=1;
         }
         svr->nmsg[index][2]++;
     }
@@ -246,16 +265,47 @@ static void updatesvr(rtksvr_t *svr, int ret, obs_t *obs, nav_t *nav, int sat,
                 }
             }
             svr->nav.ssr[i]=svr->rtcm[index].ssr[i];
+            upd=1;
         }
         svr->nmsg[index][7]++;
     }
     else if (ret==31) { /* lex message */
-        lexupdatecorr(&svr->raw[index].lexmsg,&svr->nav,&tof);
+        upd=lexupdatecorr(&svr->raw[index].lexmsg,&svr->nav,&tof);
         svr->nmsg[index][8]++;
     }
     else if (ret==-1) { /* error */
         svr->nmsg[index][9]++;
     }
+    return upd;
+}
+/* publish navigation data snapshot --------------------------------------------
+* copy navigation data updated by decoders to the snapshot not in use and make
+* it current. the caller locks svr->lockn. readers pin the current snapshot by
+* rtksvrnavget(), so only the previous one is waited for and overwritten.
+* precise ephemeris/clock are shared with the snapshots and freed by the caller
+* after two publications.
+*-----------------------------------------------------------------------------*/
+static void publishnav(rtksvr_t *svr)
+{
+    nav_t *nav;
+    eph_t *eph;
+    geph_t *geph;
+    seph_t *seph;
+    int i=1-atomic_get(&svr->inav);
+    
+    /* wait for readers of previous snapshot (one positioning epoch) */
+    while (atomic_get(svr->nref+i)>0) sleepms(1);
+    
+    nav=svr->navs+i;
+    eph=nav->eph; geph=nav->geph; seph=nav->seph;
+    *nav=svr->nav;
+    nav->eph=eph; nav->geph=geph; nav->seph=seph;
+    memcpy(eph ,svr->nav.eph ,sizeof(eph_t )*svr->nav.n );
+    memcpy(geph,svr->nav.geph,sizeof(geph_t)*svr->nav.ng);
+    memcpy(seph,svr->nav.seph,sizeof(seph_t)*svr->nav.ns);
+    
+    atomic_set(&svr->inav,i);
+    svr->npub++;
 }
 /* decode receiver raw/rtcm data ---------------------------------------------*/
 static int decoderaw(rtksvr_t *svr, int index)
@@ -263,11 +313,12 @@ static int decoderaw(rtksvr_t *svr, int index)
     obs_t *obs;
     nav_t *nav;
     sbsmsg_t *sbsmsg=NULL;
-    int i,ret,sat,fobs=0;
+    int i,ret,sat,fobs=0,upd=0;
     
     tracet(4,"decoderaw: index=%d\n",index);
     
-    rtksvrlock(svr);
+    /* correction stream thread does not block positioning */
+    if (index<2) rtksvrlock(svr);
     
     for (i=0;i<svr->nb[index];i++) {
         
@@ -298,7 +349,14 @@ static int decoderaw(rtksvr_t *svr, int index)
         }
 #endif
         /* update rtk server */
-        if (ret>0) updatesvr(svr,ret,obs,nav,sat,sbsmsg,index,fobs);
+        if (ret==1) {
+            updatesvr(svr,ret,obs,nav,sat,sbsmsg,index,fobs);
+        }
+        else if (ret>1) {
+            lock(&svr->lockn);
+            upd|=updatesvr(svr,ret,obs,nav,sat,sbsmsg,index,fobs);
+            unlock(&svr->lockn);
+        }
         
         /* observation data received */
         if (ret==1) {
@@ -307,14 +365,22 @@ static int decoderaw(rtksvr_t *svr, int index)
     }
     svr->nb[index]=0;
     
-    rtksvrunlock(svr);
+    if (index<2) rtksvrunlock(svr);
     
+    /* publish navigation data with complete ephemerides/correction epochs */
+    if (upd) {
+        lock(&svr->lockn);
+        publishnav(svr);
+        unlock(&svr->lockn);
+    }
     return fobs;
 }
 /* decode download file ------------------------------------------------------*/
 static void decodefile(rtksvr_t *svr, int index)
 {
     nav_t nav={0};
+    peph_t *peph;
+    pclk_t *pclk;
     char file[1024];
     int nb;
     
@@ -341,12 +407,19 @@ static void decodefile(rtksvr_t *svr, int index)
             tracet(1,"sp3 file read error: %s\n",file);
             return;
         }
-        /* update precise ephemeris */
-        rtksvrlock(svr);
+        /* update precise ephemeris (old one freed after both snapshots) */
+        lock(&svr->lockn);
         
-        if (svr->nav.peph) free(svr->nav.peph);
+        peph=svr->nav.peph;
         svr->nav.ne=svr->nav.nemax=nav.ne;
         svr->nav.peph=nav.peph;
+        publishnav(svr);
+        publishnav(svr);
+        free(peph);
+        
+        unlock(&svr->lockn);
+        
+        rtksvrlock(svr);
         svr->ftime[index]=utc2gpst(timeget());
         strcpy(svr->files[index],file);
         
@@ -359,18 +432,81 @@ static void decodefile(rtksvr_t *svr, int index)
             tracet(1,"rinex clock file read error: %s\n",file);
             return;
         }
-        /* update precise clock */
-        rtksvrlock(svr);
+        /* update precise clock (old one freed after both snapshots) */
+        lock(&svr->lockn);
         
-        if (svr->nav.pclk) free(svr->nav.pclk);
+        pclk=svr->nav.pclk;
         svr->nav.nc=svr->nav.ncmax=nav.nc;
         svr->nav.pclk=nav.pclk;
+        publishnav(svr);
+        publishnav(svr);
+        free(pclk);
+        
+        unlock(&svr->lockn);
+        
+        rtksvrlock(svr);
         svr->ftime[index]=utc2gpst(timeget());
         strcpy(svr->files[index],file);
         
         rtksvrunlock(svr);
     }
 }
+/* read and decode input stream ---------------------------------------------*/
+static int inputstr(rtksvr_t *svr, int index)
+{
+    unsigned char *p,*q;
+    int n;
+    
+    p=svr->buff[index]+svr->nb[index]; q=svr->buff[index]+svr->buffsize;
+    
+    /* read receiver raw/rtcm data from input stream */
+    if ((n=strread(svr->stream+index,p,q-p))>0) {
+        
+        /* write receiver raw/rtcm data to log stream */
+        strwrite(svr->stream+index+5,p,n);
+        svr->nb[index]+=n;
+        
+        /* save peek buffer */
+        rtksvrlock(svr);
+        n=n<svr->buffsize-svr->npb[index]?n:svr->buffsize-svr->npb[index];
+        memcpy(svr->pbuf[index]+svr->npb[index],p,n);
+        svr->npb[index]+=n;
+        rtksvrunlock(svr);
+    }
+    if (svr->format[index]==STRFMT_SP3||svr->format[index]==STRFMT_RNXCLK) {
+        /* decode download file */
+        decodefile(svr,index);
+        return 0;
+    }
+    /* decode receiver raw/rtcm data */
+    return decoderaw(svr,index);
+}
+/* correction stream thread --------------------------------------------------*/
+#ifdef WIN32
+static DWORD WINAPI rtksvrcorrthread(void *arg)
+#else
+static void *rtksvrcorrthread(void *arg)
+#endif
+{
+    rtksvr_t *svr=(rtksvr_t *)arg;
+    unsigned int tick;
+    int cputime;
+    
+    tracet(3,"rtksvrcorrthread:\n");
+    
+    while (svr->state) {
+        tick=tickget();
+        
+        /* decode corrections and publish navigation data snapshot */
+        inputstr(svr,2);
+        
+        cputime=(int)(tickget()-tick);
+        
+        /* sleep until next cycle */
+        sleepms(svr->cycle-cputime);
+    }
+    return 0;
+}
 /* rtk server thread ---------------------------------------------------------*/
 #ifdef WIN32
 static DWORD WINAPI rtksvrthread(void *arg)
@@ -381,10 +517,10 @@ static void *rtksvrthread(void *arg)
     rtksvr_t *svr=(rtksvr_t *)arg;
     obs_t obs;
     obsd_t data[MAXOBS*2];
+    const nav_t *nav;
     double tt;
     unsigned int tick,ticknmea;
-    unsigned char *p,*q;
-    int i,j,n,fobs[3]={0},cycle,cputime;
+    int i,j,fobs[3]={0},cycle,cputime,inav,nstr=2;
     
     tracet(3,"rtksvrthread:\n");
     
@@ -392,36 +528,20 @@ static void *rtksvrthread(void *arg)
     svr->tick=tickget();
     ticknmea=svr->tick-1000;
     
+    /* create correction stream thread (decoded here if failed) */
+#ifdef WIN32
+    if (!(svr->cthread=CreateThread(NULL,0,rtksvrcorrthread,svr,0,NULL))) {
+#else
+    if (pthread_create(&svr->cthread,NULL,rtksvrcorrthread,svr)) {
+#endif
+        tracet(2,"rtksvrthread: correction thread create error\n");
+        nstr=3;
+    }
     for (cycle=0;svr->state;cycle++) {
         tick=tickget();
         
-        for (i=0;i<3;i++) {
-            p=svr->buff[i]+svr->nb[i]; q=svr->buff[i]+svr->buffsize;
-            
-            /* read receiver raw/rtcm data from input stream */
-            if ((n=strread(svr->stream+i,p,q-p))<=0) {
-                continue;
-            }
-            /* write receiver raw/rtcm data to log stream */
-            strwrite(svr->stream+i+5,p,n);
-            svr->nb[i]+=n;
-            
-            /* save peek buffer */
-            rtksvrlock(svr);
-            n=n<svr->buffsize-svr->npb[i]?n:svr->buffsize-svr->npb[i];
-            memcpy(svr->pbuf[i]+svr->npb[i],p,n);
-            svr->npb[i]+=n;
-            rtksvrunlock(svr);
-        }
-        for (i=0;i<3;i++) {
-            if (svr->format[i]==STRFMT_SP3||svr->format[i]==STRFMT_RNXCLK) {
-                /* decode download file */
-                decodefile(svr,i);
-            }
-            else {
-                /* decode receiver raw/rtcm data */
-                fobs[i]=decoderaw(svr,i);
-            }
+        for (i=0;i<nstr;i++) {
+            fobs[i]=inputstr(svr,i);
         }
         for (i=0;i<fobs[0];i++) { /* for each rover observation data */
             obs.n=0;
@@ -431,10 +551,12 @@ static void *rtksvrthread(void *arg)
             for (j=0;j<svr->obs[1][0].n&&obs.n<MAXOBS*2;j++) {
                 obs.data[obs.n++]=svr->obs[1][0].data[j];
             }
-            /* rtk positioning */
+            /* rtk positioning with navigation data snapshot */
+            nav=rtksvrnavget(svr,&inav);
             rtksvrlock(svr);
-            rtkpos(&svr->rtk,obs.data,obs.n,&svr->nav);
+            rtkpos(&svr->rtk,obs.data,obs.n,nav);
             rtksvrunlock(svr);
+            rtksvrnavrel(svr,inav);
             
             if (svr->rtk.sol.stat!=SOLQ_NONE) {
                 
@@ -474,6 +596,14 @@ static void *rtksvrthread(void *arg)
         /* sleep until next cycle */
         sleepms(svr->cycle-cputime);
     }
+    if (nstr<3) {
+#ifdef WIN32
+        WaitForSingleObject(svr->cthread,10000);
+        CloseHandle(svr->cthread);
+#else
+        pthread_join(svr->cthread,NULL);
+#endif
+    }
     for (i=0;i<MAXSTRRTK;i++) strclose(svr->stream+i);
     for (i=0;i<3;i++) {
         svr->nb[i]=svr->npb[i]=0;
@@ -500,6 +630,7 @@ extern int rtksvrinit(rtksvr_t *svr)
     eph_t  eph0 ={0,-1,-1};
     geph_t geph0={0,-1};
     seph_t seph0={0};
+    nav_t *nav;
     int i,j;
     
     tracet(3,"rtksvrinit:\n");
@@ -523,21 +654,26 @@ extern int rtksvrinit(rtksvr_t *svr)
     for (i=0;i<3;i++) svr->files[i][0]='\0';
     svr->moni=NULL;
     svr->tick=0;
-    svr->thread=0;
+    svr->thread=svr->cthread=0;
     svr->cputime=svr->prcout=0;
+    svr->inav=svr->nref[0]=svr->nref[1]=0;
+    svr->npub=svr->nretry=0;
     
-    if (!(svr->nav.eph =(eph_t  *)malloc(sizeof(eph_t )*MAXSAT *2))||
-        !(svr->nav.geph=(geph_t *)malloc(sizeof(geph_t)*NSATGLO*2))||
-        !(svr->nav.seph=(seph_t *)malloc(sizeof(seph_t)*NSATSBS*2))) {
-        tracet(1,"rtksvrinit: malloc error\n");
-        return 0;
+    for (j=0;j<3;j++) {
+        nav=j<2?svr->navs+j:&svr->nav;
+        if (!(nav->eph =(eph_t  *)malloc(sizeof(eph_t )*MAXSAT *2))||
+            !(nav->geph=(geph_t *)malloc(sizeof(geph_t)*NSATGLO*2))||
+            !(nav->seph=(seph_t *)malloc(sizeof(seph_t)*NSATSBS*2))) {
+            tracet(1,"rtksvrinit: malloc error\n");
+            return 0;
+        }
+        for (i=0;i<MAXSAT *2;i++) nav->eph [i]=eph0;
+        for (i=0;i<NSATGLO*2;i++) nav->geph[i]=geph0;
+        for (i=0;i<NSATSBS*2;i++) nav->seph[i]=seph0;
+        nav->n =MAXSAT *2;
+        nav->ng=NSATGLO*2;
+        nav->ns=NSATSBS*2;
     }
-    for (i=0;i<MAXSAT *2;i++) svr->nav.eph [i]=eph0;
-    for (i=0;i<NSATGLO*2;i++) svr->nav.geph[i]=geph0;
-    for (i=0;i<NSATSBS*2;i++) svr->nav.seph[i]=seph0;
-    svr->nav.n =MAXSAT *2;
-    svr->nav.ng=NSATGLO*2;
-    svr->nav.ns=NSATSBS*2;
     
     for (i=0;i<3;i++) for (j=0;j<MAXOBSBUF;j++) {
         if (!(svr->obs[i][j].data=(obsd_t *)malloc(sizeof(obsd_t)*MAXOBS))) {
@@ -552,6 +688,7 @@ extern int rtksvrinit(rtksvr_t *svr)
     for (i=0;i<MAXSTRRTK;i++) strinit(svr->stream+i);
     
     initlock(&svr->lock);
+    initlock(&svr->lockn);
     
     return 1;
 }
@@ -567,6 +704,11 @@ extern void rtksvrfree(rtksvr_t *svr)
     free(svr->nav.eph );
     free(svr->nav.geph);
     free(svr->nav.seph);
+    for (i=0;i<2;i++) {
+        free(svr->navs[i].eph );
+        free(svr->navs[i].geph);
+        free(svr->navs[i].seph);
+    }
     for (i=0;i<3;i++) for (j=0;j<MAXOBSBUF;j++) {
         free(svr->obs[i][j].data);
     }
@@ -579,6 +721,38 @@ extern void rtksvrfree(rtksvr_t *svr)
 extern void rtksvrlock  (rtksvr_t *svr) {lock  (&svr->lock);}
 extern void rtksvrunlock(rtksvr_t *svr) {unlock(&svr->lock);}
 
+/* get/release navigation data snapshot ----------------------------------------
+* get current navigation data snapshot without lock and release it
+* args   : rtksvr_t *svr    IO rtk server
+*          int    *index    O  snapshot index (rtksvrnavget)
+*          int    index     I  snapshot index (rtksvrnavrel)
+* return : navigation data snapshot (rtksvrnavget)
+* notes  : the snapshot holds complete ephemerides and ssr correction epochs
+*          published by the decoders and is not changed until released.
+*          do not lock the rtk server (rtksvrlock()) while holding a snapshot
+*          out of the server thread.
+*-----------------------------------------------------------------------------*/
+extern const nav_t *rtksvrnavget(rtksvr_t *svr, int *index)
+{
+    int i;
+    
+    for (;;) {
+        i=atomic_get(&svr->inav);
+        atomic_inc(svr->nref+i);
+        
+        /* snapshot replaced before pinned? */
+        if (atomic_get(&svr->inav)==i) break;
+        atomic_dec(svr->nref+i);
+        atomic_inc(&svr->nretry);
+    }
+    *index=i;
+    return svr->navs+i;
+}
+extern void rtksvrnavrel(rtksvr_t *svr, int index)
+{
+    atomic_dec(svr->nref+index);
+}
+
 /* start rtk server ------------------------------------------------------------
 * start rtk server thread
 * args   : rtksvr_t *svr    IO rtk server
@@ -686,6 +860,9 @@ extern int rtksvrstart(rtksvr_t *svr, int cycle, int buffsize, int *strs,
     for (i=0;i<NSATGLO*2;i++) svr->nav.geph[i].tof=time0;
     for (i=0;i<NSATSBS*2;i++) svr->nav.seph[i].tof=time0;
     updatenav(&svr->nav);
+    lock(&svr->lockn);
+    publishnav(svr);
+    unlock(&svr->lockn);
     
     /* set monitor stream */
     svr->moni=moni;
@@ -13,11 +13,17 @@
 *                           suppress warnings
 *           2013/05/08 1.4  fix bug on 1 s offset for javad -> rtcm conversion
 *           2014/10/16 1.5  support input from stdout
+*           2019/10/18 1.6  write output streams from shared ring buffer by
+*                           output threads
+*                           add api strsvrsetring(), strsvrlag()
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
 
 static const char rcsid[]="$Id$";
 
+#define CHKSIZE     256         /* mean input chunk size for chunk ring (bytes) */
+#define MINNCHK     64          /* min number of chunks in ring buffer */
+
 /* test observation data message ---------------------------------------------*/
 static int is_obsmsg(int msg)
 {
@@ -352,6 +358,121 @@ static void strconv(stream_t *str, strconv_t *conv, unsigned char *buff, int n)
     write_nav_cycle(str,conv);
     write_sta_cycle(str,conv);
 }
+/* test overlap of ring buffer regions ---------------------------------------*/
+static int is_overlap(int off1, int n1, int off2, int n2)
+{
+    return off1<off2+n2&&off2<off1+n1;
+}
+/* allocate input chunk in ring buffer -----------------------------------------
+* allocate ring buffer region of buffsize bytes for next input chunk. regions
+* being written by outputs are skipped, so input never waits for outputs.
+* outputs lagging more than the ring buffer lose the overwritten chunks.
+* the caller locks svr->lock.
+*-----------------------------------------------------------------------------*/
+static int allocchk(strsvr_t *svr)
+{
+    strout_t *out;
+    strchk_t *chk;
+    unsigned int seq;
+    int i,j,off=svr->woff;
+    
+    for (i=0;i<2*svr->nstr+2;i++) {
+        if (off+svr->buffsize>svr->rsize) off=0;
+        
+        for (j=1;j<svr->nstr;j++) {
+            out=svr->out+j;
+            if (out->nbusy>0&&is_overlap(off,svr->buffsize,out->boff,out->nbusy)) {
+                off=out->boff+out->nbusy;
+                break;
+            }
+        }
+        if (j>=svr->nstr) break;
+    }
+    if (i>=2*svr->nstr+2) return -1;
+    
+    /* invalidate chunks overwritten */
+    for (seq=svr->wseq-svr->nchk+1;seq!=svr->wseq;seq++) {
+        chk=svr->chk+seq%svr->nchk;
+        if (chk->n>0&&is_overlap(off,svr->buffsize,chk->off,chk->n)) chk->lost=1;
+    }
+    /* drop chunks of outputs lagging more than chunk ring */
+    for (j=1;j<svr->nstr;j++) {
+        out=svr->out+j;
+        if ((int)(svr->wseq-out->rseq)<svr->nchk) continue;
+        chk=svr->chk+out->rseq%svr->nchk;
+        if (!chk->lost) out->ndrop+=chk->n;
+        out->rseq++;
+    }
+    return off;
+}
+/* write input chunks to output stream -----------------------------------------
+* write input chunks to output stream directly from ring buffer. the chunk being
+* written is marked by out->boff and out->nbusy not to be overwritten.
+* return : bytes written from ring buffer
+*-----------------------------------------------------------------------------*/
+static int writeout(strsvr_t *svr, strout_t *out)
+{
+    strchk_t *chk;
+    stream_t *str=svr->stream+out->index;
+    strconv_t *conv=svr->conv[out->index-1];
+    unsigned int seq,tick=tickget();
+    int n=0;
+    
+    lock(&svr->lock);
+    
+    for (;out->rseq!=svr->wseq;out->rseq++) {
+        chk=svr->chk+out->rseq%svr->nchk;
+        
+        /* drop chunks overwritten or exceeding max lag */
+        if (chk->lost) {
+            out->ndrop+=chk->n;
+            continue;
+        }
+        if (svr->maxlag>0&&(int)(tick-chk->tick)>svr->maxlag) {
+            out->ndrop+=chk->n;
+            continue;
+        }
+        seq=out->rseq;
+        out->boff=chk->off;
+        out->nbusy=n=chk->n;
+        break;
+    }
+    unlock(&svr->lock);
+    
+    if (conv) {
+        strconv(str,conv,svr->buff+out->boff,n);
+    }
+    else if (n>0) {
+        strwrite(str,svr->buff+out->boff,n);
+    }
+    if (n<=0) return 0;
+    
+    lock(&svr->lock);
+    out->nbusy=0;
+    if (out->rseq==seq) out->rseq++; /* not dropped while written */
+    unlock(&svr->lock);
+    
+    return n;
+}
+/* output stream thread ------------------------------------------------------*/
+#ifdef WIN32
+static DWORD WINAPI stroutthread(void *arg)
+#else
+static void *stroutthread(void *arg)
+#endif
+{
+    strout_t *out=(strout_t *)arg;
+    strsvr_t *svr=(strsvr_t *)out->svr;
+    
+    tracet(3,"stroutthread: index=%d\n",out->index);
+    
+    while (svr->state) {
+        
+        /* sleep if caught up with input */
+        if (!writeout(svr,out)) sleepms(svr->cycle);
+    }
+    return 0;
+}
 /* stearm server thread ------------------------------------------------------*/
 #ifdef WIN32
 static DWORD WINAPI strsvrthread(void *arg)
@@ -360,8 +481,9 @@ static void *strsvrthread(void *arg)
 #endif
 {
     strsvr_t *svr=(strsvr_t *)arg;
+    strchk_t *chk;
     unsigned int tick,ticknmea;
-    int i,n;
+    int i,n,off,thread[16]={0};
     
     tracet(3,"strsvrthread:\n");
     
@@ -369,38 +491,67 @@ static void *strsvrthread(void *arg)
     svr->tick=tickget();
     ticknmea=svr->tick-1000;
     
+    /* create output threads (written here if failed) */
+    for (i=1;i<svr->nstr;i++) {
+#ifdef WIN32
+        thread[i]=(svr->out[i].thread=CreateThread(NULL,0,stroutthread,
+                                                   svr->out+i,0,NULL))!=NULL;
+#else
+        thread[i]=!pthread_create(&svr->out[i].thread,NULL,stroutthread,
+                                  svr->out+i);
+#endif
+        if (!thread[i]) tracet(2,"strsvrthread: output thread error i=%d\n",i);
+    }
     while (svr->state) {
         tick=tickget();
         
-        /* read data from input stream */
-        n=strread(svr->stream,svr->buff,svr->buffsize);
+        /* read data from input stream to ring buffer */
+        lock(&svr->lock);
+        off=allocchk(svr);
+        unlock(&svr->lock);
+        
+        n=off<0?0:strread(svr->stream,svr->buff+off,svr->buffsize);
+        
+        lock(&svr->lock);
+        if (n>0) {
+            chk=svr->chk+svr->wseq%svr->nchk;
+            chk->off=off;
+            chk->n=n;
+            chk->lost=0;
+            chk->tick=tick;
+            svr->wseq++;
+            svr->woff=off+n;
+        }
+        for (i=0;i<n&&svr->npb<svr->buffsize;i++) {
+            svr->pbuf[svr->npb++]=svr->buff[off+i];
+        }
+        unlock(&svr->lock);
         
-        /* write data to output streams */
+        /* write data to output streams without thread */
         for (i=1;i<svr->nstr;i++) {
-            if (svr->conv[i-1]) {
-                strconv(svr->stream+i,svr->conv[i-1],svr->buff,n);
-            }
-            else {
-                strwrite(svr->stream+i,svr->buff,n);
-            }
+            if (!thread[i]) while (writeout(svr,svr->out+i)) ;
         }
         /* write nmea messages to input stream */
         if (svr->nmeacycle>0&&(int)(tick-ticknmea)>=svr->nmeacycle) {
             strsendnmea(svr->stream,svr->nmeapos);
             ticknmea=tick;
         }
-        lock(&svr->lock);
-        for (i=0;i<n&&svr->npb<svr->buffsize;i++) {
-            svr->pbuf[svr->npb++]=svr->buff[i];
-        }
-        unlock(&svr->lock);
-        
         sleepms(svr->cycle-(int)(tickget()-tick));
     }
+    for (i=1;i<svr->nstr;i++) {
+        if (!thread[i]) continue;
+#ifdef WIN32
+        WaitForSingleObject(svr->out[i].thread,10000);
+        CloseHandle(svr->out[i].thread);
+#else
+        pthread_join(svr->out[i].thread,NULL);
+#endif
+    }
     for (i=0;i<svr->nstr;i++) strclose(svr->stream+i);
     svr->npb=0;
     free(svr->buff); svr->buff=NULL;
     free(svr->pbuf); svr->pbuf=NULL;
+    free(svr->chk ); svr->chk =NULL;
     
     return 0;
 }
@@ -419,17 +570,48 @@ extern void strsvrinit(strsvr_t *svr, int nout)
     svr->state=0;
     svr->cycle=0;
     svr->buffsize=0;
+    svr->rsize=svr->nchk=svr->maxlag=0;
     svr->nmeacycle=0;
     svr->npb=0;
     for (i=0;i<3;i++) svr->nmeapos[i]=0.0;
     svr->buff=svr->pbuf=NULL;
+    svr->chk=NULL;
+    svr->wseq=0;
+    svr->woff=0;
     svr->tick=0;
     for (i=0;i<nout+1&&i<16;i++) strinit(svr->stream+i);
     svr->nstr=i;
-    for (i=0;i<16;i++) svr->conv[i]=NULL;
+    for (i=0;i<16;i++) {
+        svr->conv[i]=NULL;
+        svr->out[i].svr=svr;
+        svr->out[i].index=i;
+        svr->out[i].rseq=0;
+        svr->out[i].boff=svr->out[i].nbusy=0;
+        svr->out[i].ndrop=0;
+        svr->out[i].thread=0;
+    }
     svr->thread=0;
     initlock(&svr->lock);
 }
+/* set stream server ring buffer -----------------------------------------------
+* set ring buffer size and max output lag of stream server
+* args   : strsvr_t *svr    IO  stream sever struct
+*          int    rsize     I   ring buffer size (bytes) (0:64 x buffer size)
+*          int    maxlag    I   max output lag before dropping data (ms)
+*                               (0:no, lag up to ring buffer size)
+* return : none
+* notes  : call before strsvrstart(). the ring buffer is at least
+*          (outputs+2) x buffer size.
+*-----------------------------------------------------------------------------*/
+extern void strsvrsetring(strsvr_t *svr, int rsize, int maxlag)
+{
+    tracet(3,"strsvrsetring: rsize=%d maxlag=%d\n",rsize,maxlag);
+    
+    if (svr->state) return;
+    
+    svr->rsize=rsize<=0?0:rsize;
+    svr->maxlag=maxlag<=0?0:maxlag;
+}
 /* start stream server ---------------------------------------------------------
 * start stream server
 * args   : strsvr_t *svr    IO  stream sever struct
@@ -458,6 +640,11 @@ extern void strsvrinit(strsvr_t *svr, int nout)
 *          char   *cmd      I   input stream start command (NULL: no cmd)
 *          double *nmeapos  I   nmea request position (ecef) (m) (NULL: no)
 * return : status (0:error,1:ok)
+* notes  : the input stream is read to a ring buffer shared by the outputs, and
+*          each output stream is written from the ring buffer by its own thread.
+*          an output slower than the input lags behind. it loses data older
+*          than the max output lag or overwritten in the ring buffer instead of
+*          blocking the input or the other outputs. see strsvrsetring().
 *-----------------------------------------------------------------------------*/
 extern int strsvrstart(strsvr_t *svr, int *opts, int *strs, char **paths,
                        strconv_t **conv, const char *cmd, const double *nmeapos)
@@ -477,15 +664,29 @@ extern int strsvrstart(strsvr_t *svr, int *opts, int *strs, char **paths,
     svr->cycle=opts[4];
     svr->buffsize=opts[3]<4096?4096:opts[3]; /* >=4096byte */
     svr->nmeacycle=0<opts[5]&&opts[5]<1000?1000:opts[5]; /* >=1s */
+    if (svr->rsize<=0) svr->rsize=64*svr->buffsize;
+    if (svr->rsize<(svr->nstr+1)*svr->buffsize) {
+        svr->rsize=(svr->nstr+1)*svr->buffsize; /* >=(outputs+2) x buffsize */
+    }
+    svr->nchk=svr->rsize/CHKSIZE<MINNCHK?MINNCHK:svr->rsize/CHKSIZE;
     for (i=0;i<3;i++) svr->nmeapos[i]=nmeapos?nmeapos[i]:0.0;
     
     for (i=0;i<svr->nstr-1;i++) svr->conv[i]=conv[i];
     
-    if (!(svr->buff=(unsigned char *)malloc(svr->buffsize))||
-        !(svr->pbuf=(unsigned char *)malloc(svr->buffsize))) {
-        free(svr->buff); free(svr->pbuf);
+    if (!(svr->buff=(unsigned char *)malloc(svr->rsize))||
+        !(svr->pbuf=(unsigned char *)malloc(svr->buffsize))||
+        !(svr->chk=(strchk_t *)calloc(svr->nchk,sizeof(strchk_t)))) {
+        free(svr->buff); free(svr->pbuf); free(svr->chk);
+        svr->buff=svr->pbuf=NULL; svr->chk=NULL;
         return 0;
     }
+    svr->wseq=0;
+    svr->woff=0;
+    for (i=0;i<svr->nstr;i++) {
+        svr->out[i].rseq=0;
+        svr->out[i].boff=svr->out[i].nbusy=0;
+        svr->out[i].ndrop=0;
+    }
     /* open streams */
     for (i=0;i<svr->nstr;i++) {
         strcpy(file1,paths[0]); if ((p=strstr(file1,"::"))) *p='\0';
@@ -564,6 +765,33 @@ extern void strsvrstat(strsvr_t *svr, int *stat, int *byte, int *bps, char *msg)
         if (*s) p+=sprintf(p,"(%d) %s ",i,s);
     }
 }
+/* get stream server output lag ------------------------------------------------
+* get lag and dropped data of stream server outputs
+* args   : strsvr_t *svr    IO  stream sever struct
+*          int    *lag      O   output lag behind input (ms) (lag[0]=0)
+*          int    *drop     O   output bytes dropped (drop[0]=0)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void strsvrlag(strsvr_t *svr, int *lag, int *drop)
+{
+    strout_t *out;
+    unsigned int tick=tickget();
+    int i;
+    
+    tracet(4,"strsvrlag:\n");
+    
+    lock(&svr->lock);
+    for (i=0;i<svr->nstr;i++) {
+        out=svr->out+i;
+        lag[i]=drop[i]=0;
+        if (i==0||!svr->chk) continue;
+        if (out->rseq!=svr->wseq) {
+            lag[i]=(int)(tick-svr->chk[out->rseq%svr->nchk].tick);
+        }
+        drop[i]=(int)out->ndrop;
+    }
+    unlock(&svr->lock);
+}
 /* peek input/output stream ----------------------------------------------------
 * peek input/output stream of stream server
 * args   : strsvr_t *svr    IO  stream sever struct
@@ -0,0 +1,284 @@
+/*-----------------------------------------------------------------------------
+* AuxStore.c : auxiliary sensor time-series store (obd-ii, references)
+*
+* notes   : auxiliary logs are parsed once into named series with columnar,
+*           time-sorted arrays (t[],v[]). lookups at increasing (or slowly
+*           varying) query times use a cursor, so each query costs O(1)
+*           amortized instead of a rescan of the log.
+*
+*           supported inputs:
+*           (1) obd-ii logger csv, one pid per line:
+*               "SECONDS";"PID";"VALUE";"UNITS"
+*               "16770.6623919";"Vehicle speed";"0";"km/h"
+*           (2) text columns "time val1 val2 ..." (obd_sync.txt,
+*               obdspeedms.txt, velacc_reference.txt)
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/09 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define KMH2MS      (1.0/3.6)   /* km/h to m/s */
+
+/* get or add series by name -------------------------------------------------*/
+static auxseries_t *addseries(auxstore_t *st, const char *name,
+                              const char *unit)
+{
+    auxseries_t *s;
+    int i;
+
+    for (i=0;i<st->n;i++) {
+        if (!strcmp(st->s[i].name,name)) return st->s+i;
+    }
+    if (st->n>=st->nmax) {
+        st->nmax=st->nmax<=0?16:st->nmax*2;
+        if (!(s=(auxseries_t *)realloc(st->s,sizeof(auxseries_t)*st->nmax))) {
+            st->nmax=st->n;
+            return NULL;
+        }
+        st->s=s;
+    }
+    s=st->s+st->n++;
+    memset(s,0,sizeof(auxseries_t));
+    strncpy(s->name,name,sizeof(s->name)-1);
+    strncpy(s->unit,unit,sizeof(s->unit)-1);
+    return s;
+}
+/* add sample to series ------------------------------------------------------*/
+static int addsample(auxseries_t *s, double t, double v)
+{
+    double *tt,*vv;
+    int nmax;
+
+    if (s->n>=s->nmax) {
+        nmax=s->nmax<=0?1024:s->nmax*2;
+        if (!(tt=(double *)realloc(s->t,sizeof(double)*nmax))) return 0;
+        s->t=tt;
+        if (!(vv=(double *)realloc(s->v,sizeof(double)*nmax))) return 0;
+        s->v=vv;
+        s->nmax=nmax;
+    }
+    if (s->n>0&&t<s->t[s->n-1]) s->sort=1;
+    s->t[s->n]=t;
+    s->v[s->n++]=v;
+    return 1;
+}
+/* compare samples by time ---------------------------------------------------*/
+static int cmpsmp(const void *p1, const void *p2)
+{
+    const double *a=(const double *)p1,*b=(const double *)p2;
+    return a[0]<b[0]?-1:(a[0]>b[0]?1:0);
+}
+/* sort series by time (only if out of order on input) -----------------------*/
+static void sortseries(auxseries_t *s)
+{
+    double *tv;
+    int i;
+
+    if (!s->sort||s->n<2) return;
+    if (!(tv=(double *)malloc(sizeof(double)*2*s->n))) return;
+    for (i=0;i<s->n;i++) {
+        tv[2*i]=s->t[i]; tv[2*i+1]=s->v[i];
+    }
+    qsort(tv,s->n,sizeof(double)*2,cmpsmp);
+    for (i=0;i<s->n;i++) {
+        s->t[i]=tv[2*i]; s->v[i]=tv[2*i+1];
+    }
+    free(tv);
+    s->sort=0;
+}
+/* next quoted csv field (in place) ------------------------------------------*/
+static char *csvfield(char **p)
+{
+    char *q=*p,*f;
+
+    if (!q||!*q) return NULL;
+    if (*q=='"') {
+        f=++q;
+        while (*q&&*q!='"') q++;
+        if (*q) *q++='\0';
+    }
+    else f=q;
+    while (*q&&*q!=';') q++;
+    if (*q) *q++='\0';
+    *p=q;
+    return f;
+}
+/* read obd-ii logger csv ------------------------------------------------------
+* read obd-ii csv log into per-pid series
+* args   : auxstore_t *st   IO  auxiliary time-series store
+*          char   *file     I   obd-ii csv file
+*          double toff      I   offset added to logger time (s)
+* return : number of samples read (-1: file open error)
+* notes  : km/h values are converted to m/s. non-numeric values are skipped
+*-----------------------------------------------------------------------------*/
+extern int aux_readobd(auxstore_t *st, const char *file, double toff)
+{
+    FILE *fp;
+    auxseries_t *s;
+    char buff[1024],*p,*fs,*fpid,*fv,*fu,*end;
+    double t,v;
+    int i,n=0;
+
+    trace(3,"aux_readobd: file=%s\n",file);
+
+    if (!(fp=fopen(file,"r"))) {
+        trace(2,"obd-ii file open error: %s\n",file);
+        return -1;
+    }
+    while (fgets(buff,sizeof(buff),fp)) {
+        for (p=buff+strlen(buff)-1;p>=buff&&(*p=='\r'||*p=='\n');p--) *p='\0';
+        p=buff;
+        if (!(fs=csvfield(&p))||!(fpid=csvfield(&p))||!(fv=csvfield(&p))) continue;
+        if (!(fu=csvfield(&p))) fu="";
+
+        t=strtod(fs,&end); if (end==fs) continue; /* header */
+        v=strtod(fv,&end); if (end==fv) continue;
+
+        if (!strcmp(fu,"km/h")) {
+            v*=KMH2MS; fu="m/s";
+        }
+        if (!(s=addseries(st,fpid,fu))||!addsample(s,t+toff,v)) break;
+        n++;
+    }
+    fclose(fp);
+
+    for (i=0;i<st->n;i++) sortseries(st->s+i);
+    return n;
+}
+/* read text columns -----------------------------------------------------------
+* read whitespace separated columns "time val1 val2 ..." into series
+* args   : auxstore_t *st   IO  auxiliary time-series store
+*          char   *file     I   text file
+*          char   **names   I   series names of value columns
+*          char   **units   I   units of value columns
+*          int    ncol      I   number of value columns
+*          double toff      I   offset added to time column (s)
+* return : number of records read (-1: file open error)
+*-----------------------------------------------------------------------------*/
+extern int aux_readcols(auxstore_t *st, const char *file, const char **names,
+                        const char **units, int ncol, double toff)
+{
+    FILE *fp;
+    auxseries_t *s;
+    char buff[1024],*p,*end;
+    double t,v;
+    int i,n=0,is[MAXAUXCOL];
+
+    trace(3,"aux_readcols: file=%s ncol=%d\n",file,ncol);
+
+    if (ncol>MAXAUXCOL) ncol=MAXAUXCOL;
+    if (!(fp=fopen(file,"r"))) {
+        trace(2,"aux file open error: %s\n",file);
+        return -1;
+    }
+    for (i=0;i<ncol;i++) {
+        if (!(s=addseries(st,names[i],units[i]))) {
+            fclose(fp);
+            return 0;
+        }
+        is[i]=(int)(s-st->s);
+    }
+    while (fgets(buff,sizeof(buff),fp)) {
+        t=strtod(buff,&end);
+        if (end==buff) continue;
+        for (i=0,p=end;i<ncol;i++,p=end) {
+            v=strtod(p,&end);
+            if (end==p) break;
+            if (!addsample(st->s+is[i],t+toff,v)) break;
+        }
+        n++;
+    }
+    fclose(fp);
+
+    for (i=0;i<ncol;i++) sortseries(st->s+is[i]);
+    return n;
+}
+/* get series by name ----------------------------------------------------------
+* args   : auxstore_t *st   I   auxiliary time-series store
+*          char   *name     I   series name (e.g. "Vehicle speed")
+* return : series (NULL: not found)
+* notes  : the pointer is valid until the next series is added to the store
+*-----------------------------------------------------------------------------*/
+extern const auxseries_t *aux_get(const auxstore_t *st, const char *name)
+{
+    int i;
+
+    for (i=0;i<st->n;i++) {
+        if (!strcmp(st->s[i].name,name)) return st->s+i;
+    }
+    return NULL;
+}
+/* initialize cursor -----------------------------------------------------------
+* args   : auxcur_t *cur    O   series cursor
+*          auxseries_t *s   I   series (NULL: no data)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void aux_initcur(auxcur_t *cur, const auxseries_t *s)
+{
+    cur->s=s;
+    cur->i=0;
+}
+/* interpolate series at time --------------------------------------------------
+* interpolate series value at query time with cursor
+* args   : auxcur_t *cur    IO  series cursor
+*          double t         I   query time (s)
+*          double maxgap    I   max time between bracketing samples (s)
+*          double *val      O   interpolated value
+* return : status (1:ok,0:no data, outside series or data gap)
+* notes  : the cursor moves from its last position, so monotonic queries are
+*          O(1) amortized
+*-----------------------------------------------------------------------------*/
+extern int aux_interp(auxcur_t *cur, double t, double maxgap, double *val)
+{
+    const auxseries_t *s=cur->s;
+    double a;
+    int i;
+
+    if (!s||s->n<=0) return 0;
+
+    if (s->n==1) {
+        if (fabs(t-s->t[0])>maxgap) return 0;
+        *val=s->v[0];
+        return 1;
+    }
+    i=cur->i<0?0:(cur->i>s->n-2?s->n-2:cur->i);
+    while (i<s->n-2&&s->t[i+1]<t) i++;
+    while (i>0&&s->t[i]>t) i--;
+    cur->i=i;
+
+    if (t<s->t[i]||t>s->t[i+1]||s->t[i+1]-s->t[i]>maxgap) return 0;
+
+    a=s->t[i+1]-s->t[i];
+    a=a<=0.0?0.0:(t-s->t[i])/a;
+    *val=s->v[i]+(s->v[i+1]-s->v[i])*a;
+    return 1;
+}
+/* free auxiliary time-series store --------------------------------------------
+* args   : auxstore_t *st   IO  auxiliary time-series store
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void aux_free(auxstore_t *st)
+{
+    int i;
+
+    for (i=0;i<st->n;i++) {
+        free(st->s[i].t); free(st->s[i].v);
+    }
+    free(st->s);
+    st->s=NULL;
+    st->n=st->nmax=0;
+}
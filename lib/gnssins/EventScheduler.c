@@ -0,0 +1,229 @@
+/*-----------------------------------------------------------------------------
+* EventScheduler.c : time-ordered multi-sensor event scheduler
+*
+* notes   : timestamped sensor streams (imu samples, gnss epochs, odometry,
+*           map constraints) are merged in strict time order. stream sources
+*           are pulled with one event of lookahead each (k-way merge through
+*           a binary min-heap). events pushed by a producer (e.g. gnss epochs
+*           from rtkpos) are buffered in the same heap, so producers may
+*           deliver them out of order up to the queue size. events earlier
+*           than the last dispatched one are rejected as late.
+*
+*           events of equal time are ordered by type (gnss, odometry, map,
+*           imu) and then by arrival, so replay is deterministic.
+*
+*           event times are continuous gps time (week*604800+tow), so the
+*           order holds across gps week rollover.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/08 1.0 new
+*           2019/10/20 1.1 order events by continuous gps time instead of
+*                          time of week
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+/* compare events (1: a before b) --------------------------------------------*/
+static int evtless(const evt_t *a, const evt_t *b)
+{
+    if (a->time!=b->time) return a->time<b->time;
+    if (a->type!=b->type) return a->type<b->type;
+    return a->seq<b->seq;
+}
+/* insert event into heap ----------------------------------------------------*/
+static int heappush(sched_t *sched, const evt_t *evt)
+{
+    evt_t tmp;
+    int i,p;
+
+    if (sched->n>=MAXEVTQ) {
+        sched->nfull++;
+        trace(2,"sched: event queue full type=%d t=%.3f\n",evt->type,evt->time);
+        return 0;
+    }
+    i=sched->n++;
+    sched->heap[i]=*evt;
+    sched->heap[i].seq=sched->seq++;
+
+    for (;i>0;i=p) {
+        p=(i-1)/2;
+        if (!evtless(sched->heap+i,sched->heap+p)) break;
+        tmp=sched->heap[p]; sched->heap[p]=sched->heap[i]; sched->heap[i]=tmp;
+    }
+    return 1;
+}
+/* remove first event from heap ----------------------------------------------*/
+static void heappop(sched_t *sched, evt_t *evt)
+{
+    evt_t tmp;
+    int i,c,n;
+
+    *evt=sched->heap[0];
+    n=--sched->n;
+    sched->heap[0]=sched->heap[n];
+
+    for (i=0;(c=2*i+1)<n;i=c) {
+        if (c+1<n&&evtless(sched->heap+c+1,sched->heap+c)) c++;
+        if (!evtless(sched->heap+c,sched->heap+i)) break;
+        tmp=sched->heap[c]; sched->heap[c]=sched->heap[i]; sched->heap[i]=tmp;
+    }
+}
+/* fetch lookahead events of sources -----------------------------------------*/
+static void fillsrc(sched_t *sched)
+{
+    evtsrc_t *src;
+    evt_t evt;
+    int i;
+
+    for (i=0;i<sched->nsrc;i++) {
+        src=sched->src+i;
+        if (src->pending||src->eof) continue;
+
+        memset(&evt,0,sizeof(evt_t));
+        if (!src->fetch(src->arg,&evt)) {
+            src->eof=1;
+            continue;
+        }
+        evt.type=src->type;
+        evt.src=i;
+        if (heappush(sched,&evt)) src->pending=1;
+    }
+}
+/* initialize event scheduler --------------------------------------------------
+* args   : sched_t *sched   O   event scheduler
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void sched_init(sched_t *sched)
+{
+    memset(sched,0,sizeof(sched_t));
+    sched->tlast=-1E9;
+}
+/* add stream source -----------------------------------------------------------
+* args   : sched_t *sched   IO  event scheduler
+*          int    type      I   event type of source (EVT_???)
+*          evtfetch_t fetch I   fetch function (returns 1:ok,0:end of stream)
+*          void   *arg      I   fetch argument
+* return : source index (-1: error)
+* notes  : fetch sets evt->time and evt->data. data must stay valid until the
+*          event is dispatched (one event per source is queued at a time)
+*-----------------------------------------------------------------------------*/
+extern int sched_addsrc(sched_t *sched, int type, evtfetch_t fetch, void *arg)
+{
+    evtsrc_t *src;
+
+    if (sched->nsrc>=MAXEVTSRC||type<0||type>=EVT_NTYPE) return -1;
+
+    src=sched->src+sched->nsrc;
+    src->type=type;
+    src->fetch=fetch;
+    src->arg=arg;
+    src->pending=src->eof=0;
+    return sched->nsrc++;
+}
+/* set event handler -----------------------------------------------------------
+* args   : sched_t *sched   IO  event scheduler
+*          int    type      I   event type (EVT_???)
+*          evthandler_t handler I handler (NULL: events discarded)
+*          void   *ctx      I   handler context
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void sched_sethandler(sched_t *sched, int type, evthandler_t handler,
+                             void *ctx)
+{
+    if (type<0||type>=EVT_NTYPE) return;
+    sched->handler[type]=handler;
+    sched->ctx[type]=ctx;
+}
+/* push event ------------------------------------------------------------------
+* args   : sched_t *sched   IO  event scheduler
+*          evt_t  *evt      I   event (time, type, data)
+* return : status (1:queued, 0:rejected late or queue full)
+*-----------------------------------------------------------------------------*/
+extern int sched_push(sched_t *sched, const evt_t *evt)
+{
+    evt_t e=*evt;
+
+    if (e.type<0||e.type>=EVT_NTYPE) return 0;
+
+    if (e.time<sched->tlast) {
+        sched->nlate++;
+        trace(2,"sched: late event rejected type=%d t=%.3f tlast=%.3f\n",
+              e.type,e.time,sched->tlast);
+        return 0;
+    }
+    e.src=-1;
+    return heappush(sched,&e);
+}
+/* peek next event -------------------------------------------------------------
+* args   : sched_t *sched   IO  event scheduler
+* return : next event (NULL: no event)
+*-----------------------------------------------------------------------------*/
+extern const evt_t *sched_peek(sched_t *sched)
+{
+    fillsrc(sched);
+    return sched->n>0?sched->heap:NULL;
+}
+/* dispatch next event ---------------------------------------------------------
+* args   : sched_t *sched   IO  event scheduler
+* return : status (1:dispatched, 0:no event)
+*-----------------------------------------------------------------------------*/
+extern int sched_step(sched_t *sched)
+{
+    evt_t evt;
+
+    fillsrc(sched);
+    if (sched->n<=0) return 0;
+
+    heappop(sched,&evt);
+    if (evt.src>=0) sched->src[evt.src].pending=0;
+    sched->tlast=evt.time;
+
+    if (sched->handler[evt.type]) {
+        sched->handler[evt.type](&evt,sched->ctx[evt.type]);
+        sched->ndisp[evt.type]++;
+    }
+    else sched->nnohdl++;
+
+    return 1;
+}
+/* dispatch events up to time --------------------------------------------------
+* dispatch queued and source events in time order until time tend
+* args   : sched_t *sched   IO  event scheduler
+*          double tend      I   end time (events with time <= tend)
+* return : number of dispatched events
+*-----------------------------------------------------------------------------*/
+extern int sched_run(sched_t *sched, double tend)
+{
+    const evt_t *evt;
+    int n=0;
+
+    while ((evt=sched_peek(sched))&&evt->time<=tend) {
+        n+=sched_step(sched);
+    }
+    return n;
+}
+/* print scheduler statistics --------------------------------------------------
+* args   : sched_t *sched   I   event scheduler
+*          FILE   *fp       I   output file pointer
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void sched_stat(const sched_t *sched, FILE *fp)
+{
+    fprintf(fp,"events dispatched: gnss=%u odo=%u map=%u imu=%u\n",
+            sched->ndisp[EVT_GNSS],sched->ndisp[EVT_ODO],sched->ndisp[EVT_MAP],
+            sched->ndisp[EVT_IMU]);
+    fprintf(fp,"events rejected  : late=%u queue-full=%u no-handler=%u\n",
+            sched->nlate,sched->nfull,sched->nnohdl);
+}
@@ -49,6 +49,9 @@ extern void initPNindex(const prcopt_t *opt)
   NT = xnT(opt);
   IN = xiBs(opt, 1);
   NN = xnB();
+
+  /* loosely coupled: navigation error states only */
+  if (insgnssopt.lc) nrc = nrr = NT = NN = 0;
 }
 
 /* precise tropospheric model ------------------------------------------------*/
@@ -2934,7 +2937,7 @@ static void getF(const insgnss_opt_t *opt, const double *Cbe, const double *pos,
 
   setzero(F, nx, nx);
 
-  matmul3("NN", Cbe, fib, omega);
+  matmul3v("N", Cbe, fib, omega);
   skewsym3(omega, F21);
 
   ecef2pos(pos, rn);
@@ -3106,7 +3109,7 @@ static void getPhi1(const insgnss_opt_t *opt, double dt, const double *Cbe,
     //for (j=irg;j<irg+nrg;j++) phi[i+j*nx] =WC  [i-IA+(j-irg)*3]*dt;
   }
   /* velocity transmit matrix */
-  matmul3("NN", Cbe, fib, omega);
+  matmul3v("N", Cbe, fib, omega);
   skewsym3(omega, T);
   ecef2pos(pos, rn);
   Gravity_ECEF(pos, ge);
@@ -3219,6 +3222,58 @@ static void corr_meas(const obsd_t *obs, const nav_t *nav, const double *azel,
       if (P[0]!=0.0&&P[i]!=0.0) *Pc=C1*P[0]+C2*P[i];
 }
 
+/* u-d factors of ins/gnss ekf covariance --------------------------------------
+* args   : ins_states_t *ins  I   ins states
+* return : u-d factors, master copy of the covariance in u-d mode (udfilt)
+* notes  : factorized from ins->P (initial covariance) at first use. in u-d
+*          mode ins->P is a read-only view rebuilt by inssyncP()
+*-----------------------------------------------------------------------------*/
+extern udfac_t *insudfac(const ins_states_t *ins)
+{
+  if (insud.n != ins->nx && ud_init(&insud, ins->P, ins->nx))
+    trace(2, "insudfac: u-d factorization error nx=%d\n", ins->nx);
+  return &insud;
+}
+/* covariance view of ins/gnss ekf (rebuilt from u-d factors if modified) ----*/
+extern void inssyncP(const insgnss_opt_t *opt, ins_states_t *ins)
+{
+  if (opt->udfilt) ud_toP(insudfac(ins), ins->P, ins->nx);
+}
+/* variance of ins/gnss ekf state --------------------------------------------*/
+extern double insvar(const insgnss_opt_t *opt, const ins_states_t *ins, int i)
+{
+  return opt->udfilt ? ud_var(insudfac(ins), i) : ins->P[i + i * ins->nx];
+}
+/* add process noise to ins/gnss ekf state (P(i,i)+=q) -----------------------*/
+static void insaddvar(ins_states_t *ins, int i, double q)
+{
+  if (insgnssopt.udfilt) ud_addvar(insudfac(ins), i, q);
+  else ins->P[i + i * ins->nx] += q;
+}
+/* reset covariance to initial error covariance ------------------------------*/
+static void resetP(const insgnss_opt_t *opt, double *P, int nx)
+{
+  getP0(opt, P, nx);
+
+  if (opt->udfilt && ud_init(&insud, P, nx))
+    trace(2, "resetP: u-d factorization error nx=%d\n", nx);
+}
+/* propagate covariance with u-d factors (P=phi*(P0+Q/2)*phi'+Q/2) -----------*/
+static void udpropP(const insgnss_opt_t *opt, const double *Q, const double *phi,
+                    ins_states_t *ins, int nx)
+{
+  udfac_t *ud = insudfac(ins);
+  int i;
+
+  if (ud_predict(ud, phi, Q, nx))
+  {
+    trace(2, "udpropP: u-d time update error nx=%d\n", nx);
+    return;
+  }
+  /* initialize every epoch for clock (white noise) */
+  for (i = irc; i < irc + nrc; i++)
+    ud_reset(ud, i, SQR(opt->unc.rc == 0.0 ? UNC_CLK : opt->unc.rc));
+}
 /* propagate state estimates noting that all states are zero due to closed-loop
  * correction----------------------------------------------------------------*/
 static void propx(const insgnss_opt_t *opt, const double *x0, double *x)
@@ -3252,18 +3307,18 @@ static void updstat(const insgnss_opt_t *opt, ins_states_t *ins, const double dt
     //gettimeofday(&start, NULL); //do stuff
     /* propagate state estimation error covariance */
     if (fabs(dt) >= MAXUPDTIMEINT){
-      getP0(opt, P, nx);
+      resetP(opt, P, nx);
     }
     else{
-      propP(opt, Q, phi, P0, P, nx);
+      opt->udfilt ? udpropP(opt, Q, phi, ins, nx) : propP(opt, Q, phi, P0, P, nx);
     }
     /* propagate state estimates noting that
       * all states are zero due to close-loop correction */
     if (x)
       propx(opt, x0, x);
 
-    /* predict info. */
-    if (ins->P0)
+    /* predict info. (no dense predicted covariance in u-d mode) */
+    if (ins->P0 && !opt->udfilt)
       matcpy(ins->P0, P, nx, nx);
     if (ins->F)
       matcpy(ins->F, phi, nx, nx);
@@ -3401,7 +3456,7 @@ void kf_noise_init(insgnss_opt_t *opt)
   }
 }
 /* check ins states covariance matrix----------------------------------------*/
-static int chkpcov(int nx, const insgnss_opt_t *opt, double *P)
+static int chkpcov(const insgnss_opt_t *opt, ins_states_t *ins)
 {
   int i;
   double var = 0.0;
@@ -3422,15 +3477,15 @@ static int chkpcov(int nx, const insgnss_opt_t *opt, double *P)
   // }
 
   for (i = xiP(); i < xiP() + 3; i++){
-    var += SQRT(P[i + i * nx]);
+    var += SQRT(insvar(opt, ins, i));
   }
 
   printf("checkpcov: var summation: %lf\n", var);
 
   if ((var / 3) > 100){
-    if (P){
+    if (ins->P){
       printf("checkpcov: ok\n");
-      getP0(opt, P, nx);
+      resetP(opt, ins->P, ins->nx);
     }
   }
 
@@ -3589,7 +3644,7 @@ static void udtrop_ppp(rtk_t *rtk, int nx, ins_states_t *ins)
     }
     else {
       printf("If state is not zero: \n");
-        ins->P[i+i*nx]+=SQR(rtk->opt.prn[2])*fabs(rtk->tt);
+        insaddvar(ins,i,SQR(rtk->opt.prn[2])*fabs(rtk->tt));
         
         if (rtk->opt.tropopt>=TROPOPT_ESTG) {
             for (j=i+1;j<i+3;j++) {
@@ -3676,7 +3731,7 @@ static void udbias_ppp(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav, i
             sat=obs[i].sat;
             j=xiBs(&rtk->opt,sat);
             
-            ins->P[j+j*nx]+=SQR(rtk->opt.prn[0])*fabs(rtk->tt);
+            insaddvar(ins,j,SQR(rtk->opt.prn[0])*fabs(rtk->tt));
             
             if (bias[i]==0.0||(ins->x[j]!=0.0&&!slip[i])) continue;
             
@@ -3711,16 +3766,16 @@ static void udstate_ppp(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav,
     udbias_ppp(rtk,obs,n,nav, nx, ins);
 }
 /* exclude meas of eclipsing satellite (block IIA) ---------------------------*/
-static void testeclipse(const obsd_t *obs, int n, const nav_t *nav, double *rs)
+static void testeclipse(const obsd_t *obs, int n, const nav_t *nav, double *rs,
+                        const double *rsun)
 {
-    double rsun[3],esun[3],r,ang,erpv[5]={0},cosa;
+    double esun[3],r,ang,cosa;
     int i,j;
     const char *type;
     
     trace(3,"testeclipse:\n");
     
     /* unit vector of sun direction (ecef) */
-    sunmoonpos(gpst2utc(obs[0].time),erpv,rsun,NULL,NULL);
     normv3(rsun,esun);
     
     for (i=0;i<n;i++) {
@@ -3788,45 +3843,39 @@ static int ppp_res(int post, const obsd_t *obs, int n, const double *rs,
                    const double *dts, const double *vare, const int *svh,
                    const double *dr, int *exc, const nav_t *nav,
                    const double *x, rtk_t *rtk, double *v, double *H, double *R,
-                   double *azel,double *rpos, insgnss_opt_t *insopt,ins_states_t *insc)
+                   int *vsat, double *azel,double *rpos, insgnss_opt_t *insopt,
+                   ins_states_t *insc)
 {
   prcopt_t *opt=&rtk->opt;
-    double r,rr[3],disp[3],pos[3],e[3],meas[2],dtdx[3],dantr[NFREQ]={0};
-    double dants[NFREQ]={0},var[MAXOBS*2],dtrp=0.0,vart=0.0,varm[2]={0};
-    int i,j,k,sat,sys,nv=0,nx=insc->nx,brk,tideopt;
+    double r,rr[3],pos[3],meas[2],dtdx[3],*dantr,*dants;
+    double var[MAXOBS*2],dtrp=0.0,vart=0.0,varm[2]={0};
+    const double *e;
+    int i,j,k,sat,sys,nv=0,nx=insc->nx,brk;
 
     printf("res_ppp : n=%d nx=%d\n",n,nx);
 
     for (i=0;i<MAXSAT;i++) rtk->ssat[i].vsat[0]=0;
 
-    if (insopt->Nav_or_KF){
-      for (i=0;i<3;i++) rr[i]=insc->re[i];
-    }else{
-      for (i=0;i<3;i++) rr[i]=rtk->x[i];
-      }
-    for (i=0;i<3;i++) rr[i]=insc->re[i];
-    //for (i=0;i<3;i++) rr[i]=rtk->sol.rr[i];
-
-    /* earth tides correction */
-    if (opt->tidecorr) {
-        tideopt=1; /* 1:solid, 2:solid+otl+pole */
-        tidedisp(gpst2utc(obs[0].time),rr,tideopt,&nav->erp,opt->odisp[0],
-                 disp);
-        for (i=0;i<3;i++) rr[i]+=disp[i];
+    /* tide-corrected position and receiver-satellite geometry (cached) */
+    if (!satcache_rcv(&satcache,insc->re,opt,nav,rtk->ssat)) return 0;
+    for (i=0;i<3;i++) {
+        rr[i]=satcache.rr[i];
+        pos[i]=satcache.pos[i];
     }
-    ecef2pos(rr,pos);
-
     for (i=0;i<n&&i<MAXOBS;i++) {
       sat=obs[i].sat;
 
         if (!(sys=satsys(sat,NULL))||!rtk->ssat[sat-1].vs) continue;
 
         /* geometric distance/azimuth/elevation angle */
-        if ((r=geodist(rs+i*6,rr,e))<=0.0||
-            satazel(pos,e,azel+i*2)<opt->elmin) continue;
+        if (!satcache.stat[i]) continue;
+        r=satcache.r[i];
+        e=satcache.e+i*3;
+        azel[i*2]=satcache.azel[i*2]; azel[1+i*2]=satcache.azel[1+i*2];
+        if (azel[1+i*2]<opt->elmin) continue;
 
         /* excluded satellite? */
-        if (satexclude(obs[i].sat,svh[i],opt)) continue;
+        if (exc[i]||satexclude(obs[i].sat,svh[i],opt)) continue;
 
         /* tropospheric delay correction */
         if (opt->tropopt==TROPOPT_SAAS) {
@@ -3848,17 +3897,9 @@ static int ppp_res(int post, const obsd_t *obs, int n, const double *rs,
             dtrp=prectrop(obs[i].time,pos,azel+i*2,opt,x,dtdx,&vart);
             printf("Tropo PRECTROP: %lf\n", dtrp);
         }
-        /* satellite antenna model */
-        if (opt->posopt[0]) {
-            satantpcv(rs+i*6,rr,nav->pcvs+sat-1,dants);
-        }
-        /* receiver antenna model */
-        antmodel(opt->pcvr,opt->antdel[0],azel+i*2,opt->posopt[1],dantr);
-
-        /* phase windup correction */
-        if (opt->posopt[2]) {
-            windupcorr(rtk->sol.time,rs+i*6,rr,&rtk->ssat[sat-1].phw);
-        }
+        /* satellite/receiver antenna model (phase windup updated in cache) */
+        dants=satcache.dants+i*NFREQ;
+        dantr=satcache.dantr+i*NFREQ;
         /* ionosphere and antenna phase corrected measurements */
         if (!corrmeas(obs+i,nav,pos,azel+i*2,&rtk->opt,dantr,dants,
                       rtk->ssat[sat-1].phw,meas,varm,&brk)) {
@@ -3932,7 +3973,7 @@ static int ppp_res(int post, const obsd_t *obs, int n, const double *rs,
          }
          
          if (j==0) rtk->ssat[sat-1].vsat[0]=1;
-         nv++;
+         vsat[nv++]=sat;
 
      } // Phase and code loop (j)
 
@@ -4042,15 +4083,17 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
     const prcopt_t *opt=&rtk->opt;
     double *rs,*dts,*var,*v,*H,*R,*azel,*xp,*Pp,dr[3]={0},std[3];
     double *x,*P,rr[3], *K;
+    udfac_t udp={0};
     char str[32];
-    int i,j,nv,info=0,svh[MAXOBS],exc[MAXOBS]={0},stat=SOLQ_SINGLE,tc;
+    int i,j,k,nv,info=0,svh[MAXOBS],exc[MAXOBS]={0},stat=SOLQ_SINGLE,tc;
+    int vsat[MAXOBS*2],exsat[MAXFDEEX];
     int nx=insp->nx;    
     
     time2str(obs[0].time,str,2);
     printf("pppos   : time=%s nx=%d n=%d\n",str,insp->nx,n);
     printf("pppos inputs: ins.nx=%d, rtk->nx=%d, nsat:%d time: %lf\n",insp->nx,rtk->nx, n, insp->time);
     
-    rs=mat(6,n); dts=mat(2,n); var=mat(1,n); azel=zeros(2,n);
+    azel=zeros(2,n);
     
     for (i=0;i<MAXSAT;i++) for (j=0;j<opt->nf;j++) rtk->ssat[i].fix[j]=0;
 
@@ -4059,17 +4102,14 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
 
     printf("GLonass clock: %lf\n", insp->dtr[1]);
   
-    /* satellite positions and clocks */
-    satposs(obs[0].time,obs,n,nav,rtk->opt.sateph,rs,dts,var,svh);
+    /* satellite positions and clocks (once per epoch) */
+    satcache_sat(&satcache,obs,n,nav,opt);
+    rs=satcache.rs; dts=satcache.dts; var=satcache.var;
+    for (i=0;i<n&&i<MAXOBS;i++) svh[i]=satcache.svh[i];
     
     /* exclude measurements of eclipsing satellite (block IIA) */
     if (rtk->opt.posopt[3]) {
-        testeclipse(obs,n,nav,rs);
-    }
-    /* earth tides correction */
-    if (opt->tidecorr) {
-        tidedisp(gpst2utc(obs[0].time),rtk->x,opt->tidecorr==1?1:7,&nav->erp,
-                 opt->odisp[0],dr);
+        testeclipse(obs,n,nav,rs,satcache.rsun);
     }
     nv=n*rtk->opt.nf*2;//insp->nx*2;
     xp=zeros(insp->nx,1); Pp=zeros(insp->nx,insp->nx);
@@ -4091,12 +4131,21 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
       for (i=0;i<3;i++) insp->re[i]=rtk->opt.seed[i]; /* position */
       for (i=0;i<3;i++) rtk->sol.rr[i]=rtk->opt.seed[i]; /* position */
       for (i=0;i<3;i++) rtk->sol.rr[i+3]=insp->x[xiV()+i]=0.0; /* velocity - start as static*/
-      for (i=0;i<3;i++) insp->P[(xiP()+i)+(xiP()+i)*insp->nx]=rtk->opt.seed[3]; 
-      for (i=0;i<3;i++) insp->P[(xiV()+i)+(xiV()+i)*insp->nx]=0.00125; //0.00125 *It bridged perfeclty the obstruction
+      if (insopt->udfilt) {
+        for (i=0;i<3;i++) ud_reset(insudfac(insp),xiP()+i,rtk->opt.seed[3]);
+        for (i=0;i<3;i++) ud_reset(insudfac(insp),xiV()+i,0.00125);
+      }
+      else {
+        for (i=0;i<3;i++) insp->P[(xiP()+i)+(xiP()+i)*insp->nx]=rtk->opt.seed[3]; 
+        for (i=0;i<3;i++) insp->P[(xiV()+i)+(xiV()+i)*insp->nx]=0.00125; //0.00125 *It bridged perfeclty the obstruction
+      }
       rtk->opt.seed[3]=-1;  
     }
     matcpy(xp,insp->x,nx,1);
 
+    /* covariance view of u-d factors (fde, adaptive noise) */
+    inssyncP(insopt,insp);
+
     /* ins/gnss filter iteration */
     for (i=0;i<MAX_ITER;i++) {
 
@@ -4105,14 +4154,31 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
         matcpy(Pp,insp->P,nx,nx);
 
         /* prefit residuals */
-        if (!(nv=ppp_res(0,obs,n,rs,dts,var,svh,dr,exc,nav,xp,rtk,v,H,R,azel,rr,insopt,insp))) {
+        if (!(nv=ppp_res(0,obs,n,rs,dts,var,svh,dr,exc,nav,xp,rtk,v,H,R,vsat,azel,rr,insopt,insp))) {
             trace(2,"%s ppp (%d) no valid obs data\n",str,i+1);
             break;
         }
         printf("PPP nv: %d \n", nv); 
 
-        /* measurement update of ekf states */
-        if((info=filter_adap(xp,Pp,H,v,R,nx,nv,K)) ) {
+        /* innovation fault detection and exclusion */
+        if (insopt->fde) {
+            nv=insfde_res(&insfde,xp,Pp,H,v,R,nx,nv,vsat,exsat);
+
+            for (j=0;j<MAXFDEEX&&exsat[j];j++) {
+                for (k=0;k<n&&k<MAXOBS;k++) if (obs[k].sat==exsat[j]) exc[k]=1;
+                rtk->ssat[exsat[j]-1].vsat[0]=0;
+                rtk->ssat[exsat[j]-1].rejc[0]++;
+            }
+        }
+
+        /* measurement update of ekf states (u-d: on copy of factors) */
+        if (insopt->udfilt&&ud_copy(&udp,insudfac(insp))) {
+            trace(2,"%s ppp (%d) u-d factors copy error\n",str,i+1);
+            info=0;
+            break;
+        }
+        if((info=insopt->udfilt?ud_filter(&udp,xp,H,v,R,nx,nv,K):
+                                filter_adap(xp,Pp,H,v,R,nx,nv,K)) ) {
             trace(2,"%s ppp (%d) filter error info=%d\n",str,i+1,info);
             info=0;
             break;
@@ -4140,11 +4206,12 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
         printf("\n");
 
         /* postfit residuals */
-        if (ppp_res(i+1,obs,n,rs,dts,var,svh,dr,exc,nav,xp,rtk,v,H,R,azel,rr,insopt,insp)) {
+        if (ppp_res(i+1,obs,n,rs,dts,var,svh,dr,exc,nav,xp,rtk,v,H,R,vsat,azel,rr,insopt,insp)) {
              printf("Postfit ok:\n");
             /* update state and covariance matrix */
             matcpy(insp->x,xp,nx,1);
-            matcpy(insp->P,Pp,nx,nx);
+            if (insopt->udfilt) ud_copy(&insud,&udp);
+            else matcpy(insp->P,Pp,nx,nx);
 
             stat=SOLQ_PPP;
             insopt->Nav_or_KF=1;
@@ -4313,7 +4380,7 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
     {
       for (j = 0; j < nx; j++)
       {
-        (i==j?printf("%.15lf ", insp->P[i*nx + j]):0); 
+        (i==j?printf("%.15lf ", insvar(insopt,insp,i)):0); 
       }
     }
     printf("\n");
@@ -4324,15 +4391,24 @@ extern int pppos1(rtk_t *rtk, const obsd_t *obs, ins_states_t *insp,
     }
     if (stat==SOLQ_PPP) {
       info=1; 
+        inssyncP(insopt,insp);
+
+        /* integer ambiguity resolution */
+        if ((opt->modear==ARMODE_PPPAR||opt->modear==ARMODE_PPPAR_ILS)&&
+            insamb_res(&insamb,rtk,obs,n,nav,insp,insopt)) {
+            stat=SOLQ_FIX;
+        }
         printf("ppp solution update");
         insp2antp(insp,insopt,rr);
+        inssyncP(insopt,insp);
 
         /* update solution status */
         update_stat(rtk,obs,n,stat, insp);
 
     }
-    free(rs); free(dts); free(var); free(azel);
+    free(azel);
     free(xp); free(Pp); free(v); free(H); free(R); free(K);
+    ud_free(&udp);
 
     printf("ppp solution info: %d\n",info);
     return info;
@@ -4463,7 +4539,7 @@ extern int rechkatt(ins_states_t *ins, const imuraw_t *imu)
          matmul("TN",3,1,3,1.0,C,vel,0.0,vn);
 
           printf("Solw.ve: %lf %lf %lf \n", solw[NPOS-1].rr[3],solw[NPOS-1].rr[4],solw[NPOS-1].rr[5] );
-          printf("Vn: %lf %lf %lf \n", vn[3*i+0],vn[3*i+1],vn[3*i+2]);
+          printf("Vn: %lf %lf %lf \n", vn[0],vn[1],vn[2]);
 
         
         /* check velocity whether is straight driving  */
@@ -4473,14 +4549,13 @@ extern int rechkatt(ins_states_t *ins, const imuraw_t *imu)
             return 0;
         }
         printf("straight driving by gnss\n");
-        if (!(staticInfo.static_counter>10?staticInfo.gyros[9]:staticInfo.gyros[staticInfo.static_counter])) {
+        if (motdet.turn) {
             printf("no straight driving: by accelerometers\n");
             return 0;
         }
         printf("straight driving by accel too\n");
         /* check velocity */
-        if (!(staticInfo.static_counter>10?staticInfo.vel_gnss[9]:staticInfo.vel_gnss[staticInfo.static_counter])
-            && (staticInfo.static_counter>10?staticInfo.gyros[9]:staticInfo.gyros[staticInfo.static_counter]) ) {
+        if (!motdet.stat&&!motdet.turn) {
         // if (norm(vel,3)>MAXVEL
         //     &&norm(imu->wibb0,3)<MAXGYRO) {
               printf("Velocity and gyro turn check ok\n");
@@ -4615,17 +4690,17 @@ extern int TC_INS_GNSS_core1(rtk_t *rtk, const obsd_t *obs, int n, nav_t *nav,
   {
     for (j = 0; j < insc->nx; j++)
     {
-      (i==j?printf("%lf ", insc->P[i * insc->nx + j]):0);
+      (i==j?printf("%lf ", insvar(ig_opt, insc, i)):0);
     }
   }
   printf("\n GNSS time: %lf", gnss_time);
 
   /* Checking input values  */
-  chkpcov(nx, ig_opt, insc->P);
+  chkpcov(ig_opt, insc);
 
     for (i = 0; i < insc->nx; i++)
   {
-    if (insc->P[i * insc->nx + i] < 0.0 ){
+    if (insvar(ig_opt, insc, i) < 0.0 ){
       printf("NEGATIVE VALUE AT P[%d]",i * insc->nx + i);
       //exit(0);
     }
@@ -4724,4 +4799,127 @@ extern int TC_INS_GNSS_core1(rtk_t *rtk, const obsd_t *obs, int n, nav_t *nav,
   return 1;
 
   printf("\n *****************  TC INSGNSS CORE ENDS *************************\n");
+}
+/* loosely coupled measurement update ------------------------------------------
+* update the ins error states with the gnss position/velocity solution
+* args   : rtk_t *rtk         I   rtk control/result struct (gnss solution)
+*          ins_states_t *ins  IO  ins states
+*          insgnss_opt_t *opt I   ins/gnss options
+* return : 1 (ok) or 0 (fail)
+* notes  : innovation = ins - gnss of antenna position and velocity, the
+*          design matrix is identity on the position/velocity block so the
+*          update goes through navfilter(). the velocity is used only if the
+*          gnss solution has velocity covariance (doppler)
+*-----------------------------------------------------------------------------*/
+static int lcupd(const rtk_t *rtk, ins_states_t *ins, insgnss_opt_t *opt)
+{
+    const sol_t *sol=&rtk->sol;
+    double rr[3],v[6],H[36]={0},R[36]={0},x[MAXLCX];
+    int i,j,nv,nx=ins->nx,is=xiV(),ivel;
+
+    if (nx>MAXLCX) return 0;
+
+    /* antenna position of ins */
+    insp2antp(ins,opt,rr);
+
+    ivel=sol->qrv[0]>0.0&&sol->qrv[1]>0.0&&sol->qrv[2]>0.0&&
+         norm(sol->rr+3,3)>0.0;
+    nv=ivel?6:3;
+
+    /* position */
+    for (i=0;i<3;i++) {
+        v[i]=rr[i]-sol->rr[i];
+        H[xiP()-is+i+i*6]=1.0;
+    }
+    R[0]=sol->qr[0]; R[1+nv]=sol->qr[1]; R[2+2*nv]=sol->qr[2];
+    R[1]=R[nv]=sol->qr[3]; R[2+nv]=R[1+2*nv]=sol->qr[4];
+    R[2]=R[2*nv]=sol->qr[5];
+    for (i=0;i<3;i++) if (R[i+i*nv]<=0.0) R[i+i*nv]=SQR(STD_POS);
+
+    /* velocity */
+    if (ivel) {
+        for (i=0;i<3;i++) {
+            v[3+i]=ins->ve[i]-sol->rr[3+i];
+            H[xiV()-is+i+(3+i)*6]=1.0;
+        }
+        R[3+3*nv]=sol->qrv[0]; R[4+4*nv]=sol->qrv[1]; R[5+5*nv]=sol->qrv[2];
+        R[3+4*nv]=R[4+3*nv]=sol->qrv[3];
+        R[4+5*nv]=R[5+4*nv]=sol->qrv[4];
+        R[3+5*nv]=R[5+3*nv]=sol->qrv[5];
+    }
+    if (norm(v,3)>MAXINOP||(ivel&&norm(v+3,3)>MAXINOV)) {
+        trace(2,"lcupd: innovation too large dp=%.1f dv=%.1f\n",norm(v,3),
+              ivel?norm(v+3,3):0.0);
+        return 0;
+    }
+    if (opt->udfilt?ud_navfilter(insudfac(ins),x,H,v,R,nx,nv,is,6):
+                    navfilter(x,ins->P,H,v,R,nx,nv,is,6)) {
+        trace(2,"lcupd: filter error\n");
+        return 0;
+    }
+    clp(ins,opt,x);
+    for (j=0;j<xnCl();j++) ins->x[j]=0.0;
+    return 1;
+}
+/* loosely coupled ins/gnss ----------------------------------------------------
+* ins navigation and loosely coupled integration with the gnss solution
+* args   : rtk_t *rtk         IO  rtk control/result struct
+*          obsd_t *obs        I   observation data
+*          int    n           I   number of observation data
+*          nav_t  *nav        I   navigation data
+*          ins_states_t *insc IO  ins states
+*          insgnss_opt_t *ig_opt IO ins/gnss options
+*          int    nav_or_int  I   integrate (1) or navigate only (0)
+* return : 1 (ok) or 0 (imu and gnss out of sync)
+* notes  : same propagation as TC_INS_GNSS_core1() with the xnCl() navigation
+*          error states only (no clock, troposphere or phase bias states).
+*          rtk->sol is the gnss solution of the epoch (single or ppp)
+*-----------------------------------------------------------------------------*/
+extern int LC_INS_GNSS_core1(rtk_t *rtk, const obsd_t *obs, int n, nav_t *nav,
+                             ins_states_t *insc, insgnss_opt_t *ig_opt,
+                             int nav_or_int)
+{
+  double dt, gnss_time=time2gpst(rtk->sol.time, NULL);
+
+  trace(3, "LC_INS_GNSS_core1: time=%.3f nx=%d\n", gnss_time, insc->nx);
+
+  kf_par_unc_init(ig_opt);
+  kf_noise_init(ig_opt);
+  initPNindex(&rtk->opt);
+
+  /* ins navigation */
+  Nav_equations_ECEF1(insc);
+
+  /* propagate ins states */
+  if (fabs(insc->time - insc->proptime) < 0.002) {
+    propinss(insc, ig_opt, fabs(insc->time - insc->ptctime), insc->x, insc->P);
+    insc->ptctime = insc->time;
+  }
+  chkpcov(ig_opt, insc);
+
+  ig_opt->Nav_or_KF = 0;
+
+  if (nav_or_int && obs && n > 0 && rtk->sol.stat != SOLQ_NONE) {
+    dt = gnss_time - insc->ptctime;
+
+    /* check synchronization */
+    if (fabs(dt) > 3.0) {
+      trace(2, "observation and imu sync error\n");
+      return 0;
+    }
+    propinss(insc, ig_opt, dt, insc->x, insc->P);
+
+    /* loosely coupled */
+    ig_opt->Nav_or_KF = lcupd(rtk, insc, ig_opt);
+  }
+  if (ig_opt->Nav_or_KF) {
+    insc->ptctime = insc->time;
+    rechkatt(insc, &insc->data);
+  }
+  update_ins_state_n(insc);
+
+  matmul("TN", 3, 1, 3, 1.0, insc->Cbe, insc->ve, 0.0, insc->vb);
+
+  insc->ptctime = gnss_time;
+  return 1;
 }
\ No newline at end of file
@@ -71,6 +71,7 @@ extern "C" {
 #define CORRETIME 360.0     /* correlation time for gauss-markov process */
 #define MAXROT (10.0 * D2R) /* max rotation of vehicle when velocity matching alignment */
 #define MAXSOLS 5           /* max number of solutions for reboot lc  */
+#define MAXLCX 17           /* max number of loosely coupled ekf states */
 #define MAXDIFF 10.0        /* max time difference between solution */
 #define MAXVARDIS (10.0)    /* max variance of disable estimated state */
 #define REBOOT 1            /* ins loosely coupled reboot if always update fail */
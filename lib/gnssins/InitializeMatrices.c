@@ -214,11 +214,15 @@ extern void initP(int is, int ni, int nx, double unc, double unc0, double *P0)
     }
 }
 
-/* initialize state and covariance -------------------------------------------*/
+/* initialize state and covariance (u-d factors in u-d mode) -----------------*/
 extern void tcinitx(ins_states_t *ins,double xi, double var, int i)
 {
     int j;
     ins->x[i]=xi;
+    if (insgnssopt.udfilt) {
+        ud_reset(insudfac(ins),i,var);
+        return;
+    }
     for (j=0;j<ins->nx;j++) {
         ins->P[i+j*ins->nx]=ins->P[j+i*ins->nx]=i==j?var:0.0;
     }
@@ -0,0 +1,257 @@
+/*-----------------------------------------------------------------------------
+* InsGnssAR.c : integer ambiguity resolution of tightly coupled ins/gnss
+*
+* reference :
+*    [1] M.Ge, G.Gendt, M.Rothacher, C.Shi, J.Liu, Resolution of GPS carrier-
+*        phase ambiguities in Precise Point Positioning (PPP) with daily
+*        observations, J.Geodesy, Vol.82, 389-399, 2008
+*    [2] P.J.G.Teunissen, An optimality property of the integer least-squares
+*        estimator, J.Geodesy, Vol.73, 587-593, 1999
+*
+* notes   : gps ambiguities of the ionosphere-free phase bias states of the
+*           tightly coupled ekf are single-differenced against the highest
+*           satellite. wide-lane ambiguities are rounded from averaged
+*           melbourne-wubbena combinations and the narrow-lane float
+*           ambiguities are decorrelated and searched by lambda.
+*
+*           warm start: the z-transformation of the previous epoch is kept.
+*           while the set of single-differenced ambiguities is unchanged, the
+*           reduction starts from Z'*Q*Z of that transformation, which is
+*           already nearly decorrelated, and only a few gauss transformations
+*           and permutations remain. the transformation is rebuilt from the
+*           identity when satellites enter or leave or the reference changes.
+*
+*           partial ar: the largest trailing subset of the decorrelated
+*           ambiguities whose bootstrapped success rate [2] exceeds ARSUCCMIN
+*           is searched. the trailing block of the LD factors is the
+*           factorization of the subset, so no refactorization is needed.
+*           the subset is shrunk until the ratio test passes.
+*
+*           fixed ambiguities are applied to the ekf as tight constraints and
+*           the navigation corrections are fed back by close-loop.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/13 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define MINARAMB    4           /* min number of ambiguities to fix */
+#define ARSUCCMIN   0.999       /* min bootstrapped success rate of subset */
+#define MWMINCNT    10          /* min mw averaging count for wide-lane */
+#define MWTHRES     0.25        /* max wide-lane fraction to fix (cycle) */
+#define MWGAP       30.0        /* max mw averaging gap (s) */
+#define CONST_AMB   0.001       /* constraint to fixed ambiguity (m) */
+
+/* elapsed time (s) ----------------------------------------------------------*/
+static double monotime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* update melbourne-wubbena wide-lane averages -------------------------------*/
+static void updmw(insamb_t *amb, const rtk_t *rtk, const obsd_t *obs, int n,
+                  const nav_t *nav)
+{
+    const double *lam;
+    double mw,d;
+    int i,sat;
+
+    for (i=0;i<n&&i<MAXOBS;i++) {
+        sat=obs[i].sat;
+        lam=nav->lam[sat-1];
+        if (satsys(sat,NULL)!=SYS_GPS) continue;
+        if (obs[i].L[0]==0.0||obs[i].L[1]==0.0||obs[i].P[0]==0.0||
+            obs[i].P[1]==0.0||lam[0]<=0.0||lam[1]<=0.0) continue;
+
+        /* reset average on cycle slip or data gap */
+        if ((rtk->ssat[sat-1].slip[0]|rtk->ssat[sat-1].slip[1])&3||
+            fabs(timediff(obs[i].time,amb->tmw[sat-1]))>MWGAP) {
+            amb->nmw[sat-1]=0;
+            amb->mw[sat-1]=amb->mwv[sat-1]=0.0;
+        }
+        /* wide-lane phase minus narrow-lane code (cycle) */
+        mw=obs[i].L[0]-obs[i].L[1]-(obs[i].P[0]/lam[0]+obs[i].P[1]/lam[1])*
+           (1.0/lam[0]-1.0/lam[1])/(1.0/lam[0]+1.0/lam[1]);
+
+        d=mw-amb->mw[sat-1];
+        amb->nmw[sat-1]++;
+        amb->mw[sat-1]+=d/amb->nmw[sat-1];
+        amb->mwv[sat-1]+=d*(mw-amb->mw[sat-1]);
+        amb->tmw[sat-1]=obs[i].time;
+    }
+}
+/* bootstrapped success rate of trailing subset ------------------------------*/
+static double succrate(const double *D, int n, int p)
+{
+    double ps=1.0;
+    int i;
+
+    for (i=n-p;i<n;i++) ps*=erf(1.0/(2.0*sqrt(2.0*D[i])));
+    return ps;
+}
+/* initialize ambiguity resolution ---------------------------------------------
+* args   : insamb_t *amb    O   ambiguity resolution state
+* return : none
+* notes  : warm start is enabled, amb->warm=0 forces cold starts
+*-----------------------------------------------------------------------------*/
+extern void insamb_init(insamb_t *amb)
+{
+    memset(amb,0,sizeof(insamb_t));
+    amb->warm=1;
+}
+/* resolve ambiguities of tightly coupled ekf ----------------------------------
+* args   : insamb_t *amb    IO  ambiguity resolution state
+*          rtk_t  *rtk      IO  rtk control/result struct
+*          obsd_t *obs      I   observation data
+*          int    n         I   number of observation data
+*          nav_t  *nav      I   navigation data
+*          ins_states_t *ins IO ins states (ekf states and covariance)
+*          insgnss_opt_t *opt I ins/gnss options
+* return : number of fixed ambiguities (0:no fix)
+* notes  : call after the float measurement update of the epoch, ssat vsat,
+*          lock and satcache geometry of the epoch are used. in u-d mode
+*          (opt->udfilt) ins->P has to be the current view (inssyncP()), the
+*          fixed ambiguity constraints update the u-d factors
+*-----------------------------------------------------------------------------*/
+extern int insamb_res(insamb_t *amb, rtk_t *rtk, const obsd_t *obs, int n,
+                      const nav_t *nav, ins_states_t *ins,
+                      const insgnss_opt_t *opt)
+{
+    const prcopt_t *popt=&rtk->opt;
+    const double *lam;
+    double el[MAXARAMB+1],nw[MAXARAMB],a[MAXARAMB],Q[MAXARAMB*MAXARAMB];
+    double L[MAXARAMB*MAXARAMB],D[MAXARAMB],z[MAXARAMB],Lp[MAXARAMB*MAXARAMB];
+    double E[MAXARAMB*2],s[2],lamnl,c2,bw,t0,*xa,*H,*v,*R;
+    int i,j,k,p,sat,rsat,na=0,nc=0,ref=-1,jr,ix[MAXARAMB],cand[MAXARAMB+1];
+    int nx=ins->nx,warm,info;
+
+    amb->nep++;
+    updmw(amb,rtk,obs,n,nav);
+
+    /* candidate satellites: gps, valid phase, locked, averaged mw */
+    for (i=0;i<n&&i<MAXOBS&&nc<=MAXARAMB;i++) {
+        sat=obs[i].sat;
+        if (satsys(sat,NULL)!=SYS_GPS||!rtk->ssat[sat-1].vsat[0]) continue;
+        if (rtk->ssat[sat-1].lock[0]<popt->minlock) continue;
+        if (amb->nmw[sat-1]<MWMINCNT) continue;
+        if (satcache.sat[i]!=sat||!satcache.stat[i]) continue;
+        if ((el[nc]=satcache.azel[1+i*2])<popt->elmaskar) continue;
+        j=xiBs(popt,sat);
+        if (ins->x[j]==0.0||ins->P[j+j*nx]<=0.0) continue;
+        if (ref<0||el[nc]>el[ref]) ref=nc;
+        cand[nc++]=sat;
+    }
+    if (nc<MINARAMB+1) {
+        amb->na=0;
+        return 0;
+    }
+    rsat=cand[ref];
+    jr=xiBs(popt,rsat);
+    lam=nav->lam[rsat-1];
+    lamnl=lam[0]*lam[1]/(lam[0]+lam[1]);
+    c2=-SQR(lam[0])/(SQR(lam[1])-SQR(lam[0]));
+
+    /* wide-lane fix and narrow-lane float ambiguities */
+    for (i=0;i<nc;i++) {
+        if (i==ref) continue;
+        sat=cand[i];
+        bw=amb->mw[sat-1]-amb->mw[rsat-1]+nav->wlbias[sat-1]-
+           nav->wlbias[rsat-1];
+        nw[na]=ROUND(bw);
+        if (fabs(bw-nw[na])>MWTHRES) continue;
+        ix[na]=xiBs(popt,sat);
+        a[na]=(ins->x[ix[na]]-ins->x[jr]+c2*lam[1]*nw[na])/lamnl;
+        cand[na++]=sat; /* na<=i, compacts candidates */
+    }
+    for (i=0;i<na;i++) for (j=0;j<na;j++) {
+        Q[i+j*na]=(ins->P[ix[i]+ix[j]*nx]-ins->P[ix[i]+jr*nx]-
+                   ins->P[jr+ix[j]*nx]+ins->P[jr+jr*nx])/SQR(lamnl);
+    }
+    if (na<MINARAMB) {
+        amb->na=0;
+        return 0;
+    }
+    /* warm start if ambiguity set is unchanged */
+    warm=amb->warm&&amb->na==na&&amb->ref==jr;
+    for (i=0;warm&&i<na;i++) if (amb->sat[i]!=cand[i]) warm=0;
+    if (warm) amb->nwarm++;
+    else {
+        amb->ncold++;
+        for (i=0;i<na;i++) for (j=0;j<na;j++) amb->Z[i+j*na]=i==j?1.0:0.0;
+    }
+    t0=monotime();
+    info=lambda_reduct(na,Q,amb->Z,L,D);
+    amb->tred+=monotime()-t0;
+    if (info) {
+        amb->na=0;
+        return 0;
+    }
+    amb->na=na;
+    amb->ref=jr;
+    for (i=0;i<na;i++) amb->sat[i]=cand[i];
+
+    matmul("TN",na,1,na,1.0,amb->Z,a,0.0,z); /* z=Z'*a */
+
+    /* largest trailing subset with enough success rate */
+    for (p=MINARAMB;p<na&&succrate(D,na,p+1)>=ARSUCCMIN;p++) ;
+    if (succrate(D,na,p)<ARSUCCMIN) return 0;
+
+    /* search subsets until ratio test passes */
+    t0=monotime();
+    for (;p>=MINARAMB;p--) {
+        k=na-p;
+        for (i=0;i<p;i++) for (j=0;j<p;j++) Lp[i+j*p]=L[k+i+(k+j)*na];
+        if (lambda_search(p,2,Lp,D+k,z+k,E,s)) continue;
+        if (s[0]<=0.0||s[1]/s[0]>=popt->thresar[0]) break;
+    }
+    amb->tsrch+=monotime()-t0;
+    if (p<MINARAMB) return 0;
+
+    rtk->sol.ratio=(float)MIN(s[0]>0.0?s[1]/s[0]:999.9,999.9);
+
+    trace(3,"insamb_res: na=%d fix=%d ratio=%.1f warm=%d\n",na,p,
+          rtk->sol.ratio,warm);
+
+    /* constraints of fixed decorrelated ambiguities */
+    xa=mat(nx,1); H=zeros(nx,p); v=mat(p,1); R=zeros(p,p);
+    matcpy(xa,ins->x,nx,1);
+    for (i=0;i<xnCl();i++) xa[i]=1E-20;
+
+    for (j=0;j<p;j++) {
+        k=na-p+j;
+        for (i=0;i<na;i++) {
+            H[ix[i]+j*nx]+=amb->Z[i+k*na]/lamnl;
+            H[jr   +j*nx]-=amb->Z[i+k*na]/lamnl;
+        }
+        v[j]=E[j]-z[k];
+        R[j+j*p]=SQR(CONST_AMB/lamnl);
+    }
+    if ((info=opt->udfilt?ud_filter(insudfac(ins),xa,H,v,R,nx,p,NULL):
+                          filter(xa,ins->P,H,v,R,nx,p))) {
+        trace(2,"insamb_res: filter error info=%d\n",info);
+        p=0;
+    }
+    else {
+        matcpy(ins->x,xa,nx,1);
+        clp(ins,opt,xa);
+        for (i=0;i<na;i++) rtk->ssat[cand[i]-1].fix[0]=2;
+        amb->nfix++;
+        amb->namb+=p;
+    }
+    free(xa); free(H); free(v); free(R);
+    return p;
+}
@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------
+* InsGnssFDE.c : innovation fault detection and exclusion of tightly coupled
+*                ins/gnss
+*
+* reference :
+*    [1] W.Baarda, A testing procedure for use in geodetic networks,
+*        Netherlands Geodetic Commission, Publications on Geodesy 2(5), 1968
+*    [2] P.J.G.Teunissen, Quality control in integrated navigation systems,
+*        IEEE Aerospace and Electronic Systems Magazine 5(7), 35-41, 1990
+*
+* notes   : the innovation covariance S=H'*P*H+R of the prefit residuals of
+*           the epoch is formed and inverted once. the overall model test
+*           v'*S^-1*v is checked by chi-square and the observation with the
+*           largest w-test statistic w=(S^-1*v)(i)/sqrt(S^-1(i,i)) [1][2] is
+*           identified as faulty. all the observations of the satellite are
+*           excluded.
+*
+*           the exclusion is applied to the inverse by the downdate of the
+*           partitioned inverse, with the rows b of the satellite and the
+*           rows a left
+*
+*             S(a,a)^-1 = Si(a,a)-Si(a,b)*Si(b,b)^-1*Si(b,a)
+*
+*           and to S^-1*v and v'*S^-1*v the same way, so only a 1x1 or 2x2
+*           inverse is needed per excluded satellite and the residuals,
+*           design matrix and S are not rebuilt. the tests are repeated until
+*           the overall model test passes.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/16 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define MINFDESAT   5           /* min number of satellites left */
+#define WTEST       3.29        /* critical value of w-test (alpha=0.001) */
+#define ZCHISQ      3.09        /* normal quantile of chi-square (alpha=0.001) */
+
+/* elapsed time (s) ----------------------------------------------------------*/
+static double monotime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* chi-square critical value (alpha=0.001) -----------------------------------*/
+static double chisqthres(int n)
+{
+    double a;
+
+    if (n<=0) return 0.0;
+    if (n<=100) return chisqr[n-1];
+
+    /* wilson-hilferty approximation */
+    a=2.0/(9.0*n);
+    return n*pow(1.0-a+ZCHISQ*sqrt(a),3.0);
+}
+/* number of satellites of active innovations --------------------------------*/
+static int nactsat(const int *sat, const int *act, int nv)
+{
+    int i,j,ns=0;
+
+    for (i=0;i<nv;i++) {
+        if (!act[i]) continue;
+        for (j=0;j<i;j++) if (act[j]&&sat[j]==sat[i]) break;
+        if (j==i) ns++;
+    }
+    return ns;
+}
+/* exclude satellite by downdate of inverse innovation covariance ------------*/
+static int downdate(double *Si, double *g, double *vv, int *act,
+                    const int *sat, int nv, int s)
+{
+    double Sbb[4],gb[2],t[2];
+    int i,j,k,l,nb=0,ib[2];
+
+    for (i=0;i<nv&&nb<2;i++) if (act[i]&&sat[i]==s) ib[nb++]=i;
+    if (nb<=0) return 0;
+
+    for (k=0;k<nb;k++) {
+        gb[k]=g[ib[k]];
+        for (l=0;l<nb;l++) Sbb[k+l*nb]=Si[ib[k]+ib[l]*nv];
+    }
+    if (matinv(Sbb,nb)) return 0;
+
+    for (k=0;k<nb;k++) act[ib[k]]=0;
+
+    /* v'*S^-1*v and S^-1*v of rows left */
+    for (k=0;k<nb;k++) for (l=0;l<nb;l++) *vv-=gb[k]*Sbb[k+l*nb]*gb[l];
+
+    for (i=0;i<nv;i++) {
+        if (!act[i]) continue;
+        for (k=0;k<nb;k++) {
+            for (l=0,t[k]=0.0;l<nb;l++) t[k]+=Si[i+ib[l]*nv]*Sbb[l+k*nb];
+        }
+        for (k=0;k<nb;k++) g[i]-=t[k]*gb[k];
+
+        for (j=0;j<=i;j++) {
+            if (!act[j]) continue;
+            for (k=0;k<nb;k++) Si[i+j*nv]-=t[k]*Si[ib[k]+j*nv];
+            Si[j+i*nv]=Si[i+j*nv];
+        }
+    }
+    return nb;
+}
+/* innovation fault detection and exclusion ------------------------------------
+* args   : insfde_t *fde    IO  fde statistics
+*          double *x        I   ekf states (nx x 1)
+*          double *P        I   ekf covariance (nx x nx)
+*          double *H        IO  transpose of design matrix (nx x nv)
+*          double *v        IO  innovations (nv x 1)
+*          double *R        IO  covariance of measurement error (nv x nv)
+*          int    nx        I   number of states
+*          int    nv        I   number of innovations
+*          int    *sat      IO  satellite number of innovations (nv x 1)
+*          int    *exsat    O   excluded satellites (MAXFDEEX x 1, 0: none)
+* return : number of innovations left
+* notes  : states are selected as filter() (x!=0 and P>0). the innovations of
+*          excluded satellites are removed from H, v, R and sat
+*-----------------------------------------------------------------------------*/
+extern int insfde_res(insfde_t *fde, const double *x, const double *P, double *H,
+                      double *v, double *R, int nx, int nv, int *sat, int *exsat)
+{
+    double *Si,*F,*g,vv,w,wmax,t0=monotime();
+    int i,j,k,m,*ix,*act,imax,nex=0;
+
+    for (i=0;i<MAXFDEEX;i++) exsat[i]=0;
+    if (nv<=0) return 0;
+
+    fde->nep++;
+
+    ix=imat(nx+nv,1); act=imat(nv,1);
+    Si=mat(nv,nv); F=mat(nx,nv); g=mat(nv,1);
+
+    /* innovation covariance S=H'*P*H+R of selected states */
+    for (i=m=0;i<nx;i++) if (x[i]!=0.0&&P[i+i*nx]>0.0) ix[m++]=i;
+    for (j=0;j<nv;j++) for (i=0;i<m;i++) {
+        for (k=0,F[i+j*nx]=0.0;k<m;k++) {
+            F[i+j*nx]+=P[ix[i]+ix[k]*nx]*H[ix[k]+j*nx];
+        }
+    }
+    for (i=0;i<nv;i++) for (j=0;j<=i;j++) {
+        for (k=0,w=R[i+j*nv];k<m;k++) w+=H[ix[k]+i*nx]*F[k+j*nx];
+        Si[i+j*nv]=Si[j+i*nv]=w;
+    }
+    if (matinv(Si,nv)) {
+        trace(2,"insfde: innovation covariance not invertible nv=%d\n",nv);
+        free(ix); free(act); free(Si); free(F); free(g);
+        fde->t+=monotime()-t0;
+        return nv;
+    }
+    matmul("NN",nv,1,nv,1.0,Si,v,0.0,g); /* g=S^-1*v */
+    for (i=0,vv=0.0;i<nv;i++) {
+        vv+=v[i]*g[i];
+        act[i]=1;
+    }
+    for (k=nv;nex<MAXFDEEX;) {
+
+        /* overall model test */
+        if (vv<=chisqthres(k)) break;
+        if (!nex) fde->ndet++;
+
+        /* w-test */
+        for (i=0,imax=-1,wmax=0.0;i<nv;i++) {
+            if (!act[i]||Si[i+i*nv]<=0.0) continue;
+            if ((w=fabs(g[i])/sqrt(Si[i+i*nv]))>wmax) {
+                wmax=w;
+                imax=i;
+            }
+        }
+        if (imax<0||wmax<WTEST) {
+            trace(2,"insfde: fault not identified vv=%.1f wmax=%.2f\n",vv,wmax);
+            break;
+        }
+        if (nactsat(sat,act,nv)<=MINFDESAT) {
+            trace(2,"insfde: lack of satellites to exclude sat=%2d\n",sat[imax]);
+            break;
+        }
+        trace(2,"insfde: sat=%2d excluded vv=%.1f w=%.2f\n",sat[imax],vv,wmax);
+
+        exsat[nex++]=sat[imax];
+        fde->nexs[sat[imax]-1]++;
+        fde->nexc++;
+        k-=downdate(Si,g,&vv,act,sat,nv,sat[imax]);
+    }
+    /* remove innovations of excluded satellites */
+    if (nex) {
+        for (i=m=0;i<nv;i++) {
+            if (!act[i]) continue;
+            v[m]=v[i];
+            sat[m]=sat[i];
+            for (j=0;j<nx;j++) H[j+m*nx]=H[j+i*nx];
+            ix[m++]=i;
+        }
+        for (j=0;j<m;j++) for (i=0;i<m;i++) Si[i+j*m]=R[ix[i]+ix[j]*nv];
+        matcpy(R,Si,m,m);
+        nv=m;
+    }
+    free(ix); free(act); free(Si); free(F); free(g);
+    fde->t+=monotime()-t0;
+    return nv;
+}
@@ -77,5 +77,5 @@ extern int xiTr(const prcopt_t* opt)
 /* get index of phase bias (s:satno,f:freq)----------------------------------*/
 extern int xiBs(const prcopt_t* opt,int s)
 {
-    return xiTr(opt)+s;
+    return xiTr(opt)+xnT(opt)+s-1;
 }
\ No newline at end of file
@@ -0,0 +1,495 @@
+/*-----------------------------------------------------------------------------
+* InsGnssSim.c : ins/gnss trajectory and sensor simulator
+*
+* reference :
+*    [1] P.D.Groves, Principles of GNSS, Inertial, and Multisensor Integrated
+*        Navigation Systems, 2nd ed., 2013 (5.54 kinematics in local
+*        navigation frame)
+*
+* notes   : the vehicle trajectory is either parametric (stationary, circle,
+*           figure-eight with an initial stationary period and a constant
+*           acceleration to cruise speed) or a natural cubic spline through
+*           the positions of a reference solution (e.g. reference.pos), so
+*           position, velocity and acceleration are continuous.
+*
+*           error-free specific force and angular rate are computed from the
+*           trajectory kinematics in ned-frame. the vehicle is kept level
+*           (roll=pitch=0) and the heading follows the velocity.
+*
+*           code/phase observations use satellite positions/clocks from
+*           satpos() with the real broadcast or precise products, sagnac
+*           corrected geometric range, saastamoinen troposphere, klobuchar
+*           ionosphere, constant integer ambiguities and elevation dependent
+*           white noise.
+*
+*           all functions are reentrant (no static states), the random
+*           number generator state is given by the caller so generation can
+*           be split into independent time chunks.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/11 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define SIM_MINSPD  0.5         /* min horizontal speed to follow heading (m/s) */
+#define SIM_ACC     1.0         /* default acceleration to cruise speed (m/s^2) */
+#define SIM_MAXAMB  1048576     /* max magnitude of simulated ambiguities (cyc) */
+
+/* simulated signals {code,frequency index} for each frequency ---------------*/
+static const int simsig[][3][2]={
+    {{CODE_L1C,0},{CODE_L2W,1},{CODE_L5Q,2}}, /* gps */
+    {{CODE_L1C,0},{CODE_L2P,1},{0,0}},        /* glonass */
+    {{CODE_L1C,0},{CODE_L5Q,2},{0,0}},        /* galileo */
+    {{CODE_L1C,0},{CODE_L2L,1},{CODE_L5Q,2}}  /* qzss */
+};
+/* system index of simulated signals (-1: not simulated) ---------------------*/
+static int sigsys(int sys)
+{
+    switch (sys) {
+        case SYS_GPS: return 0;
+        case SYS_GLO: return 1;
+        case SYS_GAL: return 2;
+        case SYS_QZS: return 3;
+    }
+    return -1;
+}
+/* splitmix64 ----------------------------------------------------------------*/
+static uint64_t splitmix(uint64_t x)
+{
+    x+=0x9E3779B97F4A7C15ULL;
+    x=(x^(x>>30))*0xBF58476D1CE4E5B9ULL;
+    x=(x^(x>>27))*0x94D049BB133111EBULL;
+    return x^(x>>31);
+}
+/* uniform random number in (0,1) (xorshift64*) ------------------------------*/
+static double randu(unsigned long long *rng)
+{
+    uint64_t x=*rng;
+
+    x^=x>>12; x^=x<<25; x^=x>>27;
+    *rng=x;
+    return ((x*0x2545F4914F6CDD1DULL)>>11)*(1.0/9007199254740992.0)+
+           0.5/9007199254740992.0;
+}
+/* seed random number generator ------------------------------------------------
+* args   : unsigned long long *rng  O  generator state
+*          unsigned long long seed  I  user seed
+*          unsigned long long stream I stream id (e.g. time chunk index)
+* return : none
+* notes  : streams of the same seed are independent and reproducible, so the
+*          output does not depend on how chunks are assigned to threads
+*-----------------------------------------------------------------------------*/
+extern void sim_seed(unsigned long long *rng, unsigned long long seed,
+                     unsigned long long stream)
+{
+    *rng=splitmix(splitmix(seed)^splitmix(~stream));
+    if (!*rng) *rng=0x9E3779B97F4A7C15ULL;
+}
+/* standard normal random number -----------------------------------------------
+* args   : unsigned long long *rng  IO generator state
+* return : random number N(0,1)
+*-----------------------------------------------------------------------------*/
+extern double sim_randn(unsigned long long *rng)
+{
+    double u1=randu(rng),u2=randu(rng);
+    return sqrt(-2.0*log(u1))*cos(2.0*PI*u2);
+}
+/* meridian and transverse radii of curvature --------------------------------*/
+static void radii(double lat, double *rm, double *rn)
+{
+    double e2=FE_WGS84*(2.0-FE_WGS84),s2=SQR(sin(lat));
+
+    *rn=RE_WGS84/sqrt(1.0-e2*s2);
+    *rm=RE_WGS84*(1.0-e2)/pow(1.0-e2*s2,1.5);
+}
+/* cross product of 3d vectors -----------------------------------------------*/
+static void cross(const double *a, const double *b, double *c)
+{
+    c[0]=a[1]*b[2]-a[2]*b[1];
+    c[1]=a[2]*b[0]-a[0]*b[2];
+    c[2]=a[0]*b[1]-a[1]*b[0];
+}
+/* initialize parametric trajectory --------------------------------------------
+* args   : simtrj_t *trj    O   trajectory
+*          int    type      I   trajectory type (SIMTRJ_STATIC,CIRCLE,EIGHT)
+*          gtime_t t0       I   start time (gpst)
+*          double tspan     I   time span (s)
+*          double *pos0     I   start position {lat,lon,hgt} (rad,m)
+*          double head0     I   initial heading (rad)
+*          double speed     I   cruise speed (m/s)
+*          double radius    I   turn radius (m)
+*          double tstat     I   initial stationary time (s)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void simtrj_init(simtrj_t *trj, int type, gtime_t t0, double tspan,
+                        const double *pos0, double head0, double speed,
+                        double radius, double tstat)
+{
+    int i;
+
+    memset(trj,0,sizeof(simtrj_t));
+    trj->type=type;
+    trj->t0=t0;
+    trj->tspan=tspan;
+    for (i=0;i<3;i++) trj->pos0[i]=pos0[i];
+    trj->head0=head0;
+    trj->speed=type==SIMTRJ_STATIC?0.0:speed;
+    trj->acc=SIM_ACC;
+    trj->radius=radius>0.0?radius:100.0;
+    trj->tstat=tstat;
+}
+/* solve natural cubic spline second derivatives -----------------------------*/
+static int splinec(const double *t, const double *y, int n, int stride,
+                   double *c)
+{
+    double *u,p,sig;
+    int i;
+
+    if (!(u=(double *)malloc(sizeof(double)*n))) return 0;
+
+    c[0]=u[0]=0.0;
+    for (i=1;i<n-1;i++) {
+        sig=(t[i]-t[i-1])/(t[i+1]-t[i-1]);
+        p=sig*c[(i-1)*stride]+2.0;
+        c[i*stride]=(sig-1.0)/p;
+        u[i]=(y[(i+1)*stride]-y[i*stride])/(t[i+1]-t[i])-
+             (y[i*stride]-y[(i-1)*stride])/(t[i]-t[i-1]);
+        u[i]=(6.0*u[i]/(t[i+1]-t[i-1])-sig*u[i-1])/p;
+    }
+    c[(n-1)*stride]=0.0;
+    for (i=n-2;i>=0;i--) c[i*stride]=c[i*stride]*c[(i+1)*stride]+u[i];
+
+    free(u);
+    return 1;
+}
+/* evaluate spline offsets, velocity and acceleration ------------------------*/
+static int splineval(const simtrj_t *trj, double t, double *p, double *v,
+                     double *a)
+{
+    double h,A,B;
+    int i,j,k,m;
+
+    if (t<=trj->t[0]) {
+        for (k=0;k<3;k++) {p[k]=trj->p[k]; v[k]=a[k]=0.0;}
+        return 0;
+    }
+    if (t>=trj->t[trj->n-1]) {
+        for (k=0;k<3;k++) {p[k]=trj->p[(trj->n-1)*3+k]; v[k]=a[k]=0.0;}
+        return trj->n-1;
+    }
+    for (i=0,j=trj->n-1;j-i>1;) {
+        m=(i+j)/2;
+        if (trj->t[m]<=t) i=m; else j=m;
+    }
+    h=trj->t[j]-trj->t[i];
+    A=(trj->t[j]-t)/h; B=1.0-A;
+
+    for (k=0;k<3;k++) {
+        p[k]=A*trj->p[i*3+k]+B*trj->p[j*3+k]+
+             ((A*A*A-A)*trj->c[i*3+k]+(B*B*B-B)*trj->c[j*3+k])*h*h/6.0;
+        v[k]=(trj->p[j*3+k]-trj->p[i*3+k])/h-
+             (3.0*A*A-1.0)/6.0*h*trj->c[i*3+k]+(3.0*B*B-1.0)/6.0*h*trj->c[j*3+k];
+        a[k]=A*trj->c[i*3+k]+B*trj->c[j*3+k];
+    }
+    return i;
+}
+/* read reference trajectory ---------------------------------------------------
+* read positions of a solution file as spline trajectory
+* args   : simtrj_t *trj    IO  trajectory (type,t0,tspan,pos0,head0 set)
+*          char   *file     I   solution file (rtklib pos format, e.g.
+*                               reference.pos)
+* return : number of reference points (0: error)
+* notes  : the origin is the first position. tspan is limited to the file
+*-----------------------------------------------------------------------------*/
+extern int simtrj_readref(simtrj_t *trj, const char *file)
+{
+    solbuf_t solbuf={0};
+    char *files[1];
+    double pos[3],rm,rn,v[3],a[3],p[3];
+    int i,j,n;
+
+    trace(3,"simtrj_readref: file=%s\n",file);
+
+    files[0]=(char *)file;
+    if (!readsol(files,1,&solbuf)||solbuf.n<2) {
+        freesolbuf(&solbuf);
+        return 0;
+    }
+    n=solbuf.n;
+    trj->t=(double *)malloc(sizeof(double)*n);
+    trj->p=(double *)malloc(sizeof(double)*n*3);
+    trj->c=(double *)malloc(sizeof(double)*n*3);
+    trj->head=(double *)malloc(sizeof(double)*n);
+    if (!trj->t||!trj->p||!trj->c||!trj->head) {
+        freesolbuf(&solbuf);
+        simtrj_free(trj);
+        return 0;
+    }
+    trj->type=SIMTRJ_REF;
+    trj->t0=solbuf.data[0].time;
+    ecef2pos(solbuf.data[0].rr,trj->pos0);
+    radii(trj->pos0[0],&rm,&rn);
+
+    for (i=j=0;i<n;i++) {
+        if (j>0&&timediff(solbuf.data[i].time,trj->t0)<=trj->t[j-1]) continue;
+        ecef2pos(solbuf.data[i].rr,pos);
+        trj->t[j]=timediff(solbuf.data[i].time,trj->t0);
+        trj->p[j*3  ]=(pos[0]-trj->pos0[0])*(rm+trj->pos0[2]);
+        trj->p[j*3+1]=(pos[1]-trj->pos0[1])*(rn+trj->pos0[2])*cos(trj->pos0[0]);
+        trj->p[j*3+2]=-(pos[2]-trj->pos0[2]);
+        j++;
+    }
+    freesolbuf(&solbuf);
+    trj->n=j;
+
+    for (i=0;i<3;i++) {
+        if (!splinec(trj->t,trj->p+i,trj->n,3,trj->c+i)) {
+            simtrj_free(trj);
+            return 0;
+        }
+    }
+    /* heading held while the vehicle is stopped */
+    for (i=0,j=-1;i<trj->n;i++) {
+        splineval(trj,trj->t[i]+(i<trj->n-1?1E-6:-1E-6),p,v,a);
+        if (SQR(v[0])+SQR(v[1])>SQR(SIM_MINSPD)) {
+            trj->head[i]=atan2(v[1],v[0]);
+            if (j<0) j=i;
+        }
+        else trj->head[i]=i>0?trj->head[i-1]:trj->head0;
+    }
+    for (i=0;i<j;i++) trj->head[i]=trj->head[j];
+
+    if (trj->tspan<=0.0||trj->tspan>trj->t[trj->n-1]) {
+        trj->tspan=trj->t[trj->n-1];
+    }
+    return trj->n;
+}
+/* free trajectory -------------------------------------------------------------
+* args   : simtrj_t *trj    IO  trajectory
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void simtrj_free(simtrj_t *trj)
+{
+    free(trj->t); free(trj->p); free(trj->c); free(trj->head);
+    trj->t=trj->p=trj->c=trj->head=NULL;
+    trj->n=0;
+}
+/* parametric path length, speed and acceleration along path -----------------*/
+static void pathlen(const simtrj_t *trj, double t, double *s, double *v,
+                    double *a)
+{
+    double tr=trj->speed/trj->acc,dt=t-trj->tstat;
+
+    if (trj->speed<=0.0||dt<=0.0) {
+        *s=*v=*a=0.0;
+    }
+    else if (dt<tr) {
+        *s=0.5*trj->acc*dt*dt; *v=trj->acc*dt; *a=trj->acc;
+    }
+    else {
+        *s=0.5*trj->acc*tr*tr+trj->speed*(dt-tr); *v=trj->speed; *a=0.0;
+    }
+}
+/* parametric offsets, heading and curvature at path length ------------------*/
+static void pathpos(const simtrj_t *trj, double s, double *p, double *head,
+                    double *kappa)
+{
+    double R=trj->radius,h0=trj->head0,u;
+
+    p[0]=p[1]=p[2]=0.0;
+    *head=h0; *kappa=0.0;
+
+    if (trj->type==SIMTRJ_CIRCLE) {
+        *head=h0+s/R; *kappa=1.0/R;
+        p[0]= R*(sin(*head)-sin(h0));
+        p[1]=-R*(cos(*head)-cos(h0));
+    }
+    else if (trj->type==SIMTRJ_EIGHT) {
+        u=fmod(s,4.0*PI*R);
+        if (u<2.0*PI*R) { /* right loop */
+            *head=h0+u/R; *kappa=1.0/R;
+            p[0]= R*(sin(*head)-sin(h0));
+            p[1]=-R*(cos(*head)-cos(h0));
+        }
+        else { /* left loop */
+            *head=h0-(u-2.0*PI*R)/R; *kappa=-1.0/R;
+            p[0]=-R*(sin(*head)-sin(h0));
+            p[1]= R*(cos(*head)-cos(h0));
+        }
+    }
+}
+/* trajectory state at time ----------------------------------------------------
+* args   : simtrj_t *trj    I   trajectory
+*          double t         I   time from trj->t0 (s)
+*          simpva_t *pva    O   vehicle state
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void simtrj_pva(const simtrj_t *trj, double t, simpva_t *pva)
+{
+    double p[3],v[3],a[3],s,spd,acc,head,kappa,rm0,rn0,rm,rn,sm,sn,vh2;
+    int i;
+
+    memset(pva,0,sizeof(simpva_t));
+
+    if (trj->type==SIMTRJ_REF) {
+        i=splineval(trj,t,p,v,a);
+        vh2=SQR(v[0])+SQR(v[1]);
+        if (vh2>SQR(SIM_MINSPD)) {
+            head=atan2(v[1],v[0]);
+            pva->wnb[2]=(v[0]*a[1]-v[1]*a[0])/vh2;
+        }
+        else head=trj->head[i];
+    }
+    else {
+        pathlen(trj,t,&s,&spd,&acc);
+        pathpos(trj,s,p,&head,&kappa);
+        v[0]=spd*cos(head); v[1]=spd*sin(head); v[2]=0.0;
+        a[0]=acc*cos(head)-spd*spd*kappa*sin(head);
+        a[1]=acc*sin(head)+spd*spd*kappa*cos(head);
+        a[2]=0.0;
+        pva->wnb[2]=spd*kappa;
+    }
+    pva->rpy[2]=atan2(sin(head),cos(head));
+
+    /* offsets to geodetic position, velocity scaled to local radii */
+    radii(trj->pos0[0],&rm0,&rn0);
+    pva->pos[0]=trj->pos0[0]+p[0]/(rm0+trj->pos0[2]);
+    pva->pos[1]=trj->pos0[1]+p[1]/((rn0+trj->pos0[2])*cos(trj->pos0[0]));
+    pva->pos[2]=trj->pos0[2]-p[2];
+
+    radii(pva->pos[0],&rm,&rn);
+    sm=(rm+pva->pos[2])/(rm0+trj->pos0[2]);
+    sn=(rn+pva->pos[2])*cos(pva->pos[0])/((rn0+trj->pos0[2])*cos(trj->pos0[0]));
+    pva->vn[0]=v[0]*sm; pva->an[0]=a[0]*sm;
+    pva->vn[1]=v[1]*sn; pva->an[1]=a[1]*sn;
+    pva->vn[2]=v[2];    pva->an[2]=a[2];
+}
+/* error-free imu measurements -------------------------------------------------
+* compute specific force and angular rate of the vehicle state [1] (5.54)
+* args   : simpva_t *pva    I   vehicle state
+*          double *fb       O   specific force in body-frame (m/s^2)
+*          double *wb       O   angular rate w.r.t. inertial frame in
+*                               body-frame (rad/s)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void simimu(const simpva_t *pva, double *fb, double *wb)
+{
+    double Cnb[9],Cne[9],re[3],ge[3],gn[3],wie[3],wen[3],w[3],wv[3],fn[3],wn[3];
+    double rm,rn,lat=pva->pos[0],h=pva->pos[2];
+    int i;
+
+    radii(lat,&rm,&rn);
+    rpy2dcm(pva->rpy,Cnb);
+
+    wie[0]= OMGE*cos(lat); wie[1]=0.0; wie[2]=-OMGE*sin(lat);
+    wen[0]= pva->vn[1]/(rn+h);
+    wen[1]=-pva->vn[0]/(rm+h);
+    wen[2]=-pva->vn[1]*tan(lat)/(rn+h);
+
+    /* gravity in ned-frame */
+    pos2ecef(pva->pos,re);
+    Gravity_ECEF(re,ge);
+    ned2xyz(pva->pos,Cne);
+    matmul("TN",3,1,3,1.0,Cne,ge,0.0,gn);
+
+    for (i=0;i<3;i++) w[i]=2.0*wie[i]+wen[i];
+    cross(w,pva->vn,wv);
+    for (i=0;i<3;i++) fn[i]=pva->an[i]+wv[i]-gn[i];
+    matmul("NN",3,1,3,1.0,Cnb,fn,0.0,fb);
+
+    for (i=0;i<3;i++) wn[i]=wie[i]+wen[i];
+    matmul("NN",3,1,3,1.0,Cnb,wn,0.0,wb);
+    for (i=0;i<3;i++) wb[i]+=pva->wnb[i];
+}
+/* simulated integer ambiguity of satellite and frequency --------------------*/
+static double simamb(unsigned long long seed, int sat, int f)
+{
+    uint64_t x=splitmix(seed^((uint64_t)sat<<8|(uint64_t)f));
+    return (double)((int64_t)(x%(2*SIM_MAXAMB+1))-SIM_MAXAMB);
+}
+/* simulate gnss observations --------------------------------------------------
+* simulate code and carrier-phase observations of all visible satellites
+* args   : gtime_t time     I   epoch time (receiver clock, gpst)
+*          double *rr       I   antenna position at signal reception (ecef)
+*          double dtr       I   receiver clock bias (s)
+*          nav_t  *nav      I   navigation data (brdc and/or precise)
+*          prcopt_t *opt    I   options (navsys,nf,sateph,elmin,err,eratio,
+*                               exsats)
+*          unsigned long long seed I seed of ambiguities
+*          unsigned long long *rng IO random number generator state
+*          obsd_t *obs      O   observation data (MAXOBS)
+* return : number of observation data
+* notes  : code noise std is eratio[f]*(err[1]+err[2]/sin(el)) and phase noise
+*          std is err[1]+err[2]/sin(el) (m). ambiguities are constant
+*-----------------------------------------------------------------------------*/
+extern int simobs(gtime_t time, const double *rr, double dtr, const nav_t *nav,
+                  const prcopt_t *opt, unsigned long long seed,
+                  unsigned long long *rng, obsd_t *obs)
+{
+    gtime_t tr,tt;
+    double pos[3],rs[6],dts[2],var,e[3],azel[2],r,tau,trp,ion,lam,lam1,I,sinel;
+    double sig,rho;
+    int i,j,f,sat,sys,svh,isys,nf=opt->nf>3?3:opt->nf,n=0;
+
+    tr=timeadd(time,-dtr);
+    ecef2pos(rr,pos);
+    lam1=CLIGHT/FREQ1;
+
+    for (sat=1;sat<=MAXSAT&&n<MAXOBS;sat++) {
+        sys=satsys(sat,NULL);
+        if (!(sys&opt->navsys)||opt->exsats[sat-1]==1) continue;
+        if ((isys=sigsys(sys))<0) continue;
+
+        /* satellite position and clock at signal transmission */
+        for (i=0,tau=0.075,r=0.0;i<3;i++) {
+            tt=timeadd(tr,-tau);
+            if (!satpos(tt,tt,sat,opt->sateph,nav,rs,dts,&var,&svh)||svh) {
+                r=0.0;
+                break;
+            }
+            if ((r=geodist(rs,rr,e))<=0.0) break;
+            tau=r/CLIGHT;
+        }
+        if (r<=0.0) continue;
+        if (satazel(pos,e,azel)<opt->elmin) continue;
+
+        trp=tropmodel(tr,pos,azel,REL_HUMI);
+        ion=ionmodel(tr,nav->ion_gps,pos,azel);
+        rho=r+CLIGHT*(dtr-dts[0])+trp;
+        sinel=sin(azel[1]);
+
+        memset(obs+n,0,sizeof(obsd_t));
+        obs[n].time=time;
+        obs[n].sat=sat;
+        obs[n].rcv=1;
+
+        for (f=j=0;f<nf;f++) {
+            if (!simsig[isys][f][0]) continue;
+            i=simsig[isys][f][1];
+            if ((lam=satwavelen(sat,i,nav))<=0.0) continue;
+
+            I=ion*SQR(lam/lam1);
+            sig=opt->err[1]+opt->err[2]/sinel;
+            obs[n].code[i]=(unsigned char)simsig[isys][f][0];
+            obs[n].P[i]=rho+I+opt->eratio[f]*sig*sim_randn(rng);
+            obs[n].L[i]=(rho-I+sig*sim_randn(rng))/lam+simamb(seed,sat,f);
+            obs[n].SNR[i]=(unsigned char)((35.0+15.0*sinel)*4.0);
+            j++;
+        }
+        if (j>0) n++;
+    }
+    return n;
+}
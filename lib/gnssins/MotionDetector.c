@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------
+* MotionDetector.c : incremental stationarity and turn detector
+*
+* reference :
+*    [1] B.P.Welford, Note on a Method for Calculating Corrected Sums of
+*        Squares and Products, Technometrics 4(3), 1962
+*
+* notes   : running mean and variance of the specific force norm ||f||, the
+*           angular rate norm ||w|| and the gnss speed are kept over sliding
+*           time windows. samples are stored in ring buffers and added to or
+*           removed from the statistics with welford updates, so each sample
+*           costs O(1) regardless of the window length.
+*
+*           the vehicle states use hysteresis (separate enter/leave
+*           thresholds) so the decisions do not toggle on single noisy
+*           samples:
+*
+*           static  : mean gnss speed and std of ||f|| below the enter
+*                     thresholds, left when either exceeds the leave ones
+*           turning : mean ||w|| above the enter threshold, left when it
+*                     falls below the leave threshold (straight otherwise)
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/12 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define DETMINFILL  0.5         /* min window fill ratio for decisions */
+
+/* initialize window statistics ----------------------------------------------*/
+static void initwin(winstat_t *w, double win)
+{
+    memset(w,0,sizeof(winstat_t));
+    w->win=win;
+}
+/* remove oldest sample from window statistics -------------------------------*/
+static void popwin(winstat_t *w)
+{
+    double x=w->v[w->i],mean=w->mean;
+
+    w->i=(w->i+1)%MAXDETWIN;
+    if (--w->n<=0) {
+        w->n=0; w->mean=w->m2=0.0;
+        return;
+    }
+    w->mean-=(x-mean)/w->n;
+    w->m2-=(x-mean)*(x-w->mean);
+    if (w->m2<0.0) w->m2=0.0;
+}
+/* remove samples older than window ------------------------------------------*/
+static void trimwin(winstat_t *w, double t)
+{
+    while (w->n>0&&t-w->t[w->i]>w->win) popwin(w);
+}
+/* add sample to window statistics -------------------------------------------*/
+static void addwin(winstat_t *w, double t, double x)
+{
+    double d;
+    int j;
+
+    trimwin(w,t);
+    if (w->n>=MAXDETWIN) popwin(w);
+
+    j=(w->i+w->n)%MAXDETWIN;
+    w->t[j]=t;
+    w->v[j]=x;
+    w->n++;
+    d=x-w->mean;
+    w->mean+=d/w->n;
+    w->m2+=d*(x-w->mean);
+}
+/* window covers enough time for decisions -----------------------------------*/
+static int fullwin(const winstat_t *w)
+{
+    if (w->n<2) return 0;
+    return w->t[(w->i+w->n-1)%MAXDETWIN]-w->t[w->i]>=DETMINFILL*w->win;
+}
+/* standard deviation of window samples --------------------------------------*/
+static double stdwin(const winstat_t *w)
+{
+    return w->n>1?sqrt(w->m2/(w->n-1)):0.0;
+}
+/* update vehicle states with hysteresis -------------------------------------*/
+static void updstat(motdet_t *det)
+{
+    double sf,vel,gyr;
+
+    /* static: gnss speed and specific force variation */
+    if (fullwin(&det->f)&&det->g.n>0) {
+        sf=stdwin(&det->f);
+        vel=det->g.mean;
+        if (det->stat) {
+            if (vel>det->veloff||sf>det->sfoff) det->stat=0;
+        }
+        else if (vel<det->velon&&sf<det->sfon) det->stat=1;
+    }
+    else det->stat=0;
+
+    /* turning: mean angular rate */
+    if (fullwin(&det->w)) {
+        gyr=det->w.mean;
+        if (det->turn) {
+            if (gyr<det->gyroff) det->turn=0;
+        }
+        else if (gyr>det->gyron) det->turn=1;
+    }
+}
+/* initialize motion detector --------------------------------------------------
+* args   : motdet_t *det    O   motion detector
+*          int    tact      I   imu grade (1:tactical,0:low-cost)
+* return : none
+* notes  : thresholds may be changed after initialization
+*-----------------------------------------------------------------------------*/
+extern void motdet_init(motdet_t *det, int tact)
+{
+    memset(det,0,sizeof(motdet_t));
+    initwin(&det->f,1.0);
+    initwin(&det->w,1.0);
+    initwin(&det->g,3.0);
+
+    det->velon =0.3;            /* gnss speed (m/s) */
+    det->veloff=0.519615;
+    det->sfon  =tact?0.2:1.0;   /* std of ||f|| (m/s^2) */
+    det->sfoff =tact?0.4:2.0;
+    det->gyron =10.0*D2R;       /* mean of ||w|| (rad/s) */
+    det->gyroff= 7.0*D2R;
+}
+/* input imu sample ------------------------------------------------------------
+* args   : motdet_t *det    IO  motion detector
+*          double t         I   sample time (s)
+*          double *fb       I   specific force (m/s^2)
+*          double *wb       I   angular rate (rad/s)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void motdet_imu(motdet_t *det, double t, const double *fb,
+                       const double *wb)
+{
+    addwin(&det->f,t,norm(fb,3));
+    addwin(&det->w,t,norm(wb,3));
+    trimwin(&det->g,t);
+    updstat(det);
+}
+/* input gnss speed ------------------------------------------------------------
+* args   : motdet_t *det    IO  motion detector
+*          double t         I   solution time (s)
+*          double speed     I   gnss speed (m/s)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void motdet_gnss(motdet_t *det, double t, double speed)
+{
+    addwin(&det->g,t,speed);
+    updstat(det);
+}
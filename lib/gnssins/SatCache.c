@@ -0,0 +1,178 @@
+/*-----------------------------------------------------------------------------
+* SatCache.c : per-epoch satellite state cache for ins/gnss tightly coupled
+*
+* satellite positions/clocks, sun/moon positions, tide displacement and the
+* receiver-satellite geometry (range, line-of-sight, azimuth/elevation,
+* antenna offsets and phase windup) do not change within one gnss epoch. the
+* cache is filled once per epoch and shared by every filter iteration and
+* every ins sub-epoch that touches the same observation epoch.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/04 1.0 new
+*           2019/10/20 1.1 pass cached sun/moon positions to tides and windup
+*                          count only evaluations actually made or avoided
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+/* check cached epoch matches observations ----------------------------------*/
+static int sameepoch(const satcache_t *c, const obsd_t *obs, int n)
+{
+    int i;
+
+    if (!c->satok||c->n!=n||timediff(c->time,obs[0].time)!=0.0) return 0;
+    for (i=0;i<n;i++) if (c->sat[i]!=obs[i].sat) return 0;
+    return 1;
+}
+/* reset satellite state cache -------------------------------------------------
+* args   : satcache_t *c    IO  satellite state cache
+* return : none
+* notes  : counters are kept, only the cached states are invalidated
+*-----------------------------------------------------------------------------*/
+extern void satcache_reset(satcache_t *c)
+{
+    c->satok=c->rcvok=0;
+    c->n=0;
+}
+/* fill satellite-side states of an epoch --------------------------------------
+* compute satellite positions/clocks and sun/moon positions once per epoch
+* args   : satcache_t *c    IO  satellite state cache
+*          obsd_t *obs      I   observation data of the epoch
+*          int    n         I   number of observation data
+*          nav_t  *nav      I   navigation data
+*          prcopt_t *opt    I   processing options
+* return : none
+* notes  : a second call for the same epoch is a cache hit and counted as an
+*          avoided satposs() evaluation
+*-----------------------------------------------------------------------------*/
+extern void satcache_sat(satcache_t *c, const obsd_t *obs, int n,
+                         const nav_t *nav, const prcopt_t *opt)
+{
+    double erpv[5]={0};
+    int i;
+
+    if (n>MAXOBS) n=MAXOBS;
+
+    if (sameepoch(c,obs,n)) {
+        c->nhit_sat++;
+        return;
+    }
+    trace(3,"satcache_sat: time=%s n=%d\n",time_str(obs[0].time,0),n);
+
+    c->time=obs[0].time;
+    c->n=n;
+    for (i=0;i<n;i++) c->sat[i]=obs[i].sat;
+
+    /* satellite positions and clocks */
+    satposs(obs[0].time,obs,n,nav,opt->sateph,c->rs,c->dts,c->var,c->svh);
+
+    /* sun and moon position in ecef (shared by eclipse test and tides) */
+    if (nav) geterp(&nav->erp,gpst2utc(obs[0].time),erpv);
+    sunmoonpos(gpst2utc(obs[0].time),erpv,c->rsun,c->rmoon,&c->gmst);
+
+    c->satok=1;
+    c->rcvok=0;
+    c->nsat++;
+    c->nsun++;
+}
+/* fill receiver-dependent geometry of an epoch --------------------------------
+* compute tide displacement, geometric distance, line-of-sight vector,
+* azimuth/elevation, satellite/receiver antenna offsets and phase windup for
+* all cached satellites at receiver position rr
+* args   : satcache_t *c    IO  satellite state cache (satcache_sat() first)
+*          double *rr       I   receiver position before tide correction (ecef)
+*          prcopt_t *opt    I   processing options
+*          nav_t  *nav      I   navigation data
+*          ssat_t *ssat     IO  satellite status (phase windup updated)
+* return : status (1:ok,0:no satellite states cached)
+* notes  : geometry is recomputed only if the epoch or rr changes, so the
+*          prefit/postfit residuals of every filter iteration reuse it.
+*          tides and windup use the sun/moon positions of satcache_sat()
+*-----------------------------------------------------------------------------*/
+extern int satcache_rcv(satcache_t *c, const double *rr, const prcopt_t *opt,
+                        const nav_t *nav, ssat_t *ssat)
+{
+    double disp[3]={0};
+    int i,j,sat;
+
+    if (!c->satok) return 0;
+
+    if (c->rcvok&&c->rr0[0]==rr[0]&&c->rr0[1]==rr[1]&&c->rr0[2]==rr[2]) {
+        c->nhit_geo+=c->n;
+        if (opt->tidecorr) c->nhit_tide++;
+        if (opt->posopt[2]) {
+            for (i=0;i<c->n;i++) if (c->stat[i]) c->nhit_wind++;
+        }
+        return 1;
+    }
+    trace(3,"satcache_rcv: n=%d\n",c->n);
+
+    for (i=0;i<3;i++) c->rr0[i]=c->rr[i]=rr[i];
+
+    /* earth tides correction */
+    if (opt->tidecorr) {
+        tidedisp_sunmoon(gpst2utc(c->time),rr,1,&nav->erp,opt->odisp[0],
+                         c->rsun,c->rmoon,c->gmst,disp);
+        for (i=0;i<3;i++) c->rr[i]+=disp[i];
+        c->ntide++;
+    }
+    ecef2pos(c->rr,c->pos);
+
+    for (i=0;i<c->n;i++) {
+        sat=c->sat[i];
+        c->stat[i]=0;
+        for (j=0;j<NFREQ;j++) c->dants[j+i*NFREQ]=c->dantr[j+i*NFREQ]=0.0;
+
+        /* geometric distance/azimuth/elevation angle */
+        if ((c->r[i]=geodist(c->rs+i*6,c->rr,c->e+i*3))<=0.0) continue;
+        satazel(c->pos,c->e+i*3,c->azel+i*2);
+
+        /* satellite antenna model */
+        if (opt->posopt[0]) {
+            satantpcv(c->rs+i*6,c->rr,nav->pcvs+sat-1,c->dants+i*NFREQ);
+        }
+        /* receiver antenna model */
+        antmodel(opt->pcvr,opt->antdel[0],c->azel+i*2,opt->posopt[1],
+                 c->dantr+i*NFREQ);
+
+        /* phase windup correction */
+        if (opt->posopt[2]) {
+            windupcorr_sun(c->time,c->rs+i*6,c->rr,c->rsun,&ssat[sat-1].phw);
+            c->nwind++;
+        }
+        c->stat[i]=1;
+    }
+    c->rcvok=1;
+    c->ngeo+=c->n;
+    return 1;
+}
+/* print cache counters --------------------------------------------------------
+* args   : satcache_t *c    I   satellite state cache
+*          FILE   *fp       I   output file pointer
+* return : none
+* notes  : avoided sunmoonpos() are the ones tidedisp() and windupcorr() would
+*          make, for the evaluations with the cached positions and the cache
+*          hits
+*-----------------------------------------------------------------------------*/
+extern void satcache_stat(const satcache_t *c, FILE *fp)
+{
+    fprintf(fp,"satellite state cache (computed/avoided):\n");
+    fprintf(fp,"  satposs    : %8u %8u\n",c->nsat,c->nhit_sat);
+    fprintf(fp,"  sunmoonpos : %8u %8u\n",c->nsun,
+            c->ntide+c->nhit_tide+c->nwind+c->nhit_wind);
+    fprintf(fp,"  tidedisp   : %8u %8u\n",c->ntide,c->nhit_tide);
+    fprintf(fp,"  windupcorr : %8u %8u\n",c->nwind,c->nhit_wind);
+    fprintf(fp,"  geometry   : %8u %8u\n",c->ngeo,c->nhit_geo);
+}
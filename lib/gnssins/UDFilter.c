@@ -0,0 +1,568 @@
+/*-----------------------------------------------------------------------------
+* UDFilter.c : u-d factorized (square-root) covariance propagation and update
+*
+* reference :
+*    [1] G.J.Bierman, Factorization Methods for Discrete Sequential
+*        Estimation, Academic Press, 1977
+*    [2] C.L.Thornton, G.J.Bierman, Gram-Schmidt Algorithms for Covariance
+*        Propagation, International Journal of Control 25(2), 1977
+*
+* notes   : the covariance of the ekf states is kept as P=U*D*U' with U unit
+*           upper triangular and D diagonal (>=0). the factors are the master
+*           copy of the covariance: they are factorized once from the initial
+*           (diagonal) P and then only edited at factor level, so round-off
+*           can not produce negative variances as with the dense
+*           P=(I-K*H')*P and phi*P*phi' forms. a dense P is only rebuilt on
+*           request as a read-only view (ud_toP()).
+*
+*           time update    : modified weighted gram-schmidt [2]. the rows of
+*                            phi that differ from the identity and the states
+*                            with process noise (the navigation block) are
+*                            re-triangularized only, the columns of the other
+*                            states are carried by a block product.
+*           measurement    : bierman scalar updates [1] after decorrelation
+*           update           of measurements (cholesky whitening if R is not
+*                            diagonal).
+*           state reset    : a state is decorrelated and its variance set by
+*                            dropping its row and column of U and adding its
+*                            column back to the other states by an
+*                            agee-turner rank-one update [1].
+*           process noise  : variance added to a single state by an
+*           of a state       agee-turner rank-one update [1].
+*
+*           the factors are stored as udreal_t, single precision if compiled
+*           with -DUDSINGLE. all products and sums are accumulated in double
+*           precision, only the stored factors are rounded.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/13 1.0 new
+*           2019/10/20 1.1 factors kept as master copy of the covariance,
+*                          add ud_init(),ud_reset(),ud_addvar(),ud_var(),
+*                          ud_copy(),ud_navfilter(), delete ud_fromP(),
+*                          single precision storage (-DUDSINGLE) deleted
+*           2019/10/21 1.2 single precision storage (-DUDSINGLE) restored
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+/* allocate factors ----------------------------------------------------------*/
+static int udalloc(udfac_t *ud, int n)
+{
+    udreal_t *U,*D;
+    double *w,*var;
+
+    if (n<=ud->nmax) return 1;
+
+    if (!(U=(udreal_t *)realloc(ud->U,sizeof(udreal_t)*n*n))) return 0;
+    ud->U=U;
+    if (!(D=(udreal_t *)realloc(ud->D,sizeof(udreal_t)*n))) return 0;
+    ud->D=D;
+    if (!(w=(double *)realloc(ud->w,sizeof(double)*4*n))) return 0;
+    ud->w=w;
+    if (!(var=(double *)realloc(ud->var,sizeof(double)*n))) return 0;
+    ud->var=var;
+    ud->nmax=n;
+    return 1;
+}
+/* u-d factorization of leading block of symmetric matrix (A=U*D*U') ---------*/
+static int udfact(const double *A, int lda, int n, double *U, double *D,
+                  double *b)
+{
+    double a,c;
+    int i,j,k,nneg=0;
+
+    for (j=n-1;j>=0;j--) {
+        a=A[j+j*lda];
+        for (i=0;i<j;i++) b[i]=A[i+j*lda];
+
+        for (k=j+1;k<n;k++) {
+            if ((c=U[j+k*n]*D[k])==0.0) continue;
+            a-=U[j+k*n]*c;
+            for (i=0;i<j;i++) b[i]-=U[i+k*n]*c;
+        }
+        if (a<=0.0) {
+            if (a<0.0) nneg++;
+            D[j]=0.0;
+            for (i=0;i<j;i++) U[i+j*n]=0.0;
+        }
+        else {
+            D[j]=a;
+            for (i=0;i<j;i++) U[i+j*n]=b[i]/a;
+        }
+        U[j+j*n]=1.0;
+        for (i=j+1;i<n;i++) U[i+j*n]=0.0;
+    }
+    return nneg;
+}
+/* agee-turner rank-one update (U*D*U'=U*D*U'+c*a*a') ------------------------
+* a(0..j) is destroyed, a(j+1..n-1) is assumed zero                          */
+static void udrank1(udreal_t *U, udreal_t *D, int n, double c, double *a,
+                    int j)
+{
+    double aj,d,b,beta;
+    int i;
+
+    for (;j>=0&&c>0.0;j--) {
+        if ((aj=a[j])==0.0) continue;
+        d=D[j]+c*aj*aj;
+        b=c/d;
+        beta=aj*b;
+        c=b*D[j];
+        D[j]=(udreal_t)d;
+        for (i=0;i<j;i++) {
+            a[i]-=aj*U[i+j*n];
+            U[i+j*n]=(udreal_t)(U[i+j*n]+beta*a[i]);
+        }
+    }
+}
+/* initialize u-d factors ------------------------------------------------------
+* factorize covariance of all states into u-d factors
+* args   : udfac_t *ud      IO  u-d factors
+*          double *P        I   covariance matrix (n x n)
+*          int    n         I   number of states
+* return : status (0:ok,-1:memory error or P not positive semi-definite)
+* notes  : called with the initial (diagonal) covariance and its resets only.
+*          the factors are left unchanged on error
+*-----------------------------------------------------------------------------*/
+extern int ud_init(udfac_t *ud, const double *P, int n)
+{
+    double *U,*D;
+    int i;
+
+    if (n<=0||!udalloc(ud,n)) return -1;
+
+    U=mat(n,n); D=mat(n,1);
+    if (!U||!D||udfact(P,n,n,U,D,ud->w)) {
+        free(U); free(D);
+        return -1;
+    }
+    for (i=0;i<n*n;i++) ud->U[i]=(udreal_t)U[i];
+    for (i=0;i<n;i++) ud->D[i]=(udreal_t)D[i];
+    ud->n=n;
+    ud->mod=ud->vmod=1;
+    free(U); free(D);
+    return 0;
+}
+/* copy u-d factors ------------------------------------------------------------
+* args   : udfac_t *dst     IO  u-d factors copied to
+*          udfac_t *src     I   u-d factors
+* return : status (0:ok,-1:memory error)
+*-----------------------------------------------------------------------------*/
+extern int ud_copy(udfac_t *dst, const udfac_t *src)
+{
+    if (!udalloc(dst,src->n)) return -1;
+
+    memcpy(dst->U,src->U,sizeof(udreal_t)*src->n*src->n);
+    memcpy(dst->D,src->D,sizeof(udreal_t)*src->n);
+    dst->n=src->n;
+    dst->mod=dst->vmod=1;
+    return 0;
+}
+/* covariance view of u-d factors ----------------------------------------------
+* args   : udfac_t *ud      IO  u-d factors
+*          double *P        IO  covariance matrix (n x n)
+*          int    n         I   number of states
+* return : none
+* notes  : P is rebuilt only if the factors are modified since the last call
+*          for the same P, so the readers of P pay the rebuild once
+*-----------------------------------------------------------------------------*/
+extern void ud_toP(udfac_t *ud, double *P, int n)
+{
+    const udreal_t *U=ud->U,*D=ud->D;
+    double *b=ud->w,c;
+    int i,j,k;
+
+    if (ud->n!=n||(!ud->mod&&ud->P==P)) return;
+
+    for (j=0;j<n;j++) {
+        for (i=0;i<=j;i++) b[i]=0.0;
+        for (k=j;k<n;k++) {
+            if ((c=D[k]*U[j+k*n])==0.0) continue;
+            for (i=0;i<=j;i++) b[i]+=U[i+k*n]*c;
+        }
+        for (i=0;i<=j;i++) P[i+j*n]=P[j+i*n]=b[i];
+    }
+    ud->mod=0;
+    ud->P=P;
+}
+/* variance of state -----------------------------------------------------------
+* args   : udfac_t *ud      IO  u-d factors
+*          int    i         I   state index
+* return : variance of state i (P(i,i))
+* notes  : the variances of all states are cached and recomputed only if the
+*          factors are modified, with no work for states of zero D
+*-----------------------------------------------------------------------------*/
+extern double ud_var(udfac_t *ud, int i)
+{
+    const udreal_t *U=ud->U,*D=ud->D;
+    double *var=ud->var,u;
+    int j,k,n=ud->n;
+
+    if (i<0||i>=n) return 0.0;
+
+    if (ud->vmod) {
+        for (j=0;j<n;j++) var[j]=0.0;
+        for (k=0;k<n;k++) {
+            if (D[k]<=0.0) continue;
+            var[k]+=D[k];
+            for (j=0;j<k;j++) {
+                if ((u=U[j+k*n])!=0.0) var[j]+=D[k]*u*u;
+            }
+        }
+        ud->vmod=0;
+    }
+    return var[i];
+}
+/* reset state -----------------------------------------------------------------
+* decorrelate state from the others and set its variance
+* args   : udfac_t *ud      IO  u-d factors
+*          int    i         I   state index
+*          double var       I   variance of state
+* return : none
+* notes  : same as zeroing row and column i of P and setting P(i,i)=var, the
+*          covariance of the other states is unchanged
+*-----------------------------------------------------------------------------*/
+extern void ud_reset(udfac_t *ud, int i, double var)
+{
+    udreal_t *U=ud->U;
+    double *a=ud->w;
+    int k,n=ud->n;
+
+    if (i<0||i>=n) return;
+
+    /* column of state i added back to the leading states */
+    if (ud->D[i]>0.0&&i>0) {
+        for (k=0;k<i;k++) a[k]=U[k+i*n];
+        udrank1(U,ud->D,n,ud->D[i],a,i-1);
+    }
+    for (k=0;k<i;k++) U[k+i*n]=0.0;
+    for (k=i+1;k<n;k++) U[i+k*n]=0.0;
+    ud->D[i]=(udreal_t)(var>0.0?var:0.0);
+    ud->mod=ud->vmod=1;
+}
+/* add process noise to state --------------------------------------------------
+* args   : udfac_t *ud      IO  u-d factors
+*          int    i         I   state index
+*          double q         I   variance added to state (P(i,i)+=q)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void ud_addvar(udfac_t *ud, int i, double q)
+{
+    double *a=ud->w;
+    int k;
+
+    if (q<=0.0||i<0||i>=ud->n) return;
+
+    for (k=0;k<i;k++) a[k]=0.0;
+    a[i]=1.0;
+    udrank1(ud->U,ud->D,ud->n,q,a,i);
+    ud->mod=ud->vmod=1;
+}
+/* modified weighted gram-schmidt (W*Dw*W'=U*D*U') ---------------------------*/
+static void mwgs(double *W, const double *Dw, int nb, int L, udreal_t *U,
+                 udreal_t *D, int n)
+{
+    double d,u;
+    int i,j,l;
+
+    for (j=nb-1;j>=0;j--) {
+        for (d=0.0,l=0;l<L;l++) d+=W[j+l*nb]*W[j+l*nb]*Dw[l];
+        D[j]=(udreal_t)d;
+        U[j+j*n]=1.0;
+
+        for (i=0;i<j;i++) {
+            u=0.0;
+            if (d>0.0) {
+                for (l=0;l<L;l++) u+=W[i+l*nb]*Dw[l]*W[j+l*nb];
+                u/=d;
+                for (l=0;l<L;l++) W[i+l*nb]-=u*W[j+l*nb];
+            }
+            U[i+j*n]=(udreal_t)u;
+        }
+    }
+}
+/* u-d time update -------------------------------------------------------------
+* propagate u-d factors: P=phi*(P+Q/2)*phi'+Q/2
+* args   : udfac_t *ud      IO  u-d factors
+*          double *phi      I   state transition matrix (n x n)
+*          double *Q        I   process noise covariance (n x n)
+*          int    n         I   number of states
+* return : status (0:ok,-1:error)
+* notes  : only the leading block of states whose phi rows are not identity
+*          or with process noise (nb) is re-triangularized with O(nb^3) work,
+*          the other columns cost O(nb*n^2) or O(nb*n) if phi does not couple
+*          the block to the other states.
+*-----------------------------------------------------------------------------*/
+extern int ud_predict(udfac_t *ud, const double *phi, const double *Q, int n)
+{
+    udreal_t *U=ud->U,*D=ud->D;
+    double *Ph,*W,*Dw,*Uq,*Dq,*t,u;
+    int i,j,l,r,c,nb,L,*nz;
+
+    if (ud->n!=n) return -1;
+
+    /* leading block of non-identity phi rows and process noise */
+    for (nb=0,r=n-1;r>=0&&!nb;r--) {
+        for (j=0;j<n;j++) {
+            if (phi[r+j*n]!=(r==j?1.0:0.0)||Q[r+j*n]!=0.0) {
+                nb=r+1;
+                break;
+            }
+        }
+    }
+    if (nb<=0) return 0;
+    L=3*nb;
+
+    Ph=mat(nb,n); W=mat(nb,L); Dw=mat(L,1); Uq=mat(nb,nb); Dq=mat(nb,1);
+    t=mat(nb,1); nz=imat(n,1);
+    if (!Ph||!W||!Dw||!Uq||!Dq||!t||!nz) {
+        free(Ph); free(W); free(Dw); free(Uq); free(Dq); free(t); free(nz);
+        return -1;
+    }
+    for (l=0;l<n;l++) {
+        for (nz[l]=0,i=0;i<nb;i++) {
+            Ph[i+l*nb]=phi[i+l*n];
+            if (Ph[i+l*nb]!=0.0) nz[l]=1;
+        }
+    }
+    /* process noise of block: Q11=Uq*Dq*Uq' (round-off pivots of Q to zero) */
+    udfact(Q,n,nb,Uq,Dq,t);
+
+    /* W=[phi11*U11 phi11*Uq Uq], Dw=[D1 Dq/2 Dq/2] */
+    for (c=0;c<nb;c++) {
+        for (i=0;i<nb;i++) {
+            for (u=0.0,l=0;l<=c;l++) u+=Ph[i+l*nb]*U[l+c*n];
+            W[i+c*nb]=u;
+            for (u=0.0,l=0;l<=c;l++) u+=Ph[i+l*nb]*Uq[l+c*nb];
+            W[i+(nb+c)*nb]=u;
+            W[i+(2*nb+c)*nb]=Uq[i+c*nb];
+        }
+        Dw[c]=D[c];
+        Dw[nb+c]=Dw[2*nb+c]=0.5*Dq[c];
+    }
+    /* U12=phi11*U12+phi12*U22 */
+    for (c=nb;c<n;c++) {
+        for (i=0;i<nb;i++) t[i]=0.0;
+        for (l=0;l<=c;l++) {
+            if (!nz[l]||(u=U[l+c*n])==0.0) continue;
+            for (i=0;i<nb;i++) t[i]+=Ph[i+l*nb]*u;
+        }
+        for (i=0;i<nb;i++) U[i+c*n]=(udreal_t)t[i];
+    }
+    /* re-triangularize block */
+    mwgs(W,Dw,nb,L,U,D,n);
+    ud->mod=ud->vmod=1;
+
+    free(Ph); free(W); free(Dw); free(Uq); free(Dq); free(t); free(nz);
+    return 0;
+}
+/* bierman scalar measurement update -------------------------------------------
+* ih(0..nh-1) are the indices of non-zero h in ascending order. the columns
+* with f=U'*h zero (states not correlated with the measurement) are skipped
+*-----------------------------------------------------------------------------*/
+static int bierman(udfac_t *ud, const double *h, const int *ih, int nh,
+                   double y, double r, double *dx)
+{
+    udreal_t *U=ud->U,*D=ud->D;
+    double *f=ud->w,*g=ud->w+ud->n,*k=ud->w+2*ud->n,a,ap,lam,u;
+    int i,j,l,n=ud->n;
+
+    if (r<=0.0) return -1;
+
+    /* f=U'*h, g=D*f, innovation */
+    for (l=0;l<nh;l++) y-=h[ih[l]]*dx[ih[l]];
+    for (j=0;j<n;j++) {
+        for (u=h[j],l=0;l<nh&&ih[l]<j;l++) u+=U[ih[l]+j*n]*h[ih[l]];
+        f[j]=u;
+        g[j]=D[j]*u;
+    }
+    for (a=r,j=0;j<n;j++) {
+        if (f[j]==0.0) {
+            k[j]=0.0;
+            continue;
+        }
+        ap=a;
+        a+=f[j]*g[j];
+        D[j]=(udreal_t)(D[j]*ap/a);
+        lam=-f[j]/ap;
+        for (i=0;i<j;i++) {
+            u=U[i+j*n];
+            U[i+j*n]=(udreal_t)(u+k[i]*lam);
+            k[i]+=g[j]*u;
+        }
+        k[j]=g[j];
+    }
+    for (i=0;i<n;i++) dx[i]+=k[i]*y/a;
+    return 0;
+}
+/* measurement update of selected states -------------------------------------*/
+static int udupdate(udfac_t *ud, const double *H, const double *v,
+                    const double *R, int m, const int *ix, int k, double *dx)
+{
+    double *L,*Hw,*vw,*h,u;
+    int i,j,l,n=ud->n,nh,*ih,diag=1,info=0;
+
+    for (i=0;i<m;i++) for (j=0;j<m;j++) {
+        if (i!=j&&R[i+j*m]!=0.0) diag=0;
+    }
+    Hw=mat(k,m); vw=mat(m,1); L=mat(m,m); h=zeros(n,1); ih=imat(k,1);
+    if (!Hw||!vw||!L||!h||!ih) {
+        free(Hw); free(vw); free(L); free(h); free(ih);
+        return -1;
+    }
+    for (j=0;j<m;j++) {
+        for (i=0;i<k;i++) Hw[i+j*k]=H[ix[i]+j*n];
+        vw[j]=v[j];
+    }
+    /* decorrelate measurements: R=L*L', H=H*L'^-1, v=L^-1*v */
+    if (!diag) {
+        matcpy(L,R,m,m);
+        for (j=0;j<m&&!info;j++) {
+            for (u=L[j+j*m],l=0;l<j;l++) u-=L[j+l*m]*L[j+l*m];
+            if (u<=0.0) {
+                info=-1;
+                break;
+            }
+            L[j+j*m]=sqrt(u);
+            for (i=j+1;i<m;i++) {
+                for (u=L[i+j*m],l=0;l<j;l++) u-=L[i+l*m]*L[j+l*m];
+                L[i+j*m]=u/L[j+j*m];
+            }
+        }
+        for (j=0;j<m&&!info;j++) {
+            for (l=0;l<j;l++) {
+                vw[j]-=L[j+l*m]*vw[l];
+                for (i=0;i<k;i++) Hw[i+j*k]-=L[j+l*m]*Hw[i+l*k];
+            }
+            vw[j]/=L[j+j*m];
+            for (i=0;i<k;i++) Hw[i+j*k]/=L[j+j*m];
+        }
+    }
+    for (j=0;j<m&&!info;j++) {
+        for (i=nh=0;i<k;i++) {
+            if ((h[ix[i]]=Hw[i+j*k])!=0.0) ih[nh++]=ix[i];
+        }
+        info=bierman(ud,h,ih,nh,vw[j],diag?R[j+j*m]:1.0,dx);
+    }
+    ud->mod=ud->vmod=1;
+    free(Hw); free(vw); free(L); free(h); free(ih);
+    return info;
+}
+/* u-d factorized kalman filter ------------------------------------------------
+* kalman filter measurement update with u-d factorized covariance
+* args   : udfac_t *ud      IO  u-d factors of covariance of states
+*          double *x        IO  states vector (n x 1)
+*          double *H        I   transpose of design matrix (n x m)
+*          double *v        I   innovation (measurement - model) (m x 1)
+*          double *R        I   covariance matrix of measurement error (m x m)
+*          int    n,m       I   number of states and measurements
+*          double *K        O   kalman gain of selected states (k x m)
+*                               (NULL: no output)
+* return : status (0:ok,<0:error)
+* notes  : same update as filter_adap() with the covariance as factors.
+*          states are selected as filter() (x!=0 and P(i,i)>0) and updated by
+*          m scalar bierman updates. K is output as by filter_adap() (k
+*          selected states x m) computed by K=P*H*R^-1 after the update. the
+*          factors are not restored on error, update a copy (ud_copy()) if
+*          the update may be rejected
+*-----------------------------------------------------------------------------*/
+extern int ud_filter(udfac_t *ud, double *x, const double *H, const double *v,
+                     const double *R, int n, int m, double *K)
+{
+    const udreal_t *U=ud->U,*D=ud->D;
+    double *dx,*Ri,*PH,*t,u;
+    int i,j,l,k,*ix,info;
+
+    if (ud->n!=n) return -1;
+
+    ix=imat(n,1); dx=zeros(n,1);
+    if (!ix||!dx) {
+        free(ix); free(dx);
+        return -1;
+    }
+    for (i=k=0;i<n;i++) if (x[i]!=0.0&&ud_var(ud,i)>0.0) ix[k++]=i;
+
+    if ((info=udupdate(ud,H,v,R,m,ix,k,dx))) {
+        free(ix); free(dx);
+        return info;
+    }
+    for (i=0;i<k;i++) x[ix[i]]+=dx[ix[i]];
+
+    /* K=P*H*R^-1, P*h=U*D*U'*h */
+    if (K) {
+        Ri=mat(m,m); PH=mat(k,m); t=ud->w;
+        matcpy(Ri,R,m,m);
+        if (!(info=matinv(Ri,m))) {
+            for (j=0;j<m;j++) {
+                for (l=0;l<n;l++) {
+                    for (u=H[l+j*n],i=0;i<l;i++) u+=U[i+l*n]*H[i+j*n];
+                    t[l]=D[l]*u;
+                }
+                for (i=0;i<k;i++) {
+                    for (u=t[ix[i]],l=ix[i]+1;l<n;l++) u+=U[ix[i]+l*n]*t[l];
+                    PH[i+j*k]=u;
+                }
+            }
+            matmul("NN",k,m,m,1.0,PH,Ri,0.0,K);
+        }
+        free(Ri); free(PH);
+    }
+    free(ix); free(dx);
+    return info;
+}
+/* u-d factorized kalman filter of navigation block constraints ----------------
+* same update as navfilter() with the covariance as u-d factors
+* args   : udfac_t *ud      IO  u-d factors of covariance of states
+*          double *x        O   states correction (n x 1)
+*          double *Hs       I   block of design matrix (ns x m)
+*          double *v        I   innovation (measurement - model) (m x 1)
+*          double *R        I   covariance matrix of measurement error (m x m)
+*          int    n,m       I   number of states and measurements
+*          int    is,ns     I   first state and number of states of block
+* return : status (0:ok,<0:error)
+* notes  : states with zero variance are not updated (as navfilter())
+*-----------------------------------------------------------------------------*/
+extern int ud_navfilter(udfac_t *ud, double *x, const double *Hs,
+                        const double *v, const double *R, int n, int m,
+                        int is, int ns)
+{
+    double *H;
+    int i,j,k,*ix,info;
+
+    if (ud->n!=n||m<=0||is<0||is+ns>n) return -1;
+
+    ix=imat(n,1); H=zeros(n,m);
+    if (!ix||!H) {
+        free(ix); free(H);
+        return -1;
+    }
+    for (j=0;j<m;j++) for (i=0;i<ns;i++) H[is+i+j*n]=Hs[i+j*ns];
+    for (i=k=0;i<n;i++) if (ud_var(ud,i)>0.0) ix[k++]=i;
+    for (i=0;i<n;i++) x[i]=0.0;
+
+    info=udupdate(ud,H,v,R,m,ix,k,x);
+
+    free(ix); free(H);
+    return info;
+}
+/* free u-d factors ------------------------------------------------------------
+* args   : udfac_t *ud      IO  u-d factors
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void ud_free(udfac_t *ud)
+{
+    free(ud->U); free(ud->D); free(ud->w); free(ud->var);
+    memset(ud,0,sizeof(udfac_t));
+}
@@ -0,0 +1,325 @@
+/*-----------------------------------------------------------------------------
+* Um7Decoder.c : CH Robotics UM7 NMEA ($PCHRS) stream decoder
+*
+* reference :
+*    [1] CH Robotics, UM7 Lt Orientation Sensor Datasheet, rev. 1.8 (NMEA
+*        packets, $PCHRS sensor data packet)
+*
+* notes   : the decoder is a byte-level state machine. fields are converted
+*           while the bytes arrive, so neither file lines nor stream buffers
+*           are copied. each input line may be preceded by the data logger
+*           prefix "sec,week,port,len," which gives the gps time tag:
+*
+*           394469.000,,COM3,41,$PCHRS,1,18.552,0.0504,0.1379,-0.8286,*44
+*
+*           gyro (0), accelerometer (1) and magnetometer (2) packets of the
+*           same sensor time are reassembled into one imuraw_t sample.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/07 1.0 new
+*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <dirent.h>
+
+#include "rtklib.h"
+#include "INS_GNSS.h"
+#include "../../src/satinsmap.h"
+
+#define UM7HEAD     "PCHRS"     /* um7 sensor data packet header */
+#define UM7MAXLEN   128         /* max length of um7 packet (bytes) */
+#define UM7MAXDIG   18          /* max digits of numeric field */
+#define UM7DTTOL    1E-6        /* tolerance of sample time comparison (s) */
+
+#define UM7_GYR     0x1         /* channel mask: gyroscopes */
+#define UM7_ACC     0x2         /* channel mask: accelerometers */
+#define UM7_MAG     0x4         /* channel mask: magnetometers */
+
+enum {UM7_SYNC=0,UM7_PREF,UM7_HEAD,UM7_DATA,UM7_CHKS}; /* decoder states */
+
+/* start numeric field -------------------------------------------------------*/
+static void startnum(um7raw_t *raw)
+{
+    raw->mant=0; raw->ndec=raw->ndig=raw->sign=raw->dot=0;
+}
+/* add byte to numeric field (0:error) ---------------------------------------*/
+static int addnum(um7raw_t *raw, unsigned char c)
+{
+    if (c>='0'&&c<='9') {
+        if (++raw->ndig>UM7MAXDIG) return 0;
+        raw->mant=raw->mant*10+(c-'0');
+        if (raw->dot) raw->ndec++;
+    }
+    else if (c=='.'&&!raw->dot) raw->dot=1;
+    else if ((c=='-'||c=='+')&&!raw->ndig&&!raw->sign&&!raw->dot) {
+        raw->sign=c=='-'?-1:1;
+    }
+    else return 0;
+    return 1;
+}
+/* value of numeric field ----------------------------------------------------*/
+static double numval(const um7raw_t *raw)
+{
+    static const double pw[]={1,1E1,1E2,1E3,1E4,1E5,1E6,1E7,1E8,1E9};
+    double val=(double)raw->mant;
+
+    val=raw->ndec<10?val/pw[raw->ndec]:val/pow(10.0,raw->ndec);
+    return raw->sign<0?-val:val;
+}
+/* output reassembled sample (1:output,0:incomplete sample dropped) ----------*/
+static int outsample(um7raw_t *raw)
+{
+    int i,mask=raw->mask;
+
+    raw->mask=0;
+    if (!mask) return 0;
+
+    if (!(mask&UM7_GYR)||!(mask&UM7_ACC)) {
+        raw->ndrop++;
+        trace(3,"um7 incomplete sample dropped t=%.3f mask=%d\n",raw->t,mask);
+        return 0;
+    }
+    if (!(mask&UM7_MAG)) raw->npartial++;
+
+    /* logger time tag with the sub-second part of sensor time */
+    if (raw->tsec>0.0) {
+        raw->data.sec=raw->tsec+(raw->t-floor(raw->t));
+    }
+    else raw->data.sec=raw->t;
+    raw->data.time=gpst2time(raw->tweek>0?raw->tweek:raw->week,raw->data.sec);
+
+    for (i=0;i<3;i++) {
+        raw->data.wibb0[i]=raw->g[i];
+        raw->data.fb0  [i]=raw->a[i];
+        raw->mag[i]=raw->m[i];
+    }
+    raw->magok=(mask&UM7_MAG)?1:0;
+    raw->nsample++;
+    return 1;
+}
+/* decode $PCHRS packet ------------------------------------------------------*/
+static int decode_pchrs(um7raw_t *raw)
+{
+    double t,*p;
+    int i,ch,stat=0;
+
+    if (raw->nval!=5||raw->val[0]<0.0||raw->val[0]>2.0) {
+        raw->nbad++;
+        trace(2,"um7 packet format error: nval=%d\n",raw->nval);
+        return -1;
+    }
+    ch=(int)raw->val[0];
+    t=raw->val[1];
+    raw->npkt++;
+
+    /* new sensor time: output previous sample */
+    if (raw->mask&&fabs(t-raw->t)>UM7DTTOL) stat=outsample(raw);
+
+    if (!raw->mask) {
+        raw->t=t;
+        raw->tsec=raw->prevok&1?raw->pre[0]:0.0;
+        raw->tweek=raw->prevok&2?(int)raw->pre[1]:0;
+    }
+    if (raw->mask&(1<<ch)) raw->ndup++;
+    raw->mask|=1<<ch;
+
+    switch (ch) {
+        case 0: p=raw->g; for (i=0;i<3;i++) p[i]=raw->val[2+i]*D2R;  break; /* deg/s to rad/s */
+        case 1: p=raw->a; for (i=0;i<3;i++) p[i]=raw->val[2+i]*Gcte; break; /* g to m/s^2 */
+        default:p=raw->m; for (i=0;i<3;i++) p[i]=raw->val[2+i];      break; /* unitless */
+    }
+    /* all channels of the sample received */
+    if (raw->mask==(UM7_GYR|UM7_ACC|UM7_MAG)) stat=outsample(raw);
+
+    return stat;
+}
+/* hex digit value -----------------------------------------------------------*/
+static int hexval(unsigned char c)
+{
+    if (c>='0'&&c<='9') return c-'0';
+    if (c>='A'&&c<='F') return c-'A'+10;
+    if (c>='a'&&c<='f') return c-'a'+10;
+    return -1;
+}
+/* abort packet --------------------------------------------------------------*/
+static int abortpkt(um7raw_t *raw, const char *msg)
+{
+    trace(2,"um7 packet error: %s\n",msg);
+    raw->nbad++;
+    raw->state=UM7_SYNC;
+    return -1;
+}
+/* initialize um7 decoder ------------------------------------------------------
+* args   : um7raw_t *raw    O   um7 decoder
+*          int    week      I   gps week used if the log has no week field
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void init_um7(um7raw_t *raw, int week)
+{
+    memset(raw,0,sizeof(um7raw_t));
+    raw->week=week;
+    raw->bol=1;
+}
+/* resynchronize um7 decoder -------------------------------------------------
+* restart decoding at a line start after the input file is repositioned
+* args   : um7raw_t *raw    IO  um7 decoder
+* return : none
+* notes  : the pending sample is discarded, counters are kept
+*-----------------------------------------------------------------------------*/
+extern void resync_um7(um7raw_t *raw)
+{
+    raw->state=UM7_SYNC;
+    raw->bol=1;
+    raw->mask=0;
+}
+/* input um7 packet from stream ------------------------------------------------
+* decode one byte of um7 nmea stream and reassemble imu sample
+* args   : um7raw_t *raw    IO  um7 decoder
+*          unsigned char data I stream data (1 byte)
+* return : status (-1: error message, 0: no message, 1: input imu sample)
+* notes  : the reassembled sample is in raw->data (fb0, wibb0, sec, time) and
+*          the magnetometer in raw->mag (raw->magok=1 if received).
+*          a sample is output when all channels are received or, without
+*          magnetometer, when a packet of the next sensor time arrives.
+*          packet counters: npkt (valid), nchkerr (checksum error), nbad
+*          (format error), nskip (other sentences), sample counters: nsample
+*          (output), npartial (no magnetometer), ndrop (no gyro or accl)
+*-----------------------------------------------------------------------------*/
+extern int input_um7(um7raw_t *raw, unsigned char data)
+{
+    int bol=raw->bol,h;
+
+    raw->bol=data=='\n';
+
+    switch (raw->state) {
+
+        case UM7_SYNC: /* synchronize to line start or '$' */
+            if (data=='$') {
+                raw->prevok=0;
+                break;
+            }
+            if (bol&&data!='\r'&&data!='\n') {
+                raw->state=UM7_PREF;
+                raw->npre=raw->prevok=0;
+                startnum(raw);
+                if (!addnum(raw,data)) raw->npre=-1;
+            }
+            return 0;
+
+        case UM7_PREF: /* logger prefix "sec,week,port,len," */
+            if (data=='$') break;
+            if (data=='\r'||data=='\n') {
+                raw->state=UM7_SYNC;
+                return 0;
+            }
+            if (data==',') {
+                if (raw->npre>=0&&raw->npre<2&&raw->ndig) {
+                    raw->pre[raw->npre]=numval(raw);
+                    raw->prevok|=1<<raw->npre;
+                }
+                if (raw->npre>=0) raw->npre++;
+                startnum(raw);
+            }
+            else if (raw->npre>=0&&raw->npre<2&&!addnum(raw,data)) {
+                raw->npre=-1; /* not a logger prefix */
+                raw->prevok=0;
+            }
+            return 0;
+
+        case UM7_HEAD: /* sentence header */
+            raw->sum^=data;
+            if (++raw->nbyte>UM7MAXLEN) return abortpkt(raw,"header length");
+            if (raw->nhead<(int)strlen(UM7HEAD)) {
+                if (data==UM7HEAD[raw->nhead]) {
+                    raw->nhead++;
+                    return 0;
+                }
+            }
+            else if (data==',') {
+                raw->state=UM7_DATA;
+                raw->nval=0;
+                startnum(raw);
+                return 0;
+            }
+            raw->nskip++; /* other nmea sentence ($PCHRA,$PCHRH,...) */
+            raw->state=UM7_SYNC;
+            return 0;
+
+        case UM7_DATA: /* data fields */
+            if (++raw->nbyte>UM7MAXLEN) return abortpkt(raw,"packet length");
+            if (data=='\r'||data=='\n') return abortpkt(raw,"no checksum");
+            if (data==','||data=='*') {
+                if (raw->ndig) {
+                    if (raw->nval>=UM7MAXVAL) return abortpkt(raw,"number of fields");
+                    raw->val[raw->nval++]=numval(raw);
+                }
+                else if (data==','&&raw->nval<5) return abortpkt(raw,"empty field");
+                if (data=='*') {
+                    raw->state=UM7_CHKS;
+                    raw->nchk=raw->chk=0;
+                    return 0;
+                }
+                raw->sum^=data;
+                startnum(raw);
+                return 0;
+            }
+            raw->sum^=data;
+            if (!addnum(raw,data)) return abortpkt(raw,"invalid character");
+            return 0;
+
+        case UM7_CHKS: /* checksum (2 hex digits) */
+            if ((h=hexval(data))<0) return abortpkt(raw,"checksum format");
+            raw->chk=(unsigned char)((raw->chk<<4)|h);
+            if (++raw->nchk<2) return 0;
+            raw->state=UM7_SYNC;
+            if (raw->chk!=raw->sum) {
+                trace(2,"um7 checksum error: sum=%02X chk=%02X\n",raw->sum,raw->chk);
+                raw->nchkerr++;
+                return -1;
+            }
+            return decode_pchrs(raw);
+    }
+    /* start of sentence */
+    raw->state=UM7_HEAD;
+    raw->sum=0;
+    raw->nhead=raw->nbyte=0;
+    return 0;
+}
+/* input um7 packet from file --------------------------------------------------
+* fetch next imu sample from um7 log file
+* args   : um7raw_t *raw    IO  um7 decoder
+*          FILE   *fp       I   file pointer
+* return : status (-2: end of file, -1...1: same as above)
+* notes  : the last pending sample is output at end of file
+*-----------------------------------------------------------------------------*/
+extern int input_um7f(um7raw_t *raw, FILE *fp)
+{
+    int i,data,stat;
+
+    for (i=0;i<4096;i++) {
+        if ((data=fgetc(fp))==EOF) {
+            return outsample(raw)?1:-2;
+        }
+        if ((stat=input_um7(raw,(unsigned char)data))) return stat;
+    }
+    return 0;
+}
+/* print um7 decoder statistics ------------------------------------------------
+* args   : um7raw_t *raw    I   um7 decoder
+*          FILE   *fp       I   output file pointer
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void um7stat(const um7raw_t *raw, FILE *fp)
+{
+    fprintf(fp,"um7 packets : valid=%u checksum-err=%u format-err=%u other=%u dup=%u\n",
+            raw->npkt,raw->nchkerr,raw->nbad,raw->nskip,raw->ndup);
+    fprintf(fp,"um7 samples : output=%u partial(no mag)=%u dropped=%u\n",
+            raw->nsample,raw->npartial,raw->ndrop);
+}
@@ -0,0 +1,335 @@
+/*------------------------------------------------------------------------------
+* arins.c : warm/cold started ambiguity resolution check on synthetic epochs
+*
+* notes   : runs the ambiguity resolution of the tc filter (insamb_res()) on
+*           synthetic epochs with warm start of the z-transformation and
+*           with cold starts only (insamb_t.warm=0), on the same epochs, and
+*           reports the fix rate, the wrong fixes and the reduction/search
+*           time per call of both.
+*
+*           the epochs are built as the filter would hand them over: dual
+*           frequency gps observations with melbourne-wubbena combinations
+*           of the true wide-lane ambiguities plus noise, locked satellites
+*           with geometry in satcache, and ekf ionosphere-free phase bias
+*           states of the true integer ambiguities plus a float error. the
+*           float error covariance of a satellite is
+*
+*             P(i,j) = s(i)*s(j)*(g(i)'*g(j)+DIAGW*(i==j))/(1+DIAGW)
+*
+*           g(i) a unit vector of the satellite that drifts slowly along its
+*           arc (correlation through the common geometry states) and s(i)
+*           shrinking with the age of the arc as the float solution
+*           converges. the float error is drawn from that covariance. every
+*           -arc epochs a satellite sets and a new one rises, which changes
+*           the ambiguity set and forces a cold start.
+*
+*           a fix is wrong if a fixed decorrelated ambiguity of the updated
+*           states differs from the transformed true ambiguities.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/21 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "arins"             /* program name */
+#define MAXVIS      16                  /* max number of visible satellites */
+#define NGEO        4                   /* dimension of geometry vectors */
+#define DIAGW       0.2                 /* weight of uncorrelated float error */
+#define SIGFLT      0.3                 /* float error std at arc start (m) */
+#define SIGMW       0.15                /* std of mw combination (cycle) */
+#define GDRIFT      0.02                /* drift of geometry vectors per epoch */
+#define RANGE0      2.2E7               /* geometric range (m) */
+
+typedef struct {        /* visible satellite arc */
+    int sat;            /* satellite number */
+    int age;            /* epochs since rise */
+    double el;          /* elevation (rad) */
+    double N1,Nw;       /* true l1 and wide-lane ambiguities (cycle) */
+    double g[NGEO];     /* geometry vector */
+} arc_t;
+
+typedef struct {        /* check result */
+    insamb_t amb;       /* ambiguity resolution state and statistics */
+    int nwrong;         /* number of wrong fixes */
+    int *nfix;          /* number of fixed ambiguities per epoch */
+} result_t;
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: arins [option]...",
+  "",
+  " Run the tc ambiguity resolution on synthetic epochs with warm started",
+  " and with cold started z-transformations, and report the fix rate, the",
+  " wrong fixes and the reduction/search time per call.",
+  "",
+  " -?        print help",
+  " -e num    number of epochs [600]",
+  " -ns num   number of visible gps satellites (<=16) [9]",
+  " -arc num  epochs between satellite set/rise [150]",
+  " -s seed   random seed [1]",
+  " -w ratio  max ratio of wrong fixes, exit status 1 if exceeded [0.01]",
+  " -o file   output csv file (appended) [off]",
+  " -tag str  run label written to csv [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* uniform random number in [-1,1) -------------------------------------------*/
+static unsigned long long seed=1;
+
+static double rnd(void)
+{
+    seed=seed*6364136223846793005ULL+1442695040888963407ULL;
+    return (seed>>11)*(2.0/9007199254740992.0)-1.0;
+}
+/* standard normal random number ---------------------------------------------*/
+static double rndn(void)
+{
+    double u=0.5*(rnd()+1.0);
+    return sqrt(-2.0*log(u>0.0?u:1E-300))*cos(PI*rnd());
+}
+/* new satellite arc ---------------------------------------------------------*/
+static void newarc(arc_t *a, int sat)
+{
+    int i;
+
+    a->sat=sat;
+    a->age=0;
+    a->el=(15.0+32.5*(rnd()+1.0))*D2R;
+    a->N1=floor(1E5*rnd());
+    a->Nw=floor(20.0*rnd());
+    for (i=0;i<NGEO;i++) a->g[i]=rnd();
+    normv3(a->g,a->g); a->g[3]=0.5*rnd(); /* 4th: clock/troposphere part */
+}
+/* build synthetic epoch -----------------------------------------------------*/
+static void synepoch(arc_t *arc, int ns, gtime_t time, const nav_t *nav,
+                     const prcopt_t *popt, rtk_t *rtk, ins_states_t *ins,
+                     obsd_t *obs)
+{
+    const double *lam;
+    double c2,lamnl,s[MAXVIS],u[NGEO],e,gg;
+    int i,j,k,nx=ins->nx,ix;
+
+    /* ekf states: navigation, clock, troposphere and phase biases */
+    memset(ins->x,0,sizeof(double)*nx);
+    memset(ins->P,0,sizeof(double)*nx*nx);
+    for (i=0;i<xiBs(popt,1);i++) ins->P[i+i*nx]=i<xnCl()?0.01:1.0;
+    for (i=0;i<9;i++) ins->Cbe[i]=i%4?0.0:1.0;
+    for (i=0;i<3;i++) ins->ve[i]=0.0;
+    ins->re[0]=-2430697.0; ins->re[1]=-4704189.0; ins->re[2]=3544329.0;
+
+    for (k=0;k<NGEO;k++) u[k]=rndn();
+
+    for (i=0;i<ns;i++) {
+        lam=nav->lam[arc[i].sat-1];
+        c2=-SQR(lam[0])/(SQR(lam[1])-SQR(lam[0]));
+        lamnl=lam[0]*lam[1]/(lam[0]+lam[1]);
+
+        /* drift of geometry, converging float error */
+        for (k=0;k<3;k++) arc[i].g[k]+=GDRIFT*rnd();
+        normv3(arc[i].g,arc[i].g);
+        s[i]=SIGFLT/sqrt(1.0+arc[i].age++);
+
+        /* float ionosphere-free bias (m) */
+        for (e=sqrt(DIAGW)*rndn(),k=0;k<NGEO;k++) e+=arc[i].g[k]*u[k];
+        ix=xiBs(popt,arc[i].sat);
+        ins->x[ix]=lamnl*arc[i].N1-c2*lam[1]*arc[i].Nw+s[i]*e/sqrt(1.0+DIAGW);
+
+        /* observations: code equal on both frequencies, mw=Nw+noise */
+        obs[i].time=time;
+        obs[i].sat=arc[i].sat;
+        obs[i].P[0]=obs[i].P[1]=RANGE0;
+        obs[i].L[0]=RANGE0/lam[0]+arc[i].N1+SIGMW*rndn();
+        obs[i].L[1]=RANGE0/lam[1]+arc[i].N1-arc[i].Nw;
+
+        rtk->ssat[arc[i].sat-1].vsat[0]=1;
+        rtk->ssat[arc[i].sat-1].lock[0]=arc[i].age;
+        rtk->ssat[arc[i].sat-1].slip[0]=rtk->ssat[arc[i].sat-1].slip[1]=0;
+        satcache.sat[i]=arc[i].sat;
+        satcache.stat[i]=1;
+        satcache.azel[i*2]=0.0;
+        satcache.azel[1+i*2]=arc[i].el;
+    }
+    for (i=0;i<ns;i++) for (j=0;j<ns;j++) {
+        for (gg=i==j?DIAGW:0.0,k=0;k<NGEO;k++) gg+=arc[i].g[k]*arc[j].g[k];
+        ins->P[xiBs(popt,arc[i].sat)+xiBs(popt,arc[j].sat)*nx]=
+            s[i]*s[j]*gg/(1.0+DIAGW);
+    }
+}
+/* check fixed decorrelated ambiguities against truth ------------------------*/
+static int chkfix(const insamb_t *amb, const arc_t *arc, int ns, int p,
+                  const nav_t *nav, const prcopt_t *popt,
+                  const ins_states_t *ins)
+{
+    const double *lam;
+    double a[MAXARAMB],N[MAXARAMB],za,zt,c2,lamnl;
+    int i,j,k,na=amb->na,rsat=amb->ref-xiBs(popt,1)+1;
+    const arc_t *ar=NULL,*ai;
+
+    for (i=0;i<ns;i++) if (arc[i].sat==rsat) ar=arc+i;
+    if (!ar) return 1;
+    lam=nav->lam[rsat-1];
+    c2=-SQR(lam[0])/(SQR(lam[1])-SQR(lam[0]));
+    lamnl=lam[0]*lam[1]/(lam[0]+lam[1]);
+
+    for (i=0;i<na;i++) {
+        for (ai=NULL,j=0;j<ns;j++) if (arc[j].sat==amb->sat[i]) ai=arc+j;
+        if (!ai) return 1;
+        a[i]=(ins->x[xiBs(popt,ai->sat)]-ins->x[amb->ref]+
+              c2*lam[1]*(ai->Nw-ar->Nw))/lamnl;
+        N[i]=ai->N1-ar->N1;
+    }
+    for (k=na-p;k<na;k++) {
+        for (za=zt=0.0,i=0;i<na;i++) {
+            za+=amb->Z[i+k*na]*a[i];
+            zt+=amb->Z[i+k*na]*N[i];
+        }
+        if (fabs(za-zt)>0.25) return 1;
+    }
+    return 0;
+}
+/* run epochs ----------------------------------------------------------------*/
+static void runar(int warm, int nep, int ns, int narc, unsigned long long sd,
+                  result_t *res)
+{
+    prcopt_t popt=prcopt_default;
+    insgnss_opt_t opt={0};
+    ins_states_t ins={0};
+    nav_t nav={0};
+    rtk_t *rtk;
+    obsd_t obs[MAXVIS]={{{0}}};
+    arc_t arc[MAXVIS];
+    const double ep0[]={2019,3,19,19,46,7};
+    gtime_t time=epoch2time(ep0);
+    int i,j,ep,p,next;
+
+    seed=sd;
+    popt.mode=PMODE_PPP_KINEMA;
+    popt.ionoopt=IONOOPT_IFLC;
+    popt.tropopt=TROPOPT_EST;
+    popt.navsys=SYS_GPS;
+    ins.nx=xnX(&popt);
+    ins.x=zeros(ins.nx,1);
+    ins.P=zeros(ins.nx,ins.nx);
+    rtk=(rtk_t *)calloc(1,sizeof(rtk_t));
+    rtk->opt=popt;
+    for (i=0;i<MAXSAT;i++) {
+        nav.lam[i][0]=CLIGHT/FREQ1;
+        nav.lam[i][1]=CLIGHT/FREQ2;
+    }
+    insamb_init(&res->amb);
+    res->amb.warm=warm;
+    res->nwrong=0;
+
+    for (i=0;i<ns;i++) newarc(arc+i,i+1);
+    next=ns;
+
+    for (ep=0;ep<nep;ep++,time=timeadd(time,1.0)) {
+
+        /* satellite set/rise */
+        if (ep>0&&ep%narc==0) {
+            i=(int)((rnd()+1.0)*0.5*ns)%ns;
+            rtk->ssat[arc[i].sat-1].vsat[0]=0;
+            for (j=0;j<ns;j++) {
+                if (arc[j].sat==next%MAXPRNGPS+1) {next++; j=-1;}
+            }
+            newarc(arc+i,next++%MAXPRNGPS+1);
+        }
+        synepoch(arc,ns,time,&nav,&popt,rtk,&ins,obs);
+
+        res->nfix[ep]=p=insamb_res(&res->amb,rtk,obs,ns,&nav,&ins,&opt);
+        if (p>0&&chkfix(&res->amb,arc,ns,p,&nav,&popt,&ins)) res->nwrong++;
+    }
+    free(ins.x); free(ins.P); free(rtk);
+}
+/* print and output result ---------------------------------------------------*/
+static void outres(FILE *fp, const char *tag, const char *mode,
+                   const result_t *res, int nep)
+{
+    const insamb_t *a=&res->amb;
+    int nc=MAX(a->nwarm+a->ncold,1);
+
+    if (!fp) {
+        fprintf(stdout,"%-5s %6d %6d %6d %6.1f %6d %6.1f %6d %6d %9.2f %9.2f\n",
+                mode,nep,a->nep,a->nfix,100.0*a->nfix/MAX(a->nep,1),
+                res->nwrong,a->nfix>0?(double)a->namb/a->nfix:0.0,a->nwarm,
+                a->ncold,a->tred*1E6/nc,a->tsrch*1E6/nc);
+        return;
+    }
+    fprintf(fp,"%s,%s,%d,%d,%d,%.1f,%d,%.2f,%d,%d,%.2f,%.2f\n",tag,mode,nep,
+            a->nep,a->nfix,100.0*a->nfix/MAX(a->nep,1),res->nwrong,
+            a->nfix>0?(double)a->namb/a->nfix:0.0,a->nwarm,a->ncold,
+            a->tred*1E6/nc,a->tsrch*1E6/nc);
+}
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    result_t res[2]={{{0}}};
+    unsigned long long sd=1;
+    double maxw=0.01;
+    char *outfile="",*tag="-";
+    int i,k,nep=600,ns=9,narc=150,ndiff=0,stat=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-e")&&i+1<argc) nep=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-ns")&&i+1<argc) ns=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-arc")&&i+1<argc) narc=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-s")&&i+1<argc) sd=strtoull(argv[++i],NULL,10);
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) maxw=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else printhelp();
+    }
+    if (nep<=0||ns<2||ns>MAXVIS||narc<=0) printhelp();
+
+    for (k=0;k<2;k++) {
+        res[k].nfix=imat(nep,1);
+        runar(!k,nep,ns,narc,sd,res+k);
+    }
+    for (i=0;i<nep;i++) if (res[0].nfix[i]!=res[1].nfix[i]) ndiff++;
+
+    fprintf(stdout,"%s: epochs=%d satellites=%d arc=%d\n",PROGNAME,nep,ns,narc);
+    fprintf(stdout,"%-5s %6s %6s %6s %6s %6s %6s %6s %6s %9s %9s\n","mode",
+            "epochs","ar","fix","fix%","wrong","amb","warm","cold",
+            "reduct us","search us");
+    outres(NULL,tag,"warm",res,nep);
+    outres(NULL,tag,"cold",res+1,nep);
+    fprintf(stdout,"epochs with different number of fixed ambiguities=%d\n",
+            ndiff);
+
+    for (k=0;k<2;k++) {
+        if (res[k].nwrong>maxw*MAX(res[k].amb.nfix,1)) stat=1;
+    }
+    if (*outfile) {
+        if (!(fp=fopen(outfile,"r"))) {
+            if ((fp=fopen(outfile,"w"))) {
+                fprintf(fp,"tag,mode,epochs,ar_epochs,fix_epochs,fix_pct,wrong,"
+                        "amb_per_fix,warm,cold,reduct_us,search_us\n");
+            }
+        }
+        else {
+            fclose(fp);
+            fp=fopen(outfile,"a");
+        }
+        if (fp) {
+            outres(fp,tag,"warm",res,nep);
+            outres(fp,tag,"cold",res+1,nep);
+            fclose(fp);
+        }
+    }
+    free(res[0].nfix); free(res[1].nfix);
+    return stat;
+}
@@ -0,0 +1,459 @@
+/*------------------------------------------------------------------------------
+* benchins.c : ins/gnss end-to-end throughput and scaling benchmark
+*
+* notes   : replays a dataset through postpos() and core() for every pair of
+*           imu rate and constellation set given on the command line and
+*           appends one csv record per run, so throughput can be compared
+*           across commits (-tag) on the same machine.
+*
+*           the tactical imu log ("time fz fy fx wz wy wx") is resampled to
+*           each rate: block averages of the native samples when the rate is
+*           lower, linear interpolation when it is higher. every run is
+*           executed in a child process so the peak resident set size of the
+*           run is reported by wait4() and global states start clean.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/10 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "benchins"          /* program name */
+#define MAXFILE     8                   /* max number of input files */
+#define MAXRUN      16                  /* max number of rates/constellation sets */
+#define MAXBENCHEP  864000              /* max gnss epochs profiled per run */
+
+typedef struct {        /* benchmark run result */
+    int stat;           /* status (1:ok,0:error) */
+    int nep;            /* number of gnss epochs processed by core() */
+    unsigned int nimu;  /* number of imu samples dispatched */
+    double wall;        /* postpos() wall time (s) */
+    double span;        /* processed data span (s) */
+    double lat[4];      /* core() latency p50,p90,p99,max (s) */
+} benchres_t;
+
+static int udfilt=0;    /* u-d factorized ekf covariance (-ud) */
+static int arcold=0;    /* cold-started ambiguity resolution (-arcold) */
+static int lc=0;        /* loosely coupled ins/gnss (-lc) */
+static int noaid=0;     /* spp not seeded by ins (-noaid) */
+static int fde=0;       /* innovation fde of tc update (-fde) */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: benchins [option]... file file [...]",
+  "",
+  " Replay RINEX OBS/NAV/CLK/SP3 files and a tactical imu log through the",
+  " ins/gnss tightly coupled processing for each imu rate and constellation set",
+  " and append throughput and latency statistics to a csv file.",
+  "",
+  " -?        print help",
+  " -k file   input options from configuration file [off]",
+  " -i file   tactical imu log [../data/26082019/imu_ascii.txt]",
+  " -d file   obd-ii vehicle speed file synchronized to gps time [off]",
+  " -r rates  imu rates (Hz) separated by ',' (0:native) [0]",
+  " -sys sets constellation sets separated by ',' (G:gps,R:glo,E:gal,",
+  "           C:bds,J:qzs, e.g. G,GR,GRE) [configuration]",
+  " -x sats   excluded satellites separated by ',' (e.g. G05,R12) [off]",
+  " -ud       u-d factorized (square-root) ekf covariance [off]",
+  " -arcold   rebuild ambiguity z-transformation every epoch (pos2-armode=",
+  "           ppp-ar) [off]",
+  " -lc       loosely coupled ins/gnss with gnss solution [tightly coupled]",
+  " -noaid    single point positioning not seeded by ins position [off]",
+  " -fde      innovation fault detection and exclusion [off]",
+  " -ts ds ts start day/time (ds=y/m/d ts=h:m:s) [obs start time]",
+  " -te de te end day/time   (de=y/m/d te=h:m:s) [obs end time]",
+  " -w dir    work directory for resampled imu and solution files [/tmp]",
+  " -o file   output csv file (appended) [../out/bench.csv]",
+  " -tag str  run label written to csv (e.g. commit id) [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock (s) ------------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* compare doubles -----------------------------------------------------------*/
+static int cmpdbl(const void *p1, const void *p2)
+{
+    double a=*(const double *)p1,b=*(const double *)p2;
+    return a<b?-1:(a>b?1:0);
+}
+/* percentile of sorted values (nearest rank) --------------------------------*/
+static double prctile(const double *v, int n, double p)
+{
+    int i;
+    if (n<=0) return 0.0;
+    i=(int)ceil(p/100.0*n)-1;
+    return v[i<0?0:(i>=n?n-1:i)];
+}
+/* constellation set string to navigation system -----------------------------*/
+static int str2navsys(const char *str)
+{
+    const char *p;
+    int sys=0;
+
+    for (p=str;*p;p++) {
+        switch (*p) {
+            case 'G': sys|=SYS_GPS; break;
+            case 'R': sys|=SYS_GLO; break;
+            case 'E': sys|=SYS_GAL; break;
+            case 'C': sys|=SYS_CMP; break;
+            case 'J': sys|=SYS_QZS; break;
+            case 'S': sys|=SYS_SBS; break;
+            default : return 0;
+        }
+    }
+    return sys;
+}
+/* set excluded satellites ---------------------------------------------------*/
+static void setexsats(prcopt_t *opt, const char *str)
+{
+    char buff[1024],*p;
+    int sat;
+
+    strncpy(buff,str,sizeof(buff)-1); buff[sizeof(buff)-1]='\0';
+    for (p=strtok(buff,",");p;p=strtok(NULL,",")) {
+        if (!(sat=satid2no(p))) {
+            fprintf(stderr,"invalid satellite: %s\n",p);
+            continue;
+        }
+        opt->exsats[sat-1]=1;
+    }
+}
+/* resample tactical imu log ---------------------------------------------------
+* args   : char   *infile   I   tactical imu log ("time fz fy fx wz wy wx")
+*          char   *outfile  I   resampled imu log
+*          double rate      I   output rate (Hz) (0:copy native samples)
+*          double *rate0    O   native rate (Hz)
+* return : number of samples written (-1: error)
+* notes  : for rates lower than native the output sample at t is the mean of
+*          the native samples in (t-1/rate,t], otherwise the native samples
+*          bracketing t are interpolated
+*-----------------------------------------------------------------------------*/
+static int resampleimu(const char *infile, const char *outfile, double rate,
+                       double *rate0)
+{
+    FILE *fp;
+    double *d=NULL,*dd,v[7],t,dt,a,s[7];
+    char buff[256];
+    int i,j,k,n=0,nmax=0,nout=0;
+
+    if (!(fp=fopen(infile,"r"))) {
+        fprintf(stderr,"imu file open error: %s\n",infile);
+        return -1;
+    }
+    while (fgets(buff,sizeof(buff),fp)) {
+        if (sscanf(buff,"%lf %lf %lf %lf %lf %lf %lf",v,v+1,v+2,v+3,v+4,v+5,
+                   v+6)<7) continue;
+        if (n>0&&v[0]<=d[7*(n-1)]) continue;
+        if (n>=nmax) {
+            nmax=nmax<=0?65536:nmax*2;
+            if (!(dd=(double *)realloc(d,sizeof(double)*7*nmax))) {
+                free(d); fclose(fp);
+                return -1;
+            }
+            d=dd;
+        }
+        memcpy(d+7*n++,v,sizeof(v));
+    }
+    fclose(fp);
+
+    if (n<2) {
+        free(d);
+        return -1;
+    }
+    *rate0=(n-1)/(d[7*(n-1)]-d[0]);
+
+    if (!(fp=fopen(outfile,"w"))) {
+        free(d);
+        return -1;
+    }
+    if (rate<=0.0) {
+        for (i=0;i<n;i++,nout++) {
+            fprintf(fp,"%.6f",d[7*i]);
+            for (j=1;j<7;j++) fprintf(fp," %.9f",d[7*i+j]);
+            fprintf(fp,"\n");
+        }
+    }
+    else {
+        dt=1.0/rate;
+        for (k=1,i=0;(t=d[0]+k*dt)<=d[7*(n-1)];k++) {
+            if (rate<*rate0) {
+                for (j=0;j<7;j++) s[j]=0.0;
+                for (a=0.0;i<n&&d[7*i]<=t;i++,a+=1.0) {
+                    for (j=1;j<7;j++) s[j]+=d[7*i+j];
+                }
+                if (a<=0.0) continue;
+                for (j=1;j<7;j++) s[j]/=a;
+            }
+            else {
+                while (i<n-2&&d[7*(i+1)]<t) i++;
+                a=(t-d[7*i])/(d[7*(i+1)]-d[7*i]);
+                for (j=1;j<7;j++) s[j]=d[7*i+j]+(d[7*(i+1)+j]-d[7*i+j])*a;
+            }
+            fprintf(fp,"%.6f",t);
+            for (j=1;j<7;j++) fprintf(fp," %.9f",s[j]);
+            fprintf(fp,"\n");
+            nout++;
+        }
+    }
+    fclose(fp);
+    free(d);
+    return nout;
+}
+/* execute one run (child process) -------------------------------------------*/
+static void execrun(int fd, gtime_t ts, gtime_t te, prcopt_t *popt,
+                    solopt_t *sopt, filopt_t *fopt, char **infile, int n,
+                    const char *imufile, const char *odofile, const char *dir)
+{
+    benchres_t res={0};
+    char outfile[1024];
+    double t0;
+
+    /* solution logs of core() are not part of the measurement */
+    if (!freopen("/dev/null","w",stdout)) return;
+
+    coreprof.n=0;
+    coreprof.nmax=MAXBENCHEP;
+    if (!(coreprof.lat=(double *)malloc(sizeof(double)*MAXBENCHEP))) return;
+
+    if (insgnssinit(imufile,odofile,dir)) {
+        insgnssopt.udfilt=udfilt;
+        insgnssopt.lc=lc;
+        insgnssopt.sppaid=!noaid;
+        insgnssopt.fde=fde;
+        insgnssopt.ortho=sopt->height==1;
+        insamb.warm=!arcold;
+        sprintf(outfile,"%s/%s.pos",dir,PROGNAME);
+
+        t0=walltime();
+        res.stat=!postpos(ts,te,0.0,0.0,popt,sopt,fopt,infile,n,outfile,"","");
+        res.wall=walltime()-t0;
+
+        res.nep=coreprof.n<coreprof.nmax?coreprof.n:coreprof.nmax;
+        res.nimu=coresched.ndisp[EVT_IMU];
+        res.span=coreprof.n>1?coreprof.te-coreprof.ts:0.0;
+        qsort(coreprof.lat,res.nep,sizeof(double),cmpdbl);
+        res.lat[0]=prctile(coreprof.lat,res.nep,50.0);
+        res.lat[1]=prctile(coreprof.lat,res.nep,90.0);
+        res.lat[2]=prctile(coreprof.lat,res.nep,99.0);
+        res.lat[3]=prctile(coreprof.lat,res.nep,100.0);
+        if (insamb.nep>0) {
+            fprintf(stderr,"ar: epochs=%d fix=%d (%.1f%%) amb=%.1f warm=%d "
+                    "cold=%d reduct=%.1fus search=%.1fus\n",insamb.nep,
+                    insamb.nfix,100.0*insamb.nfix/insamb.nep,
+                    insamb.nfix>0?(double)insamb.namb/insamb.nfix:0.0,
+                    insamb.nwarm,insamb.ncold,
+                    insamb.tred*1E6/MAX(insamb.nwarm+insamb.ncold,1),
+                    insamb.tsrch*1E6/MAX(insamb.nwarm+insamb.ncold,1));
+        }
+        fprintf(stderr,"spp: epochs=%d iter/epoch=%.2f ins-aided epochs=%d "
+                "iter/epoch=%.2f\n",coreprof.nspp[0],coreprof.nspp[0]>0?
+                (double)coreprof.nitr[0]/coreprof.nspp[0]:0.0,coreprof.nspp[1],
+                coreprof.nspp[1]>0?(double)coreprof.nitr[1]/coreprof.nspp[1]:0.0);
+        if (insfde.nep>0) {
+            fprintf(stderr,"fde: epochs=%d detect=%d exclude=%d time=%.1fus\n",
+                    insfde.nep,insfde.ndet,insfde.nexc,insfde.t*1E6/insfde.nep);
+        }
+        insgnssfree();
+    }
+    free(coreprof.lat);
+    if (write(fd,&res,sizeof(res))!=sizeof(res)) res.stat=0;
+}
+/* run benchmark in child process ----------------------------------------------
+* args   : ...              I   processing options and input files
+*          benchres_t *res  O   run result
+*          long   *maxrss   O   peak resident set size of run (KB)
+* return : status (1:ok,0:error)
+*-----------------------------------------------------------------------------*/
+static int benchrun(gtime_t ts, gtime_t te, prcopt_t *popt, solopt_t *sopt,
+                    filopt_t *fopt, char **infile, int n, const char *imufile,
+                    const char *odofile, const char *dir, benchres_t *res,
+                    long *maxrss)
+{
+    struct rusage ru;
+    pid_t pid;
+    int fd[2],status;
+
+    if (pipe(fd)) return 0;
+
+    fflush(stdout); fflush(stderr);
+    if ((pid=fork())<0) {
+        close(fd[0]); close(fd[1]);
+        return 0;
+    }
+    if (pid==0) {
+        close(fd[0]);
+        execrun(fd[1],ts,te,popt,sopt,fopt,infile,n,imufile,odofile,dir);
+        _exit(0);
+    }
+    close(fd[1]);
+    memset(res,0,sizeof(benchres_t));
+    if (read(fd[0],res,sizeof(benchres_t))!=sizeof(benchres_t)) res->stat=0;
+    close(fd[0]);
+
+    if (wait4(pid,&status,0,&ru)<0) return 0;
+    *maxrss=ru.ru_maxrss;
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr,"run terminated by signal %d\n",WTERMSIG(status));
+    }
+    return res->stat&&WIFEXITED(status);
+}
+/* benchmark main --------------------------------------------------------------
+* see help text
+*-----------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    prcopt_t prcopt=prcopt_default,popt;
+    solopt_t solopt=solopt_default;
+    filopt_t filopt={""};
+    gtime_t ts={0},te={0};
+    benchres_t res;
+    FILE *fp;
+    double es[]={2000,1,1,0,0,0},ee[]={2000,12,31,23,59,59};
+    double rates[MAXRUN]={0},rate0=0.0;
+    long maxrss;
+    int i,j,k,n,nrate=0,nsys=0,nimu,sys[MAXRUN];
+    char *infile[MAXFILE],*imufile="../data/26082019/imu_ascii.txt",*odofile="";
+    char *csvfile="../out/bench.csv",*dir="/tmp",*tag="-",*exsats="";
+    char sysstr[MAXRUN][16],buff[1024],*p,rimufile[1024],exstr[1024]="-";
+
+    prcopt.mode=PMODE_KINEMA;
+    prcopt.refpos=1;
+    prcopt.glomodear=1;
+    solopt.timef=0;
+    sprintf(solopt.prog,"%s ver.%s",PROGNAME,VER_RTKLIB);
+
+    for (i=1;i<argc;i++) {
+        if (!strcmp(argv[i],"-k")&&i+1<argc) {
+            resetsysopts();
+            if (!loadopts(argv[++i],sysopts)) return -1;
+            getsysopts(&prcopt,&solopt,&filopt);
+        }
+    }
+    for (i=1,n=0;i<argc;i++) {
+        if      (!strcmp(argv[i],"-k")&&i+1<argc) ++i;
+        else if (!strcmp(argv[i],"-i")&&i+1<argc) imufile=argv[++i];
+        else if (!strcmp(argv[i],"-d")&&i+1<argc) odofile=argv[++i];
+        else if (!strcmp(argv[i],"-r")&&i+1<argc) {
+            strncpy(buff,argv[++i],sizeof(buff)-1); buff[sizeof(buff)-1]='\0';
+            for (p=strtok(buff,",");p&&nrate<MAXRUN;p=strtok(NULL,",")) {
+                rates[nrate++]=atof(p);
+            }
+        }
+        else if (!strcmp(argv[i],"-sys")&&i+1<argc) {
+            strncpy(buff,argv[++i],sizeof(buff)-1); buff[sizeof(buff)-1]='\0';
+            for (p=strtok(buff,",");p&&nsys<MAXRUN;p=strtok(NULL,",")) {
+                if (!(sys[nsys]=str2navsys(p))) {
+                    fprintf(stderr,"invalid constellation set: %s\n",p);
+                    return -1;
+                }
+                strncpy(sysstr[nsys],p,15); sysstr[nsys++][15]='\0';
+            }
+        }
+        else if (!strcmp(argv[i],"-x")&&i+1<argc) exsats=argv[++i];
+        else if (!strcmp(argv[i],"-ud")) udfilt=1;
+        else if (!strcmp(argv[i],"-arcold")) arcold=1;
+        else if (!strcmp(argv[i],"-lc")) lc=1;
+        else if (!strcmp(argv[i],"-noaid")) noaid=1;
+        else if (!strcmp(argv[i],"-fde")) fde=1;
+        else if (!strcmp(argv[i],"-ts")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",es,es+1,es+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",es+3,es+4,es+5);
+            ts=epoch2time(es);
+        }
+        else if (!strcmp(argv[i],"-te")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",ee,ee+1,ee+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",ee+3,ee+4,ee+5);
+            te=epoch2time(ee);
+        }
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) dir=argv[++i];
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) csvfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else if (n<MAXFILE) infile[n++]=argv[i];
+    }
+    if (n<=0) {
+        showmsg("error : no input file\n");
+        return -2;
+    }
+    if (!insgnsschkopt(&prcopt)) return -2;
+    if (nrate<=0) rates[nrate++]=0.0;
+    if (nsys<=0) {
+        sys[nsys]=prcopt.navsys;
+        strcpy(sysstr[nsys++],"conf");
+    }
+    solopt.trace=0;
+    *filopt.trace='\0';
+    if (*exsats) {
+        setexsats(&prcopt,exsats);
+        strncpy(exstr,exsats,sizeof(exstr)-1);
+        for (p=exstr;*p;p++) if (*p==',') *p=' ';
+    }
+
+    /* csv header for a new file */
+    if (!(fp=fopen(csvfile,"a"))) {
+        fprintf(stderr,"csv file open error: %s\n",csvfile);
+        return -1;
+    }
+    if (ftell(fp)==0) {
+        fprintf(fp,"tag,imu_rate_hz,navsys,exsats,epochs,imu_samples,wall_s,"
+                "epochs_per_s,imu_per_s,realtime_x,lat_p50_ms,lat_p90_ms,"
+                "lat_p99_ms,lat_max_ms,peak_rss_kb\n");
+    }
+    for (i=0;i<nrate;i++) {
+        sprintf(rimufile,"%s/%s_imu_%g.txt",dir,PROGNAME,rates[i]);
+        if ((nimu=resampleimu(imufile,rimufile,rates[i],&rate0))<0) {
+            fprintf(stderr,"imu resample error: %s\n",imufile);
+            fclose(fp);
+            return -1;
+        }
+        for (j=0;j<nsys;j++) {
+            popt=prcopt;
+            popt.navsys=sys[j];
+
+            fprintf(stderr,"run: imu=%.1fHz (%d samples) navsys=%s ...\n",
+                    rates[i]>0.0?rates[i]:rate0,nimu,sysstr[j]);
+
+            if (!benchrun(ts,te,&popt,&solopt,&filopt,infile,n,rimufile,
+                          odofile,dir,&res,&maxrss)) {
+                fprintf(stderr,"run error: imu=%gHz navsys=%s\n",rates[i],
+                        sysstr[j]);
+                continue;
+            }
+            fprintf(fp,"%s,%.1f,%s,%s,%d,%u,%.3f,%.2f,%.1f,%.2f",tag,
+                    rates[i]>0.0?rates[i]:rate0,sysstr[j],exstr,
+                    res.nep,res.nimu,res.wall,
+                    res.wall>0.0?res.nep/res.wall:0.0,
+                    res.wall>0.0?res.nimu/res.wall:0.0,
+                    res.wall>0.0?res.span/res.wall:0.0);
+            for (k=0;k<4;k++) fprintf(fp,",%.3f",res.lat[k]*1E3);
+            fprintf(fp,",%ld\n",maxrss);
+            fflush(fp);
+        }
+        remove(rimufile);
+    }
+    fclose(fp);
+    return 0;
+}
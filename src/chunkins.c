@@ -0,0 +1,636 @@
+/*------------------------------------------------------------------------------
+* chunkins.c : time-chunked parallel ins/gnss post-processing
+*
+* notes   : the session [ts,te] is split into chunks of equal data count, the
+*           mean of the fractions of observation records and imu samples
+*           (-eqt: chunks of equal length). every chunk is processed by postpos() and core() in its own child
+*           process, at most -p at a time. the global states of core() are
+*           per process, so the chunks do not share any filter state.
+*
+*           chunk k (k>0) starts -ov seconds before its nominal start t(k)
+*           and the solutions of chunk k-1 and k overlap in [t(k)-ov,t(k)].
+*           the stitched solution switches from chunk k-1 to chunk k at the
+*           overlap midpoint t(k)-ov/2 (seam), so chunk k has converged for
+*           ov/2 seconds at its seam. the imu log is sliced per chunk in one
+*           pass, so no chunk reads the imu samples before its start.
+*
+*           the differences of the two chunks at each seam and over the
+*           second half of the overlap are written to seams.txt.
+*
+*           solution times are gps time of week, a session must not cross a
+*           gps week boundary.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/14 1.0 new
+*           2019/10/21 1.1 chunks of equal observation/imu count
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "chunkins"          /* program name */
+#define MAXFILE     8                   /* max number of input files */
+#define MAXCHUNK    64                  /* max number of chunks */
+#define IMUMARGIN   2.0                 /* imu slice margin around chunk (s) */
+#define LEAPIMU     16.0                /* imu log time to gpst (s) (inputimu) */
+#define EPTOL       1E-3                /* time tolerance of epochs (s) */
+
+typedef struct {        /* time chunk */
+    gtime_t ts,te;      /* processed span (incl. warm-up) */
+    double s0,s1;       /* stitched span [s0,s1) (tow) */
+    char dir[1024];     /* chunk work directory */
+    pid_t pid;          /* child process (0:not running) */
+    int nobs,nimu;      /* observation records/imu samples of nominal span */
+    int stat;           /* status (1:ok,0:error) */
+    double cpu;         /* child cpu time (s) */
+    double wall;        /* child wall time (s) */
+    double t0;          /* start wall time (s) */
+} chunk_t;
+
+typedef struct {        /* stitched solution file */
+    const char *name;   /* file name */
+    int pos;            /* rtklib .pos "week tow ..." (1) or "tow ..." (0) */
+} stfile_t;
+
+static const stfile_t stfiles[]={ /* stitched files */
+    {"out_PVA.txt"        ,0},
+    {"out_IMU_bias.txt"   ,0},
+    {"out_KF_SD.txt"      ,0},
+    {"out_clock_file.txt" ,0},
+    {PROGNAME ".pos"      ,1}
+};
+static int lc=0;        /* loosely coupled ins/gnss (-lc) */
+static int udfilt=0;    /* u-d factorized ekf covariance (-ud) */
+static int eqtime=0;    /* chunks of equal length (-eqt) */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: chunkins [option]... file file [...]",
+  "",
+  " Split a long RINEX OBS/NAV/CLK/SP3 session and its tactical imu log into",
+  " time chunks, process the chunks in parallel child processes through the",
+  " ins/gnss processing and stitch the chunk solutions at the midpoints of",
+  " their warm-up overlaps.",
+  "",
+  " -?        print help",
+  " -k file   input options from configuration file [off]",
+  " -i file   tactical imu log [../data/26082019/imu_ascii.txt]",
+  " -d file   obd-ii vehicle speed file synchronized to gps time [off]",
+  " -n num    number of chunks [4]",
+  " -p num    max number of parallel processes [number of cpus]",
+  " -ov sec   warm-up overlap of chunks (s), seams at its midpoint [600]",
+  " -eqt      chunks of equal length [equal observation/imu count]",
+  " -lc       loosely coupled ins/gnss with gnss solution [tightly coupled]",
+  " -ud       u-d factorized (square-root) ekf covariance [off]",
+  " -ts ds ts start day/time (ds=y/m/d ts=h:m:s) [obs start time]",
+  " -te de te end day/time   (de=y/m/d te=h:m:s) [obs end time]",
+  " -w dir    work directory of chunks [/tmp/chunkins]",
+  " -o dir    output directory of stitched solution and seams.txt [../out]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock (s) ------------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* compare times ------------------------------------------------------------*/
+static int cmptime(const void *p1, const void *p2)
+{
+    double d=*(const double *)p1-*(const double *)p2;
+    return d<0.0?-1:(d>0.0?1:0);
+}
+/* read observation record times -------------------------------------------------
+* args   : char   *file     I   rinex obs file
+*          gtime_t *ts,*te  IO  session start/end time ({0}: obs start/end)
+*          double **t       O   sorted record times (s from ts) (free by caller)
+* return : number of records in [ts,te] (-1:error)
+* notes  : one record per satellite observation, so epochs are weighted by
+*          the number of satellites
+*-----------------------------------------------------------------------------*/
+static int readobst(const char *file, gtime_t *ts, gtime_t *te, double **t)
+{
+    obs_t obs={0};
+    gtime_t t0={0},t1,t2;
+    double span;
+    int i,n=0;
+
+    if (readrnxt(file,1,t0,t0,0.0,"",&obs,NULL,NULL)<=0||obs.n<=0) {
+        free(obs.data);
+        return -1;
+    }
+    t1=t2=obs.data[0].time;
+    for (i=1;i<obs.n;i++) {
+        if (timediff(obs.data[i].time,t1)<0.0) t1=obs.data[i].time;
+        if (timediff(obs.data[i].time,t2)>0.0) t2=obs.data[i].time;
+    }
+    if (ts->time==0) *ts=t1;
+    if (te->time==0) *te=t2;
+    span=timediff(*te,*ts);
+
+    if (!(*t=(double *)malloc(sizeof(double)*obs.n))) {
+        free(obs.data);
+        return -1;
+    }
+    for (i=0;i<obs.n;i++) {
+        t0=obs.data[i].time;
+        if (timediff(t0,*ts)<0.0||timediff(t0,*ts)>span) continue;
+        (*t)[n++]=timediff(t0,*ts);
+    }
+    free(obs.data);
+    qsort(*t,n,sizeof(double),cmptime);
+    return n;
+}
+/* read imu sample times -------------------------------------------------------
+* args   : char   *file     I   tactical imu log ("time fz fy fx wz wy wx")
+*          gtime_t ts       I   session start time
+*          double span      I   session span (s)
+*          double **t       O   sorted sample times (s from ts) (free by caller)
+* return : number of samples in [ts,ts+span] (-1:error)
+*-----------------------------------------------------------------------------*/
+static int readimut(const char *file, gtime_t ts, double span, double **t)
+{
+    FILE *fp;
+    double tow,t0=time2gpst(ts,NULL)-LEAPIMU,*p;
+    char buff[256];
+    int n=0,nmax=0;
+
+    if (!(fp=fopen(file,"r"))) return -1;
+    *t=NULL;
+    while (fgets(buff,sizeof(buff),fp)) {
+        if (sscanf(buff,"%lf",&tow)<1||tow<t0||tow>t0+span) continue;
+        if (n>=nmax) {
+            nmax=nmax<=0?65536:nmax*2;
+            if (!(p=(double *)realloc(*t,sizeof(double)*nmax))) {
+                free(*t); fclose(fp);
+                return -1;
+            }
+            *t=p;
+        }
+        (*t)[n++]=tow-t0;
+    }
+    fclose(fp);
+    qsort(*t,n,sizeof(double),cmptime);
+    return n;
+}
+/* number of sorted times up to t ---------------------------------------------*/
+static int ntime(const double *ts, int n, double t)
+{
+    int i=0,j=n,k;
+
+    while (i<j) {
+        k=(i+j)/2;
+        if (ts[k]<=t) i=k+1; else j=k;
+    }
+    return i;
+}
+/* fraction of data count up to t ----------------------------------------------*/
+static double datafrac(const double *to, int no, const double *ti, int ni,
+                       double t)
+{
+    if (no>0&&ni>0) {
+        return (ntime(to,no,t)/(double)no+ntime(ti,ni,t)/(double)ni)/2.0;
+    }
+    if (no>0) return ntime(to,no,t)/(double)no;
+    return ntime(ti,ni,t)/(double)ni;
+}
+/* chunk boundaries of equal data count ----------------------------------------
+* args   : double *to       I   sorted observation record times (s from start)
+*          int    no        I   number of observation records
+*          double *ti       I   sorted imu sample times (s from start)
+*          int    ni        I   number of imu samples
+*          double span      I   session span (s)
+*          int    n         I   number of chunks
+*          double *tb       O   chunk boundaries tb[0..n] (s from start)
+* return : none
+* notes  : boundary k is the first time where the mean of the observation and
+*          imu count fractions reaches k/n. a data type without any record is
+*          not used, without any record the chunks are of equal length
+*-----------------------------------------------------------------------------*/
+static void splitdata(const double *to, int no, const double *ti, int ni,
+                      double span, int n, double *tb)
+{
+    double a,b,c;
+    int i,k;
+
+    tb[0]=0.0; tb[n]=span;
+    for (k=1;k<n;k++) {
+        if (no<=0&&ni<=0) {
+            tb[k]=span*k/n;
+            continue;
+        }
+        for (a=tb[k-1],b=span,i=0;i<64&&b-a>EPTOL;i++) {
+            c=(a+b)/2.0;
+            if (datafrac(to,no,ti,ni,c)<(double)k/n) a=c; else b=c;
+        }
+        tb[k]=b;
+    }
+}
+/* slice tactical imu log to chunks --------------------------------------------
+* args   : char   *file     I   tactical imu log ("time fz fy fx wz wy wx")
+*          chunk_t *chk     I   chunks
+*          int    n         I   number of chunks
+* return : status (1:ok,0:error)
+* notes  : one pass over the log, a sample may belong to two chunks in the
+*          overlaps. the samples are written to dir/imu.txt of each chunk
+*-----------------------------------------------------------------------------*/
+static int sliceimu(const char *file, const chunk_t *chk, int n)
+{
+    FILE *fp,*ofp[MAXCHUNK]={0};
+    double t,ts[MAXCHUNK],te[MAXCHUNK];
+    char buff[256],path[1100];
+    int i,stat=1;
+
+    if (!(fp=fopen(file,"r"))) {
+        fprintf(stderr,"imu file open error: %s\n",file);
+        return 0;
+    }
+    for (i=0;i<n;i++) {
+        ts[i]=time2gpst(chk[i].ts,NULL)-LEAPIMU-IMUMARGIN;
+        te[i]=time2gpst(chk[i].te,NULL)-LEAPIMU+IMUMARGIN;
+        sprintf(path,"%s/imu.txt",chk[i].dir);
+        if (!(ofp[i]=fopen(path,"w"))) {
+            fprintf(stderr,"imu slice open error: %s\n",path);
+            stat=0;
+            break;
+        }
+    }
+    while (stat&&fgets(buff,sizeof(buff),fp)) {
+        if (sscanf(buff,"%lf",&t)<1) continue;
+        for (i=0;i<n;i++) {
+            if (t>=ts[i]&&t<=te[i]) fputs(buff,ofp[i]);
+        }
+    }
+    for (i=0;i<n;i++) if (ofp[i]) fclose(ofp[i]);
+    fclose(fp);
+    return stat;
+}
+/* process one chunk (child process) -----------------------------------------*/
+static int execchunk(const chunk_t *chk, prcopt_t *popt, solopt_t *sopt,
+                     filopt_t *fopt, char **infile, int n, const char *odofile)
+{
+    char imufile[1100],outfile[1100];
+    int stat;
+
+    /* solution logs of core() are not part of the output */
+    if (!freopen("/dev/null","w",stdout)) return 0;
+
+    sprintf(imufile,"%s/imu.txt",chk->dir);
+    sprintf(outfile,"%s/%s.pos",chk->dir,PROGNAME);
+
+    if (!insgnssinit(imufile,odofile,chk->dir)) return 0;
+    insgnssopt.udfilt=udfilt;
+    insgnssopt.lc=lc;
+    insgnssopt.ortho=sopt->height==1;
+
+    stat=!postpos(chk->ts,chk->te,0.0,0.0,popt,sopt,fopt,infile,n,outfile,"",
+                  "");
+    insgnssfree();
+    return stat;
+}
+/* start chunk process -------------------------------------------------------*/
+static int startchunk(chunk_t *chk, prcopt_t *popt, solopt_t *sopt,
+                      filopt_t *fopt, char **infile, int n,
+                      const char *odofile)
+{
+    pid_t pid;
+
+    fflush(stdout); fflush(stderr);
+    if ((pid=fork())<0) return 0;
+    if (pid==0) {
+        _exit(execchunk(chk,popt,sopt,fopt,infile,n,odofile)?0:1);
+    }
+    chk->pid=pid;
+    chk->t0=walltime();
+    return 1;
+}
+/* wait for any chunk process ------------------------------------------------*/
+static int waitchunk(chunk_t *chk, int n)
+{
+    struct rusage ru;
+    pid_t pid;
+    int i,status;
+
+    if ((pid=wait4(-1,&status,0,&ru))<=0) return -1;
+
+    for (i=0;i<n;i++) {
+        if (chk[i].pid!=pid) continue;
+        chk[i].pid=0;
+        chk[i].stat=WIFEXITED(status)&&WEXITSTATUS(status)==0;
+        chk[i].cpu=ru.ru_utime.tv_sec+ru.ru_utime.tv_usec*1E-6+
+                   ru.ru_stime.tv_sec+ru.ru_stime.tv_usec*1E-6;
+        chk[i].wall=walltime()-chk[i].t0;
+        return i;
+    }
+    return -1;
+}
+/* solution time of record (tow) (0.0:no record) -----------------------------*/
+static double rectime(const char *buff, int pos)
+{
+    double tow;
+    int week;
+
+    if (*buff=='%'||*buff=='#') return 0.0;
+    if (pos) return sscanf(buff,"%d %lf",&week,&tow)==2?tow:0.0;
+    return sscanf(buff,"%lf",&tow)==1?tow:0.0;
+}
+/* stitch chunk files ----------------------------------------------------------
+* args   : stfile_t *sf     I   stitched file
+*          chunk_t *chk     I   chunks
+*          int    n         I   number of chunks
+*          char   *outdir   I   output directory
+* return : number of records written (-1:error)
+* notes  : records of chunk k in [s0,s1) are kept, the header of chunk 0
+*-----------------------------------------------------------------------------*/
+static int stitch(const stfile_t *sf, const chunk_t *chk, int n,
+                  const char *outdir)
+{
+    FILE *fp,*ifp;
+    double t;
+    char buff[4096],path[1100];
+    int i,nrec=0;
+
+    sprintf(path,"%s/%s",outdir,sf->name);
+    if (!(fp=fopen(path,"w"))) return -1;
+
+    for (i=0;i<n;i++) {
+        sprintf(path,"%s/%s",chk[i].dir,sf->name);
+        if (!(ifp=fopen(path,"r"))) continue;
+        while (fgets(buff,sizeof(buff),ifp)) {
+            if ((t=rectime(buff,sf->pos))==0.0) {
+                if (i==0&&(*buff=='%'||*buff=='#')) fputs(buff,fp);
+                continue;
+            }
+            if (t<chk[i].s0-EPTOL||t>=chk[i].s1-EPTOL) continue;
+            fputs(buff,fp);
+            nrec++;
+        }
+        fclose(ifp);
+    }
+    fclose(fp);
+    return nrec;
+}
+/* read out_PVA records of time span -----------------------------------------*/
+static int readpva(const char *dir, double ts, double te, double *d, int nmax)
+{
+    FILE *fp;
+    double v[11];
+    char buff[1024],path[1100];
+    int n=0;
+
+    sprintf(path,"%s/out_PVA.txt",dir);
+    if (!(fp=fopen(path,"r"))) return 0;
+
+    while (n<nmax&&fgets(buff,sizeof(buff),fp)) {
+        if (sscanf(buff,"%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",v,v+1,
+                   v+2,v+3,v+4,v+5,v+6,v+7,v+8,v+9,v+10)<11) continue;
+        if (v[0]<ts-EPTOL||v[0]>te+EPTOL) continue;
+        memcpy(d+n++*11,v,sizeof(v));
+    }
+    fclose(fp);
+    return n;
+}
+/* differences of two pva records {dn,de,du,dv,dyaw} (m,m/s,deg) -------------*/
+static void pvadiff(const double *a, const double *b, double *d)
+{
+    double pos[3],r[3],rb[3],dr[3],enu[3];
+    int i;
+
+    pos[0]=a[1]*D2R; pos[1]=a[2]*D2R; pos[2]=a[3]; pos2ecef(pos,r);
+    pos[0]=b[1]*D2R; pos[1]=b[2]*D2R; pos[2]=b[3]; pos2ecef(pos,rb);
+    for (i=0;i<3;i++) dr[i]=rb[i]-r[i];
+    pos[0]=a[1]*D2R; pos[1]=a[2]*D2R;
+    ecef2enu(pos,dr,enu);
+    d[0]=enu[1]; d[1]=enu[0]; d[2]=enu[2];
+    d[3]=sqrt(SQR(b[4]-a[4])+SQR(b[5]-a[5])+SQR(b[6]-a[6]));
+    d[4]=fmod(b[9]-a[9]+540.0,360.0)-180.0;
+}
+/* report seam discontinuities -------------------------------------------------
+* args   : chunk_t *chk     I   chunks
+*          int    n         I   number of chunks
+*          double ov        I   warm-up overlap (s)
+*          FILE   *fp       I   report file
+* return : none
+* notes  : at the seam the ins solutions of both chunks at the last common
+*          epoch before the seam are compared. the rms is over the common
+*          epochs of the second half of the overlap (after the seam)
+*-----------------------------------------------------------------------------*/
+static void seamrep(const chunk_t *chk, int n, double ov, FILE *fp)
+{
+    double *a,*b,d[5],sd[2],s,dh,dhmax;
+    int i,j,k,na,nb,nmax,nc,js;
+
+    nmax=(int)(ov*1000.0)+16; /* up to 1 kHz imu epochs */
+    if (!(a=(double *)malloc(sizeof(double)*11*nmax*2))) return;
+    b=a+11*nmax;
+
+    fprintf(fp,"%% seam  tow(s)        dn(m)    de(m)    du(m)  dv(m/s) "
+            "dyaw(deg)  n  rms dh(m)  rms du(m) max dh(m)\n");
+
+    for (k=1;k<n;k++) {
+        s=chk[k].s0;
+        na=readpva(chk[k-1].dir,s,s+ov/2.0,a,nmax);
+        nb=readpva(chk[k  ].dir,s,s+ov/2.0,b,nmax);
+
+        sd[0]=sd[1]=0.0;
+        for (i=j=nc=0,js=-1,dhmax=0.0;i<na&&j<nb;) {
+            if (a[i*11]<b[j*11]-EPTOL) {i++; continue;}
+            if (b[j*11]<a[i*11]-EPTOL) {j++; continue;}
+            pvadiff(a+i*11,b+j*11,d);
+            if (js<0) {
+                js=nc;
+                fprintf(fp,"%4d %12.3f %8.3f %8.3f %8.3f %8.3f %8.3f",k,
+                        a[i*11],d[0],d[1],d[2],d[3],d[4]);
+            }
+            dh=SQR(d[0])+SQR(d[1]);
+            sd[0]+=dh; sd[1]+=SQR(d[2]);
+            if (dh>dhmax) dhmax=dh;
+            nc++; i++; j++;
+        }
+        if (js<0) {
+            fprintf(fp,"%4d %12.3f %8s %8s %8s %8s %8s",k,s,"-","-","-","-",
+                    "-");
+        }
+        fprintf(fp," %6d %9.3f %10.3f %9.3f\n",nc,nc>0?sqrt(sd[0]/nc):0.0,
+                nc>0?sqrt(sd[1]/nc):0.0,sqrt(dhmax));
+    }
+    free(a);
+}
+/* chunked processing main -----------------------------------------------------
+* see help text
+*-----------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    prcopt_t prcopt=prcopt_default;
+    solopt_t solopt=solopt_default;
+    filopt_t filopt={""};
+    gtime_t ts={0},te={0};
+    chunk_t chk[MAXCHUNK]={{{0}}};
+    FILE *fp;
+    double es[]={2000,1,1,0,0,0},ee[]={2000,12,31,23,59,59},ov=600.0,span,t0;
+    double wall,cpu=0.0,cpumax=0.0,tb[MAXCHUNK+1],*to=NULL,*ti=NULL;
+    int i,k,n,nchk=4,np=0,nrun=0,next=0,nrec,no,ni=0,stat=1;
+    char *infile[MAXFILE],*imufile="../data/26082019/imu_ascii.txt";
+    char *odofile="",*dir="/tmp/" PROGNAME,*outdir="../out",path[1100];
+    char s1[32],s2[32];
+
+    prcopt.mode=PMODE_KINEMA;
+    prcopt.refpos=1;
+    prcopt.glomodear=1;
+    solopt.timef=0;
+    sprintf(solopt.prog,"%s ver.%s",PROGNAME,VER_RTKLIB);
+
+    for (i=1;i<argc;i++) {
+        if (!strcmp(argv[i],"-k")&&i+1<argc) {
+            resetsysopts();
+            if (!loadopts(argv[++i],sysopts)) return -1;
+            getsysopts(&prcopt,&solopt,&filopt);
+        }
+    }
+    for (i=1,n=0;i<argc;i++) {
+        if      (!strcmp(argv[i],"-k")&&i+1<argc) ++i;
+        else if (!strcmp(argv[i],"-i")&&i+1<argc) imufile=argv[++i];
+        else if (!strcmp(argv[i],"-d")&&i+1<argc) odofile=argv[++i];
+        else if (!strcmp(argv[i],"-n")&&i+1<argc) nchk=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-p")&&i+1<argc) np=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-ov")&&i+1<argc) ov=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-lc")) lc=1;
+        else if (!strcmp(argv[i],"-ud")) udfilt=1;
+        else if (!strcmp(argv[i],"-eqt")) eqtime=1;
+        else if (!strcmp(argv[i],"-ts")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",es,es+1,es+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",es+3,es+4,es+5);
+            ts=epoch2time(es);
+        }
+        else if (!strcmp(argv[i],"-te")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",ee,ee+1,ee+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",ee+3,ee+4,ee+5);
+            te=epoch2time(ee);
+        }
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) dir=argv[++i];
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outdir=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else if (n<MAXFILE) infile[n++]=argv[i];
+    }
+    if (n<=0) {
+        showmsg("error : no input file\n");
+        return -2;
+    }
+    if (!insgnsschkopt(&prcopt)) return -2;
+    nchk=nchk<1?1:(nchk>MAXCHUNK?MAXCHUNK:nchk);
+    if (np<=0) np=(int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (np<=0) np=1;
+    if (ov<0.0) ov=0.0;
+    solopt.timef=0;
+    solopt.trace=0;
+    *filopt.trace='\0';
+
+    /* session span and data times */
+    if ((no=readobst(infile[0],&ts,&te,&to))<0) {
+        fprintf(stderr,"obs file read error: %s\n",infile[0]);
+        return -1;
+    }
+    if ((span=timediff(te,ts))<=0.0) {
+        fprintf(stderr,"invalid time span\n");
+        free(to);
+        return -1;
+    }
+    if ((ni=readimut(imufile,ts,span,&ti))<0) {
+        fprintf(stderr,"imu file open error: %s\n",imufile);
+        free(to);
+        return -1;
+    }
+    /* chunk boundaries */
+    if (eqtime) splitdata(NULL,0,NULL,0,span,nchk,tb);
+    else splitdata(to,no,ti,ni,span,nchk,tb);
+
+    /* chunks, seams at overlap midpoints */
+    for (k=0;k<nchk;k++) {
+        chk[k].ts=timeadd(ts,tb[k]-(k>0?ov:0.0));
+        chk[k].te=k<nchk-1?timeadd(ts,tb[k+1]):te;
+        chk[k].s0=k>0?time2gpst(timeadd(ts,tb[k]-ov/2.0),NULL):-1E9;
+        chk[k].nobs=ntime(to,no,tb[k+1])-(k>0?ntime(to,no,tb[k]):0);
+        chk[k].nimu=ntime(ti,ni,tb[k+1])-(k>0?ntime(ti,ni,tb[k]):0);
+        chk[k].s1=1E9;
+        if (k>0) chk[k-1].s1=chk[k].s0;
+        sprintf(chk[k].dir,"%s/chunk%02d",dir,k);
+        mkdir(dir,0755);
+        mkdir(chk[k].dir,0755);
+    }
+    free(to); free(ti);
+
+    fprintf(stderr,"slicing imu log: %s\n",imufile);
+    if (!sliceimu(imufile,chk,nchk)) return -1;
+
+    /* process chunks, at most np at a time */
+    t0=walltime();
+    while (next<nchk||nrun>0) {
+        while (next<nchk&&nrun<np) {
+            time2str(chk[next].ts,s1,0); time2str(chk[next].te,s2,0);
+            fprintf(stderr,"chunk %2d: %s-%s obs=%d imu=%d start\n",next,s1,s2,
+                    chk[next].nobs,chk[next].nimu);
+            if (!startchunk(chk+next,&prcopt,&solopt,&filopt,infile,n,
+                            odofile)) {
+                fprintf(stderr,"chunk %2d: fork error\n",next);
+                chk[next].stat=0;
+            }
+            else nrun++;
+            next++;
+        }
+        if ((k=waitchunk(chk,nchk))<0) break;
+        nrun--;
+        fprintf(stderr,"chunk %2d: %s wall=%.1fs cpu=%.1fs\n",k,
+                chk[k].stat?"ok":"error",chk[k].wall,chk[k].cpu);
+    }
+    wall=walltime()-t0;
+
+    for (k=0;k<nchk;k++) {
+        stat&=chk[k].stat;
+        cpu+=chk[k].cpu;
+        if (chk[k].cpu>cpumax) cpumax=chk[k].cpu;
+    }
+    /* stitch solutions and report seams */
+    mkdir(outdir,0755);
+    for (i=0;i<(int)(sizeof(stfiles)/sizeof(*stfiles));i++) {
+        if ((nrec=stitch(stfiles+i,chk,nchk,outdir))<0) {
+            fprintf(stderr,"output file open error: %s/%s\n",outdir,
+                    stfiles[i].name);
+            continue;
+        }
+        fprintf(stderr,"stitched %-20s %d records\n",stfiles[i].name,nrec);
+    }
+    sprintf(path,"%s/seams.txt",outdir);
+    if ((fp=fopen(path,"w"))) {
+        fprintf(fp,"%% %s: chunks=%d processes=%d overlap=%.1fs split=%s\n",
+                PROGNAME,nchk,np,ov,eqtime?"time":"count");
+        fprintf(fp,"%% wall=%.2fs cpu=%.2fs max chunk cpu=%.2fs "
+                "speedup=%.2f bound=%.2f\n",wall,cpu,cpumax,
+                wall>0.0?cpu/wall:0.0,cpumax>0.0?cpu/cpumax:0.0);
+        seamrep(chk,nchk,ov,fp);
+        fclose(fp);
+    }
+    fprintf(stderr,"wall=%.2fs cpu=%.2fs speedup=%.2f (bound %.2f with %d "
+            "processes)\n",wall,cpu,wall>0.0?cpu/wall:0.0,
+            cpumax>0.0?cpu/cpumax:0.0,nchk);
+    return stat?0:-1;
+}
@@ -0,0 +1,516 @@
+/*------------------------------------------------------------------------------
+* convins.c : sequential vs parallel rinex conversion check
+*
+* notes   : converts a raw receiver log to RINEX with convrnx() once
+*           sequentially (nthread=1) and once per given number of decoding
+*           threads, compares the output files with the sequential ones and
+*           reports the wall times and the speedups. the "PGM / RUN BY / DATE"
+*           header lines hold the conversion time and are not compared.
+*
+*           with -gen, a RTCM 3 log is first encoded from RINEX OBS/NAV
+*           files (1005/1033 station, 1019/1020 ephemerides, 1077/1087 MSM7
+*           observations), repeated -rep times shifted by the session length
+*           and with garbage bytes between messages every GENGARB epochs, so
+*           the chunk boundary search of the parallel decoder is exercised on
+*           a log of any size.
+*
+*           with -gen and -r sbf, a Septentrio SBF log is encoded instead
+*           (5891 gps ephemerides, 4027 MeasEpoch with one type-1 sub-block
+*           of L1 C/A per gps/glonass satellite). the type-2 sub-blocks of
+*           the decoder can not hold real L2 offsets and glonass ephemerides
+*           are read with a 16-bit toe, so both are not encoded. the carrier
+*           phase is shifted by whole cycles per arc to fit the type-1 range.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/20 1.0 new
+*           2019/10/21 1.1 add sbf log (-r sbf)
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "convins"           /* program name */
+#define MAXFILE     8                   /* max number of input files */
+#define MAXRUN      16                  /* max number of thread counts */
+#define NOUTF       7                   /* number of rinex output files */
+#define GENEPH      30.0                /* ephemeris interval of -gen (s) */
+#define GENSTA      10.0                /* station interval of -gen (s) */
+#define GENGARB     97                  /* garbage interval of -gen (epochs) */
+#define SBFMAXCP    8000.0              /* max type-1 carrier offset (cycle) */
+
+static const char *outext[NOUTF]={ /* output file extensions */
+    "obs","nav","gnav","hnav","qnav","lnav","sbs"
+};
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: convins [option]... file",
+  "        convins -gen file [-rep n] obsfile navfile [...]",
+  "",
+  " Convert a raw receiver log to RINEX sequentially and with parallel",
+  " decoding threads, compare the outputs and report the speedups.",
+  "",
+  " -?        print help",
+  " -r fmt    log format (rtcm3,ubx,oem4,sbf) [rtcm3]",
+  " -n list   numbers of decoding threads separated by ',' [2,4]",
+  " -tr y/m/d h:m:s approx log start time (rtcm3) [system time]",
+  " -w dir    work directory of rinex outputs [/tmp]",
+  " -gen file encode rinex obs/nav files to a rtcm3 or sbf (-r) log (file)",
+  "           and exit",
+  " -rep n    repetitions of the session in -gen [1]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock time (s) -------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* shift time if set ---------------------------------------------------------*/
+static gtime_t shifttime(gtime_t t, double off)
+{
+    return t.time?timeadd(t,off):t;
+}
+/* write rtcm3 message -------------------------------------------------------*/
+static void outrtcm3(FILE *fp, rtcm_t *rtcm, int type, int sync)
+{
+    if (gen_rtcm3(rtcm,type,sync)) fwrite(rtcm->buff,1,rtcm->nbyte,fp);
+}
+/* set little-endian fields of sbf block -------------------------------------*/
+static void setU2(unsigned char *p, unsigned short u) {memcpy(p,&u,2);}
+static void setU4(unsigned char *p, unsigned int   u) {memcpy(p,&u,4);}
+static void setI4(unsigned char *p, int            i) {memcpy(p,&i,4);}
+static void setR4(unsigned char *p, float          r) {memcpy(p,&r,4);}
+static void setR8(unsigned char *p, double         r) {memcpy(p,&r,8);}
+
+/* write sbf block (body from buff+14) ---------------------------------------*/
+static void outsbf(FILE *fp, unsigned char *buff, int id, int len, gtime_t time)
+{
+    double tow;
+    int week;
+
+    len=(len+3)/4*4; /* padded to 4 bytes */
+    tow=time2gpst(time,&week);
+    buff[0]='$'; buff[1]='@';
+    setU2(buff+4,(unsigned short)id);
+    setU2(buff+6,(unsigned short)len);
+    setU4(buff+8,(unsigned int)floor(tow*1000.0+0.5));
+    setU2(buff+12,(unsigned short)week);
+    setU2(buff+2,crc16(buff+4,len-4));
+    fwrite(buff,1,len,fp);
+}
+/* nearest ephemeris of satellite (-1:none) ----------------------------------*/
+static int neareph(const nav_t *nav, int sat, gtime_t time)
+{
+    double dt,dtmin=1E9;
+    int i,k=-1,prn,sys=satsys(sat,&prn);
+
+    if (sys==SYS_GPS) {
+        for (i=0;i<nav->n;i++) {
+            if (nav->eph[i].sat!=sat) continue;
+            if ((dt=fabs(timediff(nav->eph[i].toe,time)))<dtmin) {dtmin=dt; k=i;}
+        }
+    }
+    else if (sys==SYS_GLO) {
+        for (i=0;i<nav->ng;i++) {
+            if (nav->geph[i].sat!=sat) continue;
+            if ((dt=fabs(timediff(nav->geph[i].toe,time)))<dtmin) {dtmin=dt; k=i;}
+        }
+    }
+    return k;
+}
+/* encode ephemerides of epoch -----------------------------------------------*/
+static void geneph(FILE *fp, rtcm_t *rtcm, const nav_t *nav, const obsd_t *obs,
+                   int n, gtime_t time, double off, int rep)
+{
+    eph_t *eph;
+    geph_t *geph;
+    int i,k,prn,sat,sys;
+
+    for (i=0;i<n;i++) {
+        sat=obs[i].sat;
+        sys=satsys(sat,&prn);
+        if ((k=neareph(nav,sat,obs[i].time))<0) continue;
+        rtcm->ephsat=sat;
+        rtcm->time=time;
+
+        if (sys==SYS_GPS) {
+            eph=rtcm->nav.eph+sat-1;
+            *eph=nav->eph[k];
+            eph->toe=shifttime(eph->toe,off);
+            eph->toc=shifttime(eph->toc,off);
+            eph->ttr=shifttime(eph->ttr,off);
+            eph->iode=(eph->iode+rep*7)%256; /* new iode per repetition */
+            eph->iodc=(eph->iodc&0x300)|eph->iode;
+            outrtcm3(fp,rtcm,1019,0);
+        }
+        else if (sys==SYS_GLO) {
+            geph=rtcm->nav.geph+prn-1;
+            *geph=nav->geph[k];
+            geph->toe=shifttime(geph->toe,off);
+            geph->tof=shifttime(geph->tof,off);
+            outrtcm3(fp,rtcm,1020,0);
+        }
+    }
+}
+/* encode gps ephemerides of epoch to sbf ------------------------------------*/
+static void sbfeph(FILE *fp, const nav_t *nav, const obsd_t *obs, int n,
+                   gtime_t time, double off, int rep)
+{
+    eph_t eph;
+    unsigned char buff[MAXRAWLEN];
+    double toes,toc;
+    int i,k,prn,week;
+
+    for (i=0;i<n;i++) {
+        if (satsys(obs[i].sat,&prn)!=SYS_GPS) continue;
+        if ((k=neareph(nav,obs[i].sat,obs[i].time))<0) continue;
+        eph=nav->eph[k];
+        toes=time2gpst(shifttime(eph.toe,off),&week);
+        toc=time2gpst(shifttime(eph.toc,off),NULL);
+        eph.iode=(eph.iode+rep*7)%256; /* new iode per repetition */
+        eph.iodc=(eph.iodc&0x300)|eph.iode;
+
+        memset(buff,0,sizeof(buff));
+        buff[14]=(unsigned char)prn;
+        setU2(buff+16,(unsigned short)week);
+        buff[18]=(unsigned char)eph.code;
+        buff[19]=(unsigned char)eph.sva;
+        buff[21]=(unsigned char)eph.flag;
+        setU2(buff+22,(unsigned short)eph.iodc);
+        buff[24]=(unsigned char)eph.iode;
+        setR4(buff+ 28,(float)eph.tgd[0]);
+        setU4(buff+ 32,(unsigned int)toc);
+        setR4(buff+ 36,(float)eph.f2);
+        setR4(buff+ 40,(float)eph.f1);
+        setR4(buff+ 44,(float)eph.f0);
+        setR4(buff+ 48,(float)eph.crs);
+        setR4(buff+ 52,(float)(eph.deln/PI));
+        setR8(buff+ 56,eph.M0/PI);
+        setR4(buff+ 64,(float)eph.cuc);
+        setR8(buff+ 68,eph.e);
+        setR4(buff+ 76,(float)eph.cus);
+        setR8(buff+ 80,sqrt(eph.A));
+        setU4(buff+ 88,(unsigned int)toes);
+        setR4(buff+ 92,(float)eph.cic);
+        setR8(buff+ 96,eph.OMG0/PI);
+        setR4(buff+104,(float)eph.cis);
+        setR8(buff+108,eph.i0/PI);
+        setR4(buff+116,(float)eph.crc);
+        setR8(buff+120,eph.omg/PI);
+        setR4(buff+128,(float)(eph.OMGd/PI));
+        setR4(buff+132,(float)(eph.idot/PI));
+        outsbf(fp,buff,5891,136,time);
+    }
+}
+/* encode observations of epoch to sbf MeasEpoch -------------------------------
+* amb/tarc hold the whole cycles removed from the carrier phase and the start
+* of the arc per satellite
+*-----------------------------------------------------------------------------*/
+static void sbfmeas(FILE *fp, const nav_t *nav, const obsd_t *obs, int n,
+                    double *amb, gtime_t *tarc)
+{
+    unsigned char buff[MAXRAWLEN],*p=buff+20;
+    double lam,psr,mm,msb,cp;
+    int i,k,m=0,prn,sys,frq=0,svid,sig,lock;
+
+    memset(buff,0,sizeof(buff));
+
+    for (i=0;i<n&&20+(m+1)*20<=MAXRAWLEN;i++) {
+        sys=satsys(obs[i].sat,&prn);
+        if (obs[i].P[0]==0.0||obs[i].L[0]==0.0) continue;
+        if (sys==SYS_GPS&&prn<=37) {
+            svid=prn; sig=0;
+            lam=299792458/1575.42e6;
+        }
+        else if (sys==SYS_GLO) {
+            for (k=0;k<nav->ng;k++) if (nav->geph[k].sat==obs[i].sat) break;
+            if (k>=nav->ng) continue;
+            frq=nav->geph[k].frq;
+            svid=prn+37; sig=8;
+            lam=299792458/(1602.00e6+562.50e3*frq);
+        }
+        else continue;
+
+        /* pseudorange as decoded (mm with msb scale 4294967296.296) */
+        mm=floor(obs[i].P[0]*1000.0+0.5);
+        msb=floor(mm/4294967296.0);
+        psr=(msb*4294967296.296+(mm-msb*4294967296.0))*0.001;
+
+        /* carrier phase offset to pseudorange less whole cycles of arc */
+        cp=obs[i].L[0]-psr/lam-amb[obs[i].sat-1];
+        if (tarc[obs[i].sat-1].time==0||fabs(cp)>SBFMAXCP||(obs[i].LLI[0]&1)) {
+            amb[obs[i].sat-1]=floor(obs[i].L[0]-psr/lam+0.5);
+            tarc[obs[i].sat-1]=obs[i].time;
+            cp=obs[i].L[0]-psr/lam-amb[obs[i].sat-1];
+        }
+        cp=floor(cp*1000.0+0.5);
+        lock=(int)timediff(obs[i].time,tarc[obs[i].sat-1]);
+
+        p[0]=(unsigned char)m;
+        p[1]=(unsigned char)sig;
+        p[2]=(unsigned char)svid;
+        p[3]=(unsigned char)msb&0x0F;
+        setU4(p+4,(unsigned int)(mm-msb*4294967296.0));
+        setI4(p+8,(int)floor(obs[i].D[0]*1E4+0.5));
+        setU2(p+12,(unsigned short)(cp-floor(cp/65536.0)*65536.0));
+        p[14]=(unsigned char)(signed char)floor(cp/65536.0);
+        p[15]=(unsigned char)(obs[i].SNR[0]>40?obs[i].SNR[0]-40:0);
+        setU2(p+16,(unsigned short)(lock<65535?lock:65535));
+        p[18]=(unsigned char)(sys==SYS_GLO?(frq+8)<<3:0);
+        p+=20; m++;
+    }
+    if (m<=0) return;
+    buff[14]=(unsigned char)m; /* N1 */
+    buff[15]=20;               /* SB1Length */
+    buff[16]=12;               /* SB2Length */
+    outsbf(fp,buff,4027,20+m*20,obs[0].time);
+}
+/* write garbage with false preambles ----------------------------------------*/
+static void outgarb(FILE *fp, int format, unsigned int *seed)
+{
+    int k,m,c=0;
+
+    *seed=*seed*1103515245+12345;
+    for (k=0,m=20+(*seed>>8)%600;k<m;k++) {
+        *seed=*seed*1103515245+12345;
+        if (format==STRFMT_SEPT&&c=='$') c='@';
+        else if (k==0||(*seed>>8)%50==0) c=format==STRFMT_SEPT?'$':0xD3;
+        else c=(int)((*seed>>8)&0xFF);
+        fputc(c,fp);
+    }
+}
+/* encode rinex obs/nav files to rtcm3 or sbf log ----------------------------*/
+static int genlog(const char *file, int format, char **infile, int n,
+                  int nrep, gtime_t *ts)
+{
+    FILE *fp;
+    obs_t obs={0};
+    nav_t nav={0};
+    rtcm_t *rtcm;
+    obsd_t data[MAXOBS];
+    gtime_t time,teph={0},tsta={0},tarc[MAXSAT]={{0}};
+    double off,span,amb[MAXSAT]={0};
+    char tstr[32];
+    unsigned int seed=12345;
+    int i,j,k,q,nep=0,nr;
+
+    for (i=0;i<n;i++) readrnx(infile[i],1,"",&obs,&nav,NULL);
+    if (obs.n<=0) {
+        fprintf(stderr,"no observation data\n");
+        freeobs(&obs); freenav(&nav,0xFF);
+        return 0;
+    }
+    sortobs(&obs);
+    uniqnav(&nav);
+
+    if (!(rtcm=(rtcm_t *)malloc(sizeof(rtcm_t)))||!init_rtcm(rtcm)||
+        !(fp=fopen(file,"wb"))) {
+        fprintf(stderr,"log file open error: %s\n",file);
+        if (rtcm) free_rtcm(rtcm);
+        free(rtcm);
+        freeobs(&obs); freenav(&nav,0xFF);
+        return 0;
+    }
+    rtcm->staid=1;
+    *ts=obs.data[0].time;
+    span=timediff(obs.data[obs.n-1].time,*ts)+1.0;
+
+    for (q=0;q<nrep;q++) {
+        off=q*span;
+        for (i=0;i<obs.n;i=j) {
+            for (j=i;j<obs.n&&timediff(obs.data[j].time,obs.data[i].time)==0.0;
+                 j++) ;
+            time=timeadd(obs.data[i].time,off);
+
+            if (teph.time==0||timediff(time,teph)>=GENEPH) {
+                if (format==STRFMT_SEPT) {
+                    sbfeph(fp,&nav,obs.data+i,j-i,time,off,q);
+                }
+                else geneph(fp,rtcm,&nav,obs.data+i,j-i,time,off,q);
+                teph=time;
+            }
+            if (format==STRFMT_RTCM3&&
+                (tsta.time==0||timediff(time,tsta)>=GENSTA)) {
+                rtcm->time=time;
+                outrtcm3(fp,rtcm,1005,0);
+                outrtcm3(fp,rtcm,1033,0);
+                tsta=time;
+            }
+            for (k=nr=0;k<j-i&&k<MAXOBS;k++) {
+                data[k]=obs.data[i+k];
+                data[k].time=time;
+                if (satsys(data[k].sat,NULL)==SYS_GLO) nr++;
+            }
+            if (format==STRFMT_SEPT) {
+                sbfmeas(fp,&nav,data,k,amb,tarc);
+            }
+            else {
+                rtcm->time=time;
+                rtcm->obs.data=data;
+                rtcm->obs.n=k;
+                outrtcm3(fp,rtcm,1077,nr>0);
+                if (nr>0) outrtcm3(fp,rtcm,1087,0);
+                rtcm->obs.data=NULL;
+                rtcm->obs.n=0;
+            }
+            /* garbage with false preambles */
+            if (++nep%GENGARB==0) outgarb(fp,format,&seed);
+        }
+    }
+    time2str(*ts,tstr,0);
+    fprintf(stderr,"%s: %d epochs x %d, %ld bytes, start %s (-tr)\n",file,
+            nep/nrep,nrep,ftell(fp),tstr);
+    fclose(fp);
+    free_rtcm(rtcm);
+    free(rtcm);
+    freeobs(&obs); freenav(&nav,0xFF);
+    return 1;
+}
+/* compare rinex files except run time lines (1:same) ------------------------*/
+static int cmpfile(const char *file1, const char *file2)
+{
+    FILE *fp1,*fp2;
+    char buff1[1024],*p1,buff2[1024],*p2;
+    int stat=1;
+
+    fp1=fopen(file1,"r");
+    fp2=fopen(file2,"r");
+    if (!fp1||!fp2) {
+        stat=!fp1&&!fp2; /* both not written */
+        if (fp1) fclose(fp1);
+        if (fp2) fclose(fp2);
+        return stat;
+    }
+    while (stat) {
+        p1=fgets(buff1,sizeof(buff1),fp1);
+        p2=fgets(buff2,sizeof(buff2),fp2);
+        if (!p1||!p2) {
+            stat=!p1&&!p2;
+            break;
+        }
+        if (strstr(buff1,"PGM / RUN BY / DATE")&&
+            strstr(buff2,"PGM / RUN BY / DATE")) continue;
+        stat=!strcmp(buff1,buff2);
+    }
+    fclose(fp1);
+    fclose(fp2);
+    return stat;
+}
+/* convert log with decoding threads (wall time, <0:error) -------------------*/
+static double convlog(int format, const rnxopt_t *opt, const char *file,
+                      const char *dir, int nthread)
+{
+    rnxopt_t opt_=*opt;
+    char path[NOUTF][1024],*ofile[NOUTF];
+    double t0;
+    int i,stat;
+
+    for (i=0;i<NOUTF;i++) {
+        sprintf(path[i],"%s/%s_%d.%s",dir,PROGNAME,nthread,outext[i]);
+        remove(path[i]);
+        ofile[i]=path[i];
+    }
+    opt_.nthread=nthread;
+
+    t0=walltime();
+    stat=convrnx(format,&opt_,file,ofile);
+    return stat>0?walltime()-t0:-1.0;
+}
+int main(int argc, char **argv)
+{
+    rnxopt_t opt={{0}};
+    gtime_t ts={0};
+    double ep[6]={0},t1,tn;
+    char *infile[MAXFILE],*file="",*genfile="",*dir="/tmp",*fmt="rtcm3",*p;
+    char buff[256],path1[1024],pathn[1024];
+    int i,j,n=0,nrep=1,format,nthr[MAXRUN]={2,4},nrun=2,same,stat=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-r")&&i+1<argc) fmt=argv[++i];
+        else if (!strcmp(argv[i],"-n")&&i+1<argc) {
+            strncpy(buff,argv[++i],sizeof(buff)-1); buff[sizeof(buff)-1]='\0';
+            for (nrun=0,p=strtok(buff,",");p&&nrun<MAXRUN;p=strtok(NULL,",")) {
+                nthr[nrun++]=atoi(p);
+            }
+        }
+        else if (!strcmp(argv[i],"-tr")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",ep,ep+1,ep+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",ep+3,ep+4,ep+5);
+            ts=epoch2time(ep);
+        }
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) dir=argv[++i];
+        else if (!strcmp(argv[i],"-gen")&&i+1<argc) genfile=argv[++i];
+        else if (!strcmp(argv[i],"-rep")&&i+1<argc) nrep=atoi(argv[++i]);
+        else if (*argv[i]=='-') printhelp();
+        else if (n<MAXFILE) infile[n++]=argv[i];
+    }
+    if      (!strcmp(fmt,"rtcm3")) format=STRFMT_RTCM3;
+    else if (!strcmp(fmt,"ubx"  )) format=STRFMT_UBX;
+    else if (!strcmp(fmt,"oem4" )) format=STRFMT_OEM4;
+    else if (!strcmp(fmt,"sbf"  )) format=STRFMT_SEPT;
+    else {
+        fprintf(stderr,"invalid log format: %s\n",fmt);
+        return -1;
+    }
+    /* encode rtcm3 or sbf log */
+    if (*genfile) {
+        if (n<=0) printhelp();
+        if (format!=STRFMT_RTCM3&&format!=STRFMT_SEPT) {
+            fprintf(stderr,"-gen supports rtcm3 and sbf: %s\n",fmt);
+            return -1;
+        }
+        return genlog(genfile,format,infile,n,nrep<1?1:nrep,&ts)?0:-1;
+    }
+    if (n<=0) printhelp();
+    file=infile[0];
+    opt.rnxver=3.02;
+    opt.navsys=SYS_ALL;
+    opt.obstype=OBSTYPE_ALL;
+    opt.freqtype=FREQTYPE_ALL;
+    opt.trtcm=ts;
+    for (i=0;i<6;i++) memset(opt.mask[i],'1',63);
+
+    /* sequential reference conversion */
+    if ((t1=convlog(format,&opt,file,dir,1))<0.0) {
+        fprintf(stderr,"conversion error: %s\n",file);
+        return -1;
+    }
+    fprintf(stdout,"%s: %s format=%s\n",PROGNAME,file,fmt);
+    fprintf(stdout,"%8s %9s %8s %s\n","threads","wall(s)","speedup","output");
+    fprintf(stdout,"%8d %9.2f %8.2f %s\n",1,t1,1.0,"reference");
+
+    for (j=0;j<nrun;j++) {
+        if (nthr[j]<=1) continue;
+        if ((tn=convlog(format,&opt,file,dir,nthr[j]))<0.0) {
+            fprintf(stdout,"%8d %9s %8s %s\n",nthr[j],"-","-","error");
+            stat=1;
+            continue;
+        }
+        for (i=0,same=1;i<NOUTF;i++) {
+            sprintf(path1,"%s/%s_%d.%s",dir,PROGNAME,1,outext[i]);
+            sprintf(pathn,"%s/%s_%d.%s",dir,PROGNAME,nthr[j],outext[i]);
+            if (!cmpfile(path1,pathn)) {
+                fprintf(stderr,"output differs: %s %s\n",path1,pathn);
+                same=0;
+            }
+        }
+        fprintf(stdout,"%8d %9.2f %8.2f %s\n",nthr[j],tn,tn>0.0?t1/tn:0.0,
+                same?"identical":"DIFFERS");
+        if (!same) stat=1;
+    }
+    return stat;
+}
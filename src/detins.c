@@ -0,0 +1,265 @@
+/*------------------------------------------------------------------------------
+* detins.c : motion detector check on static and turning segments
+*
+* notes   : runs the incremental motion detector (MotionDetector.c) on an imu
+*           log and the gnss speed of a true trajectory, and checks the
+*           detected static/turning states against labels derived from the
+*           trajectory.
+*
+*           the trajectory is the truth file of siminsgnss ("week tow lat
+*           lon hgt vn ve vd roll pitch yaw dtr"). its speed is fed to the
+*           detector as gnss speed at every epoch, the imu samples up to the
+*           epoch before it. labels are taken from the speed and the yaw rate
+*           (central difference of yaw) of the trajectory:
+*
+*           static   : speed below LBLSTAT, moving above LBLMOVE
+*           turning  : |yaw rate| above LBLTURN x turning enter threshold,
+*                      straight below LBLSTRT x turning leave threshold
+*
+*           a label is used only if it holds over +/-guard seconds, so the
+*           transitions and the window latency of the detector are not
+*           scored. the agreement of detected and labelled states is
+*           reported per class (classes without labelled epochs are not
+*           scored) and the exit status is 1 if any class is below the
+*           minimum agreement.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/20 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "detins"            /* program name */
+#define IMULEAP     16.0                /* imu log time to gps time (s) */
+#define LBLSTAT     0.05                /* static label max speed (m/s) */
+#define LBLMOVE     1.0                 /* moving label min speed (m/s) */
+#define LBLTURN     1.2                 /* turning label factor of gyron */
+#define LBLSTRT     0.5                 /* straight label factor of gyroff */
+
+typedef struct {        /* true trajectory */
+    int n,nmax;         /* number/allocated of epochs */
+    double *t;          /* time of week (s) */
+    double *spd;        /* speed (m/s) */
+    double *yaw;        /* yaw (rad) */
+} truth_t;
+
+typedef struct {        /* agreement of detected and labelled states */
+    int n[2][2];        /* number of epochs [label][detected] */
+} agree_t;
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: detins [option]... -i imu truth",
+  "",
+  " Run the motion detector on an imu log (tactical kvh text) and the speed",
+  " of a true trajectory (siminsgnss truth file) and check the detected",
+  " static and turning states against labels from the trajectory.",
+  "",
+  " -?        print help",
+  " -i file   imu log (tactical kvh text)",
+  " -low      low-cost imu thresholds of the detector [tactical]",
+  " -g guard  label guard time around state changes (s) [1.0]",
+  " -m ratio  min agreement of every state class [0.95]",
+  " -o file   epoch states (\"tow speed yawrate stat_lbl stat_det turn_lbl",
+  "           turn_det\") [off]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* extend true trajectory buffers -------------------------------------------*/
+static int growtruth(truth_t *trj)
+{
+    double *p;
+    int nmax=trj->nmax<=0?4096:trj->nmax*2;
+
+    if (!(p=(double *)realloc(trj->t,sizeof(double)*nmax))) return 0;
+    trj->t=p;
+    if (!(p=(double *)realloc(trj->spd,sizeof(double)*nmax))) return 0;
+    trj->spd=p;
+    if (!(p=(double *)realloc(trj->yaw,sizeof(double)*nmax))) return 0;
+    trj->yaw=p;
+    trj->nmax=nmax;
+    return 1;
+}
+/* read true trajectory ------------------------------------------------------*/
+static int readtruth(const char *file, truth_t *trj)
+{
+    FILE *fp;
+    double week,t,pos[3],vn[3],rpy[3];
+    char buff[256];
+
+    if (!(fp=fopen(file,"r"))) {
+        fprintf(stderr,"truth file open error: %s\n",file);
+        return 0;
+    }
+    while (fgets(buff,sizeof(buff),fp)) {
+        if (buff[0]=='%') continue;
+        if (sscanf(buff,"%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",&week,&t,
+                   pos,pos+1,pos+2,vn,vn+1,vn+2,rpy,rpy+1,rpy+2)<11) continue;
+        if (trj->n>=trj->nmax&&!growtruth(trj)) {
+            fclose(fp);
+            return 0;
+        }
+        trj->t  [trj->n]=t;
+        trj->spd[trj->n]=norm(vn,3);
+        trj->yaw[trj->n]=rpy[2]*D2R;
+        trj->n++;
+    }
+    fclose(fp);
+    return trj->n;
+}
+/* free true trajectory -----------------------------------------------------*/
+static void freetruth(truth_t *trj)
+{
+    free(trj->t); free(trj->spd); free(trj->yaw);
+    trj->t=trj->spd=trj->yaw=NULL;
+    trj->n=trj->nmax=0;
+}
+/* yaw rate of epoch by central difference (rad/s) ---------------------------*/
+static double yawrate(const truth_t *trj, int k)
+{
+    int i=k>0?k-1:k,j=k<trj->n-1?k+1:k;
+    double dyaw;
+
+    if (i==j||trj->t[j]<=trj->t[i]) return 0.0;
+    dyaw=trj->yaw[j]-trj->yaw[i];
+    if (dyaw> PI) dyaw-=2.0*PI;
+    if (dyaw<-PI) dyaw+=2.0*PI;
+    return dyaw/(trj->t[j]-trj->t[i]);
+}
+/* state labels of epoch over guard time (-1:none) ---------------------------*/
+static void label(const truth_t *trj, const motdet_t *det, int k, double guard,
+                  int *lstat, int *lturn)
+{
+    double yr;
+    int i,nstat=0,nmove=0,nturn=0,nstrt=0,n=0;
+
+    for (i=k;i>=0&&trj->t[k]-trj->t[i]<=guard;i--) ;
+    for (i++;i<trj->n&&trj->t[i]-trj->t[k]<=guard;i++,n++) {
+        yr=fabs(yawrate(trj,i));
+        if (trj->spd[i]<LBLSTAT) nstat++;
+        if (trj->spd[i]>LBLMOVE) {
+            nmove++;
+            if (yr>LBLTURN*det->gyron) nturn++;
+            if (yr<LBLSTRT*det->gyroff) nstrt++;
+        }
+    }
+    *lstat=nstat==n?1:(nmove==n?0:-1);
+    *lturn=nturn==n?1:(nstrt==n?0:-1);
+}
+/* read imu sample (tactical kvh text) ---------------------------------------*/
+static int readimu(FILE *fp, double *t, double *fb, double *wb)
+{
+    double f[3],w[3];
+    char buff[256];
+
+    while (fgets(buff,sizeof(buff),fp)) {
+        if (sscanf(buff,"%lf %lf %lf %lf %lf %lf %lf",t,f+2,f+1,f,w+2,w+1,
+                   w)<7) continue;
+        *t+=IMULEAP;
+        fb[0]=f[0]*Gcte; fb[1]=f[1]*Gcte; fb[2]=f[2]*Gcte;
+        wb[0]=w[0]*D2R;  wb[1]=w[1]*D2R;  wb[2]=w[2]*D2R;
+        return 1;
+    }
+    return 0;
+}
+/* agreement ratio of state class --------------------------------------------*/
+static double ratio(const agree_t *a, int lbl)
+{
+    int n=a->n[lbl][0]+a->n[lbl][1];
+    return n>0?(double)a->n[lbl][lbl]/n:1.0;
+}
+/* output agreement of state -------------------------------------------------*/
+static int outagree(const agree_t *a, const char *name, const char *s1,
+                    const char *s0, double minr)
+{
+    int i,stat=1;
+
+    fprintf(stdout,"%-8s: %8s %8s %8s\n",name,"label","epochs","agree");
+    for (i=1;i>=0;i--) {
+        if (a->n[i][0]+a->n[i][1]<=0) {
+            fprintf(stdout,"%-8s  %8s %8d %8s\n","",i?s1:s0,0,"-");
+            continue;
+        }
+        fprintf(stdout,"%-8s  %8s %8d %7.1f%%%s\n","",i?s1:s0,
+                a->n[i][0]+a->n[i][1],ratio(a,i)*100.0,
+                ratio(a,i)<minr?" FAIL":"");
+        if (ratio(a,i)<minr) stat=0;
+    }
+    return stat;
+}
+int main(int argc, char **argv)
+{
+    FILE *fp,*fpo=NULL;
+    truth_t trj={0};
+    agree_t as={{{0}}},at={{{0}}};
+    double t,fb[3],wb[3],guard=1.0,minr=0.95;
+    char *imufile="",*trjfile="",*outfile="";
+    int i,k,tact=1,lstat,lturn,more;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-i")&&i+1<argc) imufile=argv[++i];
+        else if (!strcmp(argv[i],"-low")) tact=0;
+        else if (!strcmp(argv[i],"-g")&&i+1<argc) guard=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-m")&&i+1<argc) minr=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else trjfile=argv[i];
+    }
+    if (!*imufile||!*trjfile) printhelp();
+
+    if (readtruth(trjfile,&trj)<=0) {
+        fprintf(stderr,"no truth epoch: %s\n",trjfile);
+        freetruth(&trj);
+        return -1;
+    }
+    if (!(fp=fopen(imufile,"r"))) {
+        fprintf(stderr,"imu file open error: %s\n",imufile);
+        freetruth(&trj);
+        return -1;
+    }
+    if (*outfile&&!(fpo=fopen(outfile,"w"))) {
+        fprintf(stderr,"output file open error: %s\n",outfile);
+    }
+    motdet_init(&motdet,tact);
+
+    more=readimu(fp,&t,fb,wb);
+    for (k=0;k<trj.n;k++) {
+
+        /* imu samples up to the epoch, then gnss speed */
+        for (;more&&t<=trj.t[k]+1E-6;more=readimu(fp,&t,fb,wb)) {
+            motdet_imu(&motdet,t,fb,wb);
+        }
+        motdet_gnss(&motdet,trj.t[k],trj.spd[k]);
+
+        label(&trj,&motdet,k,guard,&lstat,&lturn);
+        if (lstat>=0) as.n[lstat][motdet.stat]++;
+        if (lturn>=0) at.n[lturn][motdet.turn]++;
+
+        if (fpo) {
+            fprintf(fpo,"%.3f %.3f %.3f %d %d %d %d\n",trj.t[k],trj.spd[k],
+                    yawrate(&trj,k)*R2D,lstat,motdet.stat,lturn,motdet.turn);
+        }
+    }
+    fprintf(stdout,"%s: epochs=%d guard=%.1fs min agreement=%.1f%%\n",PROGNAME,
+            trj.n,guard,minr*100.0);
+    i =outagree(&as,"static","static","moving",minr);
+    i&=outagree(&at,"turning","turning","straight",minr);
+
+    fclose(fp);
+    if (fpo) fclose(fpo);
+    freetruth(&trj);
+    return i?0:1;
+}
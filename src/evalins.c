@@ -0,0 +1,399 @@
+/*------------------------------------------------------------------------------
+* evalins.c : streaming accuracy evaluation of ins/gnss solutions
+*
+* notes   : replaces analysis/reference.R. the solution (out_PVA.txt of
+*           satinsmap or a rtklib .pos solution file) and the reference
+*           trajectory (rtklib .pos) are stream-merged by gps time of week.
+*           the reference is linearly interpolated in ecef between the two
+*           records bracketing each solution epoch, so the solution rate
+*           does not have to match the reference rate.
+*
+*           the east/north/up differences are taken in the local frame of
+*           the interpolated reference position. mean, rms and std are
+*           accumulated with welford updates and percentiles are read from
+*           fixed 1 mm histograms, so the memory is constant and every
+*           record is read once.
+*
+*           the first lines of the summary are those written by
+*           reference.R (the "Horizontal RMS" line of reference.R holds the
+*           standard deviation of the horizontal error and is kept as is).
+*           the extended statistics follow them.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/13 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "evalins"           /* program name */
+#define HISTRES     0.001               /* histogram resolution (m) */
+#define HISTN       100000              /* histogram bins per sign (100 m) */
+#define TTOL        1E-3                /* time tolerance of epochs (s) */
+
+#define SOLF_PVA    0                   /* solution format: out_PVA.txt */
+#define SOLF_POSF   1                   /* solution format: rtklib .pos */
+
+typedef struct {        /* error statistics */
+    int n;              /* number of samples */
+    double mean,m2;     /* mean and sum of squared deviations (welford) */
+    double ss;          /* sum of squares */
+    double max;         /* max absolute value */
+} errstat_t;
+
+typedef struct {        /* reference trajectory stream */
+    FILE *fp;           /* reference file */
+    int n;              /* number of buffered records (0-2) */
+    double t[2];        /* time of week of bracketing records (s) */
+    double r[2][3];     /* ecef position of bracketing records (m) */
+} refstrm_t;
+
+static unsigned int histh[HISTN+1];     /* horizontal error histogram */
+static unsigned int histv[2*HISTN+2];   /* vertical error histogram (signed) */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: evalins [option]... -r reference solution",
+  "",
+  " Compare an ins/gnss solution against a reference trajectory by time of",
+  " week, interpolating the reference, and write horizontal/vertical error",
+  " statistics in the format of analysis/summary.txt.",
+  "",
+  " -?        print help",
+  " -r file   reference trajectory (rtklib .pos, lat/lon/height)",
+  " -f fmt    solution format (pva:out_PVA.txt,pos:rtklib .pos) [pva]",
+  " -a        use all out_PVA epochs (otherwise integration epochs only) [off]",
+  " -q qual   use .pos solutions of quality<=qual (0:all) [0]",
+  " -g gap    max reference gap for interpolation (s) [2.0]",
+  " -o file   summary file [stdout]",
+  " -e file   error time series (\"tow e n u hz up\") [off]",
+  " -H file   error histograms [off]",
+  " -w width  histogram bin width (m) [0.1]",
+  " -c file   append one csv record of statistics (parameter sweeps) [off]",
+  " -tag str  run label written to csv [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* add sample to error statistics --------------------------------------------*/
+static void addstat(errstat_t *s, double x)
+{
+    double d=x-s->mean;
+
+    s->n++;
+    s->mean+=d/s->n;
+    s->m2+=d*(x-s->mean);
+    s->ss+=x*x;
+    if (fabs(x)>s->max) s->max=fabs(x);
+}
+static double rmsstat(const errstat_t *s)
+{
+    return s->n>0?sqrt(s->ss/s->n):0.0;
+}
+static double stdstat(const errstat_t *s)
+{
+    return s->n>1?sqrt(s->m2/(s->n-1)):0.0;
+}
+/* add sample to histograms --------------------------------------------------*/
+static void addhist(double hz, double up)
+{
+    double a;
+
+    if (!isfinite(hz)||!isfinite(up)) return;
+
+    /* clamp bin index before conversion to int */
+    a=floor(hz/HISTRES);
+    histh[a<0.0?0:(a<HISTN?(int)a:HISTN)]++;
+    a=floor(up/HISTRES)+HISTN+1;
+    histv[a<0.0?0:(a<2*HISTN+1?(int)a:2*HISTN+1)]++;
+}
+/* percentile of histogram (nearest rank, upper bin edge) ----------------------
+* args   : int    vert      I   histogram (0:horizontal,1:vertical |up|)
+*          int    n         I   number of samples
+*          double p         I   percentile (%)
+*          double max       I   max value (returned in overflow bins)
+* return : percentile (m)
+*-----------------------------------------------------------------------------*/
+static double prcthist(int vert, int n, double p, double max)
+{
+    unsigned int c=0,k;
+    int i;
+
+    if (n<=0) return 0.0;
+    k=(unsigned int)ceil(p/100.0*n);
+    if (k<1) k=1;
+    for (i=0;i<HISTN;i++) {
+        c+=vert?histv[HISTN+1+i]+histv[HISTN-i]:histh[i];
+        if (c>=k) return MIN((i+1)*HISTRES,max);
+    }
+    return max;
+}
+/* read solution record --------------------------------------------------------
+* args   : FILE   *fp       I   solution/reference file
+*          int    fmt       I   format (SOLF_PVA,SOLF_POSF)
+*          double *t        O   time of week (s)
+*          double *pos      O   position {lat,lon,h} (rad,m)
+*          int    *flag     O   out_PVA integration flag or .pos quality
+* return : status (1:ok,0:end of file)
+* notes  : .pos records are "week tow lat lon h Q ..." or
+*          "yyyy/mm/dd hh:mm:ss lat lon h Q ...", comment lines start with %
+*-----------------------------------------------------------------------------*/
+static int readsolrec(FILE *fp, int fmt, double *t, double *pos, int *flag)
+{
+    gtime_t time;
+    double v[11];
+    char buff[1024];
+    int n;
+
+    while (fgets(buff,sizeof(buff),fp)) {
+        if (buff[0]=='%'||buff[0]=='#') continue;
+
+        if (fmt==SOLF_PVA) {
+            if (sscanf(buff,"%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",v,
+                       v+1,v+2,v+3,v+4,v+5,v+6,v+7,v+8,v+9,v+10)<11) continue;
+            *t=v[0];
+            *flag=(int)v[10];
+        }
+        else if (strchr(buff,'/')) {
+            if (str2time(buff,0,32,&time)) continue;
+            if ((n=sscanf(buff,"%*s %*s %lf %lf %lf %lf",v+1,v+2,v+3,
+                          v+4))<3) continue;
+            *t=time2gpst(time,NULL);
+            *flag=n>3?(int)v[4]:0;
+        }
+        else {
+            if ((n=sscanf(buff,"%lf %lf %lf %lf %lf %lf",v+9,v,v+1,v+2,v+3,
+                          v+4))<5) continue;
+            *t=v[0];
+            *flag=n>5?(int)v[4]:0;
+        }
+        pos[0]=v[1]*D2R;
+        pos[1]=v[2]*D2R;
+        pos[2]=v[3];
+        return 1;
+    }
+    return 0;
+}
+/* interpolate reference position ----------------------------------------------
+* args   : refstrm_t *ref   IO  reference stream
+*          double t         I   time of week of solution (s)
+*          double maxgap    I   max gap of bracketing records (s)
+*          double *rr       O   reference ecef position (m)
+* return : status (1:ok,0:no reference)
+* notes  : solution epochs must be in time order
+*-----------------------------------------------------------------------------*/
+static int interpref(refstrm_t *ref, double t, double maxgap, double *rr)
+{
+    double tr,pos[3],a;
+    int i,flag;
+
+    while (ref->n<2||ref->t[1]<t-TTOL) {
+        if (!readsolrec(ref->fp,SOLF_POSF,&tr,pos,&flag)) break;
+        if (ref->n>0&&tr<=ref->t[ref->n-1]) continue;
+        if (ref->n==2) {
+            ref->t[0]=ref->t[1];
+            matcpy(ref->r[0],ref->r[1],3,1);
+        }
+        else ref->n++;
+        ref->t[ref->n-1]=tr;
+        pos2ecef(pos,ref->r[ref->n-1]);
+    }
+    for (i=0;i<ref->n;i++) {
+        if (fabs(t-ref->t[i])>TTOL) continue;
+        matcpy(rr,ref->r[i],3,1);
+        return 1;
+    }
+    if (ref->n<2||t<ref->t[0]||t>ref->t[1]) return 0;
+    if (ref->t[1]-ref->t[0]>maxgap) return 0;
+
+    a=(t-ref->t[0])/(ref->t[1]-ref->t[0]);
+    for (i=0;i<3;i++) rr[i]=(1.0-a)*ref->r[0][i]+a*ref->r[1][i];
+    return 1;
+}
+/* output histograms ---------------------------------------------------------*/
+static void outhist(FILE *fp, double width, const errstat_t *h,
+                    const errstat_t *u)
+{
+    unsigned int c;
+    int i,j,k=(int)floor(width/HISTRES+0.5),i0,i1;
+
+    if (k<1) k=1;
+    fprintf(fp,"# horizontal error (m): from to count\n");
+    for (i=0;i<=(int)(h->max/HISTRES)&&i<HISTN;i+=k) {
+        for (j=i,c=0;j<i+k&&j<HISTN;j++) c+=histh[j];
+        fprintf(fp,"%.3f %.3f %u\n",i*HISTRES,(i+k)*HISTRES,c);
+    }
+    if (histh[HISTN]) fprintf(fp,"%.3f inf %u\n",HISTN*HISTRES,histh[HISTN]);
+
+    fprintf(fp,"\n\n# vertical error (m): from to count\n");
+    if (histv[0]) fprintf(fp,"-inf %.3f %u\n",-HISTN*HISTRES,histv[0]);
+    i0=(int)floor(-u->max/HISTRES/k)*k;
+    i1=(int)ceil(u->max/HISTRES/k)*k;
+    for (i=MAX(i0,-HISTN);i<i1&&i<HISTN;i+=k) {
+        for (j=i,c=0;j<i+k&&j<HISTN;j++) if (j>=-HISTN) c+=histv[j+HISTN+1];
+        fprintf(fp,"%.3f %.3f %u\n",i*HISTRES,(i+k)*HISTRES,c);
+    }
+    if (histv[2*HISTN+1]) {
+        fprintf(fp,"%.3f inf %u\n",HISTN*HISTRES,histv[2*HISTN+1]);
+    }
+}
+/* output summary ------------------------------------------------------------*/
+static void outsum(FILE *fp, int nsol, int nnoref, const errstat_t *s)
+{
+    static const double prc[]={50.0,68.0,95.0,99.0};
+    static const char *label[]={"East","North","Up"};
+    int i;
+
+    /* analysis/summary.txt of reference.R */
+    fprintf(fp,"Analysis summary:\n\n");
+    fprintf(fp,"Horizontal average bias: \n%.15g  m\n\n",s[3].mean);
+    fprintf(fp,"Horizontal RMS: \n%.15g  m\n",stdstat(s+3));
+
+    fprintf(fp,"\nEpochs: solution %d matched %d no reference %d\n",nsol,
+            s[3].n,nnoref);
+    fprintf(fp,"Horizontal (m): bias %.4f rms %.4f std %.4f max %.4f\n",
+            s[3].mean,rmsstat(s+3),stdstat(s+3),s[3].max);
+    fprintf(fp,"Horizontal percentiles (m):");
+    for (i=0;i<4;i++) {
+        fprintf(fp," %.0f%% %.3f",prc[i],prcthist(0,s[3].n,prc[i],s[3].max));
+    }
+    fprintf(fp,"\nVertical |up| percentiles (m):");
+    for (i=0;i<4;i++) {
+        fprintf(fp," %.0f%% %.3f",prc[i],prcthist(1,s[2].n,prc[i],s[2].max));
+    }
+    fprintf(fp,"\n");
+    for (i=0;i<3;i++) {
+        fprintf(fp,"%s (m): bias %.4f rms %.4f std %.4f max %.4f\n",label[i],
+                s[i].mean,rmsstat(s+i),stdstat(s+i),s[i].max);
+    }
+}
+/* append csv record ---------------------------------------------------------*/
+static void outcsv(const char *file, const char *tag, int nsol,
+                   const errstat_t *s)
+{
+    static const double prc[]={50.0,68.0,95.0,99.0};
+    FILE *fp;
+    int i,head=access(file,F_OK)!=0;
+
+    if (!(fp=fopen(file,"a"))) {
+        fprintf(stderr,"csv file open error: %s\n",file);
+        return;
+    }
+    if (head) {
+        fprintf(fp,"tag,nsol,nmatch,hbias,hrms,hstd,h50,h68,h95,h99,hmax,"
+                "vbias,vrms,vstd,v50,v68,v95,v99,vmax\n");
+    }
+    fprintf(fp,"%s,%d,%d,%.4f,%.4f,%.4f",tag,nsol,s[3].n,s[3].mean,
+            rmsstat(s+3),stdstat(s+3));
+    for (i=0;i<4;i++) fprintf(fp,",%.3f",prcthist(0,s[3].n,prc[i],s[3].max));
+    fprintf(fp,",%.4f,%.4f,%.4f,%.4f",s[3].max,s[2].mean,rmsstat(s+2),
+            stdstat(s+2));
+    for (i=0;i<4;i++) fprintf(fp,",%.3f",prcthist(1,s[2].n,prc[i],s[2].max));
+    fprintf(fp,",%.4f\n",s[2].max);
+    fclose(fp);
+}
+/* evalins main --------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    FILE *fp,*fpo=stdout,*fpe=NULL,*fph;
+    refstrm_t ref={0};
+    errstat_t s[4]={{0}}; /* east,north,up,horizontal */
+    double t,pos[3],rs[3],rr[3],dr[3],enu[3],maxgap=2.0,width=0.1,hz;
+    char *reffile="",*solfile="",*outfile="",*errfile="",*histfile="";
+    char *csvfile="",*tag="-";
+    int i,fmt=SOLF_PVA,all=0,qual=0,flag,nsol=0,nnoref=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-r")&&i+1<argc) reffile=argv[++i];
+        else if (!strcmp(argv[i],"-f")&&i+1<argc) {
+            fmt=!strcmp(argv[++i],"pos")?SOLF_POSF:SOLF_PVA;
+        }
+        else if (!strcmp(argv[i],"-a")) all=1;
+        else if (!strcmp(argv[i],"-q")&&i+1<argc) qual=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-g")&&i+1<argc) maxgap=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (!strcmp(argv[i],"-e")&&i+1<argc) errfile=argv[++i];
+        else if (!strcmp(argv[i],"-H")&&i+1<argc) histfile=argv[++i];
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) width=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-c")&&i+1<argc) csvfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else solfile=argv[i];
+    }
+    if (!*reffile||!*solfile) printhelp();
+
+    if (!(ref.fp=fopen(reffile,"r"))) {
+        fprintf(stderr,"reference file open error: %s\n",reffile);
+        return -1;
+    }
+    if (!(fp=fopen(solfile,"r"))) {
+        fprintf(stderr,"solution file open error: %s\n",solfile);
+        fclose(ref.fp);
+        return -1;
+    }
+    if (*errfile&&!(fpe=fopen(errfile,"w"))) {
+        fprintf(stderr,"error file open error: %s\n",errfile);
+    }
+    while (readsolrec(fp,fmt,&t,pos,&flag)) {
+        if (fmt==SOLF_PVA&&!all&&flag!=1) continue;
+        if (fmt==SOLF_POSF&&qual>0&&(flag<=0||flag>qual)) continue;
+        nsol++;
+
+        if (!interpref(&ref,t,maxgap,rr)) {
+            nnoref++;
+            continue;
+        }
+        pos2ecef(pos,rs);
+        for (i=0;i<3;i++) dr[i]=rs[i]-rr[i];
+        ecef2pos(rr,pos);
+        ecef2enu(pos,dr,enu);
+        hz=sqrt(SQR(enu[0])+SQR(enu[1]));
+
+        /* skip non-finite errors */
+        if (!isfinite(hz)||!isfinite(enu[2])) continue;
+
+        for (i=0;i<3;i++) addstat(s+i,enu[i]);
+        addstat(s+3,hz);
+        addhist(hz,enu[2]);
+
+        if (fpe) {
+            fprintf(fpe,"%.3f %.4f %.4f %.4f %.4f %.4f\n",t,enu[0],enu[1],
+                    enu[2],hz,enu[2]);
+        }
+    }
+    fclose(fp);
+    fclose(ref.fp);
+    if (fpe) fclose(fpe);
+
+    if (*outfile&&!(fpo=fopen(outfile,"w"))) {
+        fprintf(stderr,"summary file open error: %s\n",outfile);
+        return -1;
+    }
+    outsum(fpo,nsol,nnoref,s);
+    if (fpo!=stdout) fclose(fpo);
+
+    if (*histfile) {
+        if (!(fph=fopen(histfile,"w"))) {
+            fprintf(stderr,"histogram file open error: %s\n",histfile);
+        }
+        else {
+            outhist(fph,width,s+3,s+2);
+            fclose(fph);
+        }
+    }
+    if (*csvfile) outcsv(csvfile,tag,nsol,s);
+
+    return s[3].n>0?0:-1;
+}
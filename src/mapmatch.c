@@ -1,4 +1,5 @@
 /**/
+#include <pthread.h>
 #include "rtklib.h"
 #include "satinsmap.h"
 
@@ -11,6 +12,8 @@
                                        /* number of solutions */
 #define IB(s,opt)   (NR(opt)+(s)-1)    /* state index of phase bias */
 #define NX(opt)     (IB(MAXSAT,opt)+1) /* number of estimated states */
+#define ERR_SAAS    0.3             /* saastamoinen model error std (m) */
+#define REL_HUMI    0.7             /* relative humidity for saastamoinen model */
 
 /* measurement error variance ------------------------------------------------*/
 static double varerr1(int sat, int sys, double el, int type, const prcopt_t *opt)
@@ -51,135 +54,222 @@ static double varerr1(int sat, int sys, double el, int type, const prcopt_t *opt
 }
 /* Map-Matching functions ----------------------------------------------------*/
 
-/* Initial reference lane buffer ---------------------------------------------*/
-/* Fetch 15m of positions surrounding the the current lane
- file pointer (last closest point) and fill lane structure.
- args:	I	none
-        O	modify the lane.buff structure
- obs.: In case is at the begining or end of lane file,
- the buffer is filled accordingly -------------------------------------------*/
-void extern inibuff (){
- char str[150];
- double r[3];
- int i,j,k=0;
-
- /* Clean lane.buff vector in case fill size change	*/
- memset(lane.buffer, 0, sizeof(lane.buffer));
-
- //printf("Lane position: %d \n",ftell(fp_lane) );
-
- /* Reading the reference lane points 	*/
- /* Checking if file pointer is in the beginning or end of file	*/
- if ( ftell(fp_lane) <= BUFFSIZE*lane.sizeline || ftell(fp_lane) > lane.size-BUFFSIZE*lane.sizeline ){
-  if (ftell(fp_lane) <= BUFFSIZE*lane.sizeline){ 		/* Beginning of file */
-   rewind(fp_lane); /* returning to the begninning of reference lanes file */
-   for (i=0; i< BUFFSIZE*2 ; i++){
-	  fgets(str, 150, fp_lane);
-	  sscanf(str, "%lf %lf %lf", &r[0], &r[1], &r[2]);
-	  for(j=0;j<3;j++) {
-	    lane.buffer[i*3+j] = r[j];
-	  }
-    k++;
-   }
- }else{
-   fseek(fp_lane, -(BUFFSIZE+1)*lane.sizeline, SEEK_CUR); /* End of file */
-   i=0;
-   while (fgets(str, 150, fp_lane) != NULL){
-    sscanf(str, "%lf %lf %lf", &r[0], &r[1], &r[2]);
-    for(j=0;j<3;j++) lane.buffer[i*3+j] = r[j];
-	  i++;
-    k++;
-   }
-  }
-}else{						/* Anywhere in the file */
-  /* returning BUFFSIZE positions from the closest point position */
-   fseek(fp_lane, -(BUFFSIZE+1)*lane.sizeline, SEEK_CUR);
-   for (i=0; i< BUFFSIZE*2 ; i++){
-	  fgets(str, 150, fp_lane);
-	  sscanf(str, "%lf %lf %lf", &r[0], &r[1], &r[2]);
-	  for(j=0;j<3;j++) {
-		 lane.buffer[i*3+j] = r[j];
-	  }
-    k++;
-  }
- }
- lane.sizebuffer=k;
+/* Lane map initialization -----------------------------------------------------
+* Initialize an empty local frame lane map
+* args:	O lanemap_t *map  lane map
+*-----------------------------------------------------------------------------*/
+extern void lanemap_init(lanemap_t *map){
+  memset(map, 0, sizeof(lanemap_t));
+  map->tsize=LANETILE;
+  map->curr=-1;
 }
 
-/* Closest point (3D) ----------------------------------------------------------
-* Compute the closest point between the initial buffer space positions and the
-* rover SPP position
-* args:	I double rov_p[]	SPP cartesian coordinates (3x1) [m]
-*        O int lane.currsearch 	closest p. buffer position
+/* Free lane map ---------------------------------------------------------------
+* args:	IO lanemap_t *map lane map
 *-----------------------------------------------------------------------------*/
-void clstpt(double *rov_p){
- double src_area, r[3], pos[3];
- double d[BUFFSIZE*2], mindist=0.0;
+extern void lanemap_free(lanemap_t *map){
+  int i;
 
- int i=0, j=0;
- char str[150];
+  for (i=0;i<map->nt;i++) free(map->tile[i].enu);
+  free(map->pt); free(map->tile);
+  lanemap_init(map);
+}
 
- /* Determine the closest point position 	*/
- for (i=0; i< lane.sizebuffer ; i++){
-	for (j=0;j<3;j++) r[j]=lane.buffer[i*3+j];
-	d[i] = dist(rov_p, r);
- }
- /* Closest point position in the buffer size	*/
- lane.currsearch = min(d, BUFFSIZE*2, &mindist);
+/* Add lane map tile ----------------------------------------------------------*/
+static lanetile_t *addtile(lanemap_t *map, const double *pos){
+  lanetile_t *t;
 
- /* Repositioning the pointer in the lane file	*/
- fseek(fp_lane, (-(BUFFSIZE*2-lane.currsearch) )*lane.sizeline, SEEK_CUR);
+  if (map->nt>=map->ntmax) {
+    map->ntmax=map->ntmax<=0?16:map->ntmax*2;
+    if (!(t=(lanetile_t *)realloc(map->tile,sizeof(lanetile_t)*map->ntmax))) {
+      return NULL;
+    }
+    map->tile=t;
+  }
+  t=map->tile+map->nt++;
+  memset(t, 0, sizeof(lanetile_t));
+  matcpy(t->pos, pos, 3, 1);
+  pos2ecef(pos, t->r0);
+  xyz2enu(pos, t->E);
+  return t;
 }
 
-/* Azimuth ---------------------------------------------------------------------
-* Compute the azimuth between two points from the lane buffer
-* args:	I space	enu Lane buffer (lane.sizebufferx3) [m]
-*       O double az[2]  vector with azimuth and its quadrant [rad,1,2,3,4]
+/* Tile origin of lane point ---------------------------------------------------
+* Tiles are the cells of a tsize grid in the local frame of the map origin, the
+* tile origin is the cell center at the height of the map origin
 *-----------------------------------------------------------------------------*/
-void azmt(double *space, double *az){
-  double enu[3],enun[3];
-  double DE,DN,delta;
-  double azm,q; //azimuth and its quadrant
+static void tileorg(const lanemap_t *map, const double *E0, const double *r0,
+  const double *r, double *pos, int *cell){
+  double dr[3],enu[3],xyz[3];
   int j;
 
-  /* Closest point positions and next neighbour point */
-	for (j=0;j<3;j++) enu[j]=space[lane.currsearch*3+j];
+  if (map->tsize<=0.0) {
+    matcpy(pos, map->org, 3, 1);
+    cell[0]=cell[1]=0;
+    return;
+  }
+  for (j=0;j<3;j++) dr[j]=r[j]-r0[j];
+  matmul("NN", 3, 1, 3, 1.0, E0, dr, 0.0, enu);
+  for (j=0;j<2;j++) {
+    cell[j]=(int)floor(enu[j]/map->tsize+0.5);
+    enu[j]=cell[j]*map->tsize;
+  }
+  enu[2]=0.0;
+  enu2ecef(map->org, enu, dr);
+  for (j=0;j<3;j++) xyz[j]=r0[j]+dr[j];
+  ecef2pos(xyz, pos);
+  pos[2]=map->org[2];
+}
 
-  if(lane.currsearch==lane.sizebuffer) {
-    for (j=0;j<3;j++) enun[j]=space[(lane.currsearch-1)*3+j];
-    DE=enu[0]-enun[0]; DN=enu[1]-enun[1];
+/* Lane point direction and curvature ------------------------------------------
+* Azimuth of the segment to the next point and the quadratic n=a*e^2+b*e+c fit
+* of the points within LANEFIT positions, in the frame of the point tile
+*-----------------------------------------------------------------------------*/
+static void lanegeom(lanemap_t *map, int i){
+  const lanetile_t *t=map->tile+map->pt[i].tile;
+  const double *p=t->enu;
+  double A[3*2*LANEFIT],y[2*LANEFIT],X[3],Q[9],de,dn,e,s;
+  int j,k=i-t->s0,m=0;
+
+  /* azimuth from the segment to the next point (previous at the end) */
+  if (k+1<t->n) {
+    de=p[(k+1)*3]-p[k*3]; dn=p[(k+1)*3+1]-p[k*3+1];
+  }else if (k>0) {
+    de=p[k*3]-p[(k-1)*3]; dn=p[k*3+1]-p[(k-1)*3+1];
+  }else de=dn=0.0;
+  map->pt[i].az=atan2(de, dn);
+  if (map->pt[i].az<0.0) map->pt[i].az+=2.0*PI;
+
+  /* curve fit over the window surrounding the point */
+  for (j=MAX(k-LANEFIT,0);j<MIN(k+LANEFIT,t->n);j++) {
+    A[m*3]=p[j*3]*p[j*3]; A[m*3+1]=p[j*3]; A[m*3+2]=1.0;
+    y[m++]=p[j*3+1];
   }
-  else {
-    for (j=0;j<3;j++) enun[j]=space[(lane.currsearch-1)*3+j];
-    DE=enun[0]-enu[0]; DN=enun[1]-enu[1];
+  map->pt[i].kap=0.0;
+  if (m<3||lsq(A, y, 3, m, X, Q)) {
+    for (j=0;j<3;j++) map->pt[i].fit[j]=0.0;
+    return;
   }
+  for (j=0;j<3;j++) map->pt[i].fit[j]=X[j];
 
+  /* curvature of the fitted curve at the point */
+  e=p[k*3];
+  s=2.0*X[0]*e+X[1];
+  map->pt[i].kap=2.0*X[0]/pow(1.0+s*s, 1.5);
+}
 
-  delta = ( DE / DN );
-  //                                angle in radians
-  if (delta<0){ // 2nd or 4th Q
-      if ( DN < 0){
-          // 2nd quadrant
-          azm = 180*(PI/180) + atan(delta); //adding because the value is negative
-          q=2;
-        }else{
-          // 4th quadrant
-          azm = 360*(PI/180) + atan(delta);//adding because the value is negative
-          q=4;
-        }
-   }else if ( DE < 0){   // 1st or 3rd Q
-          // 3rd quadrant
-          azm = 180*(PI/180) + atan(delta);
-          q=3;
-        }
-      else{ // 1st quadrant
-          azm = atan(delta);
-          q=1;
+/* Read lane map ---------------------------------------------------------------
+* Read the reference lanes and precompute the local tangent frame lane map
+* args:	IO lanemap_t *map lane map
+*       I  char *file     reference lane file ("x y z" ecef per line) [m]
+*       I  double *org    map origin {lat,lon,h} [rad,m] (NULL: first point)
+*       I  double tsize   tile size [m] (0: single tile at the map origin)
+* return: number of lane points (0: error)
+* obs.: consecutive points in the same grid cell form a tile with its origin at
+* the cell center. every tile keeps 2*BUFFSIZE (>=LANEFIT) points of the
+* neighbour tiles in its frame, so match() windows and curve fits around a
+* point are always in one frame. direction, curvature and curve fit of every
+* point are computed here and match() only queries them.
+*-----------------------------------------------------------------------------*/
+extern int lanemap_read(lanemap_t *map, const char *file, const double *org,
+  double tsize){
+  FILE *fp;
+  lanept_t *pt;
+  lanetile_t *t;
+  double r[3],pos[3],tpos[3],r0[3],E0[9],dr[3],*enu;
+  int i,j,k,m,c0,cell[2],cell0[2],margin=MAX(2*BUFFSIZE,LANEFIT);
+  char str[150];
+
+  lanemap_free(map);
+  map->tsize=tsize;
+
+  if (!(fp=fopen(file,"r"))) {
+    fprintf(stderr,"lane file open error: %s\n",file);
+    return 0;
+  }
+  while (fgets(str, 150, fp)) {
+    if (sscanf(str, "%lf %lf %lf", r, r+1, r+2)<3) continue;
+    if (map->n>=map->nmax) {
+      map->nmax=map->nmax<=0?4096:map->nmax*2;
+      if (!(pt=(lanept_t *)realloc(map->pt,sizeof(lanept_t)*map->nmax))) {
+        fclose(fp); lanemap_free(map);
+        return 0;
       }
+      map->pt=pt;
+    }
+    memset(map->pt+map->n, 0, sizeof(lanept_t));
+    matcpy(map->pt[map->n++].r, r, 3, 1);
+  }
+  fclose(fp);
+  if (map->n<=0) return 0;
+
+  /* map origin, first lane point if not configured */
+  if (org&&(org[0]!=0.0||org[1]!=0.0||org[2]!=0.0)) matcpy(map->org, org, 3, 1);
+  else ecef2pos(map->pt[0].r, map->org);
+  pos2ecef(map->org, r0);
+  xyz2enu(map->org, E0);
+
+  /* tiles of consecutive points in the same cell */
+  for (i=0;i<map->n;i=k) {
+    tileorg(map, E0, r0, map->pt[i].r, pos, cell0);
+    for (k=i+1;k<map->n;k++) {
+      tileorg(map, E0, r0, map->pt[k].r, tpos, cell);
+      if (cell[0]!=cell0[0]||cell[1]!=cell0[1]) break;
+    }
+    if (!(t=addtile(map, pos))) {
+      lanemap_free(map);
+      return 0;
+    }
+    c0=MAX(i-margin,0);
+    t->s0=c0;
+    t->n=MIN(k+margin,map->n)-c0;
+    if (!(enu=t->enu=(double *)malloc(sizeof(double)*t->n*3))) {
+      lanemap_free(map);
+      return 0;
+    }
+    for (j=0;j<t->n;j++) {
+      for (m=0;m<3;m++) dr[m]=map->pt[t->s0+j].r[m]-t->r0[m];
+      matmul("NN", 3, 1, 3, 1.0, t->E, dr, 0.0, enu+j*3);
+    }
+    for (j=i;j<k;j++) map->pt[j].tile=map->nt-1;
+  }
+  for (i=0;i<map->n;i++) lanegeom(map, i);
+
+  trace(3,"lanemap_read: file=%s n=%d ntile=%d\n",file,map->n,map->nt);
+  return map->n;
+}
+
+/* Closest lane point ----------------------------------------------------------
+* Closest point (3D) of the lane map to a position, searched around the closest
+* point of the last query and over the whole map at the first query
+* args:	IO lanemap_t *map lane map
+*       I double *rr      position in ecef [m]
+* return: closest point index (-1: empty map)
+*-----------------------------------------------------------------------------*/
+extern int lanemap_near(lanemap_t *map, const double *rr){
+  double d,dmin=-1.0;
+  int i,i0,i1,k=-1;
+
+  if (map->n<=0) return -1;
 
-  az[0]=azm;
-  az[1]=q;
-  return az;
+  if (map->curr<0) {
+    i0=0; i1=map->n;
+  }else{
+    i0=MAX(map->curr-2*BUFFSIZE,0); i1=MIN(map->curr+2*BUFFSIZE+1,map->n);
+  }
+  for (;;) {
+    for (i=i0;i<i1;i++) {
+      d=dist(map->pt[i].r, rr);
+      if (dmin<0.0||d<dmin) {dmin=d; k=i;}
+    }
+    /* slide the search window while the minimum is at its edge */
+    if (k==i0&&i0>0) {
+      i1=i0; i0=MAX(i0-2*BUFFSIZE,0);
+    }else if (k==i1-1&&i1<map->n) {
+      i0=i1; i1=MIN(i1+2*BUFFSIZE,map->n);
+    }else break;
+  }
+  return map->curr=k;
 }
 
 /* 2D confidence ellipse parameters --------------------------------------------
@@ -219,101 +309,18 @@ void ell2D95(double* cov, double* maj_axis, double* min_axis, double* alpha){
   //printf("Ellipse pa1.: %lf,%lf,%lf\n",(sqrt( smax ) )*2.447,(sqrt( smin ) )*2.447,theta);
 }
 
-/* Curve fitting ---------------------------------------------------------------
-* Fits a curve over some points using least squares to determine its parameters
-* args:	I	double* pts set of enu points (BUFFSIZE*2 x 3)
-*       O double* a,b,c parameters of a quadratic function,such as:
-* f(x)=a*x^2+b*x+c, in this case: n = a*e^2+b*e+c
-*-----------------------------------------------------------------------------*/
-void curvfit(double* pts, double *a, double *b, double *c){
-  int i,j,n,smpsize = 40; // In this case 40*0.2 = 20 meters from te closest point
-  double* y,*x,*A,*At;
-  double *Q, X[3];
-
-  /* Getting 10m radius sample from the closest point */
-  if (lane.currsearch - (smpsize/2) <= 0 ) { //clstp at the beginning
-    n=lane.currsearch + (smpsize/2);
-    y=mat(n,1);
-    x=mat(n,1);
-    A=mat(n,3);
-    At=mat(n,3);
-    j=0;
-    for (i = 0; i < lane.currsearch+(smpsize/2); i++) {
-        x[j]=pts[i*3];
-        y[j]=pts[i*3+1];
-        j++;
-      //  printf(" %lf, %lf\n", y[i],x[i]);
-    }
-  } else {
-    if (lane.currsearch+(smpsize/2) >= lane.sizebuffer) { //clst at the end
-      n=lane.sizebuffer-(lane.currsearch-(smpsize/2));
-      y=mat(n,1);
-      x=mat(n,1);
-      A=mat(n,3);
-      At=mat(n,3);
-      j=0;
-      for (i = lane.currsearch-(smpsize/2); i < lane.sizebuffer; i++) {
-          x[j]=pts[i*3];
-          y[j]=pts[i*3+1];
-        //  printf(" %lf, %lf\n", y[j],x[j]);
-          j++;
-      }
-    }else{ //clst anywhere in the middle
-      n=(lane.currsearch+(smpsize/2))-(lane.currsearch-(smpsize/2));
-      y=mat(n,1);
-      x=mat(n,1);
-      A=mat(n,3);
-      At=mat(n,3);
-      j=0;
-      for (i = lane.currsearch-(smpsize/2); i < lane.currsearch+(smpsize/2); i++) {
-          x[j]=pts[i*3];
-          y[j]=pts[i*3+1];
-        //  printf(" %lf, %lf\n", y[j],x[j]);
-          j++;
-      }
-    }
-  }
-
-  /* Design matrix  */
-  for (i = 0; i < n; i++) {
-    A[i*3]  = x[i]*x[i];
-    A[i*3+1]= x[i];
-    A[i*3+2]= 1;
-  }
-  /* Transpose A to lsq() function */
-  for (i = 0; i < n; i++) {
-    for (j = 0; j < 3; j++) {
-      At[j*n+i]=A[i*3+j];
-    }
-  }
-
- Q=mat(3,3);
-
- /* LSQ  */
-  if (0 != lsq(At, y, 3, n, X, Q) ){
-    printf("Error estimating curve parameters\n");
-  }
-
-  *a=X[0];
-  *b=X[1];
-  *c=X[2];
-  //printf("Curve a,b,c par.: %8.10lf,%8.10lf,%8.10lf \n",X[0],X[1],X[2]);
-  //printf("Curve a,b,c par.: %8.10lf,%8.10lf,%8.10lf \n",*a,*b,*c);
-  free(x);free(y);free(A);free(At);free(Q);
-  memset(X, 0, sizeof(X));
-}
-
 /* Ellipse curve instersection -------------------------------------------------
 * Determine if lanes and ellipse intersect and returns the lane positions that
 * are within it.
 * args:	I	double e0,n0 ellipse origin points in east,north local coordinates
 *       I double a,b,alpha ellipse major and minor axis and orientation par.
-*       I double* space Lane buffer in enu coordinates (lane.sizebuffer x 3)
+*       I double* space Lane buffer in enu coordinates (ns x 3)
+*       I int ns number of lane buffer points
 *       O int* intersecflags flag vector with the position of the lane points
 *              that intersects(=1) and the ones that do not intersect(=0)
 *-----------------------------------------------------------------------------*/
 void ellcurvIntersec(double e0, double n0, double a, double b, double alpha,
-  double* space, int* intersecflags){
+  double* space, int ns, int* intersecflags){
     double ep,np,de,dn,beta,t,eell,nell;
     int i,j;
 
@@ -321,7 +328,7 @@ void ellcurvIntersec(double e0, double n0, double a, double b, double alpha,
     //fp1=fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/exp1_curvecorrep.txt","a");
 
     /* Determining angle between search points and ellipse origin */
-     for (i=0; i< lane.sizebuffer ; i++){
+     for (i=0; i< ns ; i++){
        ep=space[i*3+0];//e
        np=space[i*3+1];//n
        de=ep-e0;
@@ -360,7 +367,7 @@ void ellcurvIntersec(double e0, double n0, double a, double b, double alpha,
       }
     }
 
-    for ( i = 0; i < lane.sizebuffer; i++) {
+    for ( i = 0; i < ns; i++) {
       if(intersecflags[i]==1){//printf("Cand.:%d\n",intersecflags[i]);
       }
     }
@@ -382,10 +389,12 @@ double k;
 * Compute the search space based on the SPP rover position and its uncertaity
 * args:	I	double r SPP enu position (3x1)
 *       I	double  Q SPP enu full covariance matrix (9x1)
-*       I double* space Lane buffer in enu coordinates (lane.sizebuffer x 3)
-*       O searchcandidates[] a position flag (1) vector of the candidates [lane.sizebufferx1]
+*       I double* space Lane buffer in enu coordinates (ns x 3)
+*       I int ns number of lane buffer points
+*       O searchcandidates[] a position flag (1) vector of the candidates [ns x 1]
 *-----------------------------------------------------------------------------*/
-void ensearchspace (double *r, double *Q, double* space, int* searchcandidates){
+void ensearchspace (double *r, double *Q, double* space, int ns,
+  int* searchcandidates){
  double en[2],enQ[4];
  double flag[BUFFSIZE*2];
  double maj_axis,min_axis,alpha;
@@ -411,7 +420,7 @@ void ensearchspace (double *r, double *Q, double* space, int* searchcandidates){
  //curvfit(space,&a,&b,&c);
 
  /* Intercept ellipsoid area with the curve and determine the enhanced area   */
- ellcurvIntersec(en[0],en[1],maj_axis,min_axis,alpha,space,searchcandidates);
+ ellcurvIntersec(en[0],en[1],maj_axis,min_axis,alpha,space,ns,searchcandidates);
 
 //fprintf(fp1,"%lf %lf %lf %lf %lf\n",en[0], en[1], maj_axis, min_axis, alpha*R2D);
 //fclose(fp1);
@@ -427,333 +436,303 @@ static void soltocov(const sol_t sol, double *P)
     P[5]=P[7]=sol.qr[4]; /* yz or nu */
     P[2]=P[6]=sol.qr[5]; /* zx or ue */
 }
-/* Locking phase ---------------------------------------------------------------
-* Determine a better rover position within the ehanced search space with phase
-* observables per satellite
-* args:	I rtk_t *rtk rtk structure
-*       I rr[3] Closest point position in ecef [m]
-*       I enspc[nx3] Enhanced search space pointer, n is the number of
-*       candidates, in ecef [m]
-*       I int nc size of Enhanced search space
-*       I	rtk_t *sol solution structure with the SPP position and covariance
-*       I const obsd_t *obs structure containing the observables for one epoch
-*       I const obsd_t *nav structure containing the satellite positions
-*       I int n number of observation data
-*       I const *rs satellite position and velocity vector
-*       I const double *dts satellite clock bias
-*
-* obs.:dts[(0:1)+i*2]= obs[i] sat clock {bias,drift} (s|s/s)
-* returns an improved rover position in ecef coordinates [3x1]
+/* batched candidate ranges and residuals of satellites s0..s1-1 -------------*/
+static void lckres(lckws_t *ws, int s0, int s1, double *sp, double *sc)
+{
+  const double *cx=ws->cx, *cy=ws->cy, *cz=ws->cz;
+  double *rho, *v, sx, sy, sz, dx, dy, dz, y, w;
+  int i, j, k, nc=ws->nc;
+
+  for (i=0; i<nc; i++) sp[i]=sc[i]=0.0;
+
+  for (j=s0; j<s1; j++) {
+    if (!ws->valid[j]) continue;
+    sx=ws->rs[j*3]; sy=ws->rs[j*3+1]; sz=ws->rs[j*3+2];
+    rho=ws->rho+j*MAXLCKCAND;
+
+    /* geometric distances with earth rotation correction, candidates as
+    contiguous streams without branches for vectorization */
+    for (i=0; i<nc; i++) {
+      dx=sx-cx[i]; dy=sy-cy[i]; dz=sz-cz[i];
+      rho[i]=sqrt(dx*dx+dy*dy+dz*dz)+OMGE*(sx*cy[i]-sy*cx[i])/CLIGHT;
+    }
+    for (k=0; k<2; k++) {
+      if (ws->var[j*2+k]<=0.0) continue;
+      v=ws->V+(j*2+k)*MAXLCKCAND;
+      y=ws->y[j*2+k];
+      w=1.0/ws->var[j*2+k];
+      if (k==0) for (i=0; i<nc; i++) {v[i]=y-rho[i]; sp[i]+=w*v[i]*v[i];}
+      else      for (i=0; i<nc; i++) {v[i]=y-rho[i]; sc[i]+=w*v[i]*v[i];}
+    }
+  }
+}
+/* lock phase worker thread ----------------------------------------------------
+* wait for a job posted by lckphase_batch() and evaluate the satellite range
+* of the worker, until lckws_free()
 *-----------------------------------------------------------------------------*/
-double lckphase(rtk_t *rtk, double* rr, double* enspc, int nc, const obsd_t *obs,
-  const nav_t *nav, int n, const double *rs, const double *dts, double trop,
-  int satn, double *meas, double *vare, double *var, double vart, double *varm,
-  double *dtdx, double *v, double *H, double *R, double *azel, double *x, int sat,
-double *mmcand){
-
-    double *r1,*N, *Res, minres=0;
-    double L1,L2,r=0.0;
-    float dtsat;
-    int svh[MAXOBS], posmin;
-    const double *lam=nav->lam[obs->sat-1];
-
-    prcopt_t *opt=&rtk->opt;
-    double disp[3],pos[3],e[3],dantr[NFREQ]={0};
-    double dants[NFREQ]={0},dtrp=0.0;
-    int i,j,k,sys,nv=0,nx=rtk->nx,brk,tideopt;
-
-    double *v1,*H1,*R1,*azel1,*x1,*var1;
-
-    nv=n*rtk->opt.nf*2;
-    v1=mat(nc,2);
-    //matcpy(v1,v,nv,1);
-
-  /*  azel1=zeros(2,n); var1=mat(1,n);
-    x1=mat(rtk->nx,1);
-    matcpy(x1,x,rtk->nx,1);
-    nv=n*rtk->opt.nf*2; v1=mat(nv,1); H1=mat(rtk->nx,nv); R1=mat(nv,nv);
-
-    matcpy(v1,v,nv,1);
-    matcpy(H1,H,rtk->nx,nv);
-    matcpy(var1,var,MAXOBS,2); matcpy(azel1,azel,2,n);
-    matcpy(R1,R,nv,nv);*/
-
-    nv=0;
-
-    N=mat(2,1); /* For 1 satellite - L1 and L2  */
-    r1=mat(1,nc);
-    Res=mat(1,nc);
-
-    /* Compute the approximate geometric ranges between candidates and satellite
-    positions */
-       //printf("GOT here in phaselock?, Number of candidates: %d\n", nc);
-
-    if(nc>0){
-        for (i = 0; i < nc; i++) {
-          /* geometric distance/azimuth/elevation angle */
-          if ((r1[i]=geodist(rs,enspc+i*3,e))<=0.0) continue;
-          //  printf("Dist: %lf, Geom: %lf\n",dist(rs,enspc+i*3), geodist(rs,enspc+i*3,e) );
-          //printf("LCK ENSPCE: %lf %lf %lf\n",*(enspc+i*3),*(enspc+i*3+1),*(enspc+i*3+2));
-        //  printf("LCKSPC-XYZ: %lf %lf %lf\n",enspc[i*3+0], enspc[i*3+1], enspc[i*3+2]);
-
-        //  printf("r-P: %lf, r-L: %lf\n", meas[1]-(r[i]-CLIGHT*(*dts)+(*trop)),meas[0]-(r[i]-CLIGHT*(*dts)+(*trop)));
-        r=(double)r1[i];
-      //  printf("Geom. cand.: %lf, %lf \n",r1[i],r);
-
-         for (j = 0; j < 2; j++) {
-
-           if (meas[j]==0.0) continue;
-
-           v1[nv]=meas[j]-r;
-
-           if (sys!=SYS_GLO) {
-               v1[nv]-=x[IC(0,opt)];
-               //H1[IC(0,opt)+nx*nv]=1.0;
-           }
-           else {
-               v1[nv]-=x[IC(1,opt)];
-              // H1[IC(1,opt)+nx*nv]=1.0;
-           }
-
-           if (j==0) {
-               v1[nv]-=x[IB(obs[satn].sat,opt)];
-               //H1[IB(obs[satn].sat,opt)+nx*nv]=1.0;
-           }
-
-          // if (j==0) printf("Phase res.: %lf\n", v1[nv]);
-        //   else      //printf("Code res.: %lf\n", v1[nv]);
-
-          nv++;
-         }
-
-
-  /*       CPOIED FROM PPP_RES FUNCTION, USE IT CAREFULLY TO JUDGE THE Residuals  */
-    /*    for (j=0;j<2;j++) { // for phase and code
-
-            if (meas[j]==0.0) continue;
-
-            for (k=0;k<nx;k++) H1[k+nx*nv]=0.0;
-
-            v1[nv]=meas[j]-r;
-
-            for (k=0;k<3;k++) H1[k+nx*nv]=-e[k];
-
-            if (sys!=SYS_GLO) {
-                v1[nv]-=x[IC(0,opt)];
-                H1[IC(0,opt)+nx*nv]=1.0;
-            }
-            else {
-                v1[nv]-=x[IC(1,opt)];
-                H1[IC(1,opt)+nx*nv]=1.0;
-            }
-            if (opt->tropopt>=TROPOPT_EST) {
-                for (k=0;k<(opt->tropopt>=TROPOPT_ESTG?3:1);k++) {
-                    H1[IT(opt)+k+nx*nv]=dtdx[k];
-                }
-            }
-            if (j==0) {
-                v1[nv]-=x[IB(obs[satn].sat,opt)];
-                H1[IB(obs[satn].sat,opt)+nx*nv]=1.0;
-            }
-            var1[nv]=varerr(obs[satn].sat,sys,azel1[1+satn*2],j,opt)+varm[j]+vare[satn]+vart;
-
-            if (j==0) rtk->ssat[sat-1].resc[0]=v[nv];
-            else      rtk->ssat[sat-1].resp[0]=v[nv];
-//printf("GOT here in phaselock 15\n");
-            // test innovation
-#if 0
-            if (opt->maxinno>0.0&&fabs(v[nv])>opt->maxinno) {
-#else
-            if (opt->maxinno>0.0&&fabs(v[nv])>opt->maxinno&&sys!=SYS_GLO) {
-#endif
-                trace(2,"ppp outlier rejected %s sat=%2d type=%d v=%.3f\n",
-                      time_str(obs[satn].time,0),sat,j,v[nv]);
-                printf("PPP OUTLIER DETECTED: sat=%2d\n",sat);
-                //rtk->ssat[sat-1].rejc[0]++;
-                continue;
-            }
-            if (j==0) //rtk->ssat[sat-1].vsat[0]=1;
-
-            printf("Meas: %lf, r: %lf and v[nv]: %lf\n", meas[j], r, v1[nv]);
-            nv++;
-         }*/
-
-      }
-        /* Judge here which geometric distance candidate on r[] offers the smallest
-        residuals? per candidate, using the phase measurement  */
-        /* Compute "ambiguity" terms: Nij = frac_phase-rho(geom. dist candidates)*/
-      //  printf("Sat: %d: Nof cand.%d\n", obs->sat+1, nc);
-
-    //  for (i = 0; i < nc; i++) {
-    //    printf("Phase: %lf and Code: %lf measurements res.\n",v1[i*2],v1[i*2+1]);
-    //  }
-        posmin = min(v1,nc,&minres);
-        r=(double)r1[posmin];
-      // printf("LCK candidateXYZ: %lf, %lf, %lf\n",enspc[posmin*3], enspc[posmin*3+1], enspc[posmin*3+2] );
-
-        for (k = 0; k < 3; k++) mmcand[k]=enspc[posmin*3+k];
-      //  printf("Smaller residuals at lanepos: %d, Resvec: %d - %lf, respective Geom.: %lf\n",
-      //  posmin, min(v1,nc,&minres), minres, r);
-
-    //   L1=obs[i].L[0]*lam[0];
-    //   L2=obs[i].L[1]*lam[1];
-    //   N[i]=L1-r[i];
-      // printf("Sat: %d,\nL1 and L2: %lf, %lf\nP1 and P2: %lf, %lf",
-    //   obs[i].sat,L1,L2,obs[i].P[0],obs[i].P[1]);
-      // printf("Computed rho and P: %lf, %lf\n",r[i],obs[i].P[0]);
-  //  }
+static void *lckthread(void *arg)
+{
+  lckarg_t *a=(lckarg_t *)arg;
+  lckws_t *ws=a->ws;
+  unsigned int job=0;
+
+  for (;;) {
+    pthread_mutex_lock(&ws->lock);
+    while (ws->job==job&&!ws->quit) pthread_cond_wait(&ws->cjob, &ws->lock);
+    if (ws->quit) {
+      pthread_mutex_unlock(&ws->lock);
+      break;
     }
-    //  printf("End of phaselock, r:%lf\n",r);
+    job=ws->job;
+    pthread_mutex_unlock(&ws->lock);
 
-      free(r1); free(N); free(Res);
-      free(v1);
-      //free(v1); free(H1); free(R1);free(azel1);free(x1);free(var1);
-      return r;
-}
+    lckres(ws, a->s0, a->s1, ws->part[a->id][0], ws->part[a->id][1]);
 
+    pthread_mutex_lock(&ws->lock);
+    if (++ws->ndone>=ws->nthread-1) pthread_cond_signal(&ws->cdone);
+    pthread_mutex_unlock(&ws->lock);
+  }
+  return NULL;
+}
+/* Initialize locking phase workspace ------------------------------------------
+* Start the worker threads of the batched locking phase once for the workspace
+* args:	O lckws_t *ws workspace
+*       I int nthread number of threads with the caller (<=1:none)
+* returns the number of threads with the caller
+* obs.: the workers wait for the jobs of lckphase_batch() and are stopped by
+* lckws_free(). if a worker can not be started, fewer threads are used
+*-----------------------------------------------------------------------------*/
+extern int lckws_init(lckws_t *ws, int nthread){
+  int t;
+
+  ws->nthread=1;
+  ws->job=0; ws->ndone=ws->quit=0;
+  pthread_mutex_init(&ws->lock, NULL);
+  pthread_cond_init(&ws->cjob, NULL);
+  pthread_cond_init(&ws->cdone, NULL);
+
+  for (t=1; t<MIN(nthread, MAXLCKTHR); t++) {
+    ws->arg[t].ws=ws; ws->arg[t].id=t;
+    ws->arg[t].s0=ws->arg[t].s1=0;
+    if (pthread_create(ws->thr+t, NULL, lckthread, ws->arg+t)) break;
+    ws->nthread=t+1;
+  }
+  return ws->nthread;
+}
+/* Free locking phase workspace ------------------------------------------------
+* Stop the worker threads of lckws_init()
+* args:	IO lckws_t *ws workspace
+*-----------------------------------------------------------------------------*/
+extern void lckws_free(lckws_t *ws){
+  int t;
+
+  pthread_mutex_lock(&ws->lock);
+  ws->quit=1;
+  pthread_cond_broadcast(&ws->cjob);
+  pthread_mutex_unlock(&ws->lock);
+
+  for (t=1; t<ws->nthread; t++) pthread_join(ws->thr[t], NULL);
+  pthread_mutex_destroy(&ws->lock);
+  pthread_cond_destroy(&ws->cjob);
+  pthread_cond_destroy(&ws->cdone);
+  ws->nthread=1;
+}
+/* Batched locking phase -------------------------------------------------------
+* Evaluate all search space candidates against all satellites as one residual
+* matrix and select the candidate with the smallest weighted phase residuals
+* args:	IO lckws_t *ws workspace (lckws_init()), best candidate and residual
+*       statistics
+*       I const double *enspc[nc x 3] search space candidates in ecef [m]
+*       I int nc number of candidates (<=MAXLCKCAND)
+*       I const double *rs[ns x 6] satellite positions and velocities [m|m/s]
+*       I const double *meas[ns x 2] phase and code measurements [m]
+*       I const double *off[ns x 2] modeled non-geometric terms of phase and
+*       code (clock, bias, ...) [m]
+*       I const double *var[ns x 2] phase and code variances (<=0:unused)
+*       [m^2]
+*       I int ns number of satellites (<=MAXOBS)
+* returns the index of the best candidate (-1:no candidate or measurement)
+* obs.: residuals are ws->V[(j*2+k)*MAXLCKCAND+i] of satellite j, type k
+* (0:phase,1:code) and candidate i. candidates are held as separate x/y/z
+* arrays so that the inner loops run over contiguous memory. the phase
+* residuals select the candidate, the code residuals are used only without
+* phase. the satellites are split over the caller and the worker threads of
+* the workspace. no memory is allocated and no thread is started per call
+*-----------------------------------------------------------------------------*/
+extern int lckphase_batch(lckws_t *ws, const double *enspc, int nc,
+  const double *rs, const double *meas, const double *off, const double *var,
+  int ns){
+  double *sp=ws->part[0][0], *sc=ws->part[0][1], *s, s1, s2;
+  int i, j, k, t, nt=ws->nthread, m;
+
+  ws->nc=nc=MIN(nc, MAXLCKCAND);
+  ws->ns=ns=MIN(ns, MAXOBS);
+  ws->best=-1; ws->nv[0]=ws->nv[1]=0;
+  ws->rms[0]=ws->rms[1]=ws->ratio=0.0;
+  if (nc<=0||ns<=0) return -1;
+
+  for (i=0; i<nc; i++) {
+    ws->cx[i]=enspc[i*3]; ws->cy[i]=enspc[i*3+1]; ws->cz[i]=enspc[i*3+2];
+  }
+  for (j=0; j<ns; j++) {
+    for (k=0; k<3; k++) ws->rs[j*3+k]=rs[j*6+k];
+    ws->valid[j]=norm(rs+j*6, 3)>=RE_WGS84;
+    for (k=0; k<2; k++) {
+      ws->var[j*2+k]=ws->valid[j]&&meas[j*2+k]!=0.0?var[j*2+k]:0.0;
+      ws->y[j*2+k]=meas[j*2+k]-off[j*2+k];
+      if (ws->var[j*2+k]>0.0) ws->nv[k]++;
+    }
+  }
+  /* split satellites over threads, thread 0 is the caller */
+  m=(ns+nt-1)/nt;
+  if (nt>1) {
+    pthread_mutex_lock(&ws->lock);
+    for (t=1; t<nt; t++) {
+      ws->arg[t].s0=MIN(t*m, ns); ws->arg[t].s1=MIN((t+1)*m, ns);
+    }
+    ws->ndone=0;
+    ws->job++;
+    pthread_cond_broadcast(&ws->cjob);
+    pthread_mutex_unlock(&ws->lock);
+  }
+  lckres(ws, 0, MIN(m, ns), sp, sc);
+  if (nt>1) {
+    pthread_mutex_lock(&ws->lock);
+    while (ws->ndone<nt-1) pthread_cond_wait(&ws->cdone, &ws->lock);
+    pthread_mutex_unlock(&ws->lock);
+  }
+  for (t=1; t<nt; t++) {
+    for (i=0; i<nc; i++) {
+      sp[i]+=ws->part[t][0][i];
+      sc[i]+=ws->part[t][1][i];
+    }
+  }
+  /* best and second best candidate */
+  k=ws->nv[0]>0?0:1;
+  if (ws->nv[k]<=0) return -1;
+  s=k==0?sp:sc;
+  for (i=0, s1=s2=1E300; i<nc; i++) {
+    if (s[i]<s1) {s2=s1; s1=s[i]; ws->best=i;}
+    else if (s[i]<s2) s2=s[i];
+  }
+  for (k=0; k<2; k++) {
+    ws->ssr[k]=k==0?sp[ws->best]:sc[ws->best];
+    ws->rms[k]=ws->nv[k]>0?sqrt(ws->ssr[k]/ws->nv[k]):0.0;
+  }
+  ws->ratio=nc>1&&s1>0.0?s2/s1:0.0;
+  return ws->best;
+}
 /* Map-Matching ----------------------------------------------------------------
 * Find a position, within the enhanced search space, that
 * best represents the receiver's true position
 * args:	I	rtk_t *rtk solution structure with the SPP position and covariance
+*       and the ppp states (clocks, phase biases, troposphere)
 *       I const obsd_t *obs structure containing the observables for one epoch
 *       I int n number of observed satellites
 *       I const obsd_t *nav structure containing the satellite positions
-* returns an improved rover position in ecef coordinates [3x1]
+*       I const double *rs[n x 6] satellite positions and velocities [m|m/s]
+*       I const double *dts[n x 2] satellite clock bias and drift [s|s/s]
+*       I const double *vare[n] satellite position and clock variances [m^2]
+*       IO lckws_t *ws locking phase workspace owned by the caller
+*       (lckws_init())
+*       O double *mmcand[3] best search space candidate in ecef [m]
+* returns the number of search space candidates (0:no candidate or no best
+* candidate)
+* obs.: the lane map (lanemap_read()) holds the lanes in the tile frames, only
+* the SPP position and covariance are rotated to the frame per epoch. the
+* measurements of all satellites are modeled as in res_ppp() at the SPP
+* position and evaluated against all candidates with one lckphase_batch()
+* call. residual statistics of the best candidate are left in ws
 *-----------------------------------------------------------------------------*/
 extern int match (rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav,
-  double *enhspce){//input rtk_t
- double mm_r[3], r_spp[3], pos[3], pos1[3], pos2[3], enuspp[3],enu[3],r[3];
- double pos0[3],r0[3],enu0[3],dpos[3],enuQ[9],P[9],dr[3];
- double *enhaux;
- double lat0=45.94312323*D2R, lon0=-66.64106835*D2R, h0=52.7309; // BMO corner 1
- double space[BUFFSIZE*2*3];
- int ensrcspcflag[BUFFSIZE*2*3], count;
- float r_sppq[6];
- int i,j,k;
- FILE *fp1;
- double rs1[3],dts1[2],trop1;
- double rechgt[3]; /* Receiver height {e,n,u} */
- double rho=0.0, tow;
- double epoch[6],e[3],azq[2]; /* vector of day/time {year,month,day,hour,min,sec} */
- double recbody[3]; /* Platform gnss antena offsets in body-frame
- {x(nav.direc),y(right),z(down)} in meters */
- recbody[0]=0;recbody[1]=0.113;recbody[2]=1.629;
-
- //fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/exp1Closest_point_report.txt","a");
- //fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/spp_pos_test.txt","a");
- //fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/exp1_enhancedspace.txt","a");
- //fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/exp1_mmpoint.txt","a");
-// fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/clst_lane_heights_rtklib4.txt","a");
- //fp1 = fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/out/3dclosestpointdist_rtklib.txt","a");
-
- tow=time2gpst(rtk->sol.time,NULL);
- time2epoch(rtk->sol.time, epoch);
+  const double *rs, const double *dts, const double *vare, lckws_t *ws,
+  double *mmcand){
+ const prcopt_t *opt=&rtk->opt;
+ const double *x=rtk->x;
+ const lanetile_t *t;
+ double r_spp[3], enuspp[3], dr[3], P[9], EP[9], enuQ[9];
+ const double zazel[]={0.0,PI/2.0};
+ double enhspce[MAXLCKCAND*3], pos[3], e[3], azel[2], dantr[NFREQ]={0};
+ double dants[NFREQ]={0}, dtrp, vart, varm[2], clk, zhd, m_h, m_w;
+ double srs[MAXOBS*6], meas[MAXOBS*2], off[MAXOBS*2], var[MAXOBS*2];
+ int ensrcspcflag[BUFFSIZE*2], count=0;
+ int i,j,k,w0,w1,sat,sys,brk,ns=0;
 
  for(i=0;i<3;i++) r_spp[i]=rtk->sol.rr[i];
- for(i=0;i<6;i++) r_sppq[i]=rtk->sol.qr[i];
-
- /* Fetching data to the first buffer structure (lane.buffer)	*/
- inibuff();
-
- /* Closest point computation  			*/
- clstpt(&r_spp);
-
- /* Lane to local and lane offset with the antenna height amount  */
- /* llh to enu from lat0, h0 */
- pos0[0]=lat0;pos0[1]=lon0;pos0[2]=h0; /* Manually defining origin but it can be done
- this way: Enu baseline form - example from solution.c Rtklib function
- outenu(): */
- pos2ecef(pos0, r0);
-
- /* Vehicle height */
- //for (j=0;j<3;j++) rechgt[j]=rtk->opt.antdel[0][j];
-
- /* Lane buffer conversion to local {enu}  */
-  for (i=0; i< lane.sizebuffer; i++){
-    for (j=0;j<3;j++) r[j]=lane.buffer[i*3+j];
-    //pos1[2]=pos1[2]+rechgt[2]; /* Account the vehicle height  into the Lanes */
-    //pos2ecef(pos1, r);
-    //for (j=0;j<3;j++) lane.buffer[i*3+j]=r[j]; /* updating lane buffer  */
-    for (j = 0; j < 3; j++) dr[j]=r[j]-r0[j];
-    ecef2enu(pos0, dr, enu);
-    //d2lgs(lat0, h0, pos1, enu);
-    //printf("ENU-d2l: %lf,%lf,%lf\n",enu[0],enu[1],enu[2])
-    //for (j = 0; j < 3; j++) dr[j]=r[j]-r0[j];
-    //ecef2enu(pos, dr, enu);
-    //printf("ENU-rtk: %lf,%lf,%lf\n",enu[0],enu[1],enu[2]);
-    for (j=0; j < 3; j++) space[i*3+j] = enu[j];
- }
-
- /* SPP position and covariance to local (enu) */
- for (j = 0; j < 3; j++) dr[j]=r_spp[j]-r0[j];
- ecef2enu(pos0, dr, enuspp);
- ecef2pos(r_spp, pos2);
- //d2lgs(lat0, h0, pos2, enuspp);
- soltocov(rtk->sol,P);
- covenu(pos2, P, enuQ);
 
+ /* Closest point of the local frame lane map 	*/
+ if ((k=lanemap_near(&lanemap, r_spp))<0) return 0;
+ t=lanemap.tile+lanemap.pt[k].tile;
 
-  /* Closest point positions to local */
-	for (j=0;j<3;j++) r[j]=lane.buffer[lane.currsearch*3+j];
-  for (j = 0; j < 3; j++) dr[j]=r[j]-r0[j];
-  ecef2enu(pos0, dr, enu);
-  ecef2pos(r, pos1);
-  //d2lgs(lat0, h0, pos1, enu);
+ /* Lane buffer surrounding the closest point, already in the tile frame */
+ w0=MAX(k-BUFFSIZE, t->s0);
+ w1=MIN(k+BUFFSIZE, t->s0+t->n);
 
-  /* Closest point enu check */
-  //fprintf(fp1, "%lf %lf\n",enu[0],enu[1]);
-//  fprintf(fp1, "%lf %lf\n", (epoch[3]+epoch[4]/60+epoch[5]/3600), pos1[2]);
-  //fprintf(fp1, "%lf %lf %lf \n", tow, space[2],enuspp[2]);
+ /* SPP position and covariance to the tile frame */
+ for (j=0;j<3;j++) dr[j]=r_spp[j]-t->r0[j];
+ matmul("NN", 3, 1, 3, 1.0, t->E, dr, 0.0, enuspp);
+ soltocov(rtk->sol, P);
+ matmul("NN", 3, 3, 3, 1.0, t->E, P, 0.0, EP);
+ matmul("NT", 3, 3, 3, 1.0, EP, t->E, 0.0, enuQ);
 
  /* Enhanced search space computation       */
- ensearchspace(enuspp, enuQ, space, &ensrcspcflag);
+ ensearchspace(enuspp, enuQ, t->enu+(w0-t->s0)*3, w1-w0, ensrcspcflag);
 
-count=0;
- for (i = 0; i < lane.sizebuffer; i++) {
-   if (ensrcspcflag[i]==1) {
-     count++;
-   }
+ /* Search space candidates in ecef */
+ for (i=w0;i<w1;i++) {
+   if (ensrcspcflag[i-w0]!=1) continue;
+   for (j=0;j<3;j++) enhspce[count*3+j]=lanemap.pt[i].r[j];
+   count++;
  }
+ if (count<=0) return 0;
 
- //enhspce=mat(count,3);
-
- k=0;
- for (i = 0; i < lane.sizebuffer; i++) {
-   if (ensrcspcflag[i]==1) {
-       for (j=0;j<3;j++) r[j]=lane.buffer[i*3+j];
-       for (j=0;j<3;j++) {
-       enhspce[k] = r[j];
-       k++;
-       }
-     //fprintf(fp1, "%lf %lf\n",space[i*3],space[i*3+1]);
-   }
-}
-
-/* Lane buffer conversion to local {enu} */
- for (i=0; i< lane.sizebuffer; i++){
-   for (j=0;j<3;j++) r[j]=lane.buffer[i*3+j];
-   for (j = 0; j < 3; j++) dr[j]=r[j]-r0[j];
-   ecef2enu(pos0, dr, enu);
-   for (j=0; j < 3; j++) space[i*3+j] = enu[j];
-}
-
- /* Starting point of search is the closest point	*/
- for(i=0;i<3;i++) pos[i]=lane.buffer[lane.currsearch*3+i];//[_+1],[_+2]
-
- /* Distance between SPP-Closest point check */
- //fprintf(fp1, "%lf %lf\n", (epoch[3]+epoch[4]/60+epoch[5]/3600), dist(r_spp, pos) );
-
- //printf("GEOM. DIST. to SPP: %lf\n", geodist(rs,r_spp,e) );
-
- /* Locking phase */
- //printf("CLSPXYZ: %lf, %lf, %lf\n",pos[0],pos[1],pos[2]);
+ /* Modeled measurements of all satellites at the SPP position */
+ ecef2pos(r_spp, pos);
 
-// rho=lckphase(rtk, pos, enhspce, count, obs, nav, n, rs, dts, trop, satn, meas,
-// vare,var,vart,varm,dtdx,v,H,R,azel,x,sat,mmcand);
+ for (i=0;i<n&&i<MAXOBS;i++) {
+   sat=obs[i].sat;
+   if (!(sys=satsys(sat,NULL))||!(sys&opt->navsys)) continue;
+   if (geodist(rs+i*6, r_spp, e)<=0.0||satazel(pos, e, azel)<opt->elmin) continue;
 
-// free(enhspce);
- //fclose(fp1);
- //printf("Geom at Match: %lf\n",rho);
+   /* tropospheric delay */
+   dtrp=vart=0.0;
+   if (opt->tropopt==TROPOPT_SAAS) {
+     dtrp=tropmodel(obs[i].time, pos, azel, REL_HUMI);
+     vart=SQR(ERR_SAAS);
+   }
+   else if (opt->tropopt==TROPOPT_SBAS) {
+     dtrp=sbstropcorr(obs[i].time, pos, azel, &vart);
+   }
+   else if (opt->tropopt==TROPOPT_EST||opt->tropopt==TROPOPT_ESTG) {
+     zhd=tropmodel(obs[i].time, pos, zazel, 0.0); /* as prectrop() of ppp.c */
+     m_h=tropmapf(obs[i].time, pos, azel, &m_w);
+     dtrp=m_h*zhd+m_w*(x[IT(opt)]-zhd);
+     vart=SQR(0.01);
+   }
+   /* satellite and receiver antenna models */
+   if (opt->posopt[0]) satantpcv(rs+i*6, r_spp, nav->pcvs+sat-1, dants);
+   antmodel(opt->pcvr, opt->antdel[0], azel, opt->posopt[1], dantr);
+
+   /* ionosphere and antenna phase corrected measurements */
+   if (!corrmeas(obs+i, nav, pos, azel, opt, dantr, dants,
+                 rtk->ssat[sat-1].phw, meas+ns*2, varm, &brk)) continue;
+
+   /* non-geometric terms: satellite clock, troposphere, receiver clock and
+   phase bias */
+   clk=-CLIGHT*dts[i*2]+dtrp+x[IC(sys==SYS_GLO?1:0,opt)];
+   off[ns*2+1]=clk;
+   off[ns*2  ]=clk+x[IB(sat,opt)];
+
+   for (j=0;j<2;j++) {
+     var[ns*2+j]=varerr1(sat, sys, azel[1], j, opt)+varm[j]+vare[i]+vart;
+   }
+   for (j=0;j<6;j++) srs[ns*6+j]=rs[i*6+j];
+   ns++;
+ }
+ /* Locking phase of all satellites at once */
+ if (lckphase_batch(ws, enhspce, count, srs, meas, off, var, ns)<0) {
+   return 0;
+ }
+ for (j=0;j<3;j++) mmcand[j]=enhspce[ws->best*3+j];
  return count;
- //printf("Finished match \n");
 }
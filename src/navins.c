@@ -0,0 +1,242 @@
+/*------------------------------------------------------------------------------
+* navins.c : navigation block update against full kalman filter check
+*
+* notes   : runs the navigation block updates navfilter() and ud_navfilter()
+*           on random covariances with the design matrix shapes of the
+*           pseudo-measurements of the ins/gnss filter and repeats each
+*           update with filter() as reference:
+*
+*           nhc  : 2 rows on attitude/velocity (xiA(), 6 states), R diagonal
+*           zupt : 3 rows of identity on velocity (xiV(), 3 states)
+*           odo  : 1 row on attitude/velocity (xiA(), 6 states)
+*           lc   : 6 rows of identity on velocity/position (xiV(), 6 states),
+*                  R full (correlated position and velocity)
+*
+*           the covariance is A*A' of a random A with some states of zero
+*           variance, as the removed states of the tc filter. filter()
+*           selects the states by x!=0, so its state vector is set to a tiny
+*           value for the states of non-zero variance and subtracted after.
+*           the state corrections and the updated covariance (rebuilt from
+*           the factors for ud_navfilter()) are compared with filter(), the
+*           errors are relative, |a-b|/(1+|b|). the time per call is
+*           measured for all three.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/21 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "navins"            /* program name */
+#define NSHAPE      4                   /* number of measurement shapes */
+#define XTINY       1E-20               /* state value selecting a state */
+
+typedef struct {        /* pseudo-measurement shape */
+    const char *name;   /* name */
+    int m;              /* number of measurements */
+    int is,ns;          /* first state and number of states of block */
+    int ident;          /* design matrix identity on block (1) or random (0) */
+    int corr;           /* measurement noise correlated (1) or diagonal (0) */
+} shape_t;
+
+typedef struct {        /* check result */
+    double ex[2],eP[2]; /* max rel error of dx/P (navfilter,ud_navfilter) */
+    double t[3];        /* time (filter,navfilter,ud_navfilter) (s) */
+    int nfail;          /* number of failed updates */
+} result_t;
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: navins [option]...",
+  "",
+  " Run the navigation block updates navfilter() and ud_navfilter() on",
+  " random covariances with the nhc, zupt, odometer and loosely coupled",
+  " design matrix shapes against filter(), and report the errors and the",
+  " time per call.",
+  "",
+  " -?        print help",
+  " -n num    number of states [96]",
+  " -e num    number of random problems per shape [200]",
+  " -s seed   random seed [1]",
+  " -tol err  max relative error, exit status 1 if exceeded [1E-8]",
+  " -o file   output csv file (appended) [off]",
+  " -tag str  run label written to csv [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock time (s) -------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* uniform random number in [-1,1) -------------------------------------------*/
+static unsigned long long seed=1;
+
+static double rnd(void)
+{
+    seed=seed*6364136223846793005ULL+1442695040888963407ULL;
+    return (seed>>11)*(2.0/9007199254740992.0)-1.0;
+}
+/* max relative error of arrays ----------------------------------------------*/
+static double relerr(const double *a, const double *b, int n)
+{
+    double e,emax=0.0;
+    int i;
+
+    for (i=0;i<n;i++) {
+        if ((e=fabs(a[i]-b[i])/(1.0+fabs(b[i])))>emax) emax=e;
+    }
+    return emax;
+}
+/* random covariance with states of zero variance ----------------------------*/
+static void rndcov(double *P, double *A, int n)
+{
+    int i,j;
+
+    for (i=0;i<n*n;i++) A[i]=0.1*rnd();
+    for (i=0;i<n;i++) A[i+i*n]+=1.0+0.5*rnd();
+    matmul("NT",n,n,n,1.0,A,A,0.0,P);
+
+    /* removed states, not in the blocks of the constraints */
+    for (i=9;i<n;i++) {
+        if (rnd()>-0.6) continue;
+        for (j=0;j<n;j++) P[i+j*n]=P[j+i*n]=0.0;
+    }
+}
+/* check one shape -----------------------------------------------------------*/
+static void chkshape(const shape_t *sh, int n, int nep, result_t *res)
+{
+    udfac_t ud={0};
+    double *P,*P0,*Pu,*A,*H,*Hs,*R,v[6],x[3][MAXSAT+18],e,t0;
+    int i,j,k,ep,m=sh->m,is=sh->is,ns=sh->ns,stat;
+
+    P=mat(n,n); P0=mat(n,n); Pu=mat(n,n); A=mat(n,n); H=zeros(n,m);
+    Hs=mat(ns,m); R=mat(m,m);
+
+    for (ep=0;ep<nep;ep++) {
+        rndcov(P0,A,n);
+
+        /* design matrix block, innovation, measurement noise */
+        for (j=0;j<m;j++) {
+            for (i=0;i<ns;i++) Hs[i+j*ns]=sh->ident?(i==j?1.0:0.0):rnd();
+            v[j]=0.1*rnd();
+        }
+        for (i=0;i<m;i++) for (j=0;j<m;j++) {
+            R[i+j*m]=i==j?0.01*(1.5+rnd()):(sh->corr&&i<j?0.002*rnd():0.0);
+        }
+        for (i=0;i<m;i++) for (j=0;j<i;j++) R[i+j*m]=R[j+i*m];
+        for (j=0;j<m;j++) for (i=0;i<ns;i++) H[is+i+j*n]=Hs[i+j*ns];
+
+        /* filter() reference */
+        matcpy(P,P0,n,n);
+        for (i=0;i<n;i++) x[0][i]=P[i+i*n]>0.0?XTINY:0.0;
+        t0=walltime();
+        stat=filter(x[0],P,H,v,R,n,m);
+        res->t[0]+=walltime()-t0;
+        for (i=0;i<n;i++) if (x[0][i]!=0.0) x[0][i]-=XTINY;
+        matcpy(Pu,P,n,n);
+
+        /* navfilter() */
+        matcpy(P,P0,n,n);
+        t0=walltime();
+        stat|=navfilter(x[1],P,Hs,v,R,n,m,is,ns);
+        res->t[1]+=walltime()-t0;
+        if ((e=relerr(x[1],x[0],n))>res->ex[0]) res->ex[0]=e;
+        if ((e=relerr(P,Pu,n*n))>res->eP[0]) res->eP[0]=e;
+
+        /* ud_navfilter() */
+        if (ud_init(&ud,P0,n)) {
+            res->nfail++;
+            continue;
+        }
+        t0=walltime();
+        stat|=ud_navfilter(&ud,x[2],Hs,v,R,n,m,is,ns);
+        res->t[2]+=walltime()-t0;
+        ud_toP(&ud,P,n);
+        if ((e=relerr(x[2],x[0],n))>res->ex[1]) res->ex[1]=e;
+        if ((e=relerr(P,Pu,n*n))>res->eP[1]) res->eP[1]=e;
+
+        if (stat) res->nfail++;
+        for (k=0;k<3;k++) for (i=0;i<n;i++) x[k][i]=0.0;
+    }
+    ud_free(&ud);
+    free(P); free(P0); free(Pu); free(A); free(H); free(Hs); free(R);
+}
+int main(int argc, char **argv)
+{
+    const shape_t shapes[NSHAPE]={
+        {"nhc" ,2,0,6,0,0},
+        {"zupt",3,3,3,1,0},
+        {"odo" ,1,0,6,0,0},
+        {"lc"  ,6,3,6,1,1}
+    };
+    FILE *fp;
+    result_t res[NSHAPE]={{{0}}};
+    double tol=1E-8;
+    char *outfile="",*tag="-";
+    int i,k,n=96,nep=200,stat=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-n")&&i+1<argc) n=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-e")&&i+1<argc) nep=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-s")&&i+1<argc) seed=strtoull(argv[++i],NULL,10);
+        else if (!strcmp(argv[i],"-tol")&&i+1<argc) tol=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else printhelp();
+    }
+    if (n<12||n>MAXSAT+18||nep<=0) printhelp();
+
+    for (k=0;k<NSHAPE;k++) chkshape(shapes+k,n,nep,res+k);
+
+    fprintf(stdout,"%s: n=%d problems=%d\n",PROGNAME,n,nep);
+    fprintf(stdout,"%-5s %2s %10s %10s %10s %10s %9s %9s %9s %4s\n","shape",
+            "m","nav dx","nav P","ud dx","ud P","filter us","nav us",
+            "ud us","fail");
+    for (k=0;k<NSHAPE;k++) {
+        fprintf(stdout,"%-5s %2d %10.2E %10.2E %10.2E %10.2E %9.1f %9.1f "
+                "%9.1f %4d\n",shapes[k].name,shapes[k].m,res[k].ex[0],
+                res[k].eP[0],res[k].ex[1],res[k].eP[1],res[k].t[0]/nep*1E6,
+                res[k].t[1]/nep*1E6,res[k].t[2]/nep*1E6,res[k].nfail);
+        if (res[k].ex[0]>tol||res[k].eP[0]>tol||res[k].ex[1]>tol||
+            res[k].eP[1]>tol||res[k].nfail) stat=1;
+    }
+    if (*outfile) {
+        if (!(fp=fopen(outfile,"r"))) {
+            if ((fp=fopen(outfile,"w"))) {
+                fprintf(fp,"tag,shape,n,m,problems,nav_dx_err,nav_P_err,"
+                        "ud_dx_err,ud_P_err,filter_us,nav_us,ud_us,fail\n");
+            }
+        }
+        else {
+            fclose(fp);
+            fp=fopen(outfile,"a");
+        }
+        if (fp) {
+            for (k=0;k<NSHAPE;k++) {
+                fprintf(fp,"%s,%s,%d,%d,%d,%.2E,%.2E,%.2E,%.2E,%.1f,%.1f,"
+                        "%.1f,%d\n",tag,shapes[k].name,n,shapes[k].m,nep,
+                        res[k].ex[0],res[k].eP[0],res[k].ex[1],res[k].eP[1],
+                        res[k].t[0]/nep*1E6,res[k].t[1]/nep*1E6,
+                        res[k].t[2]/nep*1E6,res[k].nfail);
+            }
+            fclose(fp);
+        }
+    }
+    return stat;
+}
@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------------
+* plotins.c : ins/gnss plot data exporter
+*
+* notes   : reads the ins/gnss solution files of a run (out_PVA.txt,
+*           out_raw_imu.txt, out_KF_SD.txt ...) once with plotexport() and
+*           writes decimated plot data and one gnuplot script, so day-long
+*           runs are plotted without gnuplot re-reading the full text
+*           outputs for every figure. it can be run on the output directory
+*           of a finished run or while satinsmap is still writing it.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/13 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "plotins"           /* program name */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: plotins [option]... [dir]",
+  "",
+  " Read the ins/gnss solution files in dir [../out/] once, decimate every",
+  " plotted quantity to min/max/mean per bin and write plot data files and",
+  " the gnuplot script plots.gp.",
+  "",
+  " -?        print help",
+  " -o dir    output directory of plot data, script and images [dir]",
+  " -b n      number of bins per series (plot width in pixels) [1024]",
+  " -g        run gnuplot on the script [off]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* plotins main --------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    struct timespec t0,t1;
+    char *dir="../out/",*outdir=NULL,cmd[1100];
+    int i,nbin=0,run=0,nplot;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-o")&&i+1<argc) outdir=argv[++i];
+        else if (!strcmp(argv[i],"-b")&&i+1<argc) nbin=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-g")) run=1;
+        else if (*argv[i]=='-') printhelp();
+        else dir=argv[i];
+    }
+    if (!outdir) outdir=dir;
+
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+    nplot=plotexport(dir,outdir,nbin);
+    clock_gettime(CLOCK_MONOTONIC,&t1);
+
+    if (nplot<=0) {
+        fprintf(stderr,"%s: no solution files in %s\n",PROGNAME,dir);
+        return -1;
+    }
+    fprintf(stderr,"%s: %d plots exported in %.2f s\n",PROGNAME,nplot,
+            t1.tv_sec-t0.tv_sec+(t1.tv_nsec-t0.tv_nsec)*1E-9);
+
+    if (run) {
+        sprintf(cmd,"gnuplot '%s%splots.gp'",outdir,
+                outdir[strlen(outdir)-1]=='/'?"":"/");
+        return system(cmd);
+    }
+    return 0;
+}
@@ -1822,3 +1822,338 @@ fprintf(gp,"plot '../out/amb_sol_ppp_only.txt' using 1:( ($2)==30 ? ($4):1/0) wi
   fclose(gp);
 
 }
+
+/* single-pass decimating plot data exporter ---------------------------------*/
+#define PLOTBIN     1024        /* default number of bins per series (pixels) */
+#define PLOTW0      1E-3        /* initial bin width (s) */
+#define PLOTLINE    16384       /* max line length of solution files */
+
+typedef struct {        /* plot source file */
+    const char *file;   /* solution file name */
+    const char *dat;    /* decimated data file name */
+    int key;            /* satellite column (0:none) */
+    int c0,nc;          /* first column and number of quantities */
+    int nz;             /* skip zero quantities (1:on) */
+} plotsrc_t;
+
+typedef struct {        /* decimated series */
+    double t0,w;        /* first time and bin width (s) */
+    int nb;             /* number of bins used */
+    int *n;             /* number of samples per bin */
+    double *sum,*min,*max; /* statistics {bin*nc+quantity} */
+} plotser_t;
+
+typedef struct {        /* plot definition */
+    const char *png;    /* output image name */
+    int src,xy;         /* source index, track plot q[0]:x q[1]:y (1:on) */
+    const char *xlabel,*ylabel,*yrange;
+    int nq,q[3];        /* quantities */
+    const char *title[3]; /* quantity titles */
+} plotdef_t;
+
+static const plotsrc_t plotsrc[]={
+    {"out_raw_imu.txt"     ,"plot_imu.dat" ,0,2,6,0},
+    {"out_PVA.txt"         ,"plot_pva.dat" ,0,2,9,0},
+    {"out_IMU_bias.txt"    ,"plot_bias.dat",0,2,6,0},
+    {"out_KF_SD.txt"       ,"plot_kfsd.dat",0,2,9,0},
+    {"out_clock_file.txt"  ,"plot_clk.dat" ,0,2,1,0},
+    {"out_tropo_bias.txt"  ,"plot_trop.dat",0,2,1,0},
+    {"out_KF_residuals.txt","plot_res.dat" ,2,3,2,0},
+    {"out_amb_bias.txt"    ,"plot_amb.dat" ,2,3,1,1}
+};
+static const plotdef_t plotdef[]={
+    {"accelerations.png"  ,0,0,"TIME(s)","ACCELERATIONS (m/s/s)","",
+     3,{2,0,1},{"acc. z","acc. x","acc. y"}},
+    {"gyroscopes.png"     ,0,0,"TIME(s)","RATE GYROSCOPES (deg/s)","",
+     3,{5,3,4},{"gyro. z","gyro. x","gyro. y"}},
+    {"euler_angles.png"   ,1,0,"TIME(s)","ATTITUDE ANGLE (deg)","",
+     3,{8,6,7},{"yaw(z)","roll(x)","pitch(y)"}},
+    {"velocities.png"     ,1,0,"TIME(s)","VELOCITIES (m/s)","[-40:40]",
+     3,{3,4,5},{"vel. N","vel. E","vel. D"}},
+    {"positions.png"      ,1,1,"x(long)(deg)","y(lat)(deg)","",
+     2,{1,0},{"INS/GNSS position"}},
+    {"IMU_acc_bias.png"   ,2,0,"TIME(s)","IMU ACC. BIAS","",
+     3,{0,1,2},{"acc. bias x","acc. bias y","acc. bias z"}},
+    {"IMU_gyro_bias.png"  ,2,0,"TIME(s)","IMU GYROS. BIAS","",
+     3,{3,4,5},{"gyr. bias x","gyr. bias y","gyr. bias z"}},
+    {"KF_att_std.png"     ,3,0,"TIME(s)","ATTITUDE STDs","",
+     3,{0,1,2},{"roll(x) std","phi(y) std","yaw(z) std"}},
+    {"KF_vel_std.png"     ,3,0,"TIME(s)","VELOCITY STDs","",
+     3,{3,4,5},{"x vel. std","y vel. std","z vel. std"}},
+    {"KF_pos_std.png"     ,3,0,"TIME(s)","POSITION STDs","[0:20]",
+     3,{6,7,8},{"lat. std","long. std","height std"}},
+    {"KF_clk.png"         ,4,0,"TIME(s)","CLOCK","",
+     1,{0},{"clock"}},
+    {"tropo_bias.png"     ,5,0,"TIME(s)","TROPOSPHERIC DELAY (m)","[2.0:3.0]",
+     1,{0},{"tropo. delay"}},
+    {"KF_pseudorange_residuals.png",6,0,"TIME(s)","PSEUDORANGE RESIDUALS (m)",
+     "[-10:10]",1,{1},{""}},
+    {"KF_phase_residuals.png",6,0,"TIME(s)","PHASE RESIDUALS (m)","[-10:10]",
+     1,{0},{""}},
+    {"ambiguities.png"    ,7,0,"TIME(s)","AMBIGUITIES (m)","[-20:20]",
+     1,{0},{""}}
+};
+/* output file path ----------------------------------------------------------*/
+static void plotpath(char *path, const char *dir, const char *file)
+{
+    int n=(int)strlen(dir);
+    sprintf(path,"%s%s%s",dir,n>0&&dir[n-1]!='/'?"/":"",file);
+}
+/* allocate decimated series -------------------------------------------------*/
+static int newser(plotser_t *s, int nbin, int nc)
+{
+    if (!(s->n=(int *)calloc(nbin,sizeof(int)))||
+        !(s->sum=(double *)malloc(sizeof(double)*nbin*nc))||
+        !(s->min=(double *)malloc(sizeof(double)*nbin*nc))||
+        !(s->max=(double *)malloc(sizeof(double)*nbin*nc))) {
+        free(s->n); free(s->sum); free(s->min); s->n=NULL;
+        return 0;
+    }
+    s->nb=0;
+    return 1;
+}
+/* free decimated series -----------------------------------------------------*/
+static void freeser(plotser_t *s)
+{
+    free(s->n); free(s->sum); free(s->min); free(s->max);
+    s->n=NULL;
+}
+/* merge bin pairs and double bin width --------------------------------------*/
+static void mergeser(plotser_t *s, int nbin, int nc)
+{
+    int i,j,k,a,b;
+
+    for (i=0;i<nbin/2;i++) {
+        a=2*i; b=2*i+1;
+        if (s->n[a]&&s->n[b]) {
+            for (j=0;j<nc;j++) {
+                k=i*nc+j;
+                s->sum[k]=s->sum[a*nc+j]+s->sum[b*nc+j];
+                s->min[k]=MIN(s->min[a*nc+j],s->min[b*nc+j]);
+                s->max[k]=MAX(s->max[a*nc+j],s->max[b*nc+j]);
+            }
+        }
+        else if (s->n[a]||s->n[b]) {
+            if (!s->n[a]) a=b;
+            for (j=0;j<nc;j++) {
+                k=i*nc+j;
+                s->sum[k]=s->sum[a*nc+j];
+                s->min[k]=s->min[a*nc+j];
+                s->max[k]=s->max[a*nc+j];
+            }
+        }
+        s->n[i]=s->n[2*i]+s->n[2*i+1];
+    }
+    for (;i<nbin;i++) s->n[i]=0;
+    s->nb=(s->nb+1)/2;
+    s->w*=2.0;
+}
+/* add sample to decimated series --------------------------------------------*/
+static void addser(plotser_t *s, int nbin, int nc, double t, const double *v)
+{
+    double dt;
+    int i,j,k;
+
+    if (s->nb==0) {
+        s->t0=t;
+        s->w=PLOTW0;
+    }
+    dt=t<s->t0?0.0:t-s->t0;
+    while (dt/s->w>=nbin) mergeser(s,nbin,nc);
+    i=(int)(dt/s->w);
+    if (i>=s->nb) s->nb=i+1;
+
+    for (j=0;j<nc;j++) {
+        k=i*nc+j;
+        if (!s->n[i]) {
+            s->sum[k]=s->min[k]=s->max[k]=v[j];
+            continue;
+        }
+        s->sum[k]+=v[j];
+        if (v[j]<s->min[k]) s->min[k]=v[j];
+        if (v[j]>s->max[k]) s->max[k]=v[j];
+    }
+    s->n[i]++;
+}
+/* write decimated series: time mean min max per quantity --------------------*/
+static void outser(FILE *fp, const plotser_t *s, int nc)
+{
+    int i,j,gap=0;
+
+    for (i=0;i<s->nb;i++) {
+        if (!s->n[i]) {
+            if (!gap) fprintf(fp,"\n"); /* break lines over data gaps */
+            gap=1;
+            continue;
+        }
+        fprintf(fp,"%.3f",s->t0+(i+0.5)*s->w);
+        for (j=0;j<nc;j++) {
+            fprintf(fp," %.10g %.10g %.10g",s->sum[i*nc+j]/s->n[i],
+                    s->min[i*nc+j],s->max[i*nc+j]);
+        }
+        fprintf(fp,"\n");
+        gap=0;
+    }
+}
+/* read solution file once into decimated series -----------------------------*/
+static int readsrc(const char *file, const plotsrc_t *src, plotser_t *ser,
+                   int nbin)
+{
+    FILE *fp;
+    double val[16],t;
+    char *buff,*p,*q;
+    int i,c,k,n=0,ncol=src->c0+src->nc-1,sat;
+
+    if (!(fp=fopen(file,"r"))) return -1;
+    if (!(buff=(char *)malloc(PLOTLINE))) {
+        fclose(fp);
+        return -1;
+    }
+    while (fgets(buff,PLOTLINE,fp)) {
+
+        /* skip rest of long lines */
+        if (!strchr(buff,'\n')) {
+            while ((c=fgetc(fp))!=EOF&&c!='\n') ;
+        }
+        for (i=0,p=buff;i<ncol;i++,p=q) {
+            val[i]=strtod(p,&q);
+            if (q==p) break;
+        }
+        if (i<ncol) continue;
+        t=val[0];
+        if (src->key) {
+            sat=(int)val[src->key-1];
+            if (sat<1||sat>MAXSAT) continue;
+            k=sat;
+        }
+        else k=0;
+        if (src->nz&&val[src->c0-1]==0.0) continue;
+
+        if (!ser[k].n&&!newser(ser+k,nbin,src->nc)) break;
+        addser(ser+k,nbin,src->nc,t,val+src->c0-1);
+        n++;
+    }
+    free(buff);
+    fclose(fp);
+    return n;
+}
+/* write gnuplot commands of plot --------------------------------------------*/
+static void outplot(FILE *fp, const plotdef_t *def, const plotsrc_t *src,
+                    const plotser_t *ser, const char *dat, const char *png)
+{
+    const char *sep="plot ";
+    char id[8];
+    int i,j,k,nk=src->key?MAXSAT+1:1,nser=0;
+
+    fprintf(fp,"\nset output '%s'\n",png);
+    fprintf(fp,"set xlabel '%s'\nset ylabel '%s'\n",def->xlabel,def->ylabel);
+    if (*def->yrange) fprintf(fp,"set yrange %s\n",def->yrange);
+    else fprintf(fp,"set autoscale y\n");
+
+    if (def->xy) {
+        fprintf(fp,"plot '%s' u %d:%d w l lc 3 title \"%s\"\n",dat,
+                2+3*def->q[0],2+3*def->q[1],def->title[0]);
+        return;
+    }
+    /* min/max envelope first, mean lines on top */
+    for (i=0;i<2;i++) {
+        for (k=0,nser=0;k<nk;k++) {
+            if (!ser[k].n) continue;
+            if (src->key) satno2id(k,id);
+            for (j=0;j<def->nq;j++) {
+                if (i==0) {
+                    fprintf(fp,"%s'%s' index %d u 1:%d:%d w filledcurves lc %d "
+                            "fs transparent solid 0.25 notitle",sep,dat,nser,
+                            3+3*def->q[j],4+3*def->q[j],(src->key?nser:j)%8+1);
+                }
+                else {
+                    fprintf(fp,"%s'%s' index %d u 1:%d w l lc %d title \"%s\"",
+                            sep,dat,nser,2+3*def->q[j],(src->key?nser:j)%8+1,
+                            src->key?id:def->title[j]);
+                }
+                sep=", \\\n     ";
+            }
+            nser++;
+        }
+    }
+    fprintf(fp,"\n");
+}
+/* export decimated plot data and gnuplot script -------------------------------
+* description: read the ins/gnss solution files once, decimate every plotted
+*              quantity to min/max/mean per time bin and write compact plot
+*              data files with one gnuplot script for all plots
+* args   : char   *dir      I   directory of solution files (out_PVA.txt ...)
+*          char   *outdir   I   directory of plot data, script and images
+*          int    nbin      I   number of bins per series (0:default)
+* return : number of plots written to script (0:error)
+* notes  : the bin width is unknown until the end of the file, so it starts
+*          small and adjacent bins are merged (width doubled) whenever a
+*          sample falls beyond the last bin. every sample is read once and
+*          the memory is fixed by nbin.
+*          plot data: one block per series (satellite for residuals and
+*          ambiguities) separated by two blank lines, records "time mean min
+*          max" for each quantity. the script is <outdir>plots.gp and writes
+*          png images to outdir (gnuplot <outdir>plots.gp)
+*-----------------------------------------------------------------------------*/
+extern int plotexport(const char *dir, const char *outdir, int nbin)
+{
+    FILE *fp,*gp;
+    plotser_t *ser[sizeof(plotsrc)/sizeof(*plotsrc)];
+    char path[1024],dat[1024],png[1024],id[8];
+    int i,k,n,nk,nrec[sizeof(plotsrc)/sizeof(*plotsrc)],nplot=0;
+    int nsrc=(int)(sizeof(plotsrc)/sizeof(*plotsrc));
+
+    trace(3,"plotexport: dir=%s outdir=%s nbin=%d\n",dir,outdir,nbin);
+
+    if (nbin<2) nbin=PLOTBIN;
+    nbin&=~1;
+
+    for (i=0;i<nsrc;i++) {
+        nk=plotsrc[i].key?MAXSAT+1:1;
+        ser[i]=(plotser_t *)calloc(nk,sizeof(plotser_t));
+        if (!ser[i]) {
+            nrec[i]=-1;
+            continue;
+        }
+        plotpath(path,dir,plotsrc[i].file);
+        if ((nrec[i]=readsrc(path,plotsrc+i,ser[i],nbin))<=0) continue;
+
+        plotpath(path,outdir,plotsrc[i].dat);
+        if (!(fp=fopen(path,"w"))) {
+            nrec[i]=-1;
+            continue;
+        }
+        for (k=n=0;k<nk;k++) {
+            if (!ser[i][k].n) continue;
+            if (n++>0) fprintf(fp,"\n\n");
+            if (plotsrc[i].key) {
+                satno2id(k,id);
+                fprintf(fp,"# %s\n",id);
+            }
+            outser(fp,ser[i]+k,plotsrc[i].nc);
+        }
+        fclose(fp);
+    }
+    plotpath(path,outdir,"plots.gp");
+    if ((gp=fopen(path,"w"))) {
+        fprintf(gp,"# ins/gnss plots of %s\n",dir);
+        fprintf(gp,"set term png size 1280,960\nset grid\n");
+        for (i=0;i<(int)(sizeof(plotdef)/sizeof(*plotdef));i++) {
+            k=plotdef[i].src;
+            if (nrec[k]<=0) continue;
+            plotpath(dat,outdir,plotsrc[k].dat);
+            plotpath(png,outdir,plotdef[i].png);
+            outplot(gp,plotdef+i,plotsrc+k,ser[k],dat,png);
+            nplot++;
+        }
+        fclose(gp);
+    }
+    for (i=0;i<nsrc;i++) {
+        if (!ser[i]) continue;
+        nk=plotsrc[i].key?MAXSAT+1:1;
+        for (k=0;k<nk;k++) if (ser[i][k].n) freeser(ser[i]+k);
+        free(ser[i]);
+        trace(3,"plotexport: %s records=%d\n",plotsrc[i].file,nrec[i]);
+    }
+    return nplot;
+}
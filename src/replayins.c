@@ -0,0 +1,277 @@
+/*------------------------------------------------------------------------------
+* replayins.c : replay recorded rtcm3 streams through the rtk server
+*
+* notes   : recorded rover and correction (ssr) rtcm3 files are replayed by
+*           the rtk server (rtksvrstart()) with the ins/gnss core as in a live
+*           deployment. time-tagged files (file.tag written by str2str or
+*           strsvr) are replayed at -x times real time.
+*
+*           while the server runs, a check thread reads the navigation data
+*           snapshots by rtksvrnavget() as positioning does and counts
+*
+*             torn snapshots : the satellites of a correction epoch differ
+*                              from a previous snapshot of the same epoch or
+*                              the correction epoch goes backward
+*             overwritten    : the ssr corrections change while the snapshot
+*                              is held for -hold ms
+*
+*           the exit status is 1 if any is counted, so the replay is used as
+*           a regression test of the correction ingestion.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/17 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "replayins"         /* program name */
+#define MAXIDLE     3.0                 /* default idle time to end replay (s) */
+
+typedef struct {        /* snapshot check */
+    int state;          /* check state (0:stop,1:running) */
+    int hold;           /* snapshot hold time (ms) */
+    unsigned int nchk;  /* number of snapshots checked */
+    unsigned int ntorn; /* number of torn snapshots */
+    unsigned int nover; /* number of snapshots overwritten while held */
+    double tget;        /* max time of rtksvrnavget() (s) */
+    gtime_t t0;         /* last correction epoch */
+    int nsat;           /* number of satellites of last correction epoch */
+} navchk_t;
+
+static rtksvr_t svr;    /* rtk server */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: replayins [option]... -r file [-c file]",
+  "",
+  " Replay recorded rover and ssr correction rtcm3 files through the rtk",
+  " server and the ins/gnss core, and check the navigation data snapshots read",
+  " by positioning. Exit status is 1 if a torn or overwritten snapshot is",
+  " found.",
+  "",
+  " -?        print help",
+  " -k file   input options from configuration file [off]",
+  " -i file   tactical imu log [../data/26082019/imu_ascii.txt]",
+  " -r file   rover rtcm3 file [required]",
+  " -c file   correction (ssr) rtcm3 file [off]",
+  " -x speed  replay speed of time-tagged files (0:no time-tag) [10]",
+  " -hold ms  snapshot hold time of check thread [2]",
+  " -t sec    idle time of rover stream to end replay [3]",
+  " -w dir    work directory for ins/gnss solution files [/tmp]",
+  " -o file   output solution file [dir/replayins.pos]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock (s) ------------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* latest correction epoch and number of satellites of snapshot --------------*/
+static int ssrepoch(const nav_t *nav, gtime_t *t0)
+{
+    int i,n=0;
+
+    t0->time=0; t0->sec=0.0;
+    for (i=0;i<MAXSAT;i++) {
+        if (nav->ssr[i].t0[1].time==0) continue;
+        if (t0->time==0||timediff(nav->ssr[i].t0[1],*t0)>0.0) {
+            *t0=nav->ssr[i].t0[1];
+            n=0;
+        }
+        if (timediff(nav->ssr[i].t0[1],*t0)==0.0) n++;
+    }
+    return n;
+}
+/* checksum of ssr corrections of snapshot -----------------------------------*/
+static double ssrsum(const nav_t *nav)
+{
+    double sum=0.0;
+    int i,j;
+
+    for (i=0;i<MAXSAT;i++) {
+        sum+=nav->ssr[i].t0[0].time+nav->ssr[i].t0[1].time;
+        for (j=0;j<3;j++) sum+=nav->ssr[i].deph[j]+nav->ssr[i].dclk[j];
+    }
+    return sum;
+}
+/* snapshot check thread -----------------------------------------------------*/
+static void *navchkthread(void *arg)
+{
+    navchk_t *chk=(navchk_t *)arg;
+    const nav_t *nav;
+    gtime_t t0;
+    double t,sum;
+    int index,n;
+
+    while (chk->state) {
+        t=walltime();
+        nav=rtksvrnavget(&svr,&index);
+        t=walltime()-t;
+        if (t>chk->tget) chk->tget=t;
+
+        n=ssrepoch(nav,&t0);
+        sum=ssrsum(nav);
+
+        if (t0.time) {
+            if (chk->t0.time&&(timediff(t0,chk->t0)<0.0||
+                (timediff(t0,chk->t0)==0.0&&n!=chk->nsat))) {
+                fprintf(stderr,"torn snapshot: %s nsat=%d (%d)\n",
+                        time_str(t0,0),n,chk->nsat);
+                chk->ntorn++;
+            }
+            chk->t0=t0;
+            chk->nsat=n;
+        }
+        sleepms(chk->hold);
+
+        if (ssrsum(nav)!=sum) chk->nover++;
+        rtksvrnavrel(&svr,index);
+        chk->nchk++;
+    }
+    return NULL;
+}
+/* replay ins/gnss ---------------------------------------------------------------
+* args   : prcopt_t *popt   I   processing options
+*          solopt_t *sopt   I   solution options
+*          char   *rovfile  I   rover rtcm3 file
+*          char   *corfile  I   correction rtcm3 file ("": no correction)
+*          char   *outfile  I   output solution file
+*          double speed     I   replay speed (0:no time-tag)
+*          double idle      I   idle time of rover stream to end replay (s)
+*          navchk_t *chk    IO  snapshot check
+* return : status (1:ok,0:error)
+*-----------------------------------------------------------------------------*/
+static int replay(prcopt_t *popt, solopt_t *sopt, const char *rovfile,
+                  const char *corfile, const char *outfile, double speed,
+                  double idle, navchk_t *chk)
+{
+    solopt_t solopt[2];
+    pthread_t thread;
+    double pos[3]={0},t;
+    unsigned int nobs=0;
+    int i,strs[MAXSTRRTK]={0},fmts[3]={STRFMT_RTCM3,STRFMT_RTCM3,STRFMT_RTCM3};
+    int cputime=0;
+    char paths[MAXSTRRTK][MAXSTRPATH]={{0}},*ppaths[MAXSTRRTK];
+    char *cmds[3]={NULL,NULL,NULL},*rcvopts[3]={"","",""},opt[32]="";
+
+    if (speed>0.0) sprintf(opt,"::T::x%g",speed);
+    strs[0]=STR_FILE; sprintf(paths[0],"%s%s",rovfile,opt);
+    if (*corfile) {
+        strs[2]=STR_FILE; sprintf(paths[2],"%s%s",corfile,opt);
+    }
+    strs[3]=STR_FILE; strcpy(paths[3],outfile);
+    for (i=0;i<MAXSTRRTK;i++) ppaths[i]=paths[i];
+    solopt[0]=solopt[1]=*sopt;
+
+    if (!rtksvrstart(&svr,10,32768,strs,ppaths,fmts,0,cmds,rcvopts,0,0,pos,
+                     popt,solopt,NULL)) {
+        fprintf(stderr,"rtk server start error\n");
+        return 0;
+    }
+    chk->state=1;
+    if (pthread_create(&thread,NULL,navchkthread,chk)) {
+        chk->state=0;
+    }
+    /* wait until rover stream idle */
+    for (t=walltime();walltime()-t<idle;sleepms(100)) {
+        if (svr.cputime>cputime) cputime=svr.cputime;
+        if (svr.nmsg[0][0]==nobs) continue;
+        nobs=svr.nmsg[0][0];
+        t=walltime();
+        fprintf(stderr,"\rreplay: obs=%u ssr=%u snapshots=%u",nobs,
+                svr.nmsg[2][7],svr.npub);
+    }
+    fprintf(stderr,"\n");
+
+    if (chk->state) {
+        chk->state=0;
+        pthread_join(thread,NULL);
+    }
+    rtksvrstop(&svr,cmds);
+
+    fprintf(stderr,"obs: epochs=%u eph=%u ssr epochs=%u solutions=%d "
+            "max cycle=%dms\n",svr.nmsg[0][0],svr.nmsg[0][1]+svr.nmsg[2][1],
+            svr.nmsg[2][7],svr.nsol,cputime);
+    fprintf(stderr,"nav: snapshots=%u reader retries=%u checked=%u torn=%u "
+            "overwritten=%u max get=%.1fus\n",svr.npub,svr.nretry,chk->nchk,
+            chk->ntorn,chk->nover,chk->tget*1E6);
+    return 1;
+}
+/* main ----------------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    prcopt_t prcopt=prcopt_default;
+    solopt_t solopt=solopt_default;
+    filopt_t filopt={""};
+    navchk_t chk={0};
+    double speed=10.0,idle=MAXIDLE;
+    int i,stat;
+    char *imufile="../data/26082019/imu_ascii.txt",*dir="/tmp";
+    char *rovfile="",*corfile="",*outfile="",buff[1024];
+
+    prcopt.mode=PMODE_PPP_KINEMA;
+    prcopt.sateph=EPHOPT_SSRAPC;
+    solopt.timef=0;
+    sprintf(solopt.prog,"%s ver.%s",PROGNAME,VER_RTKLIB);
+    chk.hold=2;
+
+    for (i=1;i<argc;i++) {
+        if (!strcmp(argv[i],"-k")&&i+1<argc) {
+            resetsysopts();
+            if (!loadopts(argv[++i],sysopts)) return -1;
+            getsysopts(&prcopt,&solopt,&filopt);
+        }
+    }
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-k")&&i+1<argc) ++i;
+        else if (!strcmp(argv[i],"-i")&&i+1<argc) imufile=argv[++i];
+        else if (!strcmp(argv[i],"-r")&&i+1<argc) rovfile=argv[++i];
+        else if (!strcmp(argv[i],"-c")&&i+1<argc) corfile=argv[++i];
+        else if (!strcmp(argv[i],"-x")&&i+1<argc) speed=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-hold")&&i+1<argc) chk.hold=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-t")&&i+1<argc) idle=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) dir=argv[++i];
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else printhelp();
+    }
+    if (!*rovfile) {
+        fprintf(stderr,"error : no rover file\n");
+        return -2;
+    }
+    if (!*outfile) {
+        sprintf(buff,"%s/%s.pos",dir,PROGNAME);
+        outfile=buff;
+    }
+    if (!rtksvrinit(&svr)) {
+        fprintf(stderr,"rtk server init error\n");
+        return -1;
+    }
+    if (!insgnssinit(imufile,"",dir)) {
+        rtksvrfree(&svr);
+        return -1;
+    }
+    stat=replay(&prcopt,&solopt,rovfile,corfile,outfile,speed,idle,&chk);
+
+    insgnssfree();
+    rtksvrfree(&svr);
+
+    if (!stat) return -1;
+    return chk.ntorn||chk.nover?1:0;
+}
@@ -17,12 +17,15 @@
 #define MAXGYRO     (10.0*D2R)    /* max rotation speed for using non-holonomic constraint */
 #define VARVEL      SQR(0.05)     /* initial variance of receiver vel ((m/s)^2) */
 #define MINZC       15            /* min count for zero velocity update once */
+#define VARODO      SQR(0.3)      /* variance of obd-ii vehicle speed (1 km/h resolution) ((m/s)^2) */
+#define NNAVB       6             /* navigation block states of constraints (attitude,velocity) */
+#define MAXNAVX     (18+MAXSAT)   /* max number of states for navigation block update */
+#define MAXNAVM     6             /* max number of block pseudo-measurements (lc pos/vel) */
 
 
 /* global variables ----------------------------------------------------------*/
-FILE *fp_lane;       /* Lane coordinate file pointer */
 FILE *imu_tactical; /* Imu datafile pointer */
-lane_t lane;
+lanemap_t lanemap;   /* local frame lane map */
 imuraw_t imu_obs_global={{0}}; 
 pva_t pva_global={{0}};  
 pva_t pvagnss={{0}};
@@ -35,7 +38,16 @@ int gnss_w_counter = 0;
 int ins_w_counter = 0; 
 int dz_counter = 0;
 res_t resid={0};
-static_info_t staticInfo={0};
+motdet_t motdet;                    /* stationarity and turn detector */
+udfac_t insud;                      /* u-d factors of ins/gnss ekf covariance */
+insamb_t insamb;                    /* tightly coupled ambiguity resolution */
+insfde_t insfde;                    /* tightly coupled innovation fde */
+satcache_t satcache={{0}};
+um7raw_t um7raw={0};
+sched_t coresched;
+auxstore_t auxstore={0};
+coreprof_t coreprof={0};            /* core epoch latency profile */
+static auxcur_t odocur={0};           /* obd-ii vehicle speed cursor */
 const double Omge[9]={0,OMGE,0,-OMGE,0,0,0,0,0}; /* (5.18) */
 
 char *outpath1[] = {"../out/"};   
@@ -445,7 +457,8 @@ static const char *help[]={
   " -r x y z  reference (base) receiver ecef pos (m) [average of single pos]",
   " -l lat lon hgt reference (base) receiver latitude/longitude/height (deg/m)",
   " -y level  output soltion status (0:off,1:states,2:residuals) [0]",
-  " -x level  debug trace level (0:off) [0]"
+  " -x level  debug trace level (0:off) [0]",
+  " -lc       loosely coupled ins/gnss with gnss solution [tightly coupled]"
 };
 
 
@@ -551,27 +564,12 @@ int gnssimusync(float tgps, um7pack_t *imu){
 
 /* Determine heading from the map or Ground-truth trajectory -----------------*/
 extern double headfrommap(double* closest_lane_pos){
-  double next_lane_pos[3], origin_llh_pos[3], origin_xyz_pos[3];
-  double dr[3], enu_closest[3], enu_next[3], az=0.0;
-  int j;
-
-  //Origin - BMO corner 1
-  origin_llh_pos[0]= 45.94312323*D2R;
-  origin_llh_pos[1]=-66.64106835*D2R;
-  origin_llh_pos[2]= 52.7309;
-
-  pos2ecef(origin_llh_pos,origin_xyz_pos);
+  int k;
 
-  for (j=0;j<3;j++) next_lane_pos[j]=lane.buffer[(lane.currsearch+1)*3+j];
+  /* lane direction precomputed at map load time */
+  if ((k=lanemap_near(&lanemap, closest_lane_pos))<0) return 0.0;
 
-  /* Transform to local NED system  */
-  for (j=0;j<3;j++) dr[j]=closest_lane_pos[j]-origin_xyz_pos[j];
-  ecef2enu(origin_llh_pos, dr, enu_closest);
-
-  for (j=0;j<3;j++) dr[j]=next_lane_pos[j]-origin_xyz_pos[j];
-  ecef2enu(origin_llh_pos, dr, enu_next);
-
-  return az=azt(enu_closest, enu_next);
+  return lanemap.pt[k].az;
 }
 
 /* Determine velocity using the previous and current closest map point position*/
@@ -957,6 +955,158 @@ void clp1(pva_t *PVA_sol, const double *x)
 
 }
 
+/* invert small matrix in place (gauss-jordan, partial pivoting) ------------*/
+static int invsmall(double *A, int n)
+{
+    double B[MAXNAVM*MAXNAVM*2],p,t;
+    int i,j,k,r,m=2*n;
+
+    for (i=0;i<n;i++) for (j=0;j<m;j++) {
+        B[i+j*n]=j<n?A[i+j*n]:(j-n==i?1.0:0.0);
+    }
+    for (k=0;k<n;k++) {
+        for (r=k,i=k+1;i<n;i++) if (fabs(B[i+k*n])>fabs(B[r+k*n])) r=i;
+        if (fabs(B[r+k*n])<=0.0) return -1;
+        if (r!=k) {
+            for (j=0;j<m;j++) {
+                t=B[k+j*n]; B[k+j*n]=B[r+j*n]; B[r+j*n]=t;
+            }
+        }
+        p=B[k+k*n];
+        for (j=0;j<m;j++) B[k+j*n]/=p;
+        for (i=0;i<n;i++) {
+            if (i==k||(t=B[i+k*n])==0.0) continue;
+            for (j=0;j<m;j++) B[i+j*n]-=t*B[k+j*n];
+        }
+    }
+    for (i=0;i<n;i++) for (j=0;j<n;j++) A[i+j*n]=B[i+(j+n)*n];
+    return 0;
+}
+/* kalman filter update of navigation block constraints ------------------------
+* kalman filter measurement update for pseudo-measurements whose design
+* matrix is non-zero only in a contiguous block of states (e.g. attitude and
+* velocity of zupt, nhc and vehicle speed constraints)
+* args   : double *x        O   states correction (n x 1)
+*          double *P        IO  covariance matrix of states (n x n)
+*          double *Hs       I   block of design matrix (ns x m)
+*          double *v        I   innovation (measurement - model) (m x 1)
+*          double *R        I   covariance matrix of measurement error (m x m)
+*          int    n,m       I   number of states and measurements
+*          int    is,ns     I   first state and number of states of block
+* return : status (0:ok,<0:error)
+* notes  : same update as filter() with H non-zero in rows is..is+ns-1:
+*
+*          F=P(:,s)*Hs, Q=Hs'*P(s,s)*Hs+R, K=F*Q^-1, x=K*v, P=P-K*F'
+*
+*          the gain costs O(n*ns*m) and the covariance a symmetric rank-m
+*          update, instead of the O(n^3) products of filter(). states with
+*          zero variance are not updated (as filter()). no heap allocation
+*-----------------------------------------------------------------------------*/
+extern int navfilter(double *x, double *P, const double *Hs, const double *v,
+                     const double *R, int n, int m, int is, int ns)
+{
+    double F[MAXNAVX*MAXNAVM],K[MAXNAVX*MAXNAVM],Q[MAXNAVM*MAXNAVM],a;
+    int i,j,k,l;
+
+    if (n>MAXNAVX||m>MAXNAVM||m<=0||is<0||is+ns>n) return -1;
+
+    /* F=P(:,s)*Hs (states with zero variance excluded) */
+    for (i=0;i<n;i++) {
+        for (k=0;k<m;k++) {
+            F[i+k*n]=0.0;
+            if (P[i+i*n]<=0.0) continue;
+            for (j=0;j<ns;j++) {
+                if (Hs[j+k*ns]==0.0||P[is+j+(is+j)*n]<=0.0) continue;
+                F[i+k*n]+=P[i+(is+j)*n]*Hs[j+k*ns];
+            }
+        }
+    }
+    /* Q=Hs'*F(s,:)+R */
+    for (k=0;k<m;k++) for (l=0;l<m;l++) {
+        for (a=R[k+l*m],j=0;j<ns;j++) a+=Hs[j+k*ns]*F[is+j+l*n];
+        Q[k+l*m]=a;
+    }
+    if (invsmall(Q,m)) return -1;
+
+    /* K=F*Q^-1, x=K*v */
+    for (i=0;i<n;i++) {
+        for (k=0;k<m;k++) {
+            for (a=0.0,l=0;l<m;l++) a+=F[i+l*n]*Q[l+k*m];
+            K[i+k*n]=a;
+        }
+        for (a=0.0,k=0;k<m;k++) a+=K[i+k*n]*v[k];
+        x[i]=a;
+    }
+    /* P=P-K*F' (symmetric rank-m update) */
+    for (j=0;j<n;j++) {
+        if (P[j+j*n]<=0.0) continue;
+        for (i=0;i<=j;i++) {
+            if (P[i+i*n]<=0.0) continue;
+            for (a=0.0,k=0;k<m;k++) a+=K[i+k*n]*F[j+k*n];
+            P[i+j*n]-=a;
+            if (i!=j) P[j+i*n]=P[i+j*n];
+        }
+    }
+    return 0;
+}
+/* measurement sensitive-matrix for vehicle speed ---------------------------*/
+static int bldodo(const double *Cbe,const double *ve,double speed,
+                  double *v,double *H,double *R)
+{
+    int IA,IV;
+    double C[9],T[9],vb[3];
+
+    trace(3,"bldodo:\n");
+
+    IA=xiA()-xiA(); IV=xiV()-xiA(); /* rows of navigation block */
+
+    /* velocity in body-frame */
+    matmul("TN",3,1,3,1.0,Cbe,ve,0.0,vb);
+
+    skewsym3(ve,C);
+    matmul("TN",3,3,3,1.0,Cbe,C,0.0,T);
+    matt(Cbe,3,3,C);
+
+    /* forward body velocity against obd-ii speed */
+    H[IA]=T[0]; H[IA+1]=T[3]; H[IA+2]=T[6];
+    H[IV]=C[0]; H[IV+1]=C[3]; H[IV+2]=C[6];
+
+    v[0]=vb[0]-speed;
+    R[0]=VARODO;
+    return 1;
+}
+/* using vehicle speed (obd-ii) for ins navigation ----------------------------
+ * args    :  insstate_t* ins  IO  ins state
+ *            insopt_t* opt    I   ins options
+ *            double speed     I   vehicle speed at ins time (m/s)
+ * return  : 1 (ok) or 0 (fail)
+ * notes   : forward speed pseudo-measurement, complements the lateral and
+ *           vertical constraints of nhc()
+ * ---------------------------------------------------------------------------*/
+extern int odo(ins_states_t *ins,const insgnss_opt_t *opt,double speed)
+{
+    int nx=ins->nx,info=0,nv;
+    double H[NNAVB]={0},v[1],R[1],x[MAXNAVX];
+
+    trace(3,"odo: speed=%.3f\n",speed);
+
+    nv=bldodo(ins->Cbe,ins->ve,speed,v,H,R);
+
+    /* kalman filter */
+    if (nv>0) {
+        if ((info=opt->udfilt?ud_navfilter(insudfac(ins),x,H,v,R,nx,nv,xiA(),NNAVB):
+                              navfilter(x,ins->P,H,v,R,nx,nv,xiA(),NNAVB))) {
+            trace(2,"vehicle speed update filter fail\n");
+            info=0;
+        }
+        else {
+            info=1;
+            clp(ins,opt,x);
+            trace(3,"use vehicle speed update ok\n");
+        }
+    }
+    return info;
+}
 /* zero velocity update for ins navigation -----------------------------------
  * args    :  insstate_t *ins  IO  ins state
  *            insopt_t *opt    I   ins options
@@ -1087,88 +1237,22 @@ extern void imufileback(){
   }
   /* to match the begining of the line after the \n */
   fseek(imu_tactical, 1, SEEK_CUR);
-}
-/* Parse and organize the MEMs-IMU received packets ----------------------------
-* description: IMU
-* args   : char *strline       I   char with one line containing one sensor IMU readings
-* One epoch message type:
-489629.200,1946,COM3,36,$PCHRS,0,101.633,3.32,0.33,-0.49,*7E
-489629.200,1946,COM3,42,$PCHRS,1,101.633,0.3717,0.1030,-0.7725,*77
-489629.200,1946,COM3,42,$PCHRS,2,101.633,0.4922,0.2708,-1.6283,*7D, where
-secofweek sync, GPS week, port, ?, header filed, count, sensor time, x,y,z,checksum
-    O  imu.status -1: meassage not complete, 0: error reading, 1: ok
-*-----------------------------------------------------------------------------*/
-void parseimudata(char* strline, um7pack_t* imu)
-{
-   char *token;
-   int i=1, sscanstat;
-   float sensor_x,sensor_y,sensor_z;
-   double imucurrtime;
-   double G = 9.80665;
-
-  sscanstat=sscanf(strline, "%lf,%d,%*4s,%*2d,%*6s,%d,%f,%*f,%*f,%*f,%*s",
-  &imu->sec, &imu->gpsw, &imu->count, &imu->internal_time);
-
-  /* Checking if received message is complete and synchronized	*/
-  if (sscanstat < 4) {
-    imu->status=-1;
-    return;
-  }
-
-  sscanstat=sscanf(strline, "%lf,%d,%*4s,%*2d,%*6s,%d,%*f,%f,%f,%f,%3c",
-  &imu->sec, &imu->gpsw, &imu->count, &sensor_x, &sensor_y, &sensor_z, &imu->checksum);
-  /*printf("%6.1f, %d, %d, %f, %f, %f, %c \n",
-  imu->sec, imu->gpsw, imu->count, sensor_x, sensor_y, sensor_z, imu->checksum);*/
-  imu->time=gpst2time(imu->gpsw,imu->sec);
-
- /* Check if message was read successfully	*/
- if (sscanstat < 7) {
-   imu->status=0;
-   return;
- }
-
- if (imu->count == 0){
-  // printf("Gyro data: %d \n", imu->count);
-   imu->g[0]=sensor_x*D2R; imu->g[1]=sensor_y*D2R;imu->g[2]=sensor_z*D2R; /* rad/s */
-   imu->tgyr=imu->internal_time;
- }else if (imu->count == 1){
-       	//  printf("Accelerometer data: %d \n", imu->count);
-	  imu->a[0]=sensor_x*G;imu->a[1]=sensor_y*G;imu->a[2]=sensor_z*G; /* in gravities to m/s2 */
-    imu->tacc=imu->internal_time;
-       }else {
-	 // printf("Magnetometer data: %d \n", imu->count);
-	  imu->m[0]=sensor_x;imu->m[1]=sensor_y;imu->m[2]=sensor_z; /* uT unitless */
-    imu->tmag=imu->internal_time;
-       }
-
-   /* Checking if data is complete for processing	*/
-   /* Using time of each data measurement */
-   if (imu->tgyr==0.0 || imu->tacc==0.0 ) {
-     /* Not complete yet */
-     imu->status=0;
-     return;
-   }
-
-   if (imu->tgyr==imu->tacc) {
-     /* Data complete and synchronized */
-     imu->status=1;
-   }else{
-     /* Data not synchronized */
-     imu->status=0;
-   }
-   //if ( imu->count==2 ) imu->status = 1;
-
+  resync_um7(&um7raw);
 }
 /* Imu input data --------------  */
 static int inputimu(prcopt_t *opt, ins_states_t *ins, int week){
-  char check, str[150];
+  char *check, str[150];
   um7pack_t imu_curr_meas={0};
-  int i, j;
+  int i, j, stat;
 
   if(insgnssopt.Tact_or_Low){
     /* Tactical KVH input */
     // For Oct/March experiments: 2,1,0
-    check=fgets(str, 150, imu_tactical);
+    if (!(check=fgets(str, 150, imu_tactical))) {
+      /* end of file */
+      printf("END OF INS FILE\n");
+      return 0;
+    }
     sscanf(str, "%lf %lf %lf %lf %lf %lf %lf", &ins->time, &ins->data.fb0[2],\
     &ins->data.fb0[1],&ins->data.fb0[0], &ins->data.wibb0[2],&ins->data.wibb0[1],\
     &ins->data.wibb0[0]);
@@ -1192,41 +1276,29 @@ static int inputimu(prcopt_t *opt, ins_states_t *ins, int week){
 
     printf("IMU.raw.read: %lf %lf %lf %lf %lf %lf %lf - check: %d\n", ins->time, ins->data.fb0[2],\
     ins->data.fb0[1],ins->data.fb0[0], ins->data.wibb0[2],ins->data.wibb0[1],\
-    ins->data.wibb0[0], check);
+    ins->data.wibb0[0], check!=NULL);
 
     /* Turn-on bias on x and y axis */
     //  ins->data.fb0[0]=ins->data.fb0[0]-0.869565;//-0.850372;
     //  ins->data.fb0[1]=ins->data.fb0[1]+0.193414;//+0.200865;
 
-    if (check==NULL && check ==0) {
-      /* end of file */
-      printf("END OF INS FILE: %s\n", check);
-      //rewind(imu_tactical);
-      return 0;
-    }else{
-      imu_curr_meas.status=1;
-      return 1;
-      }
+    imu_curr_meas.status=1;
+    return 1;
 
   }else{
     /* Low cost IMU um7 input*/
-   while(imu_curr_meas.status!=1){
-     if(!fgets(str, 150, imu_tactical)) {
+   um7raw.week=week;
+   while ((stat=input_um7f(&um7raw,imu_tactical))!=1) {
+     if (stat==-2) {
        printf("END OF FILE?\n");
-       check=NULL;
+       um7stat(&um7raw,stdout);
        return 0;
-       }
-      parseimudata(str,&imu_curr_meas); 
-
-    // Fixing imu time
-   imu_curr_meas.sec=imu_curr_meas.sec+ \
-   ((double)imu_curr_meas.internal_time\
-   -floor((double)imu_curr_meas.internal_time));
+     }
    }
-   ins->data.sec=ins->time=imu_curr_meas.sec;
-   for (i=0;i<3;i++) ins->data.fb0[i]=imu_curr_meas.a[i];
-   for (i=0;i<3;i++) ins->data.wibb0[i]=imu_curr_meas.g[i];
-   ins->data.time=gpst2time(week, imu_curr_meas.sec);
+   ins->data.sec=ins->time=um7raw.data.sec;
+   for (i=0;i<3;i++) ins->data.fb0[i]=um7raw.data.fb0[i];
+   for (i=0;i<3;i++) ins->data.wibb0[i]=um7raw.data.wibb0[i];
+   ins->data.time=um7raw.data.time;
 
    return 1; 
   } 
@@ -1293,15 +1365,6 @@ void insbuffer(ins_states_t *insc){
   }
 }
 
-/* Stores last 10 values on a vector by sliding them*/
-extern void windowSlider(double *vec, int size, double value){
-  int i;
-    for(i=0;i<size-1;i++){ 
-      vec[i]=vec[i+1];
-    }
-    vec[size]=value; 
-}
-
 /* conversion matrix of ned frame to ecef frame--------------------------------
  * conversion matrix of ned to ecef
  * args   : double *pos     I   position {lat,lon,height} (rad/m)
@@ -1731,7 +1794,7 @@ extern void insinit(ins_states_t *ins, insgnss_opt_t *insopt, prcopt_t *opt, int
 
     trace(3,"insinit :\n");
 
-    ins->nb=ins->nx=ppptcnx(opt);
+    ins->nb=ins->nx=insopt->lc?xnCl():ppptcnx(opt);
     //ins->nb=ins->nx=insgnssopt.mode<1?15:(xnRx(opt)+nsat);
    // ins->nb=opt->mode<=PMODE_FIXED?NR(opt):0; //what is its use??  
     ins->dt=0.0;
@@ -1840,7 +1903,7 @@ extern void memset_ins_pva(ins_states_t *ins){
 }
 /* measurement sensitive-matrix for non-holonomic----------------------------*/
 static int bldnhc(const insgnss_opt_t *opt,const imuraw_t *imu,const double *Cbe,
-                  const double *ve,int nx,double *v,double *H,double *R)
+                  const double *ve,double *v,double *H,double *R)
 {
     int i,nv,IA,IV;
     double C[9],T[9],vb[3],r[2],S[9];
@@ -1848,7 +1911,7 @@ static int bldnhc(const insgnss_opt_t *opt,const imuraw_t *imu,const double *Cbe
 
     trace(3,"bldnhc:\n");
 
-    IA=xiA(); IV=xiV();
+    IA=xiA()-xiA(); IV=xiV()-xiA(); /* rows of navigation block */
 
     /* velocity in body-frame */
     matmul("TN",3,1,3,1.0,Cbe,ve,0.0,vb);
@@ -1875,8 +1938,8 @@ static int bldnhc(const insgnss_opt_t *opt,const imuraw_t *imu,const double *Cbe
             trace(2,"too large vehicle turn\n");
             continue;
         }
-        H[IA+nv*nx]=T[i]; H[IA+1+nv*nx]=T[i+3]; H[IA+2+nv*nx]=T[i+6];
-        H[IV+nv*nx]=C[i]; H[IV+1+nv*nx]=C[i+3]; H[IV+2+nv*nx]=C[i+6];
+        H[IA+nv*NNAVB]=T[i]; H[IA+1+nv*NNAVB]=T[i+3]; H[IA+2+nv*NNAVB]=T[i+6];
+        H[IV+nv*NNAVB]=C[i]; H[IV+1+nv*NNAVB]=C[i+3]; H[IV+2+nv*NNAVB]=C[i+6];
         
         v[nv  ]=vb[i];
         r[nv++]=VARVEL;
@@ -1894,35 +1957,21 @@ static int bldnhc(const insgnss_opt_t *opt,const imuraw_t *imu,const double *Cbe
 extern int nhc(ins_states_t *ins,const insgnss_opt_t *opt)
 {
     const imuraw_t *imu=&ins->data;
-    int nx=ins->nx,info=0,nv, i, j;
-    double *H,*v,*R,*x;  
+    int nx=ins->nx,info=0,nv;
+    double H[NNAVB*2]={0},v[2],R[4]={0},x[MAXNAVX];
 
     trace(3,"nhc:\n");
-    printf("nhc:\n");
-
-    H=zeros(2,nx); R=zeros(2,2);
-    v=zeros(2,1); x=zeros(1,nx);
-    for (i = 0; i < nx; i++) x[i]=1E-17;
 
-    nv=bldnhc(opt,imu,ins->Cbe,ins->ve,nx,v,H,R);
-
-    // i = xiV()+1;
-    // for (i = xiV()+1; i < xiV() + 3; i++){
-    //   R[i-(xiV()+1)+(i-(xiV()+1))*nv] = SQRT(ins->P[i + i * nx]);
-    // }
+    nv=bldnhc(opt,imu,ins->Cbe,ins->ve,v,H,R);
 
     if (nv>0) {
-        /* kalman filter */
-        info=filter(x,ins->P,H,v,R,nx,nv);
-        printf("nhc.x:\n");
-        for (i=0; i < nx; i++){
-          printf("%lf ", x[i]);
-        }
+        /* kalman filter (attitude/velocity block) */
+        info=opt->udfilt?ud_navfilter(insudfac(ins),x,H,v,R,nx,nv,xiA(),NNAVB):
+                         navfilter(x,ins->P,H,v,R,nx,nv,xiA(),NNAVB);
 
         /*  check ok? */
         if (info) {
             trace(2,"non-holonomic constraint filter fail\n"); 
-            printf("non-holonomic constraint filter fail\n");
             info=0;
         } else {
             /* solution ok */
@@ -1930,47 +1979,19 @@ extern int nhc(ins_states_t *ins,const insgnss_opt_t *opt)
             info=1;
             clp(ins,opt,x);
             trace(3,"use non-holonomic constraint ok\n");
-            printf("use non-holonomic constraint ok\n");
         }
     }
-    free(H); free(v);
-    free(R); free(x);
     return info;
 }
-/* zero velocity update for ins navigation -----------------------------------
- * args    :  insstate_t *ins  IO  ins state
- *            insopt_t *opt    I   ins options
- *            imud_t *imu      I   imu measurement data
- *            int flag         I   static flag (1: static, 0: motion)
- * return  : 1 (ok) or 0 (fail)
- * ---------------------------------------------------------------------------*/
-extern int zvu(ins_states_t *ins,const insgnss_opt_t *opt,int flag)
+/* zero velocity pseudo-measurement update -----------------------------------*/
+static int zvufilt(ins_states_t *ins,const insgnss_opt_t *opt)
 {
     imuraw_t *imu=&ins->data;
-    int nx=ins->nx,info=0, i, j;
-    static int nz=0;
-    double *x,*H,*R,*v,I[9]={-1,0,0,0,-1,0,0,0,-1};
-
-    trace(3,"zvu:\n");
-    printf("zvu:\n");
-
-   // flag&=nz++>MINZC?nz=0,true:false;
-
-    if (!flag) return info;
-
-    x=zeros(1,nx); H=zeros(3,nx);
-    R=zeros(3,3); v=zeros(3,1);
-    for (i = 0; i < nx; i++) x[i]=1E-17;
-
-    /* sensitive matrix */
-    asi_blk_mat(H,3,nx,I,3,3,0,3);
+    int info=0;
+    double x[MAXNAVX],H[9]={1,0,0,0,1,0,0,0,1},R[9]={0},v[3];
 
     /* variance matrix */
     R[0]=R[4]=R[8]=VARVEL;
-    // i = xiV();
-    // for (i = xiV(); i < xiV() + 3; i++){
-    //   R[(i-xiV())+(i-xiV())*3] = SQRT(ins->P[i + i * nx]);
-    // }        
 
     v[0]=ins->ve[0];
     v[1]=ins->ve[1];
@@ -1978,18 +1999,13 @@ extern int zvu(ins_states_t *ins,const insgnss_opt_t *opt,int flag)
 
     if (norm(v,3)<MAXVEL&&norm(imu->wibb,3)<MAXGYRO) { 
 
-        /* ekf filter */
-        info=filter(x,ins->P,H,v,R,nx,3);
-
-        printf("zvu.x:\n");
-        for (i=0; i < nx; i++){
-          printf("%lf ", x[i]);
-        }
+        /* ekf filter (velocity block) */
+        info=opt->udfilt?ud_navfilter(insudfac(ins),x,H,v,R,ins->nx,3,xiV(),3):
+                         navfilter(x,ins->P,H,v,R,ins->nx,3,xiV(),3);
 
         /* solution fail */
         if (info) {
             trace(2,"zero velocity update filter error\n");
-            printf("zero velocity update filter error\n");
             info=0;
         }
         else {
@@ -1998,71 +2014,34 @@ extern int zvu(ins_states_t *ins,const insgnss_opt_t *opt,int flag)
             info=1;
             clp(ins,opt,x);
             trace(3,"zero velocity update ok\n");
-            printf("zero velocity update ok\n");
         }
     }
-    free(x); free(H);
-    free(R); free(v);
     return info;
 }
+/* zero velocity update for ins navigation -----------------------------------
+ * args    :  insstate_t *ins  IO  ins state
+ *            insopt_t *opt    I   ins options
+ *            imud_t *imu      I   imu measurement data
+ *            int flag         I   static flag (1: static, 0: motion)
+ * return  : 1 (ok) or 0 (fail)
+ * ---------------------------------------------------------------------------*/
+extern int zvu(ins_states_t *ins,const insgnss_opt_t *opt,int flag)
+{
+    trace(3,"zvu:\n");
+
+    if (!flag) return 0;
+
+    return zvufilt(ins,opt);
+}
 
 /* Quasi_stationary IMU calibration  ************************************************/
 extern int finealign(ins_states_t *ins,const insgnss_opt_t *opt,int flag)
 {
-    imuraw_t *imu=&ins->data;
-    int nx=ins->nx,info=0, i;
-    static int nz=0;
-    double *x,*H,*R,*v,I[9]={-1,0,0,0,-1,0,0,0,-1};
-
     trace(3,"fine alignment:\n");
-    printf("fine alignment:\n");
-
-   // flag&=nz++>MINZC?nz=0,true:false;
-
-    if (!flag) return info;
-
-    x=zeros(1,nx); H=zeros(3,nx);
-    R=zeros(3,3); v=zeros(3,1);
-    for (i = 0; i < nx; i++) x[i]=1E-17;
-
-    /* sensitive matrix */
-    asi_blk_mat(H,3,nx,I,3,3,0,3);
 
-    /* variance matrix */
-    R[0]=R[4]=R[8]=VARVEL;
-
-    v[0]=ins->ve[0];
-    v[1]=ins->ve[1];
-    v[2]=ins->ve[2]; /* residual vector */
-
-    if (norm(v,3)<MAXVEL&&norm(imu->wibb,3)<MAXGYRO) { 
-
-        /* ekf filter */
-        info=filter(x,ins->P,H,v,R,nx,3);
+    if (!flag) return 0;
 
-        printf("zvu.x:\n");
-        for (i=0; i < nx; i++){
-          printf("%lf ", x[i]);
-        }
-
-        /* solution fail */
-        if (info) {
-            trace(2,"zero velocity update filter error\n");
-            printf("zero velocity update filter error\n");
-            info=0;
-        }
-        else {
-            /* solution ok */
-            //ins->stat=INSS_ZVU;
-            info=1;
-            clp(ins,opt,x);
-            trace(3,"zero velocity update ok\n");
-            printf("zero velocity update ok\n");
-        }
-    }
-    free(x); free(H);
-    free(R); free(v);
-    return info;
+    return zvufilt(ins,opt);
 }
 
 /* ZUPT detection, based on   GREJNER-BRZEZINSKA et al. (2002) 
@@ -2099,7 +2078,8 @@ void outputinsgnsssol(ins_states_t *insc, insgnss_opt_t *opt, prcopt_t *gnssopt,
   /* Output PVA solution     */ 
   if (insc->ptime>0.0) {
     fprintf(out_PVA,"%lf %.12lf %.12lf %lf %lf %lf %lf %lf %lf %lf %d\n",\
-    insc->time, insc->rn[0]*R2D, insc->rn[1]*R2D, insc->rn[2],\
+    insc->time, insc->rn[0]*R2D, insc->rn[1]*R2D,
+    insc->rn[2]-(opt->ortho?geoidh(insc->rn):0.0),\
     insc->vn[0], insc->vn[1], insc->vn[2],
     insc->an[0]*R2D,insc->an[1]*R2D,insc->an[2]*R2D, opt->Nav_or_KF);
 
@@ -2114,14 +2094,14 @@ void outputinsgnsssol(ins_states_t *insc, insgnss_opt_t *opt, prcopt_t *gnssopt,
     fprintf(out_KF_SD_file, "%lf ", insc->time);
      for (i = 0; i < insc->nx; i++){
       for (j = 0; j < insc->nx; j++){
-        (i==j?fprintf(out_KF_SD_file, "%lf ", SQRT(fabs(insc->P[i * insc->nx + j])) ):0);
+        (i==j?fprintf(out_KF_SD_file, "%lf ", SQRT(fabs(insvar(opt, insc, i))) ):0);
        }
      }
    fprintf(out_KF_SD_file, "%d\n", opt->Nav_or_KF); 
    }  
  }
 
-  if (opt->Nav_or_KF){
+  if (opt->Nav_or_KF&&!opt->lc){
      /* Generate clock output record */
   if (xnRc(gnssopt)>1){
     fprintf(out_clock_file, "%lf %lf %lf %lf %d\n", insc->time, insc->dtr[0], 
@@ -2214,141 +2194,72 @@ int gnssQC(rtk_t *rtk, int nsat){
   return 0;               
 }
 
-/* Stationary detection based on gnss and rotation test from imu measurements ******************************
-  if check=1, gnss velocity only, if check=0, imu rotation check only
-  return: 1: static, 0: no static */
-void statRotat(ins_states_t *ins, double gnss_time, int check){
-  int i;
-
-  printf("bias static and rotation detection \n");
-
-  if(gnss_w_counter >= insgnssopt.gnssw ) i=insgnssopt.gnssw-1;
-  else i=gnss_w_counter;
-
-  printf("GNSS ACCEL: %lf %lf %lf\n", gnss_time, norm(solw[i].rr+3,2), norm(ins->data.fb0 ,2)); // for debugging
+static corectx_t corectx={0};      /* core epoch context */
+static ins_states_t imusmp={{{0}}}; /* imu sample of the imu stream source */
 
+/* imu stream source ---------------------------------------------------------
+* fetch next imu sample for the core event scheduler
+* args   : void   *arg      I   core epoch context (corectx_t)
+*          evt_t  *evt      O   imu event
+* return : status (1:ok, 0:end of imu file)
+*-----------------------------------------------------------------------------*/
+static int imufetch(void *arg, evt_t *evt){
+  corectx_t *ctx=(corectx_t *)arg;
+  int week;
 
-  if (check){
-    /* Static detection by GNSS */
-      /* Velocity threshold: as low as 0.0075 m/s per axis (norm=0.0129) for aviagtion-grade 
-      and 0.5 m/s (norm=0.8660) for consumer-grade sensors  
-      Using 0.3 m/s (norm=0.519615)*/
-    if (norm(solw[i].rr+3,3)<0.519615){
-    /* Static */
-    if (staticInfo.static_counter<10) {
-      staticInfo.vel_gnss[staticInfo.static_counter]=1;
-      staticInfo.gnss_time[staticInfo.static_counter]=gnss_time;
-    }else {
-      for (i = 0; i < 9; i++) {
-        staticInfo.vel_gnss[i]=staticInfo.vel_gnss[i+1];
-        staticInfo.gnss_time[i]=staticInfo.gnss_time[i+1];
-      }
-      staticInfo.vel_gnss[9]=1;
-      staticInfo.gnss_time[9]=gnss_time;
-    }
-  }else{
-    /* Moving */
-    if (staticInfo.static_counter<10) {
-      staticInfo.vel_gnss[staticInfo.static_counter]=0;
-      staticInfo.gnss_time[staticInfo.static_counter]=gnss_time;
-    }else {
-      for (i = 0; i < 9; i++) {
-        staticInfo.vel_gnss[i]=staticInfo.vel_gnss[i+1];
-        staticInfo.gnss_time[i]=staticInfo.gnss_time[i+1];
-      }
-      staticInfo.vel_gnss[9]=0;
-      staticInfo.gnss_time[9]=gnss_time;
-    }
-  }
-  staticInfo.static_counter++;
-  }else{  /* Gyro turning test */
-    if (norm(ins->data.wibb0,3)<MAXGYRO){
-    /* Straight */
-    if (staticInfo.static_counter<10) {
-      staticInfo.gyros[staticInfo.static_counter]=1;
-      staticInfo.ins_time[staticInfo.static_counter]=ins->time;
-    }else {
-      for (i = 0; i < 9; i++) {
-        staticInfo.gyros[i]=staticInfo.vel_gnss[i+1];
-        staticInfo.ins_time[i]=staticInfo.ins_time[i+1];
-      }
-      staticInfo.gyros[9]=1;
-      staticInfo.ins_time[9]=ins->time;
-    }
-  }else{
-    /* Turning */
-    if (staticInfo.static_counter<10) {
-      staticInfo.gyros[staticInfo.static_counter]=0;
-      staticInfo.ins_time[staticInfo.static_counter]=ins->time;
-    }else {
-      for (i = 0; i < 9; i++) {
-        staticInfo.gyros[i]=staticInfo.vel_gnss[i+1];
-        staticInfo.ins_time[i]=staticInfo.ins_time[i+1];
-      }
-      staticInfo.gyros[9]=0;
-      staticInfo.ins_time[9]=ins->time;
-    }
+  if(!inputimu(&ctx->rtk->opt, &imusmp, ctx->week)) {
+    insgnssopt.ins_EOF=0;
+    printf(" ** End of imu file **\n");
+    return 0;
   }
-  staticInfo.gyro_counter++;   
- }
- 
-}
-
-/* Core function -------------------------------------------------------------
-* Description: Receive raw GNSS and INS data and determine a PVA solution
-* args:
-* rtk_t *rtk  IO
-* const obsd_t *obs I
-* int n I
-* const nav_t *nav  I
-* return:
-* obs.: this function is ran inside rtkpos function of RTKlib
-------------------------------------------------------------------------------*/
-extern void core(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav){ 
-  int i, j, week, flag, core_count=0;
-  double gnss_time, rr[3], ve[3];
-  ins_states_t insc={{{0}}};
-  prcopt_t *opt = &rtk->opt; 
- 
- 
-  printf("\n *****************  CORE BEGINS *******************: %lf\n", time2gpst(rtk->sol.time,&week));
-
-  /* Save gnss position and velocity */ 
-  matcpy(rr,rtk->sol.rr,1,3);
-  matcpy(ve,rtk->sol.rr+3,1,3);
-
-  /* initialize ins/gnss parameter default uncertainty */ 
-  //ig_paruncinit(&insgnssopt); 
-  kf_par_unc_init(&insgnssopt);
-  
-    printf("Insc.pdata: %lf %lf %lf - %lf %lf %lf\n", insc.pdata.fb0[0],insc.pdata.fb0[1],\
-    insc.pdata.fb0[2], insc.data.fb0[0],insc.data.fb0[1],insc.data.fb0[2]);
-
-  /* initialize ins state */
-  insinit(&insc, &insgnssopt, opt, n);
-  
-  /* Initialize time from GNSS */
-  gnss_time=time2gpst(rtk->sol.time,&week);
-
-  /* Feed gnss solution and measurement buffers */
-  gnssbuffer(&rtk->sol, obs, n);
+  /* continuous gps time, imu week resolved by the current gnss epoch */
+  evt->time=ctx->week*604800.0+imusmp.time;
+  if      (evt->time<ctx->tevt-302400.0) evt->time+=604800.0;
+  else if (evt->time>ctx->tevt+302400.0) evt->time-=604800.0;
+  week=(int)floor(evt->time/604800.0);
+  if (week!=ctx->week) imusmp.data.time=gpst2time(week, imusmp.time);
+  evt->data=&imusmp;
+  return 1;
+}
+
+/* gnss epoch event handler --------------------------------------------------
+* args   : evt_t  *evt      I   gnss epoch event
+*          void   *arg      IO  core epoch context (corectx_t)
+* return : status (1:ok)
+*-----------------------------------------------------------------------------*/
+static int gnssevt(evt_t *evt, void *arg){
+  corectx_t *ctx=(corectx_t *)arg;
 
-  /* Check if imu file is not at the end */
-  if(!insgnssopt.ins_EOF) return;
+  int i=gnss_w_counter>=insgnssopt.gnssw?insgnssopt.gnssw-1:gnss_w_counter;
 
   /* Static check with GNSS */
-  statRotat(&insc, gnss_time, 1);
+  motdet_gnss(&motdet, ctx->gnss_time, norm(solw[i].rr+3,3));
+  return 1;
+}
+
+/* imu sample event handler --------------------------------------------------
+* Description: INS navigation and, for the sample closing the current gnss
+* epoch, INS/GNSS integration, constraints and solution output
+* args   : evt_t  *evt      I   imu event
+*          void   *arg      IO  core epoch context (corectx_t)
+* return : status (1:ok)
+*-----------------------------------------------------------------------------*/
+static int imuevt(evt_t *evt, void *arg){
+  corectx_t *ctx=(corectx_t *)arg;
+  const ins_states_t *smp=(const ins_states_t *)evt->data;
+  ins_states_t *insc=&ctx->insc;
+  rtk_t *rtk=ctx->rtk;
+  const obsd_t *obs=ctx->obs;
+  const nav_t *nav=ctx->nav;
+  double gnss_time=ctx->gnss_time, speed;
+  int i, flag, n=ctx->n;
 
-  /* Ins and integration loop
-  Processing window - integrates when GNSS and INS mea. are closer by 0.1s
-  The do while takes care when INS or GNSS is too ahead from each other         */  
-  do {
     if (insgnssopt.ins_ini){  
       printf("\n **** Ins Loop starts ****: %d \n", ins_w_counter);
     } 
     
-    if(core_count>0){
-      memset_ins_pva(&insc);    
+    if(ctx->count>0){
+      memset_ins_pva(insc);    
     }
   
 
@@ -2357,187 +2268,389 @@ extern void core(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav){
         /* After filling ins buffer */
         //printf("After filling ins buffer: %d\n", insgnssopt.insw-1);
         //print_ins_pva(insw+insgnssopt.insw-1);
-       insc=insw[insgnssopt.insw-1];
-       insc.data=insw[insgnssopt.insw-1].data;
-       insc.data.sec=insw[insgnssopt.insw-1].data.sec; 
+       *insc=insw[insgnssopt.insw-1];
+       insc->data=insw[insgnssopt.insw-1].data;
+       insc->data.sec=insw[insgnssopt.insw-1].data.sec; 
        }else {
          /* First epoch */
         if(ins_w_counter>1) {
           //printf("Before filling ins buffer: %d\n", ins_w_counter-1);
           //print_ins_pva(insw+ins_w_counter-1);
-          insc=insw[ins_w_counter-1];
-          insc.data=insw[ins_w_counter-1].data;
-          insc.data.sec=insw[ins_w_counter-1].data.sec;
+          *insc=insw[ins_w_counter-1];
+          insc->data=insw[ins_w_counter-1].data;
+          insc->data.sec=insw[ins_w_counter-1].data.sec;
         }
        }  
 
-    /* input ins */ 
-    if(!inputimu(opt, &insc, week)) {insgnssopt.ins_EOF=0;printf(" ** End of imu file **\n"); return;}
+    /* input ins sample of the event */
+    insc->time=smp->time;
+    insc->data.sec=smp->data.sec;
+    insc->data.time=smp->data.time;
+    for (i=0;i<3;i++) insc->data.fb0[i]=smp->data.fb0[i];
+    for (i=0;i<3;i++) insc->data.wibb0[i]=smp->data.wibb0[i];
 
-    printf("Insc.pdata1: %lf %lf %lf - %lf %lf %lf\n", insc.pdata.fb0[0],insc.pdata.fb0[1],\
-    insc.pdata.fb0[2], insc.data.fb0[0],insc.data.fb0[1],insc.data.fb0[2]);
+    printf("Insc.pdata1: %lf %lf %lf - %lf %lf %lf\n", insc->pdata.fb0[0],insc->pdata.fb0[1],\
+    insc->pdata.fb0[2], insc->data.fb0[0],insc->data.fb0[1],insc->data.fb0[2]);
 
     /* Propagation time */
-    insc.proptime = gnss_time-0.5;
+    insc->proptime = gnss_time-0.5;
 
     /* Output raw INS */
-    if(insc.pdata.sec > 0.0 ){ 
-      outputrawimu(&insc);
+    if(insc->pdata.sec > 0.0 ){ 
+      outputrawimu(insc);
     }
     /* Ins time propagation */
     if (ins_w_counter >= 1){
-      insc.dt = insc.time - insc.ptime;  
+      insc->dt = insc->time - insc->ptime;  
     }
 
-    printf("Ins time: %lf %lf %lf\n", insc.dt,insc.time,insc.ptime);   
-
-    /* If INS time is ahead of GNSS exit INS loop */ 
-    if (gnss_time-insc.time < -0.01) {
-      // for tactical, -1.65 for consumer
-      printf("\n ** Ins time ahead gps time **\n", insc.time,gnss_time);   
-   
-      /* Back INS file reader up */
-      rewind(imu_tactical);
-
-      insc.stat=-1;
-      break;  
-    }else{ 
-      /* INS Navigation and/or INS/GNSS Integration */
-
-      /* correction imu accl and gyro measurements data */
-      ins_errmodel2(&insc.data.fb0,&insc.data.wibb0,
-                  &insc.data.Ma,&insc.data.Mg,
-                  &insc.data.ba,&insc.data.bg,&insc.data.Gg,
-                  &insc.data.fb,&insc.data.wibb); 
-
-      /* initial ins states */
-      // Here it's where the PVA initialization with the alignment is done 
-      if (gnss_w_counter>2 && insgnssopt.ins_ini!=1){ 
-        //150 means 1s of ins data, thus perform initialization only in the beginning 
-        if(init_inspva(solw, &insc)){
-          printf(" ** Ins initialization ok: %lf **\n", insc.time);
-          insgnssopt.ins_ini=1;
-        }else{
-          printf(" ** Ins initialization error: %lf **\n", insc.time);
-          insupdt(&insc);
-          /* Add current ins measurement to buffer */  
-          insbuffer(&insc);
-          ins_w_counter++;
-          insgnssopt.ins_ini=0;
-          continue;
-        }  
-      }      
-   
-      /* Check if ins and gps observations match for integration */ 
-      flag=interp_ins2gpst(gnss_time, &insc); 
+    printf("Ins time: %lf %lf %lf\n", insc->dt,insc->time,insc->ptime);   
+
+    /* INS Navigation and/or INS/GNSS Integration */
+
+    /* correction imu accl and gyro measurements data */
+    ins_errmodel2(insc->data.fb0,insc->data.wibb0,
+                insc->data.Ma,insc->data.Mg,
+                insc->data.ba,insc->data.bg,insc->data.Gg,
+                insc->data.fb,insc->data.wibb); 
+
+    /* initial ins states */
+    // Here it's where the PVA initialization with the alignment is done 
+    if (insgnssopt.ins_ini!=1){ 
+      //150 means 1s of ins data, thus perform initialization only in the beginning 
+      if(gnss_w_counter>2&&init_inspva(solw, insc)){
+        printf(" ** Ins initialization ok: %lf **\n", insc->time);
+        insgnssopt.ins_ini=1;
+      }else{
+        printf(" ** Ins initialization error: %lf **\n", insc->time);
+        insupdt(insc);
+        /* Add current ins measurement to buffer */  
+        insbuffer(insc);
+        ins_w_counter++;
+        insgnssopt.ins_ini=0;
+        ctx->tins=insc->time;
+        return 1;
+      }  
+    }      
+ 
+    /* Check if ins and gps observations match for integration */ 
+    flag=interp_ins2gpst(gnss_time, insc); 
 
-      /* GNSS solution quality check */
-      if(flag) flag=gnssQC(rtk, n); 
+    /* GNSS solution quality check */
+    if(flag) flag=gnssQC(rtk, n); 
 
-      //if (flag)  
+    //if (flag)  
 
-      /* Integration */ 
-      printf("GNSS time and PROP time: %lf %lf\n", gnss_time, insc.proptime );
-      TC_INS_GNSS_core1(rtk, obs, n, nav, &insc, &insgnssopt, flag);
+    /* Integration */ 
+    printf("GNSS time and PROP time: %lf %lf\n", gnss_time, insc->proptime );
+    if (insgnssopt.lc) LC_INS_GNSS_core1(rtk, obs, n, nav, insc, &insgnssopt, flag);
+    else TC_INS_GNSS_core1(rtk, obs, n, nav, insc, &insgnssopt, flag);
 
-      
-      /* Non-holonomic constraints */
-      if(insc.pdata.sec > 0.0 ){ 
-        printf("nhc update\n");
-        nhc(&insc,&insgnssopt);  
-      }
+    
+    /* Non-holonomic constraints (zero velocity update while static) */
+    if(insc->pdata.sec > 0.0 && !motdet.stat){ 
+      printf("nhc update\n");
+      nhc(insc,&insgnssopt);  
+    }
 
-      /* Static and rotation detection - It modifies staticInfo structure */
-      printf("Test: %d %lf\n",insgnssopt.Nav_or_KF, fabs(gnss_time-insc.ptctime));
-      statRotat(&insc, gnss_time, 0);
+    /* Vehicle speed (OBD-II) update */
+    if(insgnssopt.odo && insc->pdata.sec > 0.0 && \
+       aux_interp(&odocur, insc->time, MAXODOGAP, &speed)){
+      printf("odo update: %lf\n", speed);
+      odo(insc,&insgnssopt,speed);
+    }
 
+    /* Static and rotation detection */
+    motdet_imu(&motdet, insc->time, insc->data.fb0, insc->data.wibb0);
 
-      printf("Static by gnss: %lf %d\n", gnss_time, (staticInfo.static_counter>10?staticInfo.vel_gnss[9]:staticInfo.vel_gnss[staticInfo.static_counter]));
-      printf("Straight by Rotat: %lf %d\n", insc.time, (staticInfo.static_counter>10?staticInfo.gyros[9]:staticInfo.gyros[staticInfo.static_counter]));
+    printf("Static by gnss: %lf %d\n", gnss_time, motdet.stat);
+    printf("Straight by Rotat: %lf %d\n", insc->time, !motdet.turn);
 
-      detstc(&insc);  
-      
-      /* Zero velocity update */  
-      //if (zvu_counter>10) {  
-      printf("Stat condition: %d \n", staticInfo.static_counter>10?staticInfo.vel_gnss[9]:staticInfo.vel_gnss[staticInfo.static_counter]);
-      if((staticInfo.static_counter>10?staticInfo.vel_gnss[9]:staticInfo.vel_gnss[staticInfo.static_counter]) ){
-
-        /* If straight and static do a Fine alignment */
-        if ((staticInfo.static_counter>10?staticInfo.gyros[9]:staticInfo.gyros[staticInfo.static_counter])){
-          //finealign(&insc,&insgnssopt,1);
-        }
-        
-        /* Bias estimation */
-        printf("ZVU UPDATE: 1 %lf\n", insc.time);
-        /* Zero-velocity constraints */
-        zvu(&insc,&insgnssopt,1); 
-        zvu_counter=0;  
-      }else{printf("ZVU UPDATE: 0 %lf\n", insc.time);}
-
-      /* Output PVA, clock, imu bias solution     */ 
-      if(insc.ptime>0.0){  
-        outputinsgnsssol(&insc, &insgnssopt, &rtk->opt, n, obs);  
+    detstc(insc);  
+    
+    /* Zero velocity update */  
+    //if (zvu_counter>10) {  
+    printf("Stat condition: %d \n", motdet.stat);
+    if(motdet.stat){
+
+      /* If straight and static do a Fine alignment */
+      if (!motdet.turn){
+        //finealign(insc,&insgnssopt,1);
       }
+      
+      /* Bias estimation */
+      printf("ZVU UPDATE: 1 %lf\n", insc->time);
+      /* Zero-velocity constraints */
+      zvu(insc,&insgnssopt,1); 
+      zvu_counter=0;  
+    }else{printf("ZVU UPDATE: 0 %lf\n", insc->time);}
+
+    /* Output PVA, clock, imu bias solution     */ 
+    if(insc->ptime>0.0){  
+      outputinsgnsssol(insc, &insgnssopt, &rtk->opt, n, obs);  
+    }
 
-    } // end If INS time ahead of GNSS condition 
+    /* Ins antenna position at gnss epoch to seed spp of next epochs */
+    if (insgnssopt.sppaid) {
+      insp2antp(insc, &insgnssopt, rtk->xins);
+      for (i=0;i<3;i++) rtk->xins[i+3]=insc->ve[i];
+      for (i=0,rtk->qins=0.0;i<3;i++) {
+        rtk->qins+=insvar(&insgnssopt,insc,xiP()+i);
+      }
+      rtk->tins=gpst2time(ctx->week, gnss_time);
+    }
 
-    /* Re-initializing ins with gnss solution when integration occurs */
-     if (insgnssopt.Nav_or_KF==1){
-      for(i=0;i<3;i++) insc.re[i]=rtk->sol.rr[i];
-      for(i=0;i<3;i++) insc.ve[i]=rtk->sol.rr[i+3];  
+    /* Re-initializing ins with gnss solution when integration occurs
+       (tightly coupled only, the loosely coupled ekf blends the solution) */
+     if (insgnssopt.Nav_or_KF==1&&!insgnssopt.lc){
+      for(i=0;i<3;i++) insc->re[i]=rtk->sol.rr[i];
+      for(i=0;i<3;i++) insc->ve[i]=rtk->sol.rr[i+3];  
       /* Clock solution */
-      //insc.dtr[0]=rtk->sol.dtr[0]*CLIGHT;  
-      update_ins_state_n(&insc);  
+      //insc->dtr[0]=rtk->sol.dtr[0]*CLIGHT;  
+      update_ins_state_n(insc);  
       /* Gnss solution covariance to ins */ 
-      //pvclkCovfromgnss(rtk, &insc);    
+      //pvclkCovfromgnss(rtk, insc);    
     }
  
     /* Zeroing closed-loop states */
-     for (i=0;i<xnCl();i++) insc.x[i]=0.0;   
+     for (i=0;i<xnCl();i++) insc->x[i]=0.0;   
 
      /* Update ins states and measurements */
-     insc.ptctime=gnss_time;    
-     insupdt(&insc);
+     insc->ptctime=gnss_time;    
+     insupdt(insc);
 
      /* Add current ins measurement to buffer */
-     insbuffer(&insc);
+     insbuffer(insc);
 
      /* Global ins counter */ 
      ins_w_counter++;
-     core_count++;
+     ctx->count++;
      
      printf("Ins counter updated: %d\n", ins_w_counter);
      printf("\n **** Ins Loop ends **** \n");
 
-     /* Loop conditions */  
-     if (gnss_time-insc.time<0.0001) { 
-      printf("UPDATE INS AND GNSS: gpst: %lf, imut: %lf, dt diff: %lf\n", gnss_time, insc.time, gnss_time-insc.time);
-      break;
-     }else{
-       if (gnss_time-insc.time<-0.0001) {
-       printf("UPDATE INS AND GNSS: gpst: %lf, imut: %lf, dt diff: %lf\n", gnss_time, insc.time, gnss_time-insc.time);
-       break;
-       }else{
-         printf("KEEP UPDATING INS: gpst: %lf, imut: %lf, dt diff: %lf\n", gnss_time, insc.time, gnss_time-insc.time);
-        }
-      }
+     ctx->tins=insc->time;
+     return 1;
+}
 
-  } while(gnss_time-insc.time > 0.0001 || \ 
-   gnss_time-insc.time > -0.0001 );
+/* Core function -------------------------------------------------------------
+* Description: Receive raw GNSS and INS data and determine a PVA solution
+* args:
+* rtk_t *rtk  IO
+* const obsd_t *obs I
+* int n I
+* const nav_t *nav  I
+* return:
+* obs.: this function is ran inside rtkpos function of RTKlib. The gnss epoch
+* is pushed to the event scheduler, which dispatches gnss and imu events in
+* time order up to the epoch and the first imu sample after it (used to
+* interpolate the imu to gnss time). the imu log is read forward only, so
+* backward and combined solutions are rejected by insgnsschkopt(), the
+* backward pass (rtk->revs) is not run through the core
+------------------------------------------------------------------------------*/
+extern void core(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav){ 
+  corectx_t *ctx=&corectx;
+  evt_t evt={0};
+  const evt_t *next;
+  struct timespec tp0, tp1;
+  int i, week, type;
+  prcopt_t *opt = &rtk->opt; 
 
-  printf("\n ** Out of loop **\ngpst: %lf, imut: %lf, dt diff: %lf\n", gnss_time, insc.time, gnss_time-insc.time); 
+  if (rtk->revs) return;
+
+  if (coreprof.nmax) clock_gettime(CLOCK_MONOTONIC, &tp0);
  
-   /* Update */  
+  printf("\n *****************  CORE BEGINS *******************: %lf\n", time2gpst(rtk->sol.time,&week));
+
+  /* initialize ins/gnss parameter default uncertainty */ 
+  //ig_paruncinit(&insgnssopt); 
+  kf_par_unc_init(&insgnssopt);
+
+  /* initialize ins state */
+  memset(&ctx->insc,0,sizeof(ins_states_t));
+  insinit(&ctx->insc, &insgnssopt, opt, n);
+  
+  /* Initialize epoch context from GNSS */
+  ctx->gnss_time=time2gpst(rtk->sol.time,&week);
+  ctx->week=week;
+  ctx->tevt=week*604800.0+ctx->gnss_time;
+  ctx->rtk=rtk; ctx->obs=obs; ctx->n=n; ctx->nav=nav;
+  ctx->count=0;
+
+  /* Feed gnss solution and measurement buffers */
+  gnssbuffer(&rtk->sol, obs, n);
+
+  /* Check if imu file is not at the end */
+  if(!insgnssopt.ins_EOF) {insfree(&ctx->insc); return;}
+
+  /* Gnss epoch event */
+  evt.time=ctx->tevt;
+  evt.type=EVT_GNSS;
+  evt.data=ctx;
+  sched_push(&coresched, &evt);
+
+  /* Ins navigation and integration in time order up to the gnss epoch */
+  sched_run(&coresched, ctx->tevt+EVT_TTOL);
+
+  /* Close the epoch with the first imu sample after it. If the imu is
+     ahead of gnss the sample stays queued for the next epochs */
+  if (!ctx->count || ctx->tins<ctx->gnss_time-EVT_TTOL) {
+    while ((next=sched_peek(&coresched)) && \
+           next->time-ctx->tevt<=EVT_INSAHEAD) {
+      type=next->type;
+      sched_step(&coresched);
+      if (type==EVT_IMU) break;
+    }
+  }
+  printf("\n ** Out of loop **\ngpst: %lf, imut: %lf, dt diff: %lf\n", ctx->gnss_time, ctx->tins, ctx->gnss_time-ctx->tins); 
  
    /* Global gnss counters */ 
    gnss_w_counter++; 
 
    /* Free memory */ 
-   insfree(&insc);  
+   insfree(&ctx->insc);  
+
+   /* Epoch latency profile */
+   if (coreprof.nmax) {
+     clock_gettime(CLOCK_MONOTONIC, &tp1);
+     if (coreprof.n<coreprof.nmax) {
+       coreprof.lat[coreprof.n]=(tp1.tv_sec-tp0.tv_sec)+(tp1.tv_nsec-tp0.tv_nsec)*1E-9;
+     }
+     if (!coreprof.n++) coreprof.ts=ctx->gnss_time;
+     coreprof.te=ctx->gnss_time;
+     for (i=0;i<2;i++) {
+       coreprof.nspp[i]=rtk->nspp[i];
+       coreprof.nitr[i]=rtk->nitr[i];
+     }
+   }
 
  printf("\n *****************  CORE ENDS ***********************\n");
 }
 
+/* open ins/gnss output file ------------------------------------------------*/
+static FILE *openout(const char *outdir, const char *name){
+  char path[1024];
+
+  sprintf(path,"%s/%s",outdir,name);
+  return fopen(path,"w");
+}
+
+/* initialize ins/gnss processing -------------------------------------------
+* Description: set ins/gnss options, allocate solution buffers, open output
+* files and imu stream and set up the core event scheduler
+* args   : char *imufile     I   imu data file
+*          char *odofile     I   obd-ii vehicle speed synchronized to gps time
+*                                ("": no vehicle speed update)
+*          char *outdir      I   output directory of ins/gnss solution files
+* return : status (1:ok,0:error)
+*-----------------------------------------------------------------------------*/
+extern int insgnssinit(const char *imufile, const char *odofile,
+                       const char *outdir){
+  const char *obdnames[]={"Vehicle speed"}, *obdunits[]={"m/s"};
+
+  /* Global structures initialization */ 
+  insgnssopt.Tact_or_Low = 1;       /* Type of inertial, tact=1, low=0 */
+  insgnssopt.scalePN = 0;             /* use extended Process noise model */ 
+  insgnssopt.gnssw = 3; 
+  insgnssopt.insw = 10;  
+  insgnssopt.exphi = 0;            /* use precise system propagate matrix for ekf */
+  /* ins sthocastic process noises: */
+  insgnssopt.baproopt=INS_GAUSS_MARKOV;
+  insgnssopt.bgproopt=INS_GAUSS_MARKOV; 
+  insgnssopt.saproopt=INS_GAUSS_MARKOV;
+  insgnssopt.sgproopt=INS_GAUSS_MARKOV;
+  solw=(sol_t*)malloc(sizeof(sol_t)*insgnssopt.gnssw);  /* gnss solution structure window size allocation */
+  insw=(ins_states_t*)malloc(sizeof(ins_states_t)*insgnssopt.insw);   /* ins states window size allocation */
+  insgnssopt.ins_EOF=1;
+  insgnssopt.odo=1;                /* vehicle speed update if obd-ii log */
+  insgnssopt.udfilt=0;             /* u-d factorized ekf covariance */
+  insgnssopt.ortho=0;              /* ellipsoidal height output */
+  insgnssopt.lc=0;                 /* tightly coupled ekf */
+  insgnssopt.sppaid=1;             /* ins seeded spp */
+  insgnssopt.fde=0;                /* innovation fde of tc update (off until calibrated) */
+
+  /* Residuals structure */
+  resid.nv_w=10;
+  resid.data=(res_epoch_t*)malloc(sizeof(res_epoch_t)*resid.nv_w);  /* residuals structure window size allocation */
+
+  /* Global TC_KF_INS_GNSS output files    */     
+  out_PVA=openout(outdir,"out_PVA.txt"); 
+  out_clock_file=openout(outdir,"out_clock_file.txt");  
+  out_IMU_bias_file=openout(outdir,"out_IMU_bias.txt");
+  out_tropo_file=openout(outdir,"out_tropo_bias.txt");
+  out_amb_file=openout(outdir,"out_amb_bias.txt");
+  out_KF_state_error=openout(outdir,"out_KF_state_error.txt");
+  out_KF_SD_file=openout(outdir,"out_KF_SD.txt");
+  out_raw_fimu=openout(outdir,"out_raw_imu.txt");
+  out_KF_residuals=openout(outdir,"out_KF_residuals.txt");
+  if (!(imu_tactical=fopen(imufile, "r"))) {
+    fprintf(stderr,"imu file open error: %s\n",imufile);
+    return 0;
+  }
+  init_um7(&um7raw,0);
+  motdet_init(&motdet, insgnssopt.Tact_or_Low);
+  insamb_init(&insamb);
+  memset(&insfde,0,sizeof(insfde_t));
+  lanemap_init(&lanemap);
+
+  /* Core event scheduler: imu stream, gnss epochs pushed by core() */
+  sched_init(&coresched);
+  sched_addsrc(&coresched, EVT_IMU, imufetch, &corectx);
+  sched_sethandler(&coresched, EVT_GNSS, gnssevt, &corectx);
+  sched_sethandler(&coresched, EVT_IMU, imuevt, &corectx);
+
+  /* OBD-II vehicle speed synchronized to gps time */
+  if(!*odofile||aux_readcols(&auxstore, odofile, obdnames, obdunits, 1, 0.0)<=0)
+    insgnssopt.odo=0;
+  aux_initcur(&odocur, aux_get(&auxstore, "Vehicle speed"));
+  return 1;
+}
+
+/* check ins/gnss processing options -----------------------------------------
+* Description: check the postpos() options supported by the ins/gnss core
+* args   : prcopt_t *popt    I   processing options
+* return : status (1:ok,0:not supported)
+* notes  : the imu log is read forward only and the ins states belong to one
+*          filter, so the backward pass of postpos() can not run core().
+*          backward and combined solutions are rejected
+*-----------------------------------------------------------------------------*/
+extern int insgnsschkopt(const prcopt_t *popt){
+  if (popt->mode!=PMODE_SINGLE&&popt->soltype!=0) {
+    fprintf(stderr,"error : backward/combined solution not supported by the "
+            "ins/gnss core, use forward\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* free ins/gnss processing ---------------------------------------------------
+* Description: free solution buffers and close output files and imu stream
+* args   : none
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void insgnssfree(void){
+  int i;
+
+  for (i=0;i<insgnssopt.insw;i++) insfree(insw+i);  
+  free(resid.data);
+  free(solw); free(insw); 
+  aux_free(&auxstore);
+  ud_free(&insud);
+  lanemap_free(&lanemap);
+
+  fclose(out_PVA);
+  fclose(out_clock_file);
+  fclose(out_IMU_bias_file);  
+  fclose(out_tropo_file);
+  fclose(out_amb_file);
+  fclose(out_KF_SD_file);
+  fclose(out_raw_fimu);
+  fclose(imu_tactical);
+  fclose(out_KF_state_error); 
+  fclose(out_KF_residuals);    
+}
+
+#ifndef SATINSMAP_NOMAIN
 int main(void){
 
 /* Variables declaration =====================================================*/
@@ -2554,40 +2667,9 @@ char residualsfname[]="../out/PPP_car_back.pos.stat"; //Residuals file
 char tracefname[]="../out/trace.txt"; //trace file
 int l=0,c;   
    
-/* Global structures initialization */ 
-insgnssopt.Tact_or_Low = 1;       /* Type of inertial, tact=1, low=0 */
-insgnssopt.scalePN = 0;             /* use extended Process noise model */ 
-insgnssopt.gnssw = 3; 
-insgnssopt.insw = 10;  
-insgnssopt.exphi = 0;            /* use precise system propagate matrix for ekf */
-/* ins sthocastic process noises: */
-insgnssopt.baproopt=INS_GAUSS_MARKOV;
-insgnssopt.bgproopt=INS_GAUSS_MARKOV; 
-insgnssopt.saproopt=INS_GAUSS_MARKOV;
-insgnssopt.sgproopt=INS_GAUSS_MARKOV;
-solw=(sol_t*)malloc(sizeof(sol_t)*insgnssopt.gnssw);  /* gnss solution structure window size allocation */
-insw=(ins_states_t*)malloc(sizeof(ins_states_t)*insgnssopt.insw);   /* ins states window size allocation */
-insgnssopt.ins_EOF=1;
-
-/* Residuals structure */
-resid.nv_w=10;
-resid.data=(res_epoch_t*)malloc(sizeof(res_epoch_t)*resid.nv_w);  /* residuals structure window size allocation */
-
+if(!insgnssinit("../data/26082019/imu_ascii.txt","../data/26082019/obd_sync.txt","../out"))
+  return -1;
 strcpy(filopt.trace,tracefname); 
-   
-/* Global TC_KF_INS_GNSS output files    */     
-out_PVA=fopen("../out/out_PVA.txt","w"); 
-out_clock_file=fopen("../out/out_clock_file.txt","w");  
-out_IMU_bias_file=fopen("../out/out_IMU_bias.txt","w");
-out_tropo_file=fopen("../out/out_tropo_bias.txt","w");
-out_amb_file=fopen("../out/out_amb_bias.txt","w");
-out_KF_state_error=fopen("../out/out_KF_state_error.txt","w");
-out_KF_SD_file=fopen("../out/out_KF_SD.txt","w");
-out_raw_fimu=fopen("../out/out_raw_imu.txt","w");
-out_KF_residuals=fopen("../out/out_KF_residuals.txt","w");
-imu_tactical=fopen("../data/26082019/imu_ascii.txt", "r");
-
-rewind(imu_tactical);                                                   
 
 /* PPP-Kinematic  Kinematic Positioning dataset  GPS+GLONASS */  
 //char *argv[] = {"./rnx2rtkp", "../data/16102018/CAR_2890.18O", "../data/16102018/BRDC00IGS_R_20182890000_01D_MN.nav", "../data/16102018/grm20232.clk","../data/16102018/grm20232.sp3", "-o", "../out/PPP.pos", "-k", "../config/opts3.conf", "-x", "5"};
@@ -2665,6 +2747,7 @@ char *argv[] = {"./rnx2rtkp", "../data/SEPT2640.17O", "../data/grg19674.*", "../
         }
         else if (!strcmp(argv[i],"-y")&&i+1<argc) solopt.sstat=atoi(argv[++i]);
         else if (!strcmp(argv[i],"-x")&&i+1<argc) solopt.trace=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-lc")) insgnssopt.lc=1;
         else if (*argv[i]=='-') printhelp();
         else if (n<MAXFILE) infile[n++]=argv[i];
     }                                                     //end of for
@@ -2672,58 +2755,31 @@ char *argv[] = {"./rnx2rtkp", "../data/SEPT2640.17O", "../data/grg19674.*", "../
         showmsg("error : no input file");
         return -2;
     }
+    if (!insgnsschkopt(&prcopt)) return -2;
   
+   /* orthometric PVA heights with geoid of solution options */
+  insgnssopt.ortho=solopt.height==1;
+
    /* Start rnx2rtkp processing  ---------*/ 
   ret=postpos(ts,te,tint,0.0,&prcopt,&solopt,&filopt,infile,n,outfile,"","");
   if (!ret) fprintf(stderr,"%40s\r","");
+  satcache_stat(&satcache,stderr);
+  sched_stat(&coresched,stderr);
  
-  for (i=0;i<insgnssopt.insw;i++) insfree(insw+i);  
-  free(resid.data);
-  free(solw); free(insw); 
-
- /* ins navigation only */
- //imu_tactical_navigation(imu_tactical); 
-
-  fclose(out_PVA);
-  fclose(out_clock_file);
-  fclose(out_IMU_bias_file);  
-  fclose(out_tropo_file);
-  fclose(out_amb_file);
-  fclose(out_KF_SD_file);
-  fclose(out_raw_fimu);
-  fclose(imu_tactical);
-  fclose(out_KF_state_error); 
-  fclose(out_KF_residuals);    
-
+  insgnssfree();
  // char posfile[]="../out/out_PVA.txt"; 
  // imuposplot(posfile);                
 
-/* INS/GNSS plots  */ 
- char out_raw_fimu[]="../out/out_raw_imu.txt";      
- imuaccplot(out_raw_fimu);
-imugyroplot(out_raw_fimu);
-char gyrofile[]="../out/out_PVA.txt";   
-imueulerplot(gyrofile);
-char velfile[]="../out/out_PVA.txt"; 
-imuvelplot(velfile);
-char posfile[]="../out/out_PVA.txt"; 
-imuposplot(posfile);
-char imu_bias[]="../out/out_IMU_bias.txt";        
-imuaccbiasplot(imu_bias);  
-imugyrobiasplot(imu_bias);
-char imu_KF_stds[]="../out/out_KF_SD.txt"; 
-KF_att_stds_plot(imu_KF_stds);
-KF_vel_stds_plot(imu_KF_stds);
-KF_pos_stds_plot(imu_KF_stds);
-char imu_KF_clk[]="../out/out_clock_file.txt"; 
-KF_clock_plot(imu_KF_clk);
-char imu_KF_res[]="../out/out_KF_residuals.txt"; 
-KF_residuals_plot(imu_KF_res);
-char tropo_file[]="../out/out_tropo_bias.txt";
-tropo_plot(tropo_file);
- char amb_file[]="../out/out_amb_bias.txt"; 
- amb_plot(amb_file);                                  
+/* INS/GNSS plots: decimated plot data and one gnuplot script */
+ if (plotexport("../out/","../out/",0)) {
+   FILE *gp=popen("gnuplot","w");
+   if (gp) {
+     fprintf(gp,"load '../out/plots.gp'\n");
+     pclose(gp);
+   }
+ }
 
  printf("\n\n SUCCESSFULLY EXECUTED!  \n\n");
  return;
 }
+#endif /* SATINSMAP_NOMAIN */
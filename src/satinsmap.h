@@ -31,6 +31,11 @@ extern "C" {
 #define WBS		10*SPC	/* Whole buffer size in meters (m)	*/
 #define BUFFSIZE	25 /* (WBS/SPC/2) Buffer search half size of vector
  (if buffsize/2=WBS(m)/SPC(m)*s), to convert into vector positions*/
+#define LANETILE	500.0	/* default lane map tile size (m) */
+#define LANEFIT		20	/* half window of lane curve fit (points) */
+#define MAXLCKCAND	(BUFFSIZE*2)	/* max search space candidates */
+#define MAXLCKTHR	8	/* max threads of batched lock phase */
+#define MAXFDEEX	3	/* max satellites excluded by innovation fde */
 
 /* math functions */
 #define SQR(x)      ((x)*(x))
@@ -79,6 +84,19 @@ extern "C" {
 #define INS_RANDOM_CONS    2            /* stochastic process settings: random const */
 #define INS_GAUSS_MARKOV   3            /* stochastic process settings: gauss-markov */
 
+#define MAXAUXCOL   16                  /* max number of value columns of aux text files */
+#define MAXODOGAP   3.0                 /* max gap of obd-ii speed samples for update (s) */
+
+#define EVT_GNSS    0                   /* event type: gnss epoch */
+#define EVT_ODO     1                   /* event type: odometry/vehicle speed */
+#define EVT_MAP     2                   /* event type: map constraint */
+#define EVT_IMU     3                   /* event type: imu sample */
+#define EVT_NTYPE   4                   /* number of event types */
+#define MAXEVTQ     256                 /* max number of queued events */
+#define MAXEVTSRC   8                   /* max number of event sources */
+#define EVT_TTOL    0.0001              /* event time tolerance (s) */
+#define EVT_INSAHEAD 0.01               /* max imu lead to close a gnss epoch (s) (tactical, 1.65 consumer) */
+
 /* coordinate rotation matrices (Jekeli, 2001; Shin, 2001)--------------------*/
 /* Earth-Centered Inertial to Earth-Centered Fixed (i to e-frame)
    where t is the angle (g.gg) and X is the output Rotation matrix	*/
@@ -137,13 +155,64 @@ extern "C" {
 
 /* type definitions ----------------------------------------------------------*/
 
-typedef struct {        /* Reference Lane record */
-    long int	size;	/* Lane file size in bytes, or lines */
-    int sizeline; /* Size of the lines in file  */
-    int sizebuffer; /* Amount of useful data in buffer  */
-    double	buffer [BUFFSIZE*2*3];	/* Buffer reference lane points in xyz coodinates [m] */
-    int	currsearch;	/* Closest point position in the search buffer in bytes */
-} lane_t;
+typedef struct {        /* lane map point */
+    double r[3];        /* ecef position (m) */
+    int tile;           /* tile index */
+    double az;          /* lane direction azimuth (rad) */
+    double kap;         /* lane curvature of curve fit (1/m) */
+    double fit[3];      /* quadratic fit n=a*e^2+b*e+c in tile frame {a,b,c} */
+} lanept_t;
+
+typedef struct {        /* lane map tile */
+    double pos[3];      /* origin {lat,lon,h} (rad,m) */
+    double r0[3];       /* origin ecef position (m) */
+    double E[9];        /* ecef to local tangent frame rotation */
+    int s0,n;           /* first point and number of points in frame */
+    double *enu;        /* local frame lane points {e,n,u} (m) (n x 3) */
+} lanetile_t;
+
+typedef struct {        /* local frame lane map */
+    int n,nmax;         /* number of lane points */
+    int nt,ntmax;       /* number of tiles */
+    lanept_t *pt;       /* lane points */
+    lanetile_t *tile;   /* tiles */
+    double org[3];      /* map origin {lat,lon,h} (rad,m) */
+    double tsize;       /* tile size (m) (0:single tile at origin) */
+    int curr;           /* closest point of last query (-1:none) */
+} lanemap_t;
+
+typedef struct lckws_tag lckws_t;
+
+typedef struct {        /* batched lock phase thread argument */
+    lckws_t *ws;        /* workspace */
+    int id;             /* thread index */
+    int s0,s1;          /* satellite range [s0,s1) */
+} lckarg_t;
+
+struct lckws_tag {      /* batched lock phase workspace */
+    int nc,ns;          /* number of candidates and satellites */
+    double cx[MAXLCKCAND],cy[MAXLCKCAND],cz[MAXLCKCAND]; /* candidates ecef */
+    double rs[MAXOBS*3];    /* satellite positions ecef (m) */
+    int valid[MAXOBS];      /* valid satellite position */
+    double y[MAXOBS*2];     /* phase/code minus non-geometric terms (m) */
+    double var[MAXOBS*2];   /* phase/code variances (0:unused) (m^2) */
+    double rho[MAXOBS*MAXLCKCAND]; /* candidate ranges (sat x cand) (m) */
+    double V[MAXOBS*2*MAXLCKCAND]; /* residuals (sat x type x cand) (m) */
+    double part[MAXLCKTHR][2][MAXLCKCAND]; /* per thread weighted ssr */
+    lckarg_t arg[MAXLCKTHR];    /* thread arguments */
+    int nthread;        /* number of threads with the caller (lckws_init()) */
+    pthread_t thr[MAXLCKTHR];   /* worker threads (1..nthread-1) */
+    pthread_mutex_t lock;       /* lock of job, ndone and quit */
+    pthread_cond_t cjob,cdone;  /* job posted, job done by all workers */
+    unsigned int job;   /* job sequence number */
+    int ndone;          /* number of workers done with the job */
+    int quit;           /* worker shutdown request */
+    int best;           /* best candidate (-1:none) */
+    int nv[2];          /* number of phase/code residuals */
+    double ssr[2];      /* weighted phase/code ssr of best candidate */
+    double rms[2];      /* normalized phase/code rms of best candidate */
+    double ratio;       /* second best/best weighted ssr */
+};
 
 typedef struct {        /* UM7 sensor package records */
     int count; 		/* Flag for type of data, 0:gyro,1:accelerometer,2:magnetometer */
@@ -182,6 +251,32 @@ typedef struct {        /* IMU sensor measurements */
     float  stdba[3], stdbg[3]; /* acc and gyro stds */
 } imuraw_t;
 
+#define UM7MAXVAL   8           /* max number of um7 packet data fields */
+
+typedef struct {        /* UM7 NMEA stream decoder */
+    int state;          /* decoder state */
+    int bol;            /* beginning of line flag */
+    int week;           /* gps week if not in logger prefix */
+    unsigned char sum,chk; /* computed/received checksum */
+    int nhead,nbyte,nchk; /* header chars matched, packet bytes, checksum digits */
+    long long mant;     /* numeric field mantissa */
+    int ndig,ndec,sign,dot; /* numeric field digits, decimals, sign, point flag */
+    int npre,prevok;    /* logger prefix field index (-1:none) and valid mask */
+    double pre[2];      /* logger prefix {sec,week} */
+    int nval;           /* number of packet data fields */
+    double val[UM7MAXVAL]; /* packet data fields {count,time,x,y,z} */
+    int mask;           /* received channels of current sample (gyro,acc,mag) */
+    double t;           /* sensor time of current sample (s) */
+    double tsec;        /* logger time of week of current sample (s) */
+    int tweek;          /* logger gps week of current sample */
+    double g[3],a[3],m[3]; /* current sample gyro (rad/s), accl (m/s^2), mag */
+    imuraw_t data;      /* output imu sample (sec,time,fb0,wibb0) */
+    double mag[3];      /* output magnetometer (unitless) */
+    int magok;          /* output magnetometer valid flag */
+    unsigned int npkt,nchkerr,nbad,nskip,ndup; /* packet counters */
+    unsigned int nsample,npartial,ndrop;       /* sample counters */
+} um7raw_t;
+
 typedef struct {        /* Position, velocity and attitude structure (PVA) */
     double sec;		/* amount of time in seconds since the sensor was on		*/
     double t_s;    /* State-time estimation */
@@ -266,7 +361,7 @@ typedef struct {  /* GNSS/INS processing options */
   int Nav_or_KF;          /* Type of solution: Navigation sol:0 KF Integrated sol:1   */
   int ins_ini;           /* Ins intialization: 0: no 1: yes   */
   int gnssw, insw;         /* GNSS and INS measurement window sizes */
-  int lever[3];           /* lever arm from gps antenna to ins center */
+  double lever[3];        /* lever arm from gps antenna to ins center (m) */
   int scalePN;            /* Scale process noise for irregular dt */
   int exphi;              /* use precise system propagate matrix for ekf */
   psd_t psd;              /* PSD for ins-gnss loosely coupled ekf states */
@@ -279,8 +374,115 @@ typedef struct {  /* GNSS/INS processing options */
   int rgproopt;           /* non-orthogonal between sensor axes for gyro stochastic process setting */
   int raproopt;           /* non-orthogonal between sensor axes for accl stochastic process setting */
   int ins_EOF;     /* End of IMU file stream flag: 1:there is data or 0: EOF*/
+  int odo;         /* Vehicle speed (OBD-II) update: 0:off 1:on */
+  int udfilt;      /* U-D factorized (square-root) ekf covariance: 0:off 1:on */
+  int ortho;       /* PVA output height: 0:ellipsoidal 1:orthometric (geoid) */
+  int lc;          /* Coupling: 0:tightly (gnss measurements) 1:loosely (gnss solution) */
+  int sppaid;      /* Seed spp of rtkpos by ins antenna position: 0:off 1:on */
+  int fde;         /* Innovation fault detection and exclusion in tc update: 0:off 1:on */
 } insgnss_opt_t;
 
+typedef struct {        /* Auxiliary time series (one PID or column) */
+    char name[64];      /* series name (OBD-II PID or column name) */
+    char unit[16];      /* units */
+    int n,nmax;         /* number of samples and allocated */
+    int sort;           /* input out of time order flag */
+    double *t;          /* sample times (s) (sorted) */
+    double *v;          /* sample values */
+} auxseries_t;
+
+typedef struct {        /* Auxiliary time-series store */
+    int n,nmax;         /* number of series and allocated */
+    auxseries_t *s;     /* series */
+} auxstore_t;
+
+typedef struct {        /* Auxiliary series cursor */
+    const auxseries_t *s; /* series */
+    int i;              /* index of last bracketing sample */
+} auxcur_t;
+
+typedef struct {        /* Sensor event */
+    double time;        /* event time (continuous gps time week*604800+tow, s) */
+    int type;           /* event type (EVT_???) */
+    int src;            /* event source index (-1: pushed event) */
+    unsigned int seq;   /* arrival sequence (tie break) */
+    void *data;         /* event data (owned by source or pusher) */
+} evt_t;
+
+typedef int (*evtfetch_t)(void *arg, evt_t *evt);  /* source fetch (1:ok,0:end) */
+typedef int (*evthandler_t)(evt_t *evt, void *ctx); /* event handler */
+
+typedef struct {        /* Sensor stream source */
+    int type;           /* event type */
+    evtfetch_t fetch;   /* fetch next event */
+    void *arg;          /* fetch argument */
+    int pending;        /* event of the source queued */
+    int eof;            /* end of stream */
+} evtsrc_t;
+
+typedef struct {        /* Time-ordered event scheduler */
+    evt_t heap[MAXEVTQ];    /* min-heap of queued events (time,type,seq) */
+    int n;                  /* number of queued events */
+    evtsrc_t src[MAXEVTSRC]; /* stream sources (k-way merge) */
+    int nsrc;               /* number of sources */
+    evthandler_t handler[EVT_NTYPE]; /* event handlers */
+    void *ctx[EVT_NTYPE];   /* handler contexts */
+    double tlast;           /* time of last dispatched event */
+    unsigned int seq;       /* sequence counter */
+    unsigned int ndisp[EVT_NTYPE]; /* number of dispatched events by type */
+    unsigned int nlate,nfull,nnohdl; /* rejected late, queue full, no handler */
+} sched_t;
+
+typedef struct {        /* INS/GNSS core epoch context */
+    rtk_t *rtk;         /* rtk control/result of current gnss epoch */
+    const obsd_t *obs;  /* observations of current gnss epoch */
+    int n;              /* number of observations */
+    const nav_t *nav;   /* navigation data */
+    double gnss_time;   /* current gnss epoch (gps time of week, s) */
+    int week;           /* gps week */
+    double tevt;        /* current gnss epoch (continuous gps time, s) */
+    int count;          /* imu samples processed in current epoch */
+    double tins;        /* time of last processed imu sample */
+    ins_states_t insc;  /* current ins states */
+} corectx_t;
+
+typedef struct {        /* INS/GNSS core epoch latency profile */
+    int n,nmax;         /* number of epochs recorded/allocated (0: off) */
+    double *lat;        /* core() wall time per gnss epoch (s) */
+    double ts,te;       /* first/last gnss epoch (gps time of week, s) */
+    unsigned int nspp[2],nitr[2]; /* spp epochs/iterations {unaided,ins-aided} */
+} coreprof_t;
+
+#define SIMTRJ_STATIC 0         /* simulated trajectory: stationary */
+#define SIMTRJ_CIRCLE 1         /* simulated trajectory: circle */
+#define SIMTRJ_EIGHT  2         /* simulated trajectory: figure-eight */
+#define SIMTRJ_REF    3         /* simulated trajectory: reference solution */
+
+typedef struct {        /* Simulated vehicle trajectory */
+    int type;           /* trajectory type (SIMTRJ_???) */
+    gtime_t t0;         /* start time (gpst) */
+    double tspan;       /* time span (s) */
+    double pos0[3];     /* origin {lat,lon,hgt} (rad,m) */
+    double head0;       /* initial heading (rad) */
+    double speed;       /* cruise speed (m/s) */
+    double acc;         /* acceleration to cruise speed (m/s^2) */
+    double radius;      /* turn radius (m) */
+    double tstat;       /* initial stationary time (s) */
+    int n;              /* number of reference points */
+    double *t;          /* reference time from t0 (s) */
+    double *p;          /* reference offsets {n,e,d} from origin (m) */
+    double *c;          /* spline second derivatives of offsets */
+    double *head;       /* heading held at reference points (rad) */
+} simtrj_t;
+
+typedef struct {        /* Simulated vehicle state */
+    double pos[3];      /* position {lat,lon,hgt} (rad,m) */
+    double vn[3];       /* velocity in ned-frame (m/s) */
+    double an[3];       /* acceleration in ned-frame (m/s^2) */
+    double rpy[3];      /* attitude {roll,pitch,yaw} (rad) */
+    double wnb[3];      /* body rate w.r.t. ned-frame in body-frame (rad/s) */
+} simpva_t;
+
 typedef struct {        /* observation data buffer */
     int n0,n1,n2;         /* number of obervation data/allocated */
     obsd_t data0[MAXSAT];       /* observation data records */
@@ -302,24 +504,98 @@ typedef struct {        /* Residuals data buffer */
     double R[MAXSAT*MAXSAT*4];          /* R (n,n) matrix from averaged C */
 } res_t;
 
-typedef struct {        /* Static structure */
-    int static_counter;
-    int gyro_counter;
-    double gnss_time[10],ins_time[10]; /* Latest solution time */
-    int gyros[10];          /* Rotation vector index from gyro rate: 0=rotating,1=straight (at imu rate) */
-    int acc[10];          /* Static vector index from acceleremeters: 0=moving,1=static (at imu rate) */
-    int vel_nav_sol[10];          /* Static vector index from integrated/navigated sol: 0=moving,1=static (at imu rate) */
-    int vel_gnss[10];          /* Static vector index from gnss velocities: 0=moving,1=static (at gnss sol. rate)*/
-} static_info_t;
+#define MAXDETWIN   1024        /* max samples in motion detector window */
+
+typedef struct {        /* Sliding window running statistics */
+    double win;             /* window length (s) */
+    int n,i;                /* number of samples/index of oldest sample */
+    double t[MAXDETWIN];    /* sample times (ring buffer) (s) */
+    double v[MAXDETWIN];    /* sample values (ring buffer) */
+    double mean,m2;         /* running mean/sum of squared deviations */
+} winstat_t;
+
+typedef struct {        /* Stationarity and turn detector */
+    winstat_t f;            /* specific force norm ||f|| (m/s^2) */
+    winstat_t w;            /* angular rate norm ||w|| (rad/s) */
+    winstat_t g;            /* gnss speed (m/s) */
+    double velon,veloff;    /* static enter/leave gnss speed (m/s) */
+    double sfon,sfoff;      /* static enter/leave std of ||f|| (m/s^2) */
+    double gyron,gyroff;    /* turning enter/leave mean of ||w|| (rad/s) */
+    int stat;               /* static state (1:static,0:moving) */
+    int turn;               /* turning state (1:turning,0:straight) */
+} motdet_t;
+
+#ifdef UDSINGLE
+typedef float udreal_t;     /* storage type of u-d factors */
+#else
+typedef double udreal_t;    /* storage type of u-d factors */
+#endif
+
+typedef struct {        /* U-D factorized covariance (P=U*D*U') */
+    int n,nmax;             /* number of states/allocated */
+    udreal_t *U;            /* unit upper triangular factor (n x n) */
+    udreal_t *D;            /* diagonal factor (n x 1) */
+    double *w;              /* work area */
+    double *var;            /* variances of states (cache of ud_var()) */
+    const double *P;        /* covariance view of last ud_toP() */
+    int mod;                /* factors modified since last ud_toP() */
+    int vmod;               /* factors modified since last variances */
+} udfac_t;
+
+#define MAXARAMB    32          /* max number of ambiguities of tc ar */
+
+typedef struct {        /* Tightly coupled ambiguity resolution */
+    int warm;               /* warm start with previous z-transformation */
+    int na;                 /* number of ambiguities of previous epoch */
+    int ref;                /* reference ambiguity state of previous epoch */
+    int sat[MAXARAMB];      /* satellites of previous epoch ambiguities */
+    double Z[MAXARAMB*MAXARAMB]; /* z-transformation of previous epoch */
+    double mw[MAXSAT];      /* averaged mw wide-lane (cycle) */
+    double mwv[MAXSAT];     /* sum of squared deviations of mw (cycle^2) */
+    int nmw[MAXSAT];        /* number of averaged mw */
+    gtime_t tmw[MAXSAT];    /* time of last mw */
+    int nep,nfix,namb;      /* number of ar epochs/fixed epochs/fixed amb */
+    int nwarm,ncold;        /* number of warm/cold starts */
+    double tred,tsrch;      /* total reduction/search time (s) */
+} insamb_t;
+
+typedef struct {        /* Tightly coupled innovation fault detection and exclusion */
+    int nep;                /* number of tested epochs */
+    int ndet;               /* number of epochs failing overall model test */
+    int nexc;               /* number of excluded satellites */
+    int nexs[MAXSAT];       /* number of exclusions per satellite */
+    double t;               /* total fde time (s) */
+} insfde_t;
+
+typedef struct {        /* Per-epoch satellite state cache */
+    gtime_t time;           /* observation epoch of cached states */
+    int n;                  /* number of cached satellites */
+    int sat[MAXOBS];        /* satellite numbers (obs order) */
+    int satok,rcvok;        /* satellite/receiver states valid flags */
+    double rs[6*MAXOBS];    /* satellite positions and velocities (ecef) */
+    double dts[2*MAXOBS];   /* satellite clock bias and drift */
+    double var[MAXOBS];     /* satellite position and clock variance */
+    int svh[MAXOBS];        /* satellite health flags */
+    double rsun[3],rmoon[3],gmst; /* sun/moon positions (ecef) and gmst */
+    double rr0[3];          /* receiver position key (before tides) */
+    double rr[3],pos[3];    /* tide-corrected receiver position ecef/llh */
+    int stat[MAXOBS];       /* geometry status (1:valid) */
+    double r[MAXOBS];       /* geometric distances (m) */
+    double e[3*MAXOBS];     /* line-of-sight unit vectors (ecef) */
+    double azel[2*MAXOBS];  /* azimuth/elevation angles (rad) */
+    double dants[NFREQ*MAXOBS]; /* satellite antenna offsets (m) */
+    double dantr[NFREQ*MAXOBS]; /* receiver antenna offsets (m) */
+    unsigned int nsat,nsun,ntide,nwind,ngeo; /* computed: satposs, sun/moon, tides, windup, geometry per sat */
+    unsigned int nhit_sat,nhit_tide,nhit_wind,nhit_geo; /* cache hits (avoided) */
+} satcache_t;
 
 
 
 /* global variables ----------------------------------------------------------*/
-extern lane_t lane;
+extern lanemap_t lanemap;
 extern imuraw_t imu_obs_global;
 extern pva_t pva_global;
 extern pva_t pvagnss;
-extern FILE *fp_lane;
 extern FILE *fimu;
 extern FILE *out_raw_fimu;
 extern FILE *out_PVA;
@@ -341,7 +617,15 @@ extern ins_states_t *insw;
 extern insgnss_opt_t insgnssopt;
 extern res_t resid;
 extern int dz_counter;
-extern static_info_t staticInfo;
+extern motdet_t motdet;
+extern udfac_t insud;
+extern insamb_t insamb;
+extern insfde_t insfde;
+extern satcache_t satcache;
+extern um7raw_t um7raw;
+extern sched_t coresched;
+extern auxstore_t auxstore;
+extern coreprof_t coreprof;
 extern const double Omge[9]; /* earth rotation matrix in i/e-frame (5.18) */
 
 /* global states index -------------------------------------------------------*/
@@ -354,9 +638,8 @@ extern int irc, nrc; /* index and number of receiver clock state */
 extern int irr, nrr; /* index and number of receiver clock drift state */
 extern int IT, NT;   /* index and number of tropo state */
 extern int IN, NN;   /* index and number of ambiguities state */
-
-//fp_lane=fopen("/home/emerson/Desktop/Connected_folders/SatInsMap/data/Lanes1_XYZ_2016_ITRF08.txt","r");
-       /* Lane coordinate file pointer */
+extern int xnCl(void); /* number of close-loop correction states */
+extern int xiBs(const prcopt_t *opt, int s); /* index of ambiguity state */
 
 /* function declaration ------------------------------------------------------*/
 
@@ -370,15 +653,29 @@ extern int showmsg(char *format, ...);
 extern void settspan(gtime_t ts, gtime_t te);
 extern void settime(gtime_t time);
 extern void vec2skew (double *vec, double *W);
-extern void windowSlider(double *vec, int size, double value);
 
 /* map-matching functions	*/
-void extern inibuff ();
+extern void lanemap_init(lanemap_t *map);
+extern int lanemap_read(lanemap_t *map, const char *file, const double *org,
+                        double tsize);
+extern void lanemap_free(lanemap_t *map);
+extern int lanemap_near(lanemap_t *map, const double *rr);
+extern int lckws_init(lckws_t *ws, int nthread);
+extern void lckws_free(lckws_t *ws);
+extern int lckphase_batch(lckws_t *ws, const double *enspc, int nc,
+  const double *rs, const double *meas, const double *off, const double *var,
+  int ns);
 extern int match (rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav,
+  const double *rs, const double *dts, const double *vare, lckws_t *ws,
   double *mmcand);
 
 /* System positioning */
 extern void core(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav);
+extern int insgnssinit(const char *imufile, const char *odofile,
+                       const char *outdir);
+extern void insgnssfree(void);
+extern int insgnsschkopt(const prcopt_t *popt);
+extern void clp(ins_states_t *ins, const insgnss_opt_t *opt, const double *x);
 
 /* imu-mems functions --------------------------------------------------------*/
 extern void inssysmatrix(double *PHI, double *G, int nx, pva_t *pva,
@@ -406,6 +703,79 @@ ins_states_t *insc, insgnss_opt_t *ig_opt, int nav_or_int);
 extern int LC_INS_GNSS_core1(rtk_t *rtk, const obsd_t *obs, int n, nav_t *nav,\
 ins_states_t *insc, insgnss_opt_t *ig_opt, int nav_or_int);
 extern void ig_paruncinit(insgnss_opt_t *insopt);
+extern void init_um7(um7raw_t *raw, int week);
+extern int input_um7(um7raw_t *raw, unsigned char data);
+extern int input_um7f(um7raw_t *raw, FILE *fp);
+extern void resync_um7(um7raw_t *raw);
+extern void um7stat(const um7raw_t *raw, FILE *fp);
+extern void sched_init(sched_t *sched);
+extern int sched_addsrc(sched_t *sched, int type, evtfetch_t fetch, void *arg);
+extern void sched_sethandler(sched_t *sched, int type, evthandler_t handler,
+                             void *ctx);
+extern int sched_push(sched_t *sched, const evt_t *evt);
+extern const evt_t *sched_peek(sched_t *sched);
+extern int sched_step(sched_t *sched);
+extern int sched_run(sched_t *sched, double tend);
+extern void sched_stat(const sched_t *sched, FILE *fp);
+extern int aux_readobd(auxstore_t *st, const char *file, double toff);
+extern int aux_readcols(auxstore_t *st, const char *file, const char **names,
+                        const char **units, int ncol, double toff);
+extern const auxseries_t *aux_get(const auxstore_t *st, const char *name);
+extern void aux_initcur(auxcur_t *cur, const auxseries_t *s);
+extern int aux_interp(auxcur_t *cur, double t, double maxgap, double *val);
+extern void aux_free(auxstore_t *st);
+extern void satcache_reset(satcache_t *c);
+extern void satcache_sat(satcache_t *c, const obsd_t *obs, int n,
+                         const nav_t *nav, const prcopt_t *opt);
+extern int satcache_rcv(satcache_t *c, const double *rr, const prcopt_t *opt,
+                        const nav_t *nav, ssat_t *ssat);
+extern void satcache_stat(const satcache_t *c, FILE *fp);
+extern void sim_seed(unsigned long long *rng, unsigned long long seed,
+                     unsigned long long stream);
+extern double sim_randn(unsigned long long *rng);
+extern void simtrj_init(simtrj_t *trj, int type, gtime_t t0, double tspan,
+                        const double *pos0, double head0, double speed,
+                        double radius, double tstat);
+extern int simtrj_readref(simtrj_t *trj, const char *file);
+extern void simtrj_free(simtrj_t *trj);
+extern void simtrj_pva(const simtrj_t *trj, double t, simpva_t *pva);
+extern void simimu(const simpva_t *pva, double *fb, double *wb);
+extern int simobs(gtime_t time, const double *rr, double dtr, const nav_t *nav,
+                  const prcopt_t *opt, unsigned long long seed,
+                  unsigned long long *rng, obsd_t *obs);
+extern void Gravity_ECEF(double *r_eb_e, double *g);
+extern void kf_par_unc_init(insgnss_opt_t *opt);
+extern void kf_noise_init(insgnss_opt_t *opt);
+extern udfac_t *insudfac(const ins_states_t *ins);
+extern void inssyncP(const insgnss_opt_t *opt, ins_states_t *ins);
+extern double insvar(const insgnss_opt_t *opt, const ins_states_t *ins, int i);
+extern void ned2xyz(const double *pos,double *Cne);
+extern void motdet_init(motdet_t *det, int tact);
+extern void motdet_imu(motdet_t *det, double t, const double *fb,
+                       const double *wb);
+extern void motdet_gnss(motdet_t *det, double t, double speed);
+extern void rpy2dcm(const double *rpy,double *Cnb);
+extern int ud_init(udfac_t *ud, const double *P, int n);
+extern int ud_copy(udfac_t *dst, const udfac_t *src);
+extern void ud_toP(udfac_t *ud, double *P, int n);
+extern double ud_var(udfac_t *ud, int i);
+extern void ud_reset(udfac_t *ud, int i, double var);
+extern void ud_addvar(udfac_t *ud, int i, double q);
+extern int ud_predict(udfac_t *ud, const double *phi, const double *Q, int n);
+extern int ud_filter(udfac_t *ud, double *x, const double *H, const double *v,
+                     const double *R, int n, int m, double *K);
+extern int ud_navfilter(udfac_t *ud, double *x, const double *Hs,
+                        const double *v, const double *R, int n, int m,
+                        int is, int ns);
+extern void ud_free(udfac_t *ud);
+extern int navfilter(double *x, double *P, const double *Hs, const double *v,
+                     const double *R, int n, int m, int is, int ns);
+extern void insamb_init(insamb_t *amb);
+extern int insamb_res(insamb_t *amb, rtk_t *rtk, const obsd_t *obs, int n,
+                      const nav_t *nav, ins_states_t *ins,
+                      const insgnss_opt_t *opt);
+extern int insfde_res(insfde_t *fde, const double *x, const double *P, double *H,
+                      double *v, double *R, int nx, int nv, int *sat, int *exsat);
 
 /* plot functions ------------------------------------------------------------*/
 extern void mapmatchplot ();
@@ -432,6 +802,7 @@ extern void KF_state_errors_plot_gyrb(char* filename);
 extern void KF_state_errors_plot_clk(char* filename);
 extern void KF_residuals_plot_att(char* filename);
 extern void nsat ();
+extern int plotexport(const char *dir, const char *outdir, int nbin);
 
 /* geodetic and positioning functions ----------------------------------------*/
 extern d2lgs(double lat, double h, double* pos, double* e);
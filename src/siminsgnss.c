@@ -0,0 +1,587 @@
+/*------------------------------------------------------------------------------
+* siminsgnss.c : synthetic ins/gnss dataset generator
+*
+* notes   : generates a consistent dataset for load generation and regression
+*           of the ins/gnss processing: RINEX 3.03 observations, an imu log in
+*           the format read by inputimu() (tactical kvh text or um7 $PCHRS)
+*           and the true trajectory.
+*
+*           the trajectory is parametric (static, circle, figure-eight) or the
+*           spline of a reference solution (-r reference.pos). imu errors are
+*           drawn from the psd_t/unc_t models of the selected imu grade
+*           (kf_noise_init(), kf_par_unc_init()): turn-on biases, bias random
+*           walks and white noise. the receiver clock is a random walk of
+*           phase and drift with the same psd_t.
+*
+*           the span is split into time chunks generated in parallel by
+*           worker threads. every chunk has its own random number streams and
+*           the continuous processes (biases, clock) are drawn in advance, so
+*           the output is identical for any number of threads. chunks are
+*           written in time order with a bounded number of chunks in flight.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/11 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "siminsgnss"        /* program name */
+#define MAXFILE     8                   /* max number of input files */
+#define MAXTHREAD   64                  /* max number of worker threads */
+#define SIMCHUNK    60.0                /* time chunk length (s) */
+#define SIMWINDOW   2                   /* chunks in flight per thread */
+#define MAGN        0.2                 /* magnetic field north (normalized) */
+#define MAGD        0.45                /* magnetic field down (normalized) */
+
+#define IMUFMT_KVH  0                   /* imu log: tactical kvh text */
+#define IMUFMT_UM7  1                   /* imu log: um7 $PCHRS with logger prefix */
+
+typedef struct {        /* simulation chunk */
+    int stat;           /* status (0:pending,1:running,2:done,-1:error) */
+    char *obuf,*ibuf,*tbuf; /* generated rinex obs/imu/truth text */
+    size_t on,in,tn;    /* size of generated text */
+} simchunk_t;
+
+typedef struct {        /* simulation context */
+    simtrj_t trj;       /* trajectory */
+    nav_t nav;          /* navigation data */
+    prcopt_t popt;      /* gnss options (navsys,nf,sateph,elmin,err) */
+    rnxopt_t ropt;      /* rinex options */
+    insgnss_opt_t iopt; /* imu grade (psd,unc) */
+    double fi,fg;       /* imu/gnss rate (Hz) */
+    long ni,ng;         /* number of imu samples/gnss epochs */
+    long nic,ngc;       /* imu samples/gnss epochs per chunk */
+    int nb;             /* number of 1 Hz bias samples */
+    double *bias;       /* imu biases {ba,bg} at 1 Hz (m/s^2,rad/s) */
+    double *dtr;        /* receiver clock bias of gnss epochs (s) */
+    unsigned long long seed; /* random seed */
+    int imufmt;         /* imu log format (IMUFMT_???) */
+    int nchunk;         /* number of chunks */
+    int next;           /* next chunk to generate */
+    int nout;           /* chunks written */
+    int window;         /* max chunks in flight */
+    simchunk_t *chunk;  /* chunks */
+    pthread_mutex_t lock; /* lock of chunk states */
+    pthread_cond_t cond; /* chunk state changed */
+} simctx_t;
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: siminsgnss [option]... file file [...]",
+  "",
+  " Generate synthetic RINEX observations, an imu log and the true trajectory",
+  " of a vehicle with real broadcast (RINEX NAV) or precise (SP3/CLK) products",
+  " given as input files.",
+  "",
+  " -?        print help",
+  " -k file   input options from configuration file [off]",
+  " -r file   reference solution as trajectory (overrides -trj,-l,-ts) [off]",
+  " -trj type parametric trajectory (static,circle,eight) [eight]",
+  " -l lat lon hgt start position (deg,m) [45.950444 -66.641455 -2.2]",
+  " -v speed  cruise speed (m/s) [10]",
+  " -rad r    turn radius (m) [100]",
+  " -head h   initial heading (deg) [0]",
+  " -stat t   initial stationary time (s) [120]",
+  " -ts ds ts start day/time (ds=y/m/d ts=h:m:s) [2019/03/19 19:46:00]",
+  " -span t   time span (s) (0:reference solution) [600]",
+  " -fi rate  imu rate (Hz) [100]",
+  " -fg rate  gnss rate (Hz) [1]",
+  " -g grade  imu grade and log format (tact:kvh,low:um7) [tact]",
+  " -sys str  navigation systems (G:gps,R:glo,E:gal,J:qzs) [configuration]",
+  " -f freq   number of frequencies (1:L1,2:L1+L2/E5a,3:+L5) [configuration]",
+  " -m mask   elevation mask angle (deg) [configuration]",
+  " -e eph    satellite ephemeris (brdc,prec) [brdc]",
+  " -seed n   random seed [1]",
+  " -n num    number of worker threads [1]",
+  " -o prefix output file prefix (prefix.obs,prefix_imu.txt,prefix_truth.txt)",
+  "           [../out/sim]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* navigation systems string to navigation system ----------------------------*/
+static int str2navsys(const char *str)
+{
+    const char *p;
+    int sys=0;
+
+    for (p=str;*p;p++) {
+        switch (*p) {
+            case 'G': sys|=SYS_GPS; break;
+            case 'R': sys|=SYS_GLO; break;
+            case 'E': sys|=SYS_GAL; break;
+            case 'J': sys|=SYS_QZS; break;
+            default : return 0;
+        }
+    }
+    return sys;
+}
+/* read navigation products by file extension --------------------------------*/
+static int readprod(char **infile, int n, nav_t *nav)
+{
+    char *ext;
+    int i,nsp3=0;
+
+    for (i=0;i<n;i++) {
+        if (!(ext=strrchr(infile[i],'.'))) ext="";
+        if (!strcmp(ext,".sp3")||!strcmp(ext,".SP3")||!strcmp(ext,".eph")) {
+            readsp3(infile[i],nav,0);
+            nsp3++;
+        }
+        else if (!strcmp(ext,".clk")||!strcmp(ext,".CLK")) {
+            readrnxc(infile[i],nav);
+        }
+        else if (!readrnx(infile[i],1,"",NULL,nav,NULL)) {
+            fprintf(stderr,"navigation file read error: %s\n",infile[i]);
+        }
+    }
+    uniqnav(nav);
+
+    /* glonass frequency channel numbers for rinex header */
+    for (i=0;i<nav->ng;i++) {
+        if (nav->geph[i].sat<=0) continue;
+        if (satsys(nav->geph[i].sat,&n)==SYS_GLO&&n<=MAXPRNGLO) {
+            nav->glo_fcn[n-1]=(char)(nav->geph[i].frq+8);
+        }
+    }
+    return nav->n+nav->ng+nsp3>0;
+}
+/* set rinex observation types -----------------------------------------------*/
+static void setrnxopt(rnxopt_t *ropt, const prcopt_t *popt, const char *prog)
+{
+    static const int sys[]={SYS_GPS,SYS_GLO,SYS_GAL,SYS_QZS};
+    static const int isys[]={0,1,2,3};  /* index of rinex obs types */
+    static const char *codes[][3]={
+        {"1C","2W","5Q"},{"1C","2P",""},{"1C","5Q",""},{"1C","2L","5Q"}
+    };
+    static const char type[]="CLS";
+    int i,j,k,m;
+
+    memset(ropt,0,sizeof(rnxopt_t));
+    ropt->rnxver=3.03;
+    ropt->navsys=popt->navsys;
+    ropt->obstype=OBSTYPE_PR|OBSTYPE_CP|OBSTYPE_SNR;
+    ropt->freqtype=FREQTYPE_ALL;
+    strcpy(ropt->prog,prog);
+    strcpy(ropt->marker,"SIM");
+    strcpy(ropt->rec[1],"SIMULATED");
+    strcpy(ropt->ant[1],"SIMULATED");
+
+    for (i=0;i<6;i++) memset(ropt->mask[i],'1',63);
+    for (i=0;i<4;i++) {
+        if (!(popt->navsys&sys[i])) continue;
+        m=isys[i];
+        for (j=0;j<popt->nf&&j<3;j++) {
+            if (!*codes[i][j]) continue;
+            for (k=0;k<3;k++) {
+                ropt->tobs[m][ropt->nobs[m]][0]=type[k];
+                strcpy(ropt->tobs[m][ropt->nobs[m]++]+1,codes[i][j]);
+            }
+        }
+    }
+}
+/* draw imu biases and receiver clock ----------------------------------------*/
+static int drawproc(simctx_t *ctx)
+{
+    unsigned long long rng;
+    double b,d,dt=1.0/ctx->fg;
+    long i;
+    int j;
+
+    ctx->nb=(int)ceil(ctx->trj.tspan)+2;
+    if (!(ctx->bias=(double *)malloc(sizeof(double)*6*ctx->nb))||
+        !(ctx->dtr=(double *)malloc(sizeof(double)*ctx->ng))) return 0;
+
+    /* turn-on biases and random walks at 1 Hz */
+    sim_seed(&rng,ctx->seed,0xB1A5ULL);
+    for (j=0;j<6;j++) {
+        ctx->bias[j]=(j<3?ctx->iopt.unc.ba:ctx->iopt.unc.bg)*sim_randn(&rng);
+    }
+    for (i=1;i<ctx->nb;i++) for (j=0;j<6;j++) {
+        ctx->bias[6*i+j]=ctx->bias[6*(i-1)+j]+
+            sqrt(j<3?ctx->iopt.psd.ba:ctx->iopt.psd.bg)*sim_randn(&rng);
+    }
+    /* receiver clock phase (m) and drift (m/s) random walk */
+    sim_seed(&rng,ctx->seed,0xC10CULL);
+    b=ctx->iopt.unc.rc*sim_randn(&rng);
+    d=ctx->iopt.unc.rr*sim_randn(&rng);
+    for (i=0;i<ctx->ng;i++) {
+        ctx->dtr[i]=b/CLIGHT;
+        b+=d*dt+sqrt(ctx->iopt.psd.clk*dt)*sim_randn(&rng);
+        d+=sqrt(ctx->iopt.psd.clkr*dt)*sim_randn(&rng);
+    }
+    return 1;
+}
+/* output um7 packet ---------------------------------------------------------*/
+static void outum7(FILE *fp, double tow, int week, double tsen, int ch,
+                   const double *v)
+{
+    char buff[128],*p;
+    unsigned char cs=0;
+
+    sprintf(buff,"$PCHRS,%d,%.3f,%.4f,%.4f,%.4f,",ch,tsen,v[0],v[1],v[2]);
+    for (p=buff+1;*p;p++) cs^=(unsigned char)*p;
+    sprintf(p,"*%02X",cs);
+    fprintf(fp,"%.3f,%d,COM3,%d,%s\n",floor(tow),week,(int)strlen(buff),buff);
+}
+/* generate imu samples of chunk ---------------------------------------------*/
+static void genimu(const simctx_t *ctx, int k, FILE *fp)
+{
+    simpva_t pva;
+    unsigned long long rng;
+    double t,fb[3],wb[3],b[6],a,sa,sg,Cnb[9],mn[3]={MAGN,0.0,MAGD},mb[3],tow,tsen;
+    long i,i1;
+    int j,ib,week;
+
+    sim_seed(&rng,ctx->seed,2*(unsigned long long)k);
+    sa=sqrt(ctx->iopt.psd.accl*ctx->fi);
+    sg=sqrt(ctx->iopt.psd.gyro*ctx->fi);
+
+    i1=(k+1)*ctx->nic<ctx->ni?(k+1)*ctx->nic:ctx->ni;
+    for (i=k*ctx->nic;i<i1;i++) {
+        t=i/ctx->fi;
+        simtrj_pva(&ctx->trj,t,&pva);
+        simimu(&pva,fb,wb);
+
+        ib=(int)floor(t); a=t-ib;
+        if (ib>=ctx->nb-1) {ib=ctx->nb-2; a=1.0;}
+        for (j=0;j<6;j++) {
+            b[j]=ctx->bias[6*ib+j]*(1.0-a)+ctx->bias[6*(ib+1)+j]*a;
+        }
+        for (j=0;j<3;j++) {
+            fb[j]+=b[j]  +sa*sim_randn(&rng);
+            wb[j]+=b[3+j]+sg*sim_randn(&rng);
+        }
+        tow=time2gpst(timeadd(ctx->trj.t0,t),&week);
+
+        if (ctx->imufmt==IMUFMT_KVH) {
+            /* kvh log time is utc-aligned (gpst-16 s), see inputimu() */
+            fprintf(fp,"%.6f %.9f %.9f %.9f %.9f %.9f %.9f\n",tow-16.0,
+                    fb[2]/Gcte,fb[1]/Gcte,fb[0]/Gcte,wb[2]*R2D,wb[1]*R2D,
+                    wb[0]*R2D);
+        }
+        else {
+            rpy2dcm(pva.rpy,Cnb);
+            matmul("NN",3,1,3,1.0,Cnb,mn,0.0,mb);
+            for (j=0;j<3;j++) {
+                fb[j]/=Gcte; wb[j]*=R2D;
+            }
+            /* sensor time with fraction of gps time */
+            tsen=floor(t)+tow-floor(tow);
+            outum7(fp,tow,week,tsen,0,wb);
+            outum7(fp,tow,week,tsen,1,fb);
+            outum7(fp,tow,week,tsen,2,mb);
+        }
+    }
+}
+/* generate gnss epochs and truth of chunk -----------------------------------*/
+static int gengnss(const simctx_t *ctx, int k, FILE *fo, FILE *ft)
+{
+    simpva_t pva;
+    obsd_t *obs;
+    unsigned long long rng;
+    gtime_t time;
+    double t,rr[3],tow;
+    long i,i1;
+    int n,week;
+
+    if (!(obs=(obsd_t *)malloc(sizeof(obsd_t)*MAXOBS))) return 0;
+
+    sim_seed(&rng,ctx->seed,2*(unsigned long long)k+1);
+
+    i1=(k+1)*ctx->ngc<ctx->ng?(k+1)*ctx->ngc:ctx->ng;
+    for (i=k*ctx->ngc;i<i1;i++) {
+        t=i/ctx->fg;
+
+        /* receiver position at true reception time */
+        simtrj_pva(&ctx->trj,t-ctx->dtr[i],&pva);
+        pos2ecef(pva.pos,rr);
+
+        time=timeadd(ctx->trj.t0,t);
+        n=simobs(time,rr,ctx->dtr[i],&ctx->nav,&ctx->popt,ctx->seed,&rng,obs);
+        if (n>0) outrnxobsb(fo,&ctx->ropt,obs,n,0);
+
+        simtrj_pva(&ctx->trj,t,&pva);
+        tow=time2gpst(time,&week);
+        fprintf(ft,"%4d %11.4f %14.9f %14.9f %10.4f %9.4f %9.4f %9.4f %9.4f "
+                "%9.4f %9.4f %12.9f\n",week,tow,pva.pos[0]*R2D,pva.pos[1]*R2D,
+                pva.pos[2],pva.vn[0],pva.vn[1],pva.vn[2],pva.rpy[0]*R2D,
+                pva.rpy[1]*R2D,pva.rpy[2]*R2D,ctx->dtr[i]);
+    }
+    free(obs);
+    return 1;
+}
+/* generate chunk ------------------------------------------------------------*/
+static int genchunk(simctx_t *ctx, int k)
+{
+    simchunk_t *c=ctx->chunk+k;
+    FILE *fo,*fi,*ft;
+    int stat;
+
+    if (!(fo=open_memstream(&c->obuf,&c->on))) return 0;
+    if (!(fi=open_memstream(&c->ibuf,&c->in))) {
+        fclose(fo);
+        return 0;
+    }
+    if (!(ft=open_memstream(&c->tbuf,&c->tn))) {
+        fclose(fo); fclose(fi);
+        return 0;
+    }
+    genimu(ctx,k,fi);
+    stat=gengnss(ctx,k,fo,ft);
+    fclose(fo); fclose(fi); fclose(ft);
+    return stat;
+}
+/* worker thread -------------------------------------------------------------*/
+static void *simthread(void *arg)
+{
+    simctx_t *ctx=(simctx_t *)arg;
+    int k,stat;
+
+    for (;;) {
+        pthread_mutex_lock(&ctx->lock);
+        while (ctx->next<ctx->nchunk&&ctx->next>=ctx->nout+ctx->window) {
+            pthread_cond_wait(&ctx->cond,&ctx->lock);
+        }
+        if ((k=ctx->next)>=ctx->nchunk) {
+            pthread_mutex_unlock(&ctx->lock);
+            break;
+        }
+        ctx->next++;
+        ctx->chunk[k].stat=1;
+        pthread_mutex_unlock(&ctx->lock);
+
+        stat=genchunk(ctx,k);
+
+        pthread_mutex_lock(&ctx->lock);
+        ctx->chunk[k].stat=stat?2:-1;
+        pthread_cond_broadcast(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    return NULL;
+}
+/* generate and write chunks in time order -------------------------------------
+* args   : simctx_t *ctx    IO  simulation context
+*          int    nthread   I   number of worker threads
+*          FILE   *fo,*fi,*ft I output rinex obs/imu/truth files
+* return : status (1:ok,0:error)
+*-----------------------------------------------------------------------------*/
+static int simrun(simctx_t *ctx, int nthread, FILE *fo, FILE *fi, FILE *ft)
+{
+    pthread_t thread[MAXTHREAD];
+    simchunk_t *c;
+    int i,k,stat=1;
+
+    pthread_mutex_init(&ctx->lock,NULL);
+    pthread_cond_init(&ctx->cond,NULL);
+    ctx->next=ctx->nout=0;
+    ctx->window=SIMWINDOW*nthread;
+
+    for (i=0;i<nthread;i++) {
+        if (pthread_create(thread+i,NULL,simthread,ctx)) break;
+    }
+    if ((nthread=i)<=0) return 0;
+
+    for (k=0;k<ctx->nchunk;k++) {
+        c=ctx->chunk+k;
+        pthread_mutex_lock(&ctx->lock);
+        while (c->stat!=2&&c->stat!=-1) pthread_cond_wait(&ctx->cond,&ctx->lock);
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (c->stat==-1) stat=0;
+        if (c->obuf) fwrite(c->obuf,1,c->on,fo);
+        if (c->ibuf) fwrite(c->ibuf,1,c->in,fi);
+        if (c->tbuf) fwrite(c->tbuf,1,c->tn,ft);
+        free(c->obuf); free(c->ibuf); free(c->tbuf);
+        c->obuf=c->ibuf=c->tbuf=NULL;
+
+        pthread_mutex_lock(&ctx->lock);
+        ctx->nout++;
+        pthread_cond_broadcast(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+
+        fprintf(stderr,"\rgenerated: %5.1f%%",100.0*(k+1)/ctx->nchunk);
+    }
+    fprintf(stderr,"\n");
+
+    for (i=0;i<nthread;i++) pthread_join(thread[i],NULL);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->cond);
+    return stat;
+}
+/* open output file ----------------------------------------------------------*/
+static FILE *openfile(const char *prefix, const char *suffix)
+{
+    FILE *fp;
+    char file[1024];
+
+    sprintf(file,"%s%s",prefix,suffix);
+    if (!(fp=fopen(file,"w"))) fprintf(stderr,"file open error: %s\n",file);
+    return fp;
+}
+/* simulator main --------------------------------------------------------------
+* see help text
+*-----------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+    static simctx_t ctx;
+    prcopt_t prcopt=prcopt_default;
+    solopt_t solopt=solopt_default;
+    filopt_t filopt={""};
+    FILE *fo,*fi,*ft;
+    double es[]={2019,3,19,19,46,0},pos0[]={45.950444,-66.641455,-2.2};
+    double speed=10.0,radius=100.0,head=0.0,tstat=120.0,span=600.0,rr[3];
+    double fi0=100.0,fg=1.0,elmask=-1.0;
+    int i,n,nthread=1,type=SIMTRJ_EIGHT,grade=1,sys=0,nf=0,eph=EPHOPT_BRDC;
+    int stat;
+    char *infile[MAXFILE],*reffile="",*prefix="../out/sim";
+
+    for (i=1;i<argc;i++) {
+        if (!strcmp(argv[i],"-k")&&i+1<argc) {
+            resetsysopts();
+            if (!loadopts(argv[++i],sysopts)) return -1;
+            getsysopts(&prcopt,&solopt,&filopt);
+        }
+    }
+    for (i=1,n=0;i<argc;i++) {
+        if      (!strcmp(argv[i],"-k")&&i+1<argc) ++i;
+        else if (!strcmp(argv[i],"-r")&&i+1<argc) reffile=argv[++i];
+        else if (!strcmp(argv[i],"-trj")&&i+1<argc) {
+            i++;
+            if      (!strcmp(argv[i],"static")) type=SIMTRJ_STATIC;
+            else if (!strcmp(argv[i],"circle")) type=SIMTRJ_CIRCLE;
+            else if (!strcmp(argv[i],"eight" )) type=SIMTRJ_EIGHT;
+            else printhelp();
+        }
+        else if (!strcmp(argv[i],"-l")&&i+3<argc) {
+            pos0[0]=atof(argv[++i]);
+            pos0[1]=atof(argv[++i]);
+            pos0[2]=atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i],"-v")&&i+1<argc) speed=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-rad")&&i+1<argc) radius=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-head")&&i+1<argc) head=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-stat")&&i+1<argc) tstat=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-ts")&&i+2<argc) {
+            sscanf(argv[++i],"%lf/%lf/%lf",es,es+1,es+2);
+            sscanf(argv[++i],"%lf:%lf:%lf",es+3,es+4,es+5);
+        }
+        else if (!strcmp(argv[i],"-span")&&i+1<argc) span=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-fi")&&i+1<argc) fi0=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-fg")&&i+1<argc) fg=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-g")&&i+1<argc) {
+            grade=strcmp(argv[++i],"low")?1:0;
+        }
+        else if (!strcmp(argv[i],"-sys")&&i+1<argc) {
+            if (!(sys=str2navsys(argv[++i]))) printhelp();
+        }
+        else if (!strcmp(argv[i],"-f")&&i+1<argc) nf=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-m")&&i+1<argc) elmask=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-e")&&i+1<argc) {
+            eph=strcmp(argv[++i],"prec")?EPHOPT_BRDC:EPHOPT_PREC;
+        }
+        else if (!strcmp(argv[i],"-seed")&&i+1<argc) {
+            ctx.seed=strtoull(argv[++i],NULL,10);
+        }
+        else if (!strcmp(argv[i],"-n")&&i+1<argc) nthread=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) prefix=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else if (n<MAXFILE) infile[n++]=argv[i];
+    }
+    if (n<=0) {
+        showmsg("error : no input file\n");
+        return -2;
+    }
+    if (fi0<=0.0||fg<=0.0||fg>fi0) {
+        fprintf(stderr,"invalid imu/gnss rate: %g/%g Hz\n",fi0,fg);
+        return -1;
+    }
+    if (!ctx.seed) ctx.seed=1;
+    if (nthread<1) nthread=1;
+    if (nthread>MAXTHREAD) nthread=MAXTHREAD;
+
+    /* gnss options */
+    if (sys) prcopt.navsys=sys;
+    if (nf>0) prcopt.nf=nf;
+    if (elmask>=0.0) prcopt.elmin=elmask*D2R;
+    prcopt.sateph=eph;
+    ctx.popt=prcopt;
+
+    /* imu grade */
+    ctx.iopt.Tact_or_Low=grade;
+    ctx.imufmt=grade?IMUFMT_KVH:IMUFMT_UM7;
+    kf_noise_init(&ctx.iopt);
+    kf_par_unc_init(&ctx.iopt);
+
+    /* trajectory */
+    if (*reffile) {
+        ctx.trj.tspan=span;
+        if (!simtrj_readref(&ctx.trj,reffile)) {
+            fprintf(stderr,"reference solution read error: %s\n",reffile);
+            return -1;
+        }
+    }
+    else {
+        for (i=0;i<2;i++) pos0[i]*=D2R;
+        simtrj_init(&ctx.trj,type,epoch2time(es),span,pos0,head*D2R,speed,
+                    radius,tstat);
+    }
+    if (!readprod(infile,n,&ctx.nav)) {
+        fprintf(stderr,"no navigation data\n");
+        return -1;
+    }
+    ctx.fi=fi0;
+    ctx.fg=fg;
+    ctx.ni=(long)floor(ctx.trj.tspan*fi0+1E-6)+1;
+    ctx.ng=(long)floor(ctx.trj.tspan*fg+1E-6)+1;
+    ctx.nic=(long)(SIMCHUNK*fi0+0.5);
+    ctx.ngc=(long)(SIMCHUNK*fg+0.5);
+    ctx.nchunk=(int)((ctx.ni+ctx.nic-1)/ctx.nic);
+    if ((ctx.ng+ctx.ngc-1)/ctx.ngc>ctx.nchunk) {
+        ctx.nchunk=(int)((ctx.ng+ctx.ngc-1)/ctx.ngc);
+    }
+    if (!drawproc(&ctx)||
+        !(ctx.chunk=(simchunk_t *)calloc(ctx.nchunk,sizeof(simchunk_t)))) {
+        fprintf(stderr,"memory allocation error\n");
+        return -1;
+    }
+    /* rinex header */
+    setrnxopt(&ctx.ropt,&prcopt,PROGNAME);
+    ctx.ropt.tstart=ctx.ropt.ts=ctx.trj.t0;
+    ctx.ropt.tend=ctx.ropt.te=timeadd(ctx.trj.t0,ctx.trj.tspan);
+    ctx.ropt.tint=1.0/fg;
+    pos2ecef(ctx.trj.pos0,rr);
+    for (i=0;i<3;i++) ctx.ropt.apppos[i]=rr[i];
+
+    if (!(fo=openfile(prefix,".obs"))||!(fi=openfile(prefix,"_imu.txt"))||
+        !(ft=openfile(prefix,"_truth.txt"))) {
+        return -1;
+    }
+    outrnxobsh(fo,&ctx.ropt,&ctx.nav);
+    fprintf(ft,"%% week tow(s) lat(deg) lon(deg) hgt(m) vn ve vd(m/s) "
+            "roll pitch yaw(deg) dtr(s)\n");
+
+    fprintf(stderr,"simulate: span=%.1fs imu=%gHz gnss=%gHz chunks=%d "
+            "threads=%d\n",ctx.trj.tspan,fi0,fg,ctx.nchunk,nthread);
+
+    stat=simrun(&ctx,nthread,fo,fi,ft);
+
+    fclose(fo); fclose(fi); fclose(ft);
+    free(ctx.chunk); free(ctx.bias); free(ctx.dtr);
+    simtrj_free(&ctx.trj);
+    freenav(&ctx.nav,0xFF);
+    return stat?0:-1;
+}
@@ -0,0 +1,243 @@
+/*------------------------------------------------------------------------------
+* udins.c : u-d factorized against dense covariance check
+*
+* notes   : runs the operations of the u-d factorized covariance (UDFilter.c)
+*           on random problems of the shape of the tc filter and repeats
+*           each of them on a dense covariance as reference:
+*
+*           predict : ud_predict() / P=phi*(P+Q/2)*phi'+Q/2, phi differs from
+*                     the identity in the rows of the leading navigation
+*                     block, Q is non-zero only in that block
+*           reset   : ud_reset() / row and column of a state zeroed and its
+*                     variance set, also to zero (state removed)
+*           addvar  : ud_addvar() / P(i,i)+=q
+*           filter  : ud_filter() / filter_adap() with diagonal and
+*                     correlated measurement noise
+*
+*           after each operation the dense covariance rebuilt from the
+*           factors (ud_toP()) is compared with the reference, after the
+*           update also the states and the kalman gain. the errors are
+*           relative, |a-b|/(1+|b|). the time per call is measured for the
+*           predict and filter operations of both forms.
+*
+*           with -DUDSINGLE the factors are stored in single precision, the
+*           errors then show the rounding of the factors.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/21 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "udins"             /* program name */
+#define MAXMEAS     16                  /* max number of measurements */
+#define NOP         5                   /* number of checked operations */
+
+static const char *opname[NOP]={"predict","reset","addvar","filter","gain"};
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: udins [option]...",
+  "",
+  " Run the u-d factorized covariance operations on random problems of the",
+  " shape of the tc filter against the dense covariance, and report the",
+  " errors and the time per call.",
+  "",
+  " -?        print help",
+  " -n num    number of states [96]",
+  " -nb num   number of states of leading navigation block [15]",
+  " -m num    max number of measurements per epoch (<=16) [10]",
+  " -e num    number of epochs [200]",
+  " -s seed   random seed [1]",
+  " -tol err  max relative error, exit status 1 if exceeded [1E-6]",
+  " -o file   output csv file (appended) [off]",
+  " -tag str  run label written to csv [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock time (s) -------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* uniform random number in [-1,1) -------------------------------------------*/
+static unsigned long long seed=1;
+
+static double rnd(void)
+{
+    seed=seed*6364136223846793005ULL+1442695040888963407ULL;
+    return (seed>>11)*(2.0/9007199254740992.0)-1.0;
+}
+/* random state index in [i0,n) ----------------------------------------------*/
+static int rndidx(int i0, int n)
+{
+    int i=i0+(int)((rnd()+1.0)*0.5*(n-i0));
+    return i<n?i:n-1;
+}
+/* max relative error of arrays ----------------------------------------------*/
+static double relerr(const double *a, const double *b, int n)
+{
+    double e,emax=0.0;
+    int i;
+
+    for (i=0;i<n;i++) {
+        if ((e=fabs(a[i]-b[i])/(1.0+fabs(b[i])))>emax) emax=e;
+    }
+    return emax;
+}
+/* covariance error of factors -----------------------------------------------*/
+static double coverr(udfac_t *ud, const double *P, double *Pu, int n)
+{
+    ud_toP(ud,Pu,n);
+    return relerr(Pu,P,n*n);
+}
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    udfac_t ud={0};
+    double *P,*Pu,*phi,*Q,*T,*A,*x,*xd,*H,*v,*R,*K,*Kd,*xs;
+    double err[NOP]={0},e,tol=1E-6,t0,tp[2]={0},tf[2]={0},q;
+    char *outfile="",*tag="-";
+    int i,j,k,ep,m,n=96,nb=15,mmax=10,nep=200,nneg=0,stat=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-n")&&i+1<argc) n=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-nb")&&i+1<argc) nb=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-m")&&i+1<argc) mmax=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-e")&&i+1<argc) nep=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-s")&&i+1<argc) seed=strtoull(argv[++i],NULL,10);
+        else if (!strcmp(argv[i],"-tol")&&i+1<argc) tol=atof(argv[++i]);
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else printhelp();
+    }
+    if (nb<1||nb+2>n||mmax<2||mmax>MAXMEAS||nep<=0) printhelp();
+
+    P=zeros(n,n); Pu=mat(n,n); phi=eye(n); Q=zeros(n,n); T=mat(n,n);
+    A=mat(n,n); x=mat(n,1); xd=mat(n,1); xs=mat(n,1); H=mat(n,MAXMEAS);
+    v=mat(MAXMEAS,1); R=mat(MAXMEAS,MAXMEAS); K=mat(n,MAXMEAS);
+    Kd=mat(n,MAXMEAS);
+
+    /* initial covariance: navigation block and every third other state */
+    for (i=0;i<n;i++) P[i+i*n]=i<nb?1.0+i:(i%3?0.0:4.0);
+    if (ud_init(&ud,P,n)) {
+        fprintf(stderr,"u-d factorization error\n");
+        return -1;
+    }
+    for (ep=0;ep<nep;ep++) {
+
+        /* predict */
+        for (i=0;i<nb;i++) for (j=0;j<n;j++) {
+            phi[i+j*n]=(i==j)+(j<nb||j%7==0?0.05*rnd():0.0);
+        }
+        for (i=0;i<nb;i++) Q[i+i*n]=0.01*(1.5+rnd());
+        Q[1+2*n]=Q[2+n]=0.001;
+
+        t0=walltime();
+        for (i=0;i<n*n;i++) T[i]=P[i]+0.5*Q[i];
+        matmul("NN",n,n,n,1.0,phi,T,0.0,A);
+        matmul("NT",n,n,n,1.0,A,phi,0.0,P);
+        for (i=0;i<n*n;i++) P[i]+=0.5*Q[i];
+        tp[0]+=walltime()-t0;
+
+        t0=walltime();
+        ud_predict(&ud,phi,Q,n);
+        tp[1]+=walltime()-t0;
+        if ((e=coverr(&ud,P,Pu,n))>err[0]) err[0]=e;
+
+        /* reset of a state, reset to zero variance */
+        k=rndidx(nb,n); q=2.0+rnd();
+        for (j=0;j<n;j++) P[k+j*n]=P[j+k*n]=0.0;
+        P[k+k*n]=q;
+        ud_reset(&ud,k,q);
+        k=rndidx(nb,n);
+        for (j=0;j<n;j++) P[k+j*n]=P[j+k*n]=0.0;
+        ud_reset(&ud,k,0.0);
+        if ((e=coverr(&ud,P,Pu,n))>err[1]) err[1]=e;
+
+        /* process noise of a state */
+        k=rndidx(nb,n); q=0.1+0.05*rnd();
+        P[k+k*n]+=q;
+        ud_addvar(&ud,k,q);
+        if ((e=coverr(&ud,P,Pu,n))>err[2]) err[2]=e;
+
+        /* measurement update, correlated noise every other epoch */
+        m=2+ep%(mmax-1);
+        for (i=0;i<n;i++) xs[i]=P[i+i*n]>0.0?1.0+rnd():0.0;
+        for (j=0;j<m;j++) {
+            for (i=0;i<n;i++) H[i+j*n]=i<nb||i%5==j%5?rnd():0.0;
+            v[j]=rnd();
+        }
+        for (i=0;i<m;i++) for (j=0;j<m;j++) {
+            R[i+j*m]=i==j?0.5:(ep%2?0.1:0.0);
+        }
+        matcpy(xd,xs,n,1);
+        t0=walltime();
+        filter_adap(xd,P,H,v,R,n,m,Kd);
+        tf[0]+=walltime()-t0;
+
+        matcpy(x,xs,n,1);
+        t0=walltime();
+        ud_filter(&ud,x,H,v,R,n,m,K);
+        tf[1]+=walltime()-t0;
+
+        if ((e=coverr(&ud,P,Pu,n))>err[3]) err[3]=e;
+        if ((e=relerr(x,xd,n))>err[3]) err[3]=e;
+        for (i=k=0;i<n;i++) if (xs[i]!=0.0&&P[i+i*n]>0.0) k++;
+        if ((e=relerr(K,Kd,k*m))>err[4]) err[4]=e;
+
+        for (i=0;i<n;i++) if (P[i+i*n]<0.0) nneg++;
+    }
+    fprintf(stdout,"%s: n=%d nb=%d m<=%d epochs=%d storage=%s\n",PROGNAME,n,nb,
+            mmax,nep,sizeof(udreal_t)==sizeof(float)?"single":"double");
+    fprintf(stdout,"%-10s %12s\n","operation","max rel err");
+    for (i=0;i<NOP;i++) {
+        fprintf(stdout,"%-10s %12.3E%s\n",opname[i],err[i],err[i]>tol?" *":"");
+        if (err[i]>tol) stat=1;
+    }
+    fprintf(stdout,"%-10s %12s %12s\n","us/call","dense","u-d");
+    fprintf(stdout,"%-10s %12.1f %12.1f\n","predict",tp[0]/nep*1E6,tp[1]/nep*1E6);
+    fprintf(stdout,"%-10s %12.1f %12.1f\n","filter",tf[0]/nep*1E6,tf[1]/nep*1E6);
+    fprintf(stdout,"negative dense variances=%d\n",nneg);
+
+    if (*outfile) {
+        if (!(fp=fopen(outfile,"r"))) {
+            if ((fp=fopen(outfile,"w"))) {
+                fprintf(fp,"tag,storage,n,nb,epochs,err_predict,err_reset,"
+                        "err_addvar,err_filter,err_gain,predict_dense_us,"
+                        "predict_ud_us,filter_dense_us,filter_ud_us\n");
+            }
+        }
+        else {
+            fclose(fp);
+            fp=fopen(outfile,"a");
+        }
+        if (fp) {
+            fprintf(fp,"%s,%s,%d,%d,%d",tag,sizeof(udreal_t)==sizeof(float)?
+                    "single":"double",n,nb,nep);
+            for (i=0;i<NOP;i++) fprintf(fp,",%.3E",err[i]);
+            fprintf(fp,",%.1f,%.1f,%.1f,%.1f\n",tp[0]/nep*1E6,tp[1]/nep*1E6,
+                    tf[0]/nep*1E6,tf[1]/nep*1E6);
+            fclose(fp);
+        }
+    }
+    ud_free(&ud);
+    free(P); free(Pu); free(phi); free(Q); free(T); free(A); free(x); free(xd);
+    free(xs); free(H); free(v); free(R); free(K); free(Kd);
+    return stat;
+}
@@ -0,0 +1,213 @@
+/*------------------------------------------------------------------------------
+* um7ins.c : um7 decoder vs line parser timing check
+*
+* notes   : decodes a UM7 $PCHRS log (with data logger prefix) repeatedly
+*           with the byte-stream decoder (input_um7f()) and with the line
+*           parser it replaced (parseimudata() of satinsmap.c 1.0, kept here
+*           as reference with the time fix of inputimu()) and reports the
+*           time per pass and the samples of both.
+*
+*           the line parser stops at an empty week field of the logger
+*           prefix, so with -wk the week is filled in a copy of the log
+*           (work directory) and both decoders read the copy.
+*
+* version : $Revision: 1.1 $ $Date:  $
+* history : 2019/10/21 1.0 new
+*-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../lib/RTKLIB/src/rtklib.h"
+#include "satinsmap.h"
+
+#define PROGNAME    "um7ins"            /* program name */
+#define MAXLINE     150                 /* max line length of line parser */
+
+/* help text -----------------------------------------------------------------*/
+static const char *help[]={
+  "",
+  " usage: um7ins [option]... file",
+  "",
+  " Decode a UM7 $PCHRS log with the byte-stream decoder and with the line",
+  " parser it replaced, and report the time per pass and the samples.",
+  "",
+  " -?        print help",
+  " -n passes number of decoding passes [20]",
+  " -wk week  gps week filled in empty logger week fields [off]",
+  " -w dir    work directory of the log copy of -wk [/tmp]",
+  " -o file   output csv file (appended) [off]",
+  " -tag str  run label written to csv [-]"
+};
+/* print help ----------------------------------------------------------------*/
+static void printhelp(void)
+{
+    int i;
+    for (i=0;i<(int)(sizeof(help)/sizeof(*help));i++) fprintf(stderr,"%s\n",help[i]);
+    exit(0);
+}
+/* wall clock time (s) -------------------------------------------------------*/
+static double walltime(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec+tp.tv_nsec*1E-9;
+}
+/* line parser of satinsmap.c 1.0 (parseimudata()) ---------------------------*/
+static void parseimudata(char *strline, um7pack_t *imu)
+{
+    float sensor_x,sensor_y,sensor_z;
+    double G=9.80665;
+    int sscanstat;
+
+    sscanstat=sscanf(strline,"%lf,%d,%*4s,%*2d,%*6s,%d,%f,%*f,%*f,%*f,%*s",
+                     &imu->sec,&imu->gpsw,&imu->count,&imu->internal_time);
+    if (sscanstat<4) {
+        imu->status=-1;
+        return;
+    }
+    sscanstat=sscanf(strline,"%lf,%d,%*4s,%*2d,%*6s,%d,%*f,%f,%f,%f,%3c",
+                     &imu->sec,&imu->gpsw,&imu->count,&sensor_x,&sensor_y,
+                     &sensor_z,&imu->checksum);
+    imu->time=gpst2time(imu->gpsw,imu->sec);
+    if (sscanstat<7) {
+        imu->status=0;
+        return;
+    }
+    if (imu->count==0) {
+        imu->g[0]=sensor_x*D2R; imu->g[1]=sensor_y*D2R; imu->g[2]=sensor_z*D2R;
+        imu->tgyr=imu->internal_time;
+    }
+    else if (imu->count==1) {
+        imu->a[0]=sensor_x*G; imu->a[1]=sensor_y*G; imu->a[2]=sensor_z*G;
+        imu->tacc=imu->internal_time;
+    }
+    else {
+        imu->m[0]=sensor_x; imu->m[1]=sensor_y; imu->m[2]=sensor_z;
+        imu->tmag=imu->internal_time;
+    }
+    if (imu->tgyr==0.0||imu->tacc==0.0) {
+        imu->status=0;
+        return;
+    }
+    imu->status=imu->tgyr==imu->tacc?1:0;
+}
+/* decode log by line parser (samples) ---------------------------------------*/
+static int passline(FILE *fp)
+{
+    um7pack_t imu={0};
+    char str[MAXLINE];
+    int n=0;
+
+    rewind(fp);
+    while (fgets(str,MAXLINE,fp)) {
+        parseimudata(str,&imu);
+        if (imu.status!=1) continue;
+        imu.sec+=(double)imu.internal_time-floor((double)imu.internal_time);
+        n++;
+    }
+    return n;
+}
+/* decode log by byte-stream decoder (samples) -------------------------------*/
+static int passum7(FILE *fp, um7raw_t *raw, int week)
+{
+    int n=0,stat;
+
+    init_um7(raw,week);
+    rewind(fp);
+    while ((stat=input_um7f(raw,fp))!=-2) {
+        if (stat==1) n++;
+    }
+    return n;
+}
+/* copy log with empty week fields filled ------------------------------------*/
+static int fillweek(const char *file, const char *outfile, int week)
+{
+    FILE *fp,*fpo;
+    char buff[1024],*p;
+
+    if (!(fp=fopen(file,"r"))) return 0;
+    if (!(fpo=fopen(outfile,"w"))) {
+        fclose(fp);
+        return 0;
+    }
+    while (fgets(buff,sizeof(buff),fp)) {
+        if ((p=strchr(buff,','))&&p[1]==',') {
+            *p='\0';
+            fprintf(fpo,"%s,%d%s",buff,week,p+1);
+        }
+        else fputs(buff,fpo);
+    }
+    fclose(fp);
+    fclose(fpo);
+    return 1;
+}
+int main(int argc, char **argv)
+{
+    FILE *fp,*fpc;
+    static um7raw_t raw;
+    double t0,tl,tu;
+    char *file="",*dir="/tmp",*outfile="",*tag="-",path[1024];
+    int i,n=20,week=0,nl=0,nu=0;
+
+    for (i=1;i<argc;i++) {
+        if      (!strcmp(argv[i],"-n")&&i+1<argc) n=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-wk")&&i+1<argc) week=atoi(argv[++i]);
+        else if (!strcmp(argv[i],"-w")&&i+1<argc) dir=argv[++i];
+        else if (!strcmp(argv[i],"-o")&&i+1<argc) outfile=argv[++i];
+        else if (!strcmp(argv[i],"-tag")&&i+1<argc) tag=argv[++i];
+        else if (*argv[i]=='-') printhelp();
+        else file=argv[i];
+    }
+    if (!*file||n<=0) printhelp();
+
+    if (week>0) {
+        sprintf(path,"%s/%s_log.txt",dir,PROGNAME);
+        if (!fillweek(file,path,week)) {
+            fprintf(stderr,"log copy error: %s\n",path);
+            return -1;
+        }
+        file=path;
+    }
+    if (!(fp=fopen(file,"r"))) {
+        fprintf(stderr,"log open error: %s\n",file);
+        return -1;
+    }
+    t0=walltime();
+    for (i=0;i<n;i++) nl=passline(fp);
+    tl=(walltime()-t0)/n;
+
+    t0=walltime();
+    for (i=0;i<n;i++) nu=passum7(fp,&raw,week);
+    tu=(walltime()-t0)/n;
+    fclose(fp);
+
+    fprintf(stdout,"%s: %s passes=%d\n",PROGNAME,file,n);
+    fprintf(stdout,"%-12s %10s %8s\n","decoder","ms/pass","samples");
+    fprintf(stdout,"%-12s %10.2f %8d\n","line parser",tl*1E3,nl);
+    fprintf(stdout,"%-12s %10.2f %8d\n","um7 decoder",tu*1E3,nu);
+    fprintf(stdout,"speedup=%.2f\n",tu>0.0?tl/tu:0.0);
+    um7stat(&raw,stdout);
+
+    if (*outfile) {
+        if (!(fpc=fopen(outfile,"r"))) {
+            if ((fpc=fopen(outfile,"w"))) {
+                fprintf(fpc,"tag,passes,line_ms,line_samples,um7_ms,"
+                        "um7_samples,um7_partial,um7_dropped,speedup\n");
+            }
+        }
+        else {
+            fclose(fpc);
+            fpc=fopen(outfile,"a");
+        }
+        if (fpc) {
+            fprintf(fpc,"%s,%d,%.3f,%d,%.3f,%d,%u,%u,%.2f\n",tag,n,tl*1E3,nl,
+                    tu*1E3,nu,raw.npartial,raw.ndrop,tu>0.0?tl/tu:0.0);
+            fclose(fpc);
+        }
+    }
+    return 0;
+}